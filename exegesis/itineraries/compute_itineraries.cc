@@ -14,19 +14,33 @@
 
 #include "exegesis/itineraries/compute_itineraries.h"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stddef.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
+#include "absl/base/attributes.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
@@ -37,18 +51,23 @@
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_replace.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "base/commandlineflags.h"
 #include "exegesis/base/cpu_info.h"
 #include "exegesis/base/host_cpu.h"
 #include "exegesis/base/prettyprint.h"
 #include "exegesis/itineraries/decomposition.h"
 #include "exegesis/itineraries/jit_perf_evaluator.h"
-#include "exegesis/itineraries/perf_subsystem.h"
+#include "exegesis/itineraries/perf_samples.h"
 #include "exegesis/llvm/inline_asm.h"
+#include "exegesis/llvm/jit_compile_cache.h"
 #include "exegesis/proto/instructions.pb.h"
 #include "exegesis/util/category_util.h"
 #include "exegesis/util/instruction_syntax.h"
 #include "exegesis/util/status_util.h"
+#include "exegesis/util/system.h"
 #include "exegesis/x86/cpu_state.h"
 #include "exegesis/x86/operand_translator.h"
 #include "glog/logging.h"
@@ -193,12 +212,29 @@ const absl::flat_hash_set<std::string>* const kExcludedInstructions =
         "LOOPNE",
     });
 
+// The event used to measure latencies.
+constexpr const char kCyclesEvent[] = "cycles";
+
+// Sets the measurement of 'observation' from the samples of the counter
+// 'name'.
+void SetMeasurement(const PerfSamples& samples, const std::string& name,
+                    ObservationVector::Observation* observation) {
+  observation->set_measurement(samples.GetMedianOrDie(name));
+  observation->set_num_samples(samples.num_samples());
+  if (samples.num_samples() > 1) {
+    observation->set_median_absolute_deviation(
+        samples.GetMedianAbsoluteDeviationOrDie(name));
+    observation->set_confidence_interval(
+        samples.GetConfidenceIntervalOrDie(name));
+  }
+}
+
 absl::StatusOr<ObservationVector> CreateObservationVector(
-    const PerfResult& perf_result) {
+    const PerfSamples& samples) {
   ObservationVector observations;
 
   bool at_least_one_non_zero = false;
-  for (const auto& name : perf_result.Keys()) {
+  for (const auto& name : samples.Keys()) {
     // Make all the events look like Haswell events.
     // TODO(bdb): This should depend on CPUInfo.
     // TODO(ondrasej): Replace this with measurements from llvm-exegesis.
@@ -211,9 +247,9 @@ absl::StatusOr<ObservationVector> CreateObservationVector(
     ObservationVector::Observation* const observation =
         observations.add_observations();
     observation->set_event_name(key);
-    const double measurement = perf_result.GetScaledOrDie(name);
+    SetMeasurement(samples, name, observation);
+    const double measurement = observation->measurement();
     CHECK_GE(measurement, 0.0);
-    observation->set_measurement(measurement);
     at_least_one_non_zero = at_least_one_non_zero || measurement != 0.0;
   }
   if (!at_least_one_non_zero) {
@@ -225,6 +261,220 @@ absl::StatusOr<ObservationVector> CreateObservationVector(
 
 using PortMaskCount = absl::flat_hash_map<PortMask, int, PortMask::Hash>;
 
+// The itinerary of an instruction, as reported by a worker process to its
+// parent process, and as saved to checkpoint files. A serialized record is an
+// ItineraryRecordHeader, followed by the instruction key, the status message
+// and the serialized itinerary. A checkpoint file starts with a
+// CheckpointFileHeader, followed by the records.
+struct ItineraryRecord {
+  // The index of the instruction in the instruction set.
+  int instruction_index = 0;
+  // Identifies the instruction independently of its index, see
+  // GetInstructionKey().
+  std::string instruction_key;
+  absl::Status status;
+  ItineraryProto itinerary;
+};
+
+struct ItineraryRecordHeader {
+  int32_t instruction_index;
+  int32_t status_code;
+  uint32_t instruction_key_size;
+  uint32_t status_message_size;
+  uint32_t itinerary_size;
+};
+
+struct CheckpointFileHeader {
+  char magic[8];
+  // Incremented whenever the layout of the file or of the records changes.
+  uint32_t format_version;
+};
+
+constexpr char kCheckpointFileMagic[] = "EXITINS";
+static_assert(sizeof(kCheckpointFileMagic) ==
+                  sizeof(CheckpointFileHeader::magic),
+              "the magic must fill the magic field");
+constexpr uint32_t kCheckpointFormatVersion = 1;
+
+// Returns the header of the checkpoint files written by this binary.
+CheckpointFileHeader MakeCheckpointFileHeader() {
+  CheckpointFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCheckpointFileMagic, sizeof(header.magic));
+  header.format_version = kCheckpointFormatVersion;
+  return header;
+}
+
+std::string GetInstructionKey(const InstructionProto& instruction) {
+  return absl::StrCat(
+      instruction.llvm_mnemonic(), "\t",
+      instruction.raw_encoding_specification(), "\t",
+      ConvertToCodeString(GetAnyVendorSyntaxOrDie(instruction)));
+}
+
+std::string SerializeItineraryRecord(const ItineraryRecord& record) {
+  const std::string serialized_itinerary = record.itinerary.SerializeAsString();
+  ItineraryRecordHeader header;
+  header.instruction_index = record.instruction_index;
+  header.status_code = static_cast<int32_t>(record.status.code());
+  header.instruction_key_size = record.instruction_key.size();
+  header.status_message_size = record.status.message().size();
+  header.itinerary_size = serialized_itinerary.size();
+  return absl::StrCat(
+      absl::string_view(reinterpret_cast<const char*>(&header), sizeof(header)),
+      record.instruction_key, record.status.message(), serialized_itinerary);
+}
+
+// Parses the complete records at the beginning of `data`, and removes them
+// from `data`. A truncated record at the end of `data` is left in `data`.
+absl::StatusOr<std::vector<ItineraryRecord>> ConsumeItineraryRecords(
+    std::string* const data) {
+  std::vector<ItineraryRecord> records;
+  absl::string_view remaining = *data;
+  while (remaining.size() >= sizeof(ItineraryRecordHeader)) {
+    ItineraryRecordHeader header;
+    memcpy(&header, remaining.data(), sizeof(header));
+    const size_t record_size = sizeof(header) + header.instruction_key_size +
+                               header.status_message_size +
+                               header.itinerary_size;
+    if (remaining.size() < record_size) break;
+    remaining.remove_prefix(sizeof(header));
+    ItineraryRecord record;
+    record.instruction_index = header.instruction_index;
+    record.instruction_key =
+        std::string(remaining.substr(0, header.instruction_key_size));
+    remaining.remove_prefix(header.instruction_key_size);
+    record.status =
+        absl::Status(static_cast<absl::StatusCode>(header.status_code),
+                     remaining.substr(0, header.status_message_size));
+    remaining.remove_prefix(header.status_message_size);
+    if (!record.itinerary.ParseFromArray(remaining.data(),
+                                         header.itinerary_size)) {
+      return absl::DataLossError("Could not parse an itinerary record");
+    }
+    remaining.remove_prefix(header.itinerary_size);
+    records.push_back(std::move(record));
+  }
+  data->erase(0, data->size() - remaining.size());
+  return records;
+}
+
+// Writes `size` bytes to `fd`, retrying on short writes. Returns false on
+// error.
+bool WriteFully(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// Reads from `fd` until the end of the file, or until an error.
+std::string ReadUntilEof(int fd) {
+  std::string data;
+  char buffer[4096];
+  while (true) {
+    const ssize_t num_read = read(fd, buffer, sizeof(buffer));
+    if (num_read < 0 && errno == EINTR) continue;
+    if (num_read <= 0) break;
+    data.append(buffer, num_read);
+  }
+  return data;
+}
+
+// Reads from `fd` into `data` until the end of the file, or until an error.
+// Returns false if `deadline` is reached first.
+bool ReadUntilEofOrDeadline(int fd, absl::Time deadline,
+                            std::string* const data) {
+  pollfd poll_fd = {fd, POLLIN, 0};
+  char buffer[4096];
+  while (true) {
+    const absl::Duration remaining = deadline - absl::Now();
+    if (remaining <= absl::ZeroDuration()) return false;
+    const int timeout_ms = static_cast<int>(std::min<int64_t>(
+        absl::ToInt64Milliseconds(absl::Ceil(remaining, absl::Milliseconds(1))),
+        std::numeric_limits<int>::max()));
+    const int num_ready = poll(&poll_fd, 1, timeout_ms);
+    if (num_ready < 0 && errno == EINTR) continue;
+    if (num_ready < 0) return true;
+    if (num_ready == 0) continue;
+    const ssize_t num_read = read(fd, buffer, sizeof(buffer));
+    if (num_read < 0 && errno == EINTR) continue;
+    if (num_read <= 0) return true;
+    data->append(buffer, num_read);
+  }
+}
+
+// MAP_FIXED_NOREPLACE was added in Linux 4.17 and glibc 2.28. Older kernels
+// ignore it, and use the address as a hint.
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// The memory used by the measured code: a buffer for saving and restoring the
+// FPU state, and the source and destination buffers for instructions that read
+// from or write to memory. The measured code embeds their addresses, so they
+// are mapped at a fixed address: the code is then the same in every run, and
+// the functions persisted by the JIT compile cache can be reused despite
+// address space layout randomization.
+class MeasurementBuffers {
+ public:
+  // The address of the buffers. It is far from the areas where the kernel maps
+  // the heap, the stack and the shared libraries.
+  static constexpr uintptr_t kAddress = 0x200000000000;
+
+  // `buffer_size` is the size of each of the source and destination buffers.
+  explicit MeasurementBuffers(size_t buffer_size);
+  ~MeasurementBuffers() { munmap(memory_, size_); }
+
+  MeasurementBuffers(const MeasurementBuffers&) = delete;
+  MeasurementBuffers& operator=(const MeasurementBuffers&) = delete;
+
+  // The FXSAVE64 area. It is page-aligned, so it is aligned on 16 bytes as
+  // required by FXSAVE64.
+  uint8* fx_state() const { return static_cast<uint8*>(memory_); }
+  char* src() const { return static_cast<char*>(memory_) + src_offset_; }
+  char* dst() const { return static_cast<char*>(memory_) + dst_offset_; }
+
+ private:
+  size_t src_offset_ = 0;
+  size_t dst_offset_ = 0;
+  size_t size_ = 0;
+  void* memory_ = nullptr;
+};
+
+MeasurementBuffers::MeasurementBuffers(const size_t buffer_size) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const auto round_up_to_page = [page_size](size_t size) {
+    return (size + page_size - 1) / page_size * page_size;
+  };
+  src_offset_ = round_up_to_page(sizeof(FXStateBuffer));
+  dst_offset_ = src_offset_ + round_up_to_page(buffer_size);
+  size_ = dst_offset_ + round_up_to_page(buffer_size);
+  memory_ = mmap(reinterpret_cast<void*>(kAddress), size_,
+                 PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (memory_ == MAP_FAILED) {
+    // E.g. another helper already uses the address in this process.
+    LOG(WARNING) << "Could not map the measurement buffers at "
+                 << reinterpret_cast<void*>(kAddress) << ": "
+                 << strerror(errno);
+    memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(memory_ != MAP_FAILED)
+        << "Could not map the measurement buffers: " << strerror(errno);
+  }
+  if (memory_ != reinterpret_cast<void*>(kAddress)) {
+    LOG(WARNING) << "The measurement buffers are not at a fixed address, the "
+                    "persisted JIT compile cache will not be reused";
+  }
+}
+
 // A helper to compute itineraries. Every instruction is measured by generating
 // example code for the instruction, which is essentially the instruction
 // repeated `inner_iterations` times (to handle instructions that read or write
@@ -249,14 +499,30 @@ class ComputeItinerariesHelper {
     int rsi_step = 16;
     // The maximum number of bytes touched by any single instruction.
     int max_bytes_touched_per_instruction = 512;
+    // If true, every instruction is measured in a child process.
+    bool isolate_crashes = false;
+    // The child process measuring an instruction is killed after this time.
+    absl::Duration measurement_timeout = absl::InfiniteDuration();
+    // Controls how many times every instruction is measured.
+    SamplingOptions sampling;
+    // If true, the latencies of the instructions are measured too.
+    bool measure_latency = false;
   };
 
+  // 'jit_cache' must compile for the host CPU.
   ComputeItinerariesHelper(const CpuInfo& cpu_info,
                            const MicroArchitecture& microarchitecture,
+                           JitCompileCache* jit_cache,
                            const Parameters& parameters);
 
+  // Computes the itineraries of the instructions whose indices are returned by
+  // `next_instruction`, until it returns an index past the last instruction.
+  // `on_done` is called with the index and the status of every instruction once
+  // its itinerary has been computed.
   absl::Status ComputeItineraries(
       const InstructionSetProto& instruction_set,
+      const std::function<int()>& next_instruction,
+      const std::function<void(int, const absl::Status&)>& on_done,
       InstructionSetItinerariesProto* itineraries) const;
 
  private:
@@ -306,6 +572,24 @@ class ComputeItinerariesHelper {
       ++num_subtract_update_code_errors_;
     }
 
+    // Adds the counts of `other`, e.g. the statistics of a child process.
+    void Add(const Stats& other) {
+      num_instructions_ += other.num_instructions_;
+      num_unsolved_mips_ += other.num_unsolved_mips_;
+      num_assembly_errors_ += other.num_assembly_errors_;
+      num_decode_stalls_ += other.num_decode_stalls_;
+      num_instructions_with_unique_order_ +=
+          other.num_instructions_with_unique_order_;
+      num_subtract_update_code_errors_ +=
+          other.num_subtract_update_code_errors_;
+      for (int quantile = 0; quantile < kNumQuantiles; ++quantile) {
+        for (int num_uops = 0; num_uops < kMaxNumUops; ++num_uops) {
+          uop_stats_[quantile][num_uops] +=
+              other.uop_stats_[quantile][num_uops];
+        }
+      }
+    }
+
     std::string DebugString() const {
       std::string result;
       for (int quantile = 0; quantile < kNumQuantiles; ++quantile) {
@@ -353,21 +637,55 @@ class ComputeItinerariesHelper {
   // Computes the itineraries for the update code.
   absl::StatusOr<PortMaskCount> ComputeUpdateCodeMicroOps() const;
 
+  // Measures 'instruction', and decomposes its throughput observation into
+  // micro-operations. When crashes are isolated, only the measurement runs in
+  // a child process. The decomposition runs in this process, so that it uses
+  // and fills decomposition_cache_.
   absl::Status ComputeOneItinerary(const InstructionProto& instruction,
                                    const PortMaskCount& update_code_micro_ops,
                                    ItineraryProto* const itinerary,
                                    Stats* const stats) const;
 
+  // Measures 'instruction', and stores its observations in 'itinerary'. The
+  // throughput observation of 'itinerary' is left empty if the instruction is
+  // skipped.
+  absl::Status MeasureOneItinerary(const InstructionProto& instruction,
+                                   ItineraryProto* itinerary,
+                                   Stats* stats) const;
+
+  // Decomposes the throughput observation of 'itinerary' into
+  // micro-operations, and removes the micro-operations of the update code.
+  absl::Status DecomposeOneItinerary(const InstructionProto& instruction,
+                                     const PortMaskCount& update_code_micro_ops,
+                                     ItineraryProto* itinerary,
+                                     Stats* stats) const;
+
+  // Measures the latency of every dependency chain of 'instruction', see
+  // x86::InstantiateDependencyChains(), in cycles per instruction. The
+  // latencies are stored in the latency observation of 'itinerary'; the
+  // micro-operations are left untouched. Chains that cannot be compiled or
+  // measured are skipped.
+  absl::Status ComputeLatencies(const InstructionProto& instruction,
+                                ItineraryProto* itinerary) const;
+
+  // Same as MeasureOneItinerary(), but in a child process, so that an
+  // instruction that kills the process (e.g. with SIGILL or SIGSEGV) only fails
+  // this instruction. The child process reports its statistics back with the
+  // itinerary. It is killed after parameters_.measurement_timeout.
+  absl::Status MeasureOneItineraryInChildProcess(
+      const InstructionProto& instruction, ItineraryProto* itinerary,
+      Stats* stats) const;
+
   const MicroArchitecture& microarchitecture_;
   const CpuInfo& cpu_info_;
-  const std::string host_mcpu_;
+  // Compiles the measured code for the host CPU.
+  JitCompileCache* const jit_cache_;
+  // Shared by the decompositions of all the instructions. The decompositions
+  // always run in this process, so that they all share the cache.
+  const std::unique_ptr<DecompositionCache> decomposition_cache_;
   const Parameters parameters_;
-  // Source and destination buffers for instructions that read from or write to
-  // memory.
-  std::unique_ptr<char[]> src_buffer_;
-  std::unique_ptr<char[]> dst_buffer_;
-  // A buffer for saving and restoring the FPU state.
-  FXStateBuffer fx_state_buffer_;
+  // The FPU state, source and destination buffers used by the measured code.
+  const MeasurementBuffers buffers_;
   const std::string init_code_;
   const std::string prefix_code_;
   const std::string update_code_;
@@ -377,17 +695,17 @@ class ComputeItinerariesHelper {
 
 ComputeItinerariesHelper::ComputeItinerariesHelper(
     const CpuInfo& cpu_info, const MicroArchitecture& microarchitecture,
-    const Parameters& parameters)
+    JitCompileCache* const jit_cache, const Parameters& parameters)
     : microarchitecture_(microarchitecture),
       cpu_info_(cpu_info),
-      host_mcpu_(::llvm::sys::getHostCPUName().str()),
+      jit_cache_(jit_cache),
+      decomposition_cache_(new DecompositionCache(microarchitecture)),
       parameters_(parameters),
-      src_buffer_(new char[parameters_.GetBufferSize()]),
-      dst_buffer_(new char[parameters_.GetBufferSize()]),
-      init_code_(MakeInitCode(fx_state_buffer_.get())),
-      prefix_code_(MakePrefixCode(src_buffer_.get(), dst_buffer_.get())),
+      buffers_(parameters_.GetBufferSize()),
+      init_code_(MakeInitCode(buffers_.fx_state())),
+      prefix_code_(MakePrefixCode(buffers_.src(), buffers_.dst())),
       update_code_(MakeUpdateCode(parameters_.rsi_step)),
-      cleanup_code_(MakeCleanupCode(fx_state_buffer_.get())),
+      cleanup_code_(MakeCleanupCode(buffers_.fx_state())),
       // It's super-important that the registers used in the benchmark code be
       // referenced as overwritten in the constraints string. The measurements
       // may otherwise be wrong.
@@ -395,10 +713,9 @@ ComputeItinerariesHelper::ComputeItinerariesHelper(
       constraints_(
           "~{rax},~{rbx},~{rcx},~{rdx},~{rsi},~{rdi},~{mm6},~{xmm1},~{xmm5},"
           "~{r8},~{r9},~{r10}") {
-  LOG(INFO) << "Host MCPU is '" << host_mcpu_ << "'";
+  LOG(INFO) << "Host MCPU is '" << jit_cache_->mcpu() << "'";
   // Initialize the memory read buffer with valid values.
-  std::fill(src_buffer_.get(), src_buffer_.get() + parameters_.GetBufferSize(),
-            1);
+  std::fill(buffers_.src(), buffers_.src() + parameters_.GetBufferSize(), 1);
 }
 
 // Note that LLVM's inline assembly does not understand MOV r,imm64
@@ -483,16 +800,19 @@ bool TouchesMemory(const InstructionFormat& asm_syntax) {
 
 absl::StatusOr<PortMaskCount>
 ComputeItinerariesHelper::ComputeUpdateCodeMicroOps() const {
-  PerfResult result;
-  RETURN_IF_ERROR(EvaluateAssemblyString(
-      llvm::InlineAsm::AD_Intel, host_mcpu_, parameters_.inner_iterations,
+  const absl::StatusOr<VoidFunction> function = CompileAssemblyString(
+      jit_cache_, llvm::InlineAsm::AD_Intel, parameters_.inner_iterations,
       init_code_, prefix_code_,
       /*measured_code=*/"", update_code_,
-      /*suffix_code=*/"", cleanup_code_, constraints_, &result));
+      /*suffix_code=*/"", cleanup_code_, constraints_);
+  RETURN_IF_ERROR(function.status());
+  PerfSamples samples;
+  RETURN_IF_ERROR(EvaluateFunctionRepeatedly(
+      *function, parameters_.inner_iterations, parameters_.sampling, &samples));
   const absl::StatusOr<ObservationVector> observation =
-      CreateObservationVector(result);
+      CreateObservationVector(samples);
   RETURN_IF_ERROR(observation.status());
-  DecompositionSolver solver(microarchitecture_);
+  DecompositionSolver solver(microarchitecture_, decomposition_cache_.get());
   RETURN_IF_ERROR(solver.Run(*observation));
 
   const auto micro_ops = solver.GetMicroOps();
@@ -525,11 +845,24 @@ absl::Status ComputeItinerariesHelper::ComputeOneItinerary(
     const InstructionProto& instruction,
     const PortMaskCount& update_code_micro_ops, ItineraryProto* const itinerary,
     Stats* const stats) const {
+  const absl::Status status =
+      parameters_.isolate_crashes
+          ? MeasureOneItineraryInChildProcess(instruction, itinerary, stats)
+          : MeasureOneItinerary(instruction, itinerary, stats);
+  if (!status.ok() || !itinerary->has_throughput_observation()) return status;
+  return DecomposeOneItinerary(instruction, update_code_micro_ops, itinerary,
+                               stats);
+}
+
+absl::Status ComputeItinerariesHelper::MeasureOneItinerary(
+    const InstructionProto& instruction, ItineraryProto* const itinerary,
+    Stats* const stats) const {
   // The following registers are excluded because they can't be accessed in user
   // mode.
   static const absl::flat_hash_set<std::string>* const kExcludedMovOperands =
       new absl::flat_hash_set<std::string>({"CR0-CR7", "DR0-DR7"});
 
+  itinerary->clear_throughput_observation();
   const InstructionFormat& vendor_syntax = GetAnyVendorSyntaxOrDie(instruction);
   LOG(INFO) << "Processing " << PrettyPrintInstruction(instruction);
   const std::string& mnemonic = vendor_syntax.mnemonic();
@@ -568,46 +901,64 @@ absl::Status ComputeItinerariesHelper::ComputeOneItinerary(
   VLOG(1) << measured_code;
   VLOG(1) << instruction.DebugString();
 
-  // Check that the code assembles correctly before proceeding.
-  {
-    JitCompiler jit(host_mcpu_);
-    const auto fragment = jit.CompileInlineAssemblyFragment(
-        measured_code, llvm::InlineAsm::AD_Intel);
-    if (!fragment.ok()) {
-      stats->IncrementAssemblyErrors();
-      return fragment.status();
-    }
+  const bool touches_memory = TouchesMemory(vendor_syntax);
+
+  // Compiling the measured function also checks that the code assembles
+  // correctly before proceeding.
+  const absl::StatusOr<VoidFunction> function = CompileAssemblyString(
+      jit_cache_, llvm::InlineAsm::AD_Intel, parameters_.inner_iterations,
+      init_code_, prefix_code_, measured_code,
+      touches_memory ? update_code_ : "", /*suffix_code=*/"", cleanup_code_,
+      constraints_);
+  if (!function.ok()) {
+    stats->IncrementAssemblyErrors();
+    return function.status();
   }
 
-  const bool touches_memory = TouchesMemory(vendor_syntax);
   if (touches_memory) {
     LOG(INFO)
         << "The measured instruction touches memory, using the update code.";
   }
 
-  PerfResult result;
-  RETURN_IF_ERROR(EvaluateAssemblyString(
-      llvm::InlineAsm::AD_Intel, host_mcpu_, parameters_.inner_iterations,
-      init_code_, prefix_code_, measured_code,
-      touches_memory ? update_code_ : "", /*suffix_code=*/"", cleanup_code_,
-      constraints_, &result));
+  PerfSamples samples;
+  RETURN_IF_ERROR(EvaluateFunctionRepeatedly(
+      *function, parameters_.inner_iterations, parameters_.sampling, &samples));
 
-  LOG(INFO) << result.ToString();
+  LOG(INFO) << samples.ToString();
   absl::StatusOr<ObservationVector> observation_vector =
-      CreateObservationVector(result);
+      CreateObservationVector(samples);
   RETURN_IF_ERROR(observation_vector.status());
   *itinerary->mutable_throughput_observation() = *std::move(observation_vector);
 
   // Some instructions stall the decode pipeline, resulting in invalid port
   // distribution (see b/34701967 and go/cpu-mysteries/alu_16bits).
-  if (result.HasTiming("ild_stall.lcp") &&
-      result.GetScaledOrDie("ild_stall.lcp") > 0.1) {
+  if (samples.HasCounter("ild_stall.lcp") &&
+      samples.GetMedianOrDie("ild_stall.lcp") > 0.1) {
     stats->IncrementDecodeStallsErrors();
     return absl::InternalError(
         absl::StrCat("Instruction stalls decode pipeline: ", measured_code));
   }
 
-  DecompositionSolver solver(microarchitecture_);
+  if (parameters_.measure_latency) {
+    // The throughput itinerary is valid without the latencies.
+    const absl::Status latency_status =
+        ComputeLatencies(instruction, itinerary);
+    LOG_IF(WARNING, !latency_status.ok())
+        << "Could not measure the latencies of " << measured_code << ": "
+        << latency_status;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ComputeItinerariesHelper::DecomposeOneItinerary(
+    const InstructionProto& instruction,
+    const PortMaskCount& update_code_micro_ops, ItineraryProto* const itinerary,
+    Stats* const stats) const {
+  const InstructionFormat& vendor_syntax = GetAnyVendorSyntaxOrDie(instruction);
+  const std::string measured_code =
+      ConvertToCodeString(x86::InstantiateOperands(instruction));
+  const bool touches_memory = TouchesMemory(vendor_syntax);
+  DecompositionSolver solver(microarchitecture_, decomposition_cache_.get());
   if (solver.Run(itinerary->throughput_observation()).ok()) {
     stats->IncrementSolvedProblems(solver);
     LOG(INFO) << "Mixed-Integer Problem solved in " << solver.wall_time()
@@ -638,8 +989,129 @@ absl::Status ComputeItinerariesHelper::ComputeOneItinerary(
   }
 }
 
+absl::Status ComputeItinerariesHelper::ComputeLatencies(
+    const InstructionProto& instruction, ItineraryProto* itinerary) const {
+  ObservationVector* const observations =
+      itinerary->mutable_latency_observation();
+  observations->Clear();
+  for (const x86::DependencyChain& chain :
+       x86::InstantiateDependencyChains(instruction)) {
+    // The chain goes through registers, RSI does not need to be updated.
+    const std::string measured_code = ConvertToCodeString(chain.code);
+    const absl::StatusOr<VoidFunction> function = CompileAssemblyString(
+        jit_cache_, llvm::InlineAsm::AD_Intel, parameters_.inner_iterations,
+        init_code_, prefix_code_, measured_code, /*update_code=*/"",
+        /*suffix_code=*/"", cleanup_code_, constraints_);
+    if (!function.ok()) {
+      LOG(WARNING) << "Could not compile the dependency chain "
+                   << measured_code << ": " << function.status();
+      continue;
+    }
+    PerfSamples samples;
+    const absl::Status evaluation_status = EvaluateFunctionRepeatedly(
+        *function, parameters_.inner_iterations, parameters_.sampling,
+        &samples);
+    if (!evaluation_status.ok()) {
+      LOG(WARNING) << "Could not measure the dependency chain "
+                   << measured_code << ": " << evaluation_status;
+      continue;
+    }
+    if (!samples.HasCounter(kCyclesEvent)) {
+      return absl::FailedPreconditionError(absl::StrCat(
+          "Measuring latencies requires the '", kCyclesEvent, "' event"));
+    }
+    ObservationVector::Observation* const observation =
+        observations->add_observations();
+    observation->set_event_name(absl::StrCat(kCyclesEvent, ":operand_",
+                                             chain.output_operand_index,
+                                             "<-operand_",
+                                             chain.input_operand_index));
+    SetMeasurement(samples, kCyclesEvent, observation);
+    LOG(INFO) << measured_code << ": " << observation->measurement()
+              << " cycles";
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ComputeItinerariesHelper::MeasureOneItineraryInChildProcess(
+    const InstructionProto& instruction, ItineraryProto* const itinerary,
+    Stats* const stats) const {
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0) {
+    return absl::InternalError(
+        absl::StrCat("pipe() failed: ", strerror(errno)));
+  }
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return absl::InternalError(
+        absl::StrCat("fork() failed: ", strerror(errno)));
+  }
+  static_assert(std::is_trivially_copyable<Stats>::value,
+                "the statistics are sent as raw bytes");
+  if (pid == 0) {
+    close(pipe_fds[0]);
+    // The statistics of the child are sent before its record.
+    Stats child_stats;
+    ItineraryRecord record;
+    record.itinerary = *itinerary;
+    record.status =
+        MeasureOneItinerary(instruction, &record.itinerary, &child_stats);
+    const std::string serialized_record = absl::StrCat(
+        absl::string_view(reinterpret_cast<const char*>(&child_stats),
+                          sizeof(child_stats)),
+        SerializeItineraryRecord(record));
+    const bool written = WriteFully(pipe_fds[1], serialized_record.data(),
+                                    serialized_record.size());
+    google::FlushLogFiles(google::GLOG_INFO);
+    // Do not run the destructors and exit handlers of the parent process.
+    _exit(written ? 0 : 1);
+  }
+  close(pipe_fds[1]);
+  std::string data;
+  const bool timed_out = !ReadUntilEofOrDeadline(
+      pipe_fds[0], absl::Now() + parameters_.measurement_timeout, &data);
+  close(pipe_fds[0]);
+  if (timed_out) kill(pid, SIGKILL);
+  int wait_status = 0;
+  CHECK_EQ(waitpid(pid, &wait_status, 0), pid);
+
+  const std::string code =
+      ConvertToCodeString(GetAnyVendorSyntaxOrDie(instruction));
+  if (timed_out) {
+    return absl::DeadlineExceededError(
+        absl::StrCat("Measuring instruction ", code, " took more than ",
+                     absl::FormatDuration(parameters_.measurement_timeout)));
+  }
+  if (WIFSIGNALED(wait_status)) {
+    return absl::InternalError(absl::StrCat("Instruction ", code,
+                                            " was killed by signal ",
+                                            strsignal(WTERMSIG(wait_status))));
+  }
+  if (data.size() < sizeof(Stats)) {
+    return absl::InternalError(absl::StrCat(
+        "The child process did not report the itinerary of ", code));
+  }
+  Stats child_stats;
+  memcpy(&child_stats, data.data(), sizeof(child_stats));
+  data.erase(0, sizeof(child_stats));
+  stats->Add(child_stats);
+  absl::StatusOr<std::vector<ItineraryRecord>> records =
+      ConsumeItineraryRecords(&data);
+  RETURN_IF_ERROR(records.status());
+  if (records->size() != 1) {
+    return absl::InternalError(absl::StrCat(
+        "The child process did not report the itinerary of ", code));
+  }
+  *itinerary = std::move(records->front().itinerary);
+  return records->front().status;
+}
+
 absl::Status ComputeItinerariesHelper::ComputeItineraries(
     const InstructionSetProto& instruction_set,
+    const std::function<int()>& next_instruction,
+    const std::function<void(int, const absl::Status&)>& on_done,
     InstructionSetItinerariesProto* const itineraries) const {
   const absl::StatusOr<PortMaskCount> update_code_micro_ops =
       ComputeUpdateCodeMicroOps();
@@ -648,31 +1120,29 @@ absl::Status ComputeItinerariesHelper::ComputeItineraries(
   }
 
   Stats stats;
-  absl::Status global_status;
-  for (int i = 0; i < instruction_set.instructions_size(); ++i) {
+  for (int i = next_instruction(); i < instruction_set.instructions_size();
+       i = next_instruction()) {
     const absl::Status status = ComputeOneItinerary(
         instruction_set.instructions(i), update_code_micro_ops.value(),
         itineraries->mutable_itineraries(i), &stats);
     if (!status.ok()) {
       LOG(ERROR) << status;
-      global_status = status;
     }
+    on_done(i, status);
   }
 
   LOG(INFO) << stats.DebugString();
-  return global_status;
+  LOG(INFO) << "Decomposition cache: " << decomposition_cache_->num_hits()
+            << " hits, " << decomposition_cache_->num_misses() << " misses, "
+            << decomposition_cache_->num_models() << " models";
+  return absl::OkStatus();
 }
 
-}  // namespace
-
-absl::Status ComputeItineraries(
-    const InstructionSetProto& instruction_set,
-    InstructionSetItinerariesProto* const itineraries) {
-  CHECK(itineraries != nullptr);
-  CHECK_EQ(instruction_set.instructions_size(),
-           itineraries->itineraries_size());
-  const CpuInfo& host_cpu_info = HostCpuInfoOrDie();
-  LOG(INFO) << "Host CPU info: " << host_cpu_info.DebugString();
+// Returns the microarchitecture of the host, after checking that it is the one
+// of `itineraries`.
+absl::StatusOr<const MicroArchitecture*> GetHostMicroArchitecture(
+    const CpuInfo& host_cpu_info,
+    const InstructionSetItinerariesProto& itineraries) {
   const std::string& host_cpu_model_id = host_cpu_info.cpu_model_id();
   const std::string& host_microarchitecture_id =
       GetMicroArchitectureIdForCpuModelOrDie(host_cpu_model_id);
@@ -688,17 +1158,402 @@ absl::Status ComputeItineraries(
 
   // We can only guarantee that the computed itineraries are going to be valid
   // for the host microarchitecture.
-  if (microarchitecture->proto().id() != itineraries->microarchitecture_id()) {
+  if (microarchitecture->proto().id() != itineraries.microarchitecture_id()) {
     return absl::InvalidArgumentError(
         absl::StrCat("Host CPU model id '", host_cpu_model_id,
                      "' is not the requested microarchitecture ('",
                      microarchitecture->proto().id(), "' vs '",
-                     itineraries->microarchitecture_id(), "'"));
+                     itineraries.microarchitecture_id(), "'"));
+  }
+  return microarchitecture;
+}
+
+ItineraryRecord MakeItineraryRecord(
+    const InstructionSetProto& instruction_set,
+    const InstructionSetItinerariesProto& itineraries, int instruction_index,
+    const absl::Status& status) {
+  ItineraryRecord record;
+  record.instruction_index = instruction_index;
+  record.instruction_key =
+      GetInstructionKey(instruction_set.instructions(instruction_index));
+  record.status = status;
+  record.itinerary = itineraries.itineraries(instruction_index);
+  return record;
+}
+
+// The state of the computation of the itineraries of an instruction set: the
+// instructions whose itinerary is known, and their status. The itineraries are
+// saved to the checkpoint file, if any, as soon as they are known.
+class ItinerariesProgress {
+ public:
+  ItinerariesProgress(const InstructionSetProto& instruction_set,
+                      InstructionSetItinerariesProto* itineraries)
+      : instruction_set_(instruction_set),
+        itineraries_(itineraries),
+        done_(instruction_set.instructions_size(), false),
+        statuses_(instruction_set.instructions_size()) {}
+
+  ~ItinerariesProgress() {
+    if (checkpoint_fd_ >= 0) close(checkpoint_fd_);
+  }
+
+  // Opens the checkpoint file of `options`, if any. When resuming, restores
+  // the itineraries found in the checkpoint file.
+  absl::Status OpenCheckpoint(const ComputeItinerariesOptions& options);
+
+  // Records the itinerary of an instruction, and appends it to the checkpoint
+  // file.
+  void AddRecord(ItineraryRecord record);
+
+  bool IsDone(int instruction_index) const { return done_[instruction_index]; }
+
+  // Returns the status of the last failed instruction, or an error if the
+  // itinerary of some instructions is unknown.
+  absl::Status GetGlobalStatus() const;
+
+ private:
+  const InstructionSetProto& instruction_set_;
+  InstructionSetItinerariesProto* const itineraries_;
+  std::vector<bool> done_;
+  std::vector<absl::Status> statuses_;
+  std::string checkpoint_file_;
+  int checkpoint_fd_ = -1;
+};
+
+absl::Status ItinerariesProgress::OpenCheckpoint(
+    const ComputeItinerariesOptions& options) {
+  if (options.checkpoint_file.empty()) return absl::OkStatus();
+  checkpoint_file_ = options.checkpoint_file;
+  const int flags = O_RDWR | O_CREAT | O_CLOEXEC |
+                    (options.resume_from_checkpoint ? 0 : O_TRUNC);
+  checkpoint_fd_ = open(checkpoint_file_.c_str(), flags, 0644);
+  if (checkpoint_fd_ < 0) {
+    return absl::InternalError(absl::StrCat("Could not open checkpoint file '",
+                                            checkpoint_file_,
+                                            "': ", strerror(errno)));
+  }
+  std::string data;
+  if (options.resume_from_checkpoint) data = ReadUntilEof(checkpoint_fd_);
+  const CheckpointFileHeader expected_file_header = MakeCheckpointFileHeader();
+  if (data.empty()) {
+    // This is a new checkpoint file.
+    if (!WriteFully(checkpoint_fd_,
+                    reinterpret_cast<const char*>(&expected_file_header),
+                    sizeof(expected_file_header))) {
+      return absl::InternalError(
+          absl::StrCat("Could not write to checkpoint file '",
+                       checkpoint_file_, "': ", strerror(errno)));
+    }
+    return absl::OkStatus();
+  }
+  CheckpointFileHeader file_header;
+  if (data.size() < sizeof(file_header) ||
+      memcmp(data.data(), kCheckpointFileMagic, sizeof(file_header.magic)) !=
+          0) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "'", checkpoint_file_, "' is not an itinerary checkpoint file"));
+  }
+  memcpy(&file_header, data.data(), sizeof(file_header));
+  if (file_header.format_version != kCheckpointFormatVersion) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Checkpoint file '", checkpoint_file_, "' has format version ",
+        file_header.format_version, ", expected ", kCheckpointFormatVersion));
+  }
+
+  const size_t checkpoint_size = data.size();
+  data.erase(0, sizeof(file_header));
+  absl::StatusOr<std::vector<ItineraryRecord>> records =
+      ConsumeItineraryRecords(&data);
+  RETURN_IF_ERROR(records.status());
+  if (!data.empty()) {
+    // The previous run died while writing the last record. Drop it, so that
+    // the new records are appended after the last complete one.
+    LOG(WARNING) << "Dropping a truncated record at the end of "
+                 << checkpoint_file_;
+    if (ftruncate(checkpoint_fd_, checkpoint_size - data.size()) != 0 ||
+        lseek(checkpoint_fd_, 0, SEEK_END) < 0) {
+      return absl::InternalError(
+          absl::StrCat("Could not truncate checkpoint file '",
+                       checkpoint_file_, "': ", strerror(errno)));
+    }
+  }
+
+  // Records are matched to instructions by key rather than by index, so that
+  // a checkpoint can be resumed with a different subset of the instructions.
+  // The indices of each key are stored in reverse order, so that records for
+  // duplicate keys are restored in instruction order.
+  absl::flat_hash_map<std::string, std::vector<int>> indices_by_key;
+  for (int i = instruction_set_.instructions_size() - 1; i >= 0; --i) {
+    indices_by_key[GetInstructionKey(instruction_set_.instructions(i))]
+        .push_back(i);
+  }
+  int num_restored = 0;
+  for (ItineraryRecord& record : *records) {
+    std::vector<int>* const indices =
+        gtl::FindOrNull(indices_by_key, record.instruction_key);
+    if (indices == nullptr || indices->empty()) continue;
+    const int index = indices->back();
+    indices->pop_back();
+    *itineraries_->mutable_itineraries(index) = std::move(record.itinerary);
+    statuses_[index] = std::move(record.status);
+    done_[index] = true;
+    ++num_restored;
+  }
+  LOG(INFO) << "Restored " << num_restored << " itineraries from "
+            << checkpoint_file_;
+  return absl::OkStatus();
+}
+
+void ItinerariesProgress::AddRecord(ItineraryRecord record) {
+  const int index = record.instruction_index;
+  CHECK_GE(index, 0);
+  CHECK_LT(index, itineraries_->itineraries_size());
+  if (checkpoint_fd_ >= 0) {
+    const std::string serialized_record = SerializeItineraryRecord(record);
+    // A failure to checkpoint only loses the ability to resume.
+    LOG_IF(ERROR, !WriteFully(checkpoint_fd_, serialized_record.data(),
+                              serialized_record.size()))
+        << "Could not write to checkpoint file '" << checkpoint_file_
+        << "': " << strerror(errno);
+  }
+  *itineraries_->mutable_itineraries(index) = std::move(record.itinerary);
+  statuses_[index] = std::move(record.status);
+  done_[index] = true;
+}
+
+absl::Status ItinerariesProgress::GetGlobalStatus() const {
+  absl::Status global_status;
+  for (int i = 0; i < instruction_set_.instructions_size(); ++i) {
+    if (!done_[i]) {
+      global_status = absl::InternalError(
+          absl::StrCat("The itinerary of ",
+                       instruction_set_.instructions(i).llvm_mnemonic(),
+                       " was not computed"));
+      LOG(ERROR) << global_status;
+    } else if (!statuses_[i].ok()) {
+      global_status = statuses_[i];
+    }
+  }
+  return global_status;
+}
+
+// The body of a worker process. Pins the process to `core`, and computes the
+// itineraries of the instructions pulled from `next_instruction`, reporting
+// them to `report_fd`. Never returns.
+ABSL_ATTRIBUTE_NORETURN void RunWorker(
+    const CpuInfo& cpu_info, const MicroArchitecture& microarchitecture,
+    JitCompileCache* jit_cache,
+    const ComputeItinerariesHelper::Parameters& parameters,
+    const InstructionSetProto& instruction_set,
+    const ItinerariesProgress& progress, int core,
+    std::atomic<int>* next_instruction, int report_fd,
+    InstructionSetItinerariesProto* itineraries) {
+  SetCoreAffinity(core);
+  LOG(INFO) << "Worker " << getpid() << " pinned to core " << core;
+  // The helper, and therefore the perf subsystem, are created after the fork
+  // so that every worker has its own. The JIT cache was forked too: every
+  // worker has its own copy of it.
+  const ComputeItinerariesHelper helper(cpu_info, microarchitecture, jit_cache,
+                                        parameters);
+  const absl::Status worker_status = helper.ComputeItineraries(
+      instruction_set,
+      [next_instruction, &instruction_set, &progress]() {
+        int index = next_instruction->fetch_add(1);
+        while (index < instruction_set.instructions_size() &&
+               progress.IsDone(index)) {
+          index = next_instruction->fetch_add(1);
+        }
+        return index;
+      },
+      [report_fd, &instruction_set, itineraries](int index,
+                                                 const absl::Status& status) {
+        const std::string serialized_record = SerializeItineraryRecord(
+            MakeItineraryRecord(instruction_set, *itineraries, index, status));
+        CHECK(WriteFully(report_fd, serialized_record.data(),
+                         serialized_record.size()))
+            << "Could not write to the parent process: " << strerror(errno);
+      },
+      itineraries);
+  if (!worker_status.ok()) {
+    LOG(ERROR) << "Worker on core " << core << " failed: " << worker_status;
+  }
+  close(report_fd);
+  google::FlushLogFiles(google::GLOG_INFO);
+  // Do not run the destructors and exit handlers of the parent process.
+  _exit(worker_status.ok() ? 0 : 1);
+}
+
+// Reads the records of all workers until they close their pipes, and adds them
+// to `progress` as soon as they are complete. The pipes are read concurrently
+// so that no worker blocks on a full pipe. A worker that sends malformed
+// records is killed, and treated like a worker that died: the instructions it
+// did not report are left undone.
+void ReadWorkerRecords(const std::vector<pid_t>& worker_pids,
+                       const std::vector<int>& report_fds,
+                       ItinerariesProgress* const progress) {
+  std::vector<std::string> pending_data(report_fds.size());
+  std::vector<pollfd> poll_fds(report_fds.size());
+  for (int i = 0; i < report_fds.size(); ++i) {
+    poll_fds[i].fd = report_fds[i];
+    poll_fds[i].events = POLLIN;
+  }
+  int num_open = report_fds.size();
+  char buffer[4096];
+  while (num_open > 0) {
+    if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+      CHECK_EQ(errno, EINTR) << "poll() failed: " << strerror(errno);
+      continue;
+    }
+    for (int i = 0; i < poll_fds.size(); ++i) {
+      if (poll_fds[i].fd < 0 || poll_fds[i].revents == 0) continue;
+      const ssize_t num_read = read(poll_fds[i].fd, buffer, sizeof(buffer));
+      if (num_read < 0 && errno == EINTR) continue;
+      if (num_read <= 0) {
+        // A record truncated by the death of its worker is dropped.
+        close(poll_fds[i].fd);
+        // poll() ignores negative file descriptors.
+        poll_fds[i].fd = -1;
+        --num_open;
+        continue;
+      }
+      pending_data[i].append(buffer, num_read);
+      absl::StatusOr<std::vector<ItineraryRecord>> records =
+          ConsumeItineraryRecords(&pending_data[i]);
+      if (!records.ok()) {
+        LOG(ERROR) << "Worker " << worker_pids[i]
+                   << " sent a malformed record: " << records.status();
+        kill(worker_pids[i], SIGKILL);
+        close(poll_fds[i].fd);
+        poll_fds[i].fd = -1;
+        --num_open;
+        continue;
+      }
+      for (ItineraryRecord& record : *records) {
+        progress->AddRecord(std::move(record));
+      }
+    }
+  }
+}
+
+}  // namespace
+
+absl::Status ComputeItineraries(
+    const InstructionSetProto& instruction_set,
+    InstructionSetItinerariesProto* const itineraries,
+    const ComputeItinerariesOptions& options) {
+  CHECK(itineraries != nullptr);
+  CHECK_EQ(instruction_set.instructions_size(),
+           itineraries->itineraries_size());
+  const CpuInfo& host_cpu_info = HostCpuInfoOrDie();
+  LOG(INFO) << "Host CPU info: " << host_cpu_info.DebugString();
+  const absl::StatusOr<const MicroArchitecture*> microarchitecture =
+      GetHostMicroArchitecture(host_cpu_info, *itineraries);
+  RETURN_IF_ERROR(microarchitecture.status());
+
+  ItinerariesProgress progress(instruction_set, itineraries);
+  RETURN_IF_ERROR(progress.OpenCheckpoint(options));
+
+  JitCompileCache jit_cache(::llvm::sys::getHostCPUName().str());
+  if (!options.jit_cache_file.empty()) {
+    RETURN_IF_ERROR(jit_cache.PersistToFile(options.jit_cache_file));
+  }
+  ComputeItinerariesHelper::Parameters parameters;
+  parameters.isolate_crashes = options.isolate_crashes;
+  parameters.measurement_timeout = options.measurement_timeout;
+  parameters.sampling = options.sampling;
+  parameters.measure_latency = options.measure_latency;
+  ComputeItinerariesHelper helper(host_cpu_info, **microarchitecture,
+                                  &jit_cache, parameters);
+  int next_instruction = 0;
+  RETURN_IF_ERROR(helper.ComputeItineraries(
+      instruction_set,
+      [&next_instruction, &instruction_set, &progress]() {
+        while (next_instruction < instruction_set.instructions_size() &&
+               progress.IsDone(next_instruction)) {
+          ++next_instruction;
+        }
+        return next_instruction++;
+      },
+      [&instruction_set, itineraries, &progress](int index,
+                                                 const absl::Status& status) {
+        progress.AddRecord(
+            MakeItineraryRecord(instruction_set, *itineraries, index, status));
+      },
+      itineraries));
+  return progress.GetGlobalStatus();
+}
+
+absl::Status ComputeItinerariesInParallel(
+    const InstructionSetProto& instruction_set,
+    const absl::Span<const int> cores,
+    InstructionSetItinerariesProto* const itineraries,
+    const ComputeItinerariesOptions& options) {
+  CHECK(itineraries != nullptr);
+  CHECK(!cores.empty());
+  CHECK_EQ(instruction_set.instructions_size(),
+           itineraries->itineraries_size());
+  const CpuInfo& host_cpu_info = HostCpuInfoOrDie();
+  LOG(INFO) << "Host CPU info: " << host_cpu_info.DebugString();
+  const absl::StatusOr<const MicroArchitecture*> microarchitecture =
+      GetHostMicroArchitecture(host_cpu_info, *itineraries);
+  RETURN_IF_ERROR(microarchitecture.status());
+
+  ItinerariesProgress progress(instruction_set, itineraries);
+  RETURN_IF_ERROR(progress.OpenCheckpoint(options));
+  // The cache is loaded before the fork, so that the workers share it.
+  JitCompileCache jit_cache(::llvm::sys::getHostCPUName().str());
+  if (!options.jit_cache_file.empty()) {
+    RETURN_IF_ERROR(jit_cache.PersistToFile(options.jit_cache_file));
+  }
+  ComputeItinerariesHelper::Parameters parameters;
+  parameters.isolate_crashes = options.isolate_crashes;
+  parameters.measurement_timeout = options.measurement_timeout;
+  parameters.sampling = options.sampling;
+  parameters.measure_latency = options.measure_latency;
+
+  // The queue of instructions is the index of the next instruction to measure,
+  // in memory shared by all workers.
+  static_assert(std::atomic<int>::is_always_lock_free,
+                "the queue must be lock-free to be shared between processes");
+  void* const shared_memory =
+      mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared_memory == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrCat("Could not map the instruction queue: ", strerror(errno)));
+  }
+  std::atomic<int>* const next_instruction =
+      new (shared_memory) std::atomic<int>(0);
+
+  std::vector<pid_t> worker_pids;
+  std::vector<int> report_fds;
+  for (const int core : cores) {
+    int pipe_fds[2];
+    CHECK_EQ(pipe(pipe_fds), 0) << "pipe() failed: " << strerror(errno);
+    const pid_t pid = fork();
+    CHECK_GE(pid, 0) << "fork() failed: " << strerror(errno);
+    if (pid == 0) {
+      close(pipe_fds[0]);
+      for (const int fd : report_fds) close(fd);
+      RunWorker(host_cpu_info, **microarchitecture, &jit_cache, parameters,
+                instruction_set, progress, core, next_instruction,
+                pipe_fds[1], itineraries);
+    }
+    close(pipe_fds[1]);
+    worker_pids.push_back(pid);
+    report_fds.push_back(pipe_fds[0]);
   }
 
-  ComputeItinerariesHelper helper(host_cpu_info, *microarchitecture,
-                                  ComputeItinerariesHelper::Parameters());
-  return helper.ComputeItineraries(instruction_set, itineraries);
+  ReadWorkerRecords(worker_pids, report_fds, &progress);
+  for (int i = 0; i < worker_pids.size(); ++i) {
+    int wait_status = 0;
+    CHECK_EQ(waitpid(worker_pids[i], &wait_status, 0), worker_pids[i]);
+    if (!WIFEXITED(wait_status)) {
+      LOG(ERROR) << "Worker on core " << cores[i] << " died abnormally";
+    }
+  }
+  munmap(shared_memory, sizeof(std::atomic<int>));
+  return progress.GetGlobalStatus();
 }
 
 }  // namespace itineraries
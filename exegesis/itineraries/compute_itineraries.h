@@ -22,17 +22,64 @@
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "exegesis/base/microarchitecture.h"
+#include "exegesis/itineraries/perf_samples.h"
 #include "exegesis/proto/instructions.pb.h"
 
 namespace exegesis {
 namespace itineraries {
 
+// Options for computing itineraries.
+struct ComputeItinerariesOptions {
+  // If not empty, the itinerary of every instruction is appended to this file
+  // as soon as it is computed, so that the progress is not lost if the
+  // computation dies.
+  std::string checkpoint_file;
+  // If true, the instructions found in `checkpoint_file` are not measured
+  // again, and their itineraries are read from it. Otherwise, the checkpoint
+  // file is overwritten. Resuming fails with FailedPreconditionError if the
+  // file is not a checkpoint file, or was written with another format version.
+  bool resume_from_checkpoint = false;
+  // If true, every instruction is measured in a child process, so that an
+  // instruction that crashes (e.g. with SIGILL or SIGSEGV) is reported as
+  // failed instead of killing the computation.
+  bool isolate_crashes = false;
+  // With `isolate_crashes`, the child process that measures an instruction is
+  // killed if it runs for longer than this, and the instruction is reported as
+  // failed.
+  absl::Duration measurement_timeout = absl::Minutes(5);
+  // If not empty, the compiled measurement code is persisted to this file, and
+  // reused by the next runs on the same CPU instead of being compiled again.
+  std::string jit_cache_file;
+  // Controls how many times every instruction is measured. The observations
+  // are the medians of the samples.
+  SamplingOptions sampling;
+  // If true, the latencies of the instructions are measured too, through
+  // chains of dependent instances of each instruction. They are stored in the
+  // latency observations only. A failure to measure the latencies is logged,
+  // and does not fail the instruction.
+  bool measure_latency = false;
+};
+
 // Computes the itinerary of every instruction.
 // NOTE(bdb): Some instructions are not yet handled. For the supported
 // instructions, some addressing modes are not handled.
-absl::Status ComputeItineraries(const InstructionSetProto& instruction_set,
-                                InstructionSetItinerariesProto* itineraries);
+absl::Status ComputeItineraries(
+    const InstructionSetProto& instruction_set,
+    InstructionSetItinerariesProto* itineraries,
+    const ComputeItinerariesOptions& options = ComputeItinerariesOptions());
+
+// Same as above, but forks one worker process per core in `cores`. Each worker
+// pins itself to its core, and measures the instructions that it pulls from a
+// queue shared by all workers. The itineraries are merged back in instruction
+// order. Instructions whose worker died before reporting them are marked as
+// failed.
+absl::Status ComputeItinerariesInParallel(
+    const InstructionSetProto& instruction_set, absl::Span<const int> cores,
+    InstructionSetItinerariesProto* itineraries,
+    const ComputeItinerariesOptions& options = ComputeItinerariesOptions());
 
 }  // namespace itineraries
 }  // namespace exegesis
@@ -14,12 +14,21 @@
 
 #include "exegesis/itineraries/compute_itineraries.h"
 
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "exegesis/base/host_cpu.h"
 #include "exegesis/base/microarchitecture.h"
 #include "exegesis/proto/instructions.pb.h"
 #include "exegesis/testing/test_util.h"
 #include "exegesis/util/proto_util.h"
 #include "exegesis/util/system.h"
+#include "glog/logging.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/google/protobuf/text_format.h"
@@ -28,6 +37,8 @@ namespace exegesis {
 namespace itineraries {
 namespace {
 
+using ::exegesis::testing::EqualsProto;
+
 TEST(ComputeItinerariesTest, ADC) {
   // Restrict instructions to the given range.
   const auto instruction_set =
@@ -93,6 +104,185 @@ TEST(ComputeItinerariesTest, ADC) {
   }
 }
 
+constexpr char kAdcInstruction[] = R"pb(
+  llvm_mnemonic: "ADC8i8"
+  vendor_syntax {
+    mnemonic: "ADC"
+    operands {
+      addressing_mode: DIRECT_ADDRESSING
+      encoding: IMPLICIT_ENCODING
+      value_size_bits: 8
+      name: "AL"
+      usage: USAGE_WRITE
+    }
+    operands {
+      addressing_mode: NO_ADDRESSING
+      encoding: IMMEDIATE_VALUE_ENCODING
+      value_size_bits: 8
+      name: "imm8"
+      usage: USAGE_READ
+    }
+  }
+  available_in_64_bit: true
+  legacy_instruction: true
+  protection_mode: -1
+  raw_encoding_specification: "14 ib"
+  x86_encoding_specification {
+    opcode: 20
+    legacy_prefixes {}
+    immediate_value_bytes: 1
+  })pb";
+
+// Sets `itineraries` to empty itineraries for the host CPU, with
+// `num_itineraries` itineraries.
+void MakeHostItineraries(int num_itineraries,
+                         InstructionSetItinerariesProto* itineraries) {
+  const std::string& host_cpu_model_id = HostCpuInfoOrDie().cpu_model_id();
+  const absl::StatusOr<std::string> host_cpu_microarchitecture =
+      GetMicroArchitectureForCpuModelId(host_cpu_model_id);
+  ASSERT_OK(host_cpu_microarchitecture.status())
+      << "Unknown host CPU model ID \'" << host_cpu_model_id << "\'";
+  const MicroArchitecture* const microarchitecture =
+      MicroArchitecture::FromId(*host_cpu_microarchitecture);
+  ASSERT_NE(microarchitecture, nullptr)
+      << "Microarchitecture definition is missing for host CPU model ID \'"
+      << host_cpu_model_id << " (" << *host_cpu_microarchitecture << ")";
+  itineraries->Clear();
+  itineraries->set_microarchitecture_id(microarchitecture->proto().id());
+  for (int i = 0; i < num_itineraries; ++i) {
+    itineraries->add_itineraries();
+  }
+}
+
+TEST(ComputeItinerariesTest, InParallel) {
+  constexpr int kNumInstructions = 4;
+  InstructionSetProto instruction_set;
+  for (int i = 0; i < kNumInstructions; ++i) {
+    *instruction_set.add_instructions() =
+        ParseProtoFromStringOrDie<InstructionProto>(kAdcInstruction);
+  }
+  InstructionSetItinerariesProto itineraries;
+  ASSERT_NO_FATAL_FAILURE(MakeHostItineraries(kNumInstructions, &itineraries));
+  // Tag the itineraries to check that they are merged back in order.
+  for (int i = 0; i < kNumInstructions; ++i) {
+    itineraries.mutable_itineraries(i)->set_llvm_mnemonic(absl::StrCat(i));
+  }
+  const std::vector<int> cores = {0, GetLastAvailableCore()};
+
+  const absl::Status status =
+      ComputeItinerariesInParallel(instruction_set, cores, &itineraries);
+
+  ASSERT_EQ(itineraries.itineraries_size(), kNumInstructions);
+  for (int i = 0; i < kNumInstructions; ++i) {
+    EXPECT_EQ(itineraries.itineraries(i).llvm_mnemonic(), absl::StrCat(i));
+  }
+  // Unfortunately, since computing itineraries is based on measurements, this
+  // can sometimes fail.
+  if (!status.ok()) {
+    LOG(ERROR) << status;
+  } else {
+    for (const ItineraryProto& itinerary : itineraries.itineraries()) {
+      EXPECT_GT(itinerary.micro_ops_size(), 0);
+      EXPECT_LT(itinerary.micro_ops_size(), 3);
+    }
+  }
+}
+
+TEST(ComputeItinerariesTest, ResumesFromCheckpoint) {
+  InstructionSetProto instruction_set;
+  *instruction_set.add_instructions() =
+      ParseProtoFromStringOrDie<InstructionProto>(kAdcInstruction);
+  ComputeItinerariesOptions options;
+  options.checkpoint_file =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/itineraries.checkpoint");
+  options.isolate_crashes = true;
+  InstructionSetItinerariesProto itineraries;
+  ASSERT_NO_FATAL_FAILURE(MakeHostItineraries(1, &itineraries));
+  const absl::Status status =
+      ComputeItineraries(instruction_set, &itineraries, options);
+
+  // The itinerary and the status are restored from the checkpoint, and the
+  // instruction is not measured again. To check the latter, the instruction is
+  // given a vendor syntax that cannot be assembled. It has more operands than
+  // the original one, so it is the syntax that would be measured, but it is
+  // not part of the key of the instruction.
+  options.resume_from_checkpoint = true;
+  InstructionSetProto unassemblable_instruction_set = instruction_set;
+  *unassemblable_instruction_set.mutable_instructions(0)->add_vendor_syntax() =
+      ParseProtoFromStringOrDie<InstructionFormat>(R"pb(
+        mnemonic: "NOT_AN_INSTRUCTION"
+        operands { name: "AL" }
+        operands { name: "AL" }
+        operands { name: "AL" }
+      )pb");
+  InstructionSetItinerariesProto resumed_itineraries;
+  ASSERT_NO_FATAL_FAILURE(MakeHostItineraries(1, &resumed_itineraries));
+  EXPECT_EQ(ComputeItineraries(unassemblable_instruction_set,
+                               &resumed_itineraries, options),
+            status);
+  EXPECT_THAT(resumed_itineraries, EqualsProto(itineraries));
+
+  // Resuming also works for a different set of instructions.
+  instruction_set.add_instructions()->CopyFrom(instruction_set.instructions(0));
+  instruction_set.mutable_instructions(0)->set_llvm_mnemonic("ADC8i8_COPY");
+  ASSERT_NO_FATAL_FAILURE(MakeHostItineraries(2, &resumed_itineraries));
+  ComputeItineraries(instruction_set, &resumed_itineraries, options)
+      .IgnoreError();
+  EXPECT_THAT(resumed_itineraries.itineraries(1),
+              EqualsProto(itineraries.itineraries(0)));
+}
+
+TEST(ComputeItinerariesTest, DoesNotResumeFromOtherFiles) {
+  InstructionSetProto instruction_set;
+  *instruction_set.add_instructions() =
+      ParseProtoFromStringOrDie<InstructionProto>(kAdcInstruction);
+  ComputeItinerariesOptions options;
+  options.checkpoint_file =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/not_a_checkpoint");
+  options.resume_from_checkpoint = true;
+  {
+    std::ofstream file(options.checkpoint_file);
+    file << "This is not a checkpoint file.";
+  }
+  InstructionSetItinerariesProto itineraries;
+  ASSERT_NO_FATAL_FAILURE(MakeHostItineraries(1, &itineraries));
+  EXPECT_EQ(ComputeItineraries(instruction_set, &itineraries, options).code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+// Returns the size of the file at `path`.
+std::streamoff GetFileSize(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  CHECK(file.is_open()) << path;
+  return file.tellg();
+}
+
+TEST(ComputeItinerariesTest, ReusesPersistedJitCacheAcrossAllocations) {
+  InstructionSetProto instruction_set;
+  *instruction_set.add_instructions() =
+      ParseProtoFromStringOrDie<InstructionProto>(kAdcInstruction);
+  ComputeItinerariesOptions options;
+  options.jit_cache_file = absl::StrCat(getenv("TEST_TMPDIR"), "/jit_cache");
+  InstructionSetItinerariesProto itineraries;
+  ASSERT_NO_FATAL_FAILURE(MakeHostItineraries(1, &itineraries));
+  const absl::Status status =
+      ComputeItineraries(instruction_set, &itineraries, options);
+  const std::streamoff persisted_size = GetFileSize(options.jit_cache_file);
+
+  // Keep memory allocated so that the heap allocations of the second run land
+  // at other addresses. The measured code does not depend on them, so it is
+  // all found in the persisted cache, and nothing is appended to it.
+  std::vector<std::unique_ptr<char[]>> allocations;
+  for (int i = 0; i < 16; ++i) {
+    allocations.emplace_back(new char[1 << 20]);
+  }
+  InstructionSetItinerariesProto second_itineraries;
+  ASSERT_NO_FATAL_FAILURE(MakeHostItineraries(1, &second_itineraries));
+  EXPECT_EQ(ComputeItineraries(instruction_set, &second_itineraries, options),
+            status);
+  EXPECT_EQ(GetFileSize(options.jit_cache_file), persisted_size);
+}
+
 }  // namespace
 }  // namespace itineraries
 }  // namespace exegesis
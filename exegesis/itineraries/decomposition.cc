@@ -17,6 +17,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iterator>
 #include <numeric>
 #include <string>
@@ -24,6 +25,7 @@
 
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
@@ -32,6 +34,7 @@
 #include "absl/strings/string_view.h"
 #include "exegesis/base/microarchitecture.h"
 #include "exegesis/util/instruction_syntax.h"
+#include "exegesis/util/status_util.h"
 #include "glog/logging.h"
 #include "ortools/linear_solver/linear_solver.h"
 #include "src/google/protobuf/repeated_field.h"
@@ -57,57 +60,61 @@ int ComputeNumExecutionPorts(const std::vector<PortMask>& port_masks) {
   return max_execution_port_num + 1;
 }
 
-DecompositionSolver::DecompositionSolver(
-    const MicroArchitecture& microarchitecture)
-    : microarchitecture_(&microarchitecture),
-      num_execution_ports_(
-          ComputeNumExecutionPorts(microarchitecture_->port_masks())),
-      num_port_masks_(microarchitecture_->port_masks().size()),
-      solver_(new MPSolver("DecompositionLPForInstruction",
-                           MPSolver::GLPK_MIXED_INTEGER_PROGRAMMING)) {}
+// Owns the MPSolver holding the model, and the variables and constraints
+// that are needed to update it and to read the solution.
+class DecompositionModel {
+ public:
+  DecompositionModel(const MicroArchitecture& microarchitecture,
+                     int num_execution_ports,
+                     const std::vector<int>& max_uops_per_mask);
 
-absl::Status DecompositionSolver::Run(const ObservationVector& observations) {
-  absl::flat_hash_map<std::string, double> key_val;
-  for (const auto& observation : observations.observations()) {
-    key_val[observation.event_name()] = observation.measurement();
-  }
-  // TODO(bdb): Only consider user-time measurements with the :u modifier.
-  const double uops_retired =
-      ::exegesis::gtl::FindWithDefault(key_val, "uops_retired:all", 0.0);
-  std::vector<double> measurements(num_execution_ports_, 0.0);
-  for (int port = 0; port < num_execution_ports_; ++port) {
-    // We use 0.0 if the data does not exist. This may happen if the CPU
-    // has fewer execution ports than Haswell. This means that it is the duty
-    // of the PMU subsystem to check that the data it measures is properly
-    // stored.
-    // TODO(bdb): Add execution port information for architectures other than
-    // Haswell.
-    // TODO(bdb): Only consider user-time measurements with the :u modifier.
-    measurements[port] = ::exegesis::gtl::FindWithDefault(
-        key_val, absl::StrCat("uops_executed_port:port_", port), 0.0);
-  }
-  return Run(measurements, uops_retired);
-}
+  DecompositionModel(const DecompositionModel&) = delete;
+  DecompositionModel& operator=(const DecompositionModel&) = delete;
 
-absl::Status DecompositionSolver::Run(const std::vector<double>& measurements,
-                                      double num_uops) {
-  const double kMaxError = 1.0;
+  // Updates the right-hand sides of the constraints that depend on the
+  // instruction.
+  void SetObservation(const std::vector<double>& measurements,
+                      double num_uops);
 
-  if (num_uops > 50.0) {
-    return absl::InternalError(
-        absl::StrCat("Too many uops to solve the problem",
-                     absl::StrFormat("%.17g", num_uops)));
+  MPSolver* solver() { return solver_.get(); }
+  const MPSolver* solver() const { return solver_.get(); }
+  const std::vector<std::vector<MPVariable*>>& is_used() const {
+    return is_used_;
   }
-  // Compute the maximum number of uops per port mask. This enables us to
-  // create less variables and to make the model easier to solve.
-  std::vector<int> max_uops_per_mask(num_port_masks_, 0);
-  for (int mask = 0; mask < num_port_masks_; ++mask) {
-    double total_load = 0.0;
-    for (const int port : microarchitecture_->port_masks()[mask]) {
-      total_load += measurements[port];
-    }
-    max_uops_per_mask[mask] = static_cast<int>(total_load);
+  const std::vector<std::vector<std::vector<MPVariable*>>>& load() const {
+    return load_;
   }
+  const std::vector<MPVariable*>& error() const { return error_; }
+  const MPVariable* max_error() const { return max_error_; }
+
+ private:
+  const MicroArchitecture* const microarchitecture_;
+  const int num_execution_ports_;
+  const int num_port_masks_;
+  const std::unique_ptr<MPSolver> solver_;
+
+  // See the description of the model in the header file.
+  std::vector<std::vector<MPVariable*>> is_used_;
+  std::vector<std::vector<std::vector<MPVariable*>>> load_;
+  std::vector<std::vector<MPVariable*>> min_load_;
+  std::vector<std::vector<MPVariable*>> max_load_;
+  std::vector<MPVariable*> error_;
+  MPVariable* max_error_;
+  MPVariable* num_uops_;
+
+  // measurement_constraints_[port] is the constraint (C5) for 'port'.
+  std::vector<MPConstraint*> measurement_constraints_;
+};
+
+DecompositionModel::DecompositionModel(
+    const MicroArchitecture& microarchitecture, int num_execution_ports,
+    const std::vector<int>& max_uops_per_mask)
+    : microarchitecture_(&microarchitecture),
+      num_execution_ports_(num_execution_ports),
+      num_port_masks_(microarchitecture.port_masks().size()),
+      solver_(new MPSolver("DecompositionLPForInstruction",
+                           MPSolver::GLPK_MIXED_INTEGER_PROGRAMMING)) {
+  const double kMaxError = 1.0;
 
   // Create load_[port][mask][n].
   load_.resize(num_execution_ports_);
@@ -209,12 +216,15 @@ absl::Status DecompositionSolver::Run(const std::vector<double>& measurements,
   }
 
   // \forall port \sum_{mask,n}
-  // load_[port][mask][n] + error_[port] = measurement[port].
+  // load_[port][mask][n] + error_[port] = measurement[port], the measurements
+  // are set by SetObservation().
+  measurement_constraints_.resize(num_execution_ports_);
   for (int port = 0; port < num_execution_ports_; ++port) {
     MPConstraint* const measurement_constraint = solver_->MakeRowConstraint(
-        measurements[port], measurements[port],
+        0.0, 0.0,
         absl::StrCat("sum_over_mask_in_port_", port, "_sum_over_n_load_", port,
                      "mask_n_plus_error_", port, "_eq_measurement_", port));
+    measurement_constraints_[port] = measurement_constraint;
     measurement_constraint->SetCoefficient(error_[port], 1.0);
     for (int mask = 0; mask < num_port_masks_; ++mask) {
       for (int n = 0; n < max_uops_per_mask[mask]; ++n) {
@@ -262,9 +272,9 @@ absl::Status DecompositionSolver::Run(const std::vector<double>& measurements,
   }
 
   // num_uops_ = \sum_{mask,n} is_used_[mask][n]
-  // num_uops_ >= floor(uops_retired)
-  num_uops_ =
-      solver_->MakeNumVar(floor(num_uops), MPSolver::infinity(), "num_uops_");
+  // num_uops_ >= floor(uops_retired), the lower bound is set by
+  // SetObservation().
+  num_uops_ = solver_->MakeNumVar(0.0, MPSolver::infinity(), "num_uops_");
   MPConstraint* const num_ops_equality =
       solver_->MakeRowConstraint(0, 0, "num_uops_eq_sum_is_used_sub_mask_n");
   num_ops_equality->SetCoefficient(num_uops_, -1.0);
@@ -303,15 +313,137 @@ absl::Status DecompositionSolver::Run(const std::vector<double>& measurements,
     const double kNumUopsWeight = 1.0;
     objective->SetCoefficient(num_uops_, kNumUopsWeight);
   }
+}
+
+void DecompositionModel::SetObservation(const std::vector<double>& measurements,
+                                        double num_uops) {
+  for (int port = 0; port < num_execution_ports_; ++port) {
+    measurement_constraints_[port]->SetBounds(measurements[port],
+                                              measurements[port]);
+  }
+  num_uops_->SetLB(floor(num_uops));
+}
+
+namespace {
+
+// Returns the maximum number of uops per port mask. This enables us to
+// create less variables and to make the model easier to solve.
+std::vector<int> ComputeMaxUopsPerMask(
+    const MicroArchitecture& microarchitecture,
+    const std::vector<double>& measurements) {
+  const int num_port_masks = microarchitecture.port_masks().size();
+  std::vector<int> max_uops_per_mask(num_port_masks, 0);
+  for (int mask = 0; mask < num_port_masks; ++mask) {
+    double total_load = 0.0;
+    for (const int port : microarchitecture.port_masks()[mask]) {
+      total_load += measurements[port];
+    }
+    max_uops_per_mask[mask] = static_cast<int>(total_load);
+  }
+  return max_uops_per_mask;
+}
+
+}  // namespace
+
+DecompositionSolver::DecompositionSolver(
+    const MicroArchitecture& microarchitecture)
+    : DecompositionSolver(microarchitecture, nullptr) {}
+
+DecompositionSolver::DecompositionSolver(
+    const MicroArchitecture& microarchitecture, DecompositionCache* cache)
+    : microarchitecture_(&microarchitecture),
+      num_execution_ports_(
+          ComputeNumExecutionPorts(microarchitecture_->port_masks())),
+      num_port_masks_(microarchitecture_->port_masks().size()),
+      cache_(cache) {
+  if (cache_ != nullptr) {
+    CHECK_EQ(&cache_->microarchitecture(), microarchitecture_);
+  }
+}
+
+DecompositionSolver::~DecompositionSolver() {}
+
+absl::Status DecompositionSolver::Run(const ObservationVector& observations) {
+  absl::flat_hash_map<std::string, double> key_val;
+  for (const auto& observation : observations.observations()) {
+    key_val[observation.event_name()] = observation.measurement();
+  }
+  // TODO(bdb): Only consider user-time measurements with the :u modifier.
+  const double uops_retired =
+      ::exegesis::gtl::FindWithDefault(key_val, "uops_retired:all", 0.0);
+  std::vector<double> measurements(num_execution_ports_, 0.0);
+  for (int port = 0; port < num_execution_ports_; ++port) {
+    // We use 0.0 if the data does not exist. This may happen if the CPU
+    // has fewer execution ports than Haswell. This means that it is the duty
+    // of the PMU subsystem to check that the data it measures is properly
+    // stored.
+    // TODO(bdb): Add execution port information for architectures other than
+    // Haswell.
+    // TODO(bdb): Only consider user-time measurements with the :u modifier.
+    measurements[port] = ::exegesis::gtl::FindWithDefault(
+        key_val, absl::StrCat("uops_executed_port:port_", port), 0.0);
+  }
+  return Run(measurements, uops_retired);
+}
+
+absl::Status DecompositionSolver::Run(const std::vector<double>& measurements,
+                                      double num_uops) {
+  if (num_uops > 50.0) {
+    return absl::InternalError(
+        absl::StrCat("Too many uops to solve the problem",
+                     absl::StrFormat("%.17g", num_uops)));
+  }
+  wall_time_ = 0.0;
+  if (cache_ == nullptr) {
+    model_ = absl::make_unique<DecompositionModel>(
+        *microarchitecture_, num_execution_ports_,
+        ComputeMaxUopsPerMask(*microarchitecture_, measurements));
+    return Solve(measurements, num_uops, model_.get());
+  }
+
+  const double quantum = cache_->quantum();
+  std::vector<int64_t> key;
+  key.reserve(num_execution_ports_ + 1);
+  std::vector<double> quantized_measurements;
+  quantized_measurements.reserve(num_execution_ports_);
+  for (int port = 0; port < num_execution_ports_; ++port) {
+    key.push_back(std::llround(measurements[port] / quantum));
+    quantized_measurements.push_back(key.back() * quantum);
+  }
+  key.push_back(static_cast<int64_t>(floor(num_uops)));
+  const auto it = cache_->results_.find(key);
+  if (it != cache_->results_.end()) {
+    ++cache_->num_hits_;
+    result_ = it->second;
+    return absl::OkStatus();
+  }
+  ++cache_->num_misses_;
+  DecompositionModel* const model = cache_->GetOrCreateModel(
+      num_execution_ports_,
+      ComputeMaxUopsPerMask(*microarchitecture_, quantized_measurements));
+  RETURN_IF_ERROR(Solve(quantized_measurements, num_uops, model));
+  cache_->results_.emplace(std::move(key), result_);
+  return absl::OkStatus();
+}
+
+absl::Status DecompositionSolver::Solve(const std::vector<double>& measurements,
+                                        double num_uops,
+                                        DecompositionModel* model) {
+  model->SetObservation(measurements, num_uops);
+  MPSolver* const solver = model->solver();
 #ifdef NDEBUG
   const int kLimitInMs = 2000;
 #else
   const int kLimitInMs = 20000;
 #endif
-  solver_->set_time_limit(kLimitInMs);
-  switch (solver_->Solve()) {
+  solver->set_time_limit(kLimitInMs);
+  // The wall time of the solver accumulates over all the runs of the model.
+  const double start_wall_time = solver->wall_time();
+  const MPSolver::ResultStatus result_status = solver->Solve();
+  wall_time_ = solver->wall_time() - start_wall_time;
+  switch (result_status) {
     case MPSolver::OPTIMAL:
-      FillInResults();
+      FillInResults(*model);
       return absl::OkStatus();
     case MPSolver::FEASIBLE:
       return absl::InternalError("Model is not optimal.");
@@ -331,26 +463,25 @@ absl::Status DecompositionSolver::Run(const std::vector<double>& measurements,
   return absl::InternalError("Never reached.");
 }
 
-void DecompositionSolver::FillInResults() {
+void DecompositionSolver::FillInResults(const DecompositionModel& model) {
   const double kThreshold = 1e-6;
-  port_masks_list_.clear();
-  histogram_.clear();
-  histogram_.assign(microarchitecture_->port_masks().size(), 0);
-  port_loads_.clear();
+  result_ = Result();
+  result_.histogram.assign(microarchitecture_->port_masks().size(), 0);
   for (int mask = 0; mask < num_port_masks_; ++mask) {
-    for (int n = 0; n < is_used_[mask].size(); ++n) {
-      if (is_used_[mask][n]->solution_value() >= 1.0 - kThreshold) {
-        ++histogram_[mask];
+    for (int n = 0; n < model.is_used()[mask].size(); ++n) {
+      const double is_used = model.is_used()[mask][n]->solution_value();
+      if (is_used >= 1.0 - kThreshold) {
+        ++result_.histogram[mask];
         const PortMask port_mask(microarchitecture_->port_masks()[mask]);
-        port_masks_list_.push_back(port_mask);
+        result_.port_masks_list.push_back(port_mask);
         std::vector<double> loads;
         loads.reserve(num_execution_ports_);
         for (int port = 0; port < num_execution_ports_; ++port) {
-          loads.push_back(load_[port][mask][n]->solution_value());
+          loads.push_back(model.load()[port][mask][n]->solution_value());
         }
-        port_loads_.push_back(std::move(loads));
+        result_.port_loads.push_back(std::move(loads));
       } else {
-        CHECK_GE(kThreshold, is_used_[mask][n]->solution_value());
+        CHECK_GE(kThreshold, is_used);
       }
     }
   }
@@ -365,40 +496,42 @@ void DecompositionSolver::FillInResults() {
                           *microarchitecture_->store_address_generation());
   const int memory_buffer_write_mask_index = GetPositionInVector(
       microarchitecture_->port_masks(), *microarchitecture_->store_data());
-  signature_ =
-      OrderMicroOperations(histogram_, load_store_address_generation_mask_index,
-                           store_address_generation_mask_index,
-                           memory_buffer_write_mask_index, &is_order_unique_);
-  error_values_.clear();
-  error_values_.reserve(num_execution_ports_);
-  max_error_value_ = max_error_->solution_value();
-  for (const MPVariable* const error_var : error_) {
-    error_values_.push_back(error_var->solution_value());
-  }
+  result_.signature = OrderMicroOperations(
+      result_.histogram, load_store_address_generation_mask_index,
+      store_address_generation_mask_index, memory_buffer_write_mask_index,
+      &result_.is_order_unique);
+  result_.error_values.reserve(num_execution_ports_);
+  result_.max_error_value = model.max_error()->solution_value();
+  for (const MPVariable* const error_var : model.error()) {
+    result_.error_values.push_back(error_var->solution_value());
+  }
+  result_.objective_value = model.solver()->Objective().Value();
 }
 
 std::string DecompositionSolver::DebugString() const {
   const double kThreshold = 1e-6;
   std::string output;
-  DCHECK_EQ(port_masks_list_.size(), port_loads_.size());
-  for (const int port_mask_index : signature_) {
+  DCHECK_EQ(result_.port_masks_list.size(), result_.port_loads.size());
+  for (const int port_mask_index : result_.signature) {
     const PortMask& port_mask =
         microarchitecture_->port_masks()[port_mask_index];
     absl::StrAppend(&output, port_mask.ToString(), " ");
   }
   absl::StrAppend(&output, "\n");
-  for (int i = 0; i < port_masks_list_.size(); ++i) {
-    absl::StrAppend(&output, port_masks_list_[i].ToString(), ": {");
+  for (int i = 0; i < result_.port_masks_list.size(); ++i) {
+    absl::StrAppend(&output, result_.port_masks_list[i].ToString(), ": {");
     for (int port = 0; port < num_execution_ports_; ++port) {
-      const double load = port_loads_[i][port];
+      const double load = result_.port_loads[i][port];
       if (load < kThreshold) continue;
       absl::StrAppendFormat(&output, "%d: %.5f, ", port, load);
     }
     absl::StrAppend(&output, "}\n");
   }
-  absl::StrAppendFormat(&output, "max_error = %.5f\nerror {", max_error_value_);
+  absl::StrAppendFormat(&output, "max_error = %.5f\nerror {",
+                        result_.max_error_value);
   for (int port = 0; port < num_execution_ports_; ++port) {
-    absl::StrAppendFormat(&output, "%d: %.5f, ", port, error_values_[port]);
+    absl::StrAppendFormat(&output, "%d: %.5f, ", port,
+                          result_.error_values[port]);
   }
   absl::StrAppend(&output,
                   "}\nis_order_unique = ", static_cast<int>(is_order_unique()),
@@ -408,13 +541,14 @@ std::string DecompositionSolver::DebugString() const {
 
 DecompositionSolver::MicroOps DecompositionSolver::GetMicroOps() const {
   MicroOps result;
-  CHECK_EQ(signature_.size(), port_loads_.size());
-  for (int i = 0; i < signature_.size(); ++i) {
+  CHECK_EQ(result_.signature.size(), result_.port_loads.size());
+  for (int i = 0; i < result_.signature.size(); ++i) {
     MicroOperationProto* const micro_op = result.Add();
     *micro_op->mutable_port_mask() =
-        microarchitecture_->port_masks()[signature_[i]].ToProto();
-    micro_op->set_latency(std::lround(
-        std::accumulate(port_loads_[i].begin(), port_loads_[i].end(), 0.0)));
+        microarchitecture_->port_masks()[result_.signature[i]].ToProto();
+    const std::vector<double>& loads = result_.port_loads[i];
+    micro_op->set_latency(
+        std::lround(std::accumulate(loads.begin(), loads.end(), 0.0)));
     // For now we cannot tell whether ports can be used in parallel, so we
     // assume the best case where all micro-ops are independent.
     // TODO(courbet): Make the dependencies a DAG when the information is
@@ -423,6 +557,24 @@ DecompositionSolver::MicroOps DecompositionSolver::GetMicroOps() const {
   return result;
 }
 
+DecompositionCache::DecompositionCache(
+    const MicroArchitecture& microarchitecture, double quantum)
+    : microarchitecture_(&microarchitecture), quantum_(quantum) {
+  CHECK_GT(quantum_, 0.0);
+}
+
+DecompositionCache::~DecompositionCache() {}
+
+DecompositionModel* DecompositionCache::GetOrCreateModel(
+    int num_execution_ports, const std::vector<int>& max_uops_per_mask) {
+  std::unique_ptr<DecompositionModel>& model = models_[max_uops_per_mask];
+  if (model == nullptr) {
+    model = absl::make_unique<DecompositionModel>(
+        *microarchitecture_, num_execution_ports, max_uops_per_mask);
+  }
+  return model.get();
+}
+
 std::vector<int> OrderMicroOperations(
     std::vector<int> histogram, int load_store_address_generation_mask_index,
     int store_address_generation_mask_index, int memory_buffer_write_mask_index,
@@ -16,9 +16,12 @@
 #define EXEGESIS_ITINERARIES_DECOMPOSITION_H_
 
 #include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "exegesis/base/microarchitecture.h"
 #include "exegesis/base/port_mask.h"
@@ -120,6 +123,12 @@ int GetPositionInVector(const std::vector<T>& container, const T& value) {
   return it - container.begin();
 }
 
+// The MIP model described above, for fixed upper bounds on the number of
+// micro-operations using each port mask. Defined in the .cc file.
+class DecompositionModel;
+
+class DecompositionCache;
+
 class DecompositionSolver {
  public:
   using MicroOps = google::protobuf::RepeatedPtrField<MicroOperationProto>;
@@ -127,6 +136,14 @@ class DecompositionSolver {
   // The argument should outlive the solver.
   explicit DecompositionSolver(const MicroArchitecture& microarchitecture);
 
+  // Same as above, but reuses the models and the results of the other solvers
+  // using 'cache', see DecompositionCache. 'cache' must have been created for
+  // 'microarchitecture', and must outlive the solver.
+  DecompositionSolver(const MicroArchitecture& microarchitecture,
+                      DecompositionCache* cache);
+
+  ~DecompositionSolver();
+
   // Runs the decomposition solver on 'observation'.
   absl::Status Run(const ObservationVector& observation);
 
@@ -141,111 +158,153 @@ class DecompositionSolver {
   // Returns the result as list of micro-operations.
   MicroOps GetMicroOps() const;
 
-  // Returns the time spent to solve the underlying MIP.
-  double wall_time() const { return solver_->wall_time(); }
+  // Returns the time spent to solve the underlying MIP, in milliseconds. This
+  // is 0 when the result was found in the cache.
+  double wall_time() const { return wall_time_; }
 
   // Returns the value of the objective function after minimization.
-  double objective_value() const { return solver_->Objective().Value(); }
+  double objective_value() const { return result_.objective_value; }
 
   // Returns the list of port masks corresponding to each micro-operation
   // of the instruction.
   const std::vector<PortMask>& port_masks_list() const {
-    return port_masks_list_;
+    return result_.port_masks_list;
   }
 
   // Returns a list of vectors representing the load on each port for each of
   // the micro-operation in the same order as with port_masks_list().
   const std::vector<std::vector<double>>& port_loads() const {
-    return port_loads_;
+    return result_.port_loads;
   }
 
   // Returns the signature of the instruction, i.e. the list of all the port
   // masks it is using according to the result of the decomposition.
-  const std::vector<int>& signature() const { return signature_; }
+  const std::vector<int>& signature() const { return result_.signature; }
 
   // Returns the histogram of the instruction, i.e. how many times each port
   // mask it is using according to the result of the decomposition.
-  const std::vector<int>& histogram() const { return histogram_; }
+  const std::vector<int>& histogram() const { return result_.histogram; }
 
   // Returns the measurements assigned to error for each of the ports.
-  const std::vector<double>& error_values() const { return error_values_; }
+  const std::vector<double>& error_values() const {
+    return result_.error_values;
+  }
 
-  double max_error_value() const { return max_error_value_; }
+  double max_error_value() const { return result_.max_error_value; }
 
-  bool is_order_unique() const { return is_order_unique_; }
+  bool is_order_unique() const { return result_.is_order_unique; }
 
  private:
-  // Fills in the results (port_masks_list_, port_loads_, error_values_) at the
-  // end of Run().
-  void FillInResults();
+  friend class DecompositionCache;
 
-  // The CPU microarchitecture for which to solve. Not owned.
-  const MicroArchitecture* microarchitecture_;
+  // The result of a successful run.
+  struct Result {
+    // port_masks_list[n] is the port mask used by micro-operation n.
+    std::vector<PortMask> port_masks_list;
 
-  // The number of execution ports, as computed from execution_port_masks_.
-  const int num_execution_ports_;
+    // The signature of the instruction, i.e. the list of all the port masks it
+    // is using according to the result of the decomposition.
+    std::vector<int> signature;
 
-  // The number of port masks.
-  const int num_port_masks_;
+    // The histogram of the instruction, i.e. how many times each port
+    // mask it is using according to the result of the decomposition.
+    std::vector<int> histogram;
 
-  // port_masks_list_[n] is the port mask used by micro-operation n.
-  std::vector<PortMask> port_masks_list_;
+    // port_loads[n][port] contains the load of 'port' for micro-operation n.
+    std::vector<std::vector<double>> port_loads;
 
-  // The signature of the instruction, i.e. the list of all the port masks it
-  // is using according to the result of the decomposition.
-  std::vector<int> signature_;
+    // error_values[port] is the measurement error on port 'port'.
+    std::vector<double> error_values;
 
-  // The histogram of the instruction, i.e. how many times each port
-  // mask it is using according to the result of the decomposition.
-  std::vector<int> histogram_;
+    // The maximum measurement error on all ports.
+    double max_error_value = 0.0;
+
+    // True if the order between micro-operations computed by
+    // OrderMicroOperations is unique.
+    bool is_order_unique = false;
 
-  // port_loads_[n][port] contains the load of 'port' for micro-operation n.
-  std::vector<std::vector<double>> port_loads_;
+    // The value of the objective function after minimization.
+    double objective_value = 0.0;
+  };
 
-  // error_values_[port] is the measurement error on port 'port'.
-  std::vector<double> error_values_;
+  // Solves 'model' for 'measurements' and 'num_uops', and fills in result_.
+  absl::Status Solve(const std::vector<double>& measurements, double num_uops,
+                     DecompositionModel* model);
 
-  // The maximum measurement error on all ports.
-  double max_error_value_;
+  // Fills in result_ from the solution of 'model' at the end of Solve().
+  void FillInResults(const DecompositionModel& model);
 
-  // True if the order between micro-operations computed by
-  // OrderMicroOperations is unique.
-  bool is_order_unique_;
+  // The CPU microarchitecture for which to solve. Not owned.
+  const MicroArchitecture* microarchitecture_;
 
-  // The underlying MIP solver.
-  std::unique_ptr<operations_research::MPSolver> solver_;
+  // The number of execution ports, as computed from execution_port_masks_.
+  const int num_execution_ports_;
 
-  // is_used_[mask][n] is a binary variable representing that the nth
-  // micro-operation using 'mask' is executed.
-  std::vector<std::vector<operations_research::MPVariable*>> is_used_;
+  // The number of port masks.
+  const int num_port_masks_;
 
-  // load_[port][mask][n] represents the share of micro-operations
-  // in 'mask' that are executed on 'port'. Since there can be more than one
-  // micro-operation using 'mask', each micro-operation is given an index
-  // 'n'.
-  std::vector<std::vector<std::vector<operations_research::MPVariable*>>> load_;
+  // The cache shared with the other solvers, or nullptr. Not owned.
+  DecompositionCache* const cache_;
 
-  // min_load_[mask][n] represents the minimum load for a given 'mask'
-  // and a given 'n'.
-  std::vector<std::vector<operations_research::MPVariable*>> min_load_;
+  // The model solved by the last run when there is no cache.
+  std::unique_ptr<DecompositionModel> model_;
 
-  // max_load_[mask][n] represents the maximum load for a given 'mask'
-  // and a given 'n'.
-  std::vector<std::vector<operations_research::MPVariable*>> max_load_;
+  // The time spent to solve the model in the last run, in milliseconds.
+  double wall_time_ = 0.0;
 
-  // error_[port] is a non-negative continuous variable representing the work
-  // that cannot be assigned to any micro-operation.
-  // TODO(bdb): Check that the error is indeed nonnegative.
-  std::vector<operations_research::MPVariable*> error_;
+  Result result_;
+};
 
-  // The maximum error: \forall port, max_error_ >= error_[port].
-  operations_research::MPVariable* max_error_;
+// Shares work between the decompositions of the instructions of a
+// microarchitecture:
+// - The MIP model only depends on the instruction through the measurements
+//   and the number of measured micro-operations, once the upper bounds on the
+//   number of micro-operations using each port mask are fixed. The cache keeps
+//   one model per set of upper bounds, and only updates the right-hand sides of
+//   the constraints (C4) and (C5) before solving it for a new instruction.
+// - The results are memoized by observation. The measurements are rounded to a
+//   multiple of 'quantum' before solving, so that observations that differ
+//   only by noise below 'quantum' share the same result. Note that only the
+//   successful runs are memoized.
+// Not thread-safe: the solvers sharing a cache must run in the same thread.
+class DecompositionCache {
+ public:
+  // The default precision of the measurements in the cache.
+  static constexpr double kDefaultQuantum = 1e-3;
+
+  // 'microarchitecture' should outlive the cache.
+  explicit DecompositionCache(const MicroArchitecture& microarchitecture,
+                              double quantum = kDefaultQuantum);
+  ~DecompositionCache();
+
+  DecompositionCache(const DecompositionCache&) = delete;
+  DecompositionCache& operator=(const DecompositionCache&) = delete;
 
-  // The number of micro-operations executed, as found by the decomposition
-  // model: num_uops_ = sum_{mask, n} is_used[mask][n].
-  // num_uops_ is also lower-bounded by the number of measured micro-operations
-  // num_uops_ >= floor(measured micro-operations);
-  operations_research::MPVariable* num_uops_;
+  const MicroArchitecture& microarchitecture() const {
+    return *microarchitecture_;
+  }
+  double quantum() const { return quantum_; }
+  int num_models() const { return models_.size(); }
+  int num_hits() const { return num_hits_; }
+  int num_misses() const { return num_misses_; }
+
+ private:
+  friend class DecompositionSolver;
+
+  // Returns the model for 'max_uops_per_mask', building it if needed.
+  DecompositionModel* GetOrCreateModel(
+      int num_execution_ports, const std::vector<int>& max_uops_per_mask);
+
+  const MicroArchitecture* const microarchitecture_;
+  const double quantum_;
+  absl::flat_hash_map<std::vector<int>, std::unique_ptr<DecompositionModel>>
+      models_;
+  // The key is the quantized measurements, followed by the lower bound on the
+  // number of micro-operations.
+  absl::flat_hash_map<std::vector<int64_t>, DecompositionSolver::Result>
+      results_;
+  int num_hits_ = 0;
+  int num_misses_ = 0;
 };
 
 // Returns a signature with the port mask indices in the order in which the
@@ -14,6 +14,7 @@
 
 #include "exegesis/itineraries/decomposition.h"
 
+#include <cmath>
 #include <random>
 
 #include "absl/status/status.h"
@@ -335,6 +336,66 @@ TEST(DecompositionTest, Random) {
   DecomposeRandomInstructions(kDeterministicSeed);
 }
 
+TEST(DecompositionTest, Cache) {
+  const auto& microarchitecture = HaswellMicroArchitecture();
+  DecompositionCache cache(microarchitecture);
+  MeasurementGenerator m(microarchitecture, kDeterministicSeed);
+  const int kNumIters = 20;
+  int num_solved = 0;
+  for (int iter = 0; iter < kNumIters; ++iter) {
+    const int num_uops = 1 + iter % 3;
+    std::vector<double> measurements = m.GenerateFullVector(0.0);
+    for (int mask_index : m.GenerateSignature(num_uops)) {
+      m.Add(m.GenerateLoads(mask_index), &measurements);
+    }
+    // Use measurements that are not changed by the quantization of the cache,
+    // so that the cached and the uncached solvers solve the same problem.
+    for (double& measurement : measurements) {
+      measurement =
+          std::round(measurement / cache.quantum()) * cache.quantum();
+    }
+    const double uops_executed = m.GenerateNumUopsExecuted(num_uops);
+
+    DecompositionSolver uncached_solver(microarchitecture);
+    const absl::Status uncached_status =
+        uncached_solver.Run(measurements, uops_executed);
+    DecompositionSolver cached_solver(microarchitecture, &cache);
+    const absl::Status cached_status =
+        cached_solver.Run(measurements, uops_executed);
+    EXPECT_EQ(cached_status.ok(), uncached_status.ok());
+    if (!cached_status.ok() || !uncached_status.ok()) continue;
+    ++num_solved;
+    EXPECT_EQ(cached_solver.histogram(), uncached_solver.histogram());
+    EXPECT_NEAR(cached_solver.objective_value(),
+                uncached_solver.objective_value(), 1e-6);
+
+    // The same observation is now found in the cache.
+    const int num_hits = cache.num_hits();
+    DecompositionSolver hit_solver(microarchitecture, &cache);
+    ASSERT_OK(hit_solver.Run(measurements, uops_executed));
+    EXPECT_EQ(cache.num_hits(), num_hits + 1);
+    EXPECT_EQ(hit_solver.wall_time(), 0.0);
+    EXPECT_EQ(hit_solver.histogram(), cached_solver.histogram());
+    EXPECT_EQ(hit_solver.DebugString(), cached_solver.DebugString());
+  }
+  EXPECT_GT(num_solved, 0);
+  EXPECT_EQ(cache.num_misses(), kNumIters);
+  EXPECT_LE(cache.num_models(), kNumIters);
+
+  // Observations with the same bounds on the number of micro-operations of
+  // each port mask share their model: here, one micro-operation on port 4.
+  std::vector<double> store_data_measurements(m.GenerateFullVector(0.0));
+  store_data_measurements[4] = 1.0;
+  DecompositionSolver first_solver(microarchitecture, &cache);
+  ASSERT_OK(first_solver.Run(store_data_measurements, 1.0));
+  const int num_models = cache.num_models();
+  store_data_measurements[4] = 1.2;
+  DecompositionSolver second_solver(microarchitecture, &cache);
+  ASSERT_OK(second_solver.Run(store_data_measurements, 1.0));
+  EXPECT_EQ(cache.num_models(), num_models);
+  EXPECT_EQ(second_solver.histogram(), first_solver.histogram());
+}
+
 TEST(DecompositionTest, OrderMicroOperations) {
   const auto& microarchitecture = HaswellMicroArchitecture();
   MeasurementGenerator m(microarchitecture, kDeterministicSeed);
@@ -22,8 +22,11 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
 #include "exegesis/itineraries/perf_subsystem.h"
 #include "exegesis/llvm/inline_asm.h"
+#include "exegesis/llvm/jit_compile_cache.h"
+#include "exegesis/util/status_util.h"
 #include "exegesis/util/strings.h"
 #include "util/gtl/map_util.h"
 
@@ -36,11 +39,6 @@ std::string RepeatCode(int num_repeats, const std::string& code) {
 
 }  // namespace
 
-// The list of perf events we want to measure.
-constexpr const PerfSubsystem::EventCategory kPerfEventCategories[] = {
-    &PerfEventsProto::cycle_events, &PerfEventsProto::computation_events,
-    &PerfEventsProto::memory_events, &PerfEventsProto::uops_events};
-
 absl::Status EvaluateAssemblyString(
     llvm::InlineAsm::AsmDialect dialect, const std::string& mcpu,
     const int num_inner_iterations, const std::string& init_code,
@@ -48,7 +46,27 @@ absl::Status EvaluateAssemblyString(
     const std::string& update_code, const std::string& suffix_code,
     const std::string& cleanup_code, const std::string& constraints,
     PerfResult* result) {
-  JitCompiler jit(mcpu);
+  JitCompileCache cache(mcpu);
+  const auto inline_asm_function = CompileAssemblyString(
+      &cache, dialect, num_inner_iterations, init_code, prefix_code,
+      measured_code, update_code, suffix_code, cleanup_code, constraints);
+  if (!inline_asm_function.ok()) {
+    return absl::UnknownError(
+        absl::StrCat("Could not compile the measured code:",
+                     inline_asm_function.status().message()));
+  }
+  PerfSubsystem perf_subsystem;
+  perf_subsystem.UseUserSpaceReads();
+  return EvaluateFunction(inline_asm_function.value(), num_inner_iterations,
+                          &perf_subsystem, result);
+}
+
+absl::StatusOr<VoidFunction> CompileAssemblyString(
+    JitCompileCache* const cache, llvm::InlineAsm::AsmDialect dialect,
+    const int num_inner_iterations, const std::string& init_code,
+    const std::string& prefix_code, const std::string& measured_code,
+    const std::string& update_code, const std::string& suffix_code,
+    const std::string& cleanup_code, const std::string& constraints) {
   const std::string code =
       absl::StrCat(prefix_code, "\n",
                    RepeatCode(num_inner_iterations,
@@ -56,22 +74,47 @@ absl::Status EvaluateAssemblyString(
                    "\n", suffix_code);
   // NOTE(bdb): constraints are the same for 'code', 'init_code' and
   // 'cleanup_code'.
-  const auto inline_asm_function = jit.CompileInlineAssemblyToFunction(
+  return cache->CompileInlineAssemblyToFunction(
       1, init_code, constraints, code, constraints, cleanup_code, constraints,
       dialect);
-  if (!inline_asm_function.ok()) {
-    return absl::UnknownError(
-        absl::StrCat("Could not compile the measured code:",
-                     inline_asm_function.status().message()));
+}
+
+absl::Status EvaluateFunction(const VoidFunction& function,
+                              const int num_inner_iterations,
+                              PerfSubsystem* const perf_subsystem,
+                              PerfResult* result) {
+  perf_subsystem->StartCollectingAllEvents();
+  int num_runs = 0;
+  do {
+    function.CallOrDie();
+    ++num_runs;
+  } while (perf_subsystem->NeedsMoreRuns());
+  const PerfResult counters = perf_subsystem->StopAndReadCounters();
+  // The value of an event that was never counted would be reported as 0.
+  const std::vector<std::string> unscheduled_events =
+      counters.GetUnscheduledEvents();
+  if (!unscheduled_events.empty()) {
+    return absl::UnavailableError(
+        absl::StrCat("These events were never scheduled on the PMU: ",
+                     absl::StrJoin(unscheduled_events, ", ")));
   }
+  result->Accumulate(counters);
+  result->SetScaleFactor(num_inner_iterations * num_runs);
+  return absl::OkStatus();
+}
 
+absl::Status EvaluateFunctionRepeatedly(const VoidFunction& function,
+                                        const int num_inner_iterations,
+                                        const SamplingOptions& options,
+                                        PerfSamples* samples) {
   PerfSubsystem perf_subsystem;
-  for (const auto& events : kPerfEventCategories) {
-    perf_subsystem.StartCollectingEvents(events);
-    inline_asm_function.value().CallOrDie();
-    result->Accumulate(perf_subsystem.StopAndReadCounters());
-  }
-  result->SetScaleFactor(num_inner_iterations);
+  perf_subsystem.UseUserSpaceReads();
+  do {
+    PerfResult result;
+    RETURN_IF_ERROR(EvaluateFunction(function, num_inner_iterations,
+                                     &perf_subsystem, &result));
+    samples->AddSample(result);
+  } while (!samples->IsStable(options));
   return absl::OkStatus();
 }
 
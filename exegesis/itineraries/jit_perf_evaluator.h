@@ -18,7 +18,11 @@
 #include <string>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "exegesis/itineraries/perf_samples.h"
 #include "exegesis/itineraries/perf_subsystem.h"
+#include "exegesis/llvm/inline_asm.h"
+#include "exegesis/llvm/jit_compile_cache.h"
 #include "exegesis/x86/cpu_state.h"
 #include "llvm/IR/InlineAsm.h"
 
@@ -50,6 +54,35 @@ absl::Status EvaluateAssemblyString(
     const std::string& cleanup_code, const std::string& constraints,
     PerfResult* result);
 
+// Compiles the function measured by EvaluateAssemblyString() through 'cache',
+// with the CPU of 'cache'. The function is only compiled if it is not in the
+// cache yet. This can be used to check that the code assembles before
+// measuring it with EvaluateFunction(), without compiling it twice.
+absl::StatusOr<VoidFunction> CompileAssemblyString(
+    JitCompileCache* cache, llvm::InlineAsm::AsmDialect dialect,
+    int num_inner_iterations, const std::string& init_code,
+    const std::string& prefix_code, const std::string& measured_code,
+    const std::string& update_code, const std::string& suffix_code,
+    const std::string& cleanup_code, const std::string& constraints);
+
+// Runs Perf on a function returned by CompileAssemblyString(), collecting all
+// events with 'perf_subsystem'. The results are returned in 'result'. Returns
+// an error if some events could not be counted, because their group of
+// counters was never scheduled on the PMU.
+absl::Status EvaluateFunction(const VoidFunction& function,
+                              int num_inner_iterations,
+                              PerfSubsystem* perf_subsystem,
+                              PerfResult* result);
+
+// Same as EvaluateFunction(), but measures the function once per sample, until
+// 'options' does not require more samples. The results of each run are added
+// as a new sample to 'samples'. All samples are collected with the same
+// PerfSubsystem, whose counters are only opened for the first sample.
+absl::Status EvaluateFunctionRepeatedly(const VoidFunction& function,
+                                        int num_inner_iterations,
+                                        const SamplingOptions& options,
+                                        PerfSamples* samples);
+
 // Executes the given code, measuring the CPU state before and after execution
 // of 'code'. 'prefix_code' is run before measurements, and cleanup_code
 // afterwards.
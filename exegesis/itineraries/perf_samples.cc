@@ -0,0 +1,116 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exegesis/itineraries/perf_samples.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+#include "util/gtl/map_util.h"
+
+namespace exegesis {
+namespace {
+
+// The ratio between the standard deviation and the MAD of a normal
+// distribution.
+constexpr double kStandardDeviationPerMad = 1.4826;
+// The ratio between the standard error of the median and the standard error
+// of the mean of a normal distribution, i.e. sqrt(pi / 2).
+constexpr double kMedianStandardErrorFactor = 1.2533;
+// The 97.5% quantile of the standard normal distribution.
+constexpr double kNormalQuantile975 = 1.96;
+
+// Returns the median of 'values'. Reorders 'values'.
+double Median(std::vector<double>* values) {
+  CHECK(!values->empty());
+  const size_t middle = values->size() / 2;
+  std::nth_element(values->begin(), values->begin() + middle, values->end());
+  const double upper = (*values)[middle];
+  if (values->size() % 2 == 1) return upper;
+  const double lower =
+      *std::max_element(values->begin(), values->begin() + middle);
+  return (lower + upper) / 2.0;
+}
+
+// Returns the median absolute deviation of 'values'.
+double MedianAbsoluteDeviation(std::vector<double> values) {
+  const double median = Median(&values);
+  for (double& value : values) {
+    value = std::abs(value - median);
+  }
+  return Median(&values);
+}
+
+}  // namespace
+
+void PerfSamples::AddSample(const PerfResult& result) {
+  for (const std::string& name : result.Keys()) {
+    samples_[name].push_back(result.GetScaledOrDie(name));
+  }
+  ++num_samples_;
+}
+
+std::vector<std::string> PerfSamples::Keys() const {
+  std::vector<std::string> result;
+  for (const auto& key_val : samples_) {
+    result.push_back(key_val.first);
+  }
+  return result;
+}
+
+double PerfSamples::GetMedianOrDie(const std::string& name) const {
+  std::vector<double> values = gtl::FindOrDie(samples_, name);
+  return Median(&values);
+}
+
+double PerfSamples::GetMedianAbsoluteDeviationOrDie(
+    const std::string& name) const {
+  return MedianAbsoluteDeviation(gtl::FindOrDie(samples_, name));
+}
+
+double PerfSamples::GetConfidenceIntervalOrDie(const std::string& name) const {
+  const std::vector<double>& values = gtl::FindOrDie(samples_, name);
+  return kNormalQuantile975 * kMedianStandardErrorFactor *
+         kStandardDeviationPerMad * MedianAbsoluteDeviation(values) /
+         std::sqrt(static_cast<double>(values.size()));
+}
+
+bool PerfSamples::IsStable(const SamplingOptions& options) const {
+  if (num_samples_ >= options.max_num_samples) return true;
+  if (num_samples_ < options.min_num_samples) return false;
+  for (const auto& key_val : samples_) {
+    const double precision =
+        std::max(options.relative_precision *
+                     std::abs(GetMedianOrDie(key_val.first)),
+                 options.absolute_precision);
+    if (GetConfidenceIntervalOrDie(key_val.first) > precision) return false;
+  }
+  return true;
+}
+
+std::string PerfSamples::ToString() const {
+  std::string result;
+  for (const auto& key_val : samples_) {
+    absl::StrAppendFormat(&result, "%s: %.2f +/- %.2f (MAD: %.2f), ",
+                          key_val.first, GetMedianOrDie(key_val.first),
+                          GetConfidenceIntervalOrDie(key_val.first),
+                          GetMedianAbsoluteDeviationOrDie(key_val.first));
+  }
+  absl::StrAppendFormat(&result, "(num_samples: %d)", num_samples_);
+  return result;
+}
+
+}  // namespace exegesis
@@ -0,0 +1,87 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Robust statistics over repeated measurements of the same code.
+//
+// A single measurement is disturbed by interrupts, frequency changes or the
+// other hyperthread of the core. Instead, the code is measured several times,
+// and each counter is summarized by the median of its samples, which ignores
+// the outliers, together with the median absolute deviation (MAD) of the
+// samples and a confidence interval of the median.
+
+#ifndef EXEGESIS_ITINERARIES_PERF_SAMPLES_H_
+#define EXEGESIS_ITINERARIES_PERF_SAMPLES_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "exegesis/itineraries/perf_subsystem.h"
+
+namespace exegesis {
+
+// Controls when to stop taking samples.
+struct SamplingOptions {
+  // The number of samples is always between these two bounds. With
+  // max_num_samples = 1, the code is measured only once.
+  int min_num_samples = 5;
+  int max_num_samples = 30;
+  // Sampling stops once the 95% confidence interval of the median of every
+  // counter is narrower than 'relative_precision' times the median, or than
+  // 'absolute_precision', on each side of the median.
+  double relative_precision = 0.01;
+  double absolute_precision = 0.01;
+};
+
+class PerfSamples {
+ public:
+  PerfSamples() = default;
+
+  // Adds the scaled counters of 'result' as a new sample.
+  void AddSample(const PerfResult& result);
+
+  int num_samples() const { return num_samples_; }
+
+  // Returns the names of all counters.
+  std::vector<std::string> Keys() const;
+
+  bool HasCounter(const std::string& name) const {
+    return samples_.count(name) > 0;
+  }
+
+  // Returns the median of the samples of the given counter.
+  double GetMedianOrDie(const std::string& name) const;
+
+  // Returns the median absolute deviation of the samples of the given counter.
+  double GetMedianAbsoluteDeviationOrDie(const std::string& name) const;
+
+  // Returns the half-width of the 95% confidence interval of the median of the
+  // given counter. This is estimated from the MAD, assuming that the samples
+  // that are not outliers are normally distributed.
+  double GetConfidenceIntervalOrDie(const std::string& name) const;
+
+  // Returns true if 'options' does not require more samples.
+  bool IsStable(const SamplingOptions& options) const;
+
+  // Returns a human-readable summary of the samples.
+  std::string ToString() const;
+
+ private:
+  std::map<std::string, std::vector<double>> samples_;
+  int num_samples_ = 0;
+};
+
+}  // namespace exegesis
+
+#endif  // EXEGESIS_ITINERARIES_PERF_SAMPLES_H_
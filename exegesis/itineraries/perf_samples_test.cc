@@ -0,0 +1,82 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exegesis/itineraries/perf_samples.h"
+
+#include <cstdint>
+
+#include "exegesis/itineraries/perf_subsystem.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace exegesis {
+namespace {
+
+using ::testing::ElementsAre;
+
+// Returns a result where the counter 'name' was incremented 'count' times.
+PerfResult MakeResult(const std::string& name, uint64_t count) {
+  return PerfResult({{name, TimingInfo(count, 1, 1)}});
+}
+
+TEST(PerfSamplesTest, IgnoresOutliers) {
+  PerfSamples samples;
+  for (const uint64_t count : {10, 11, 9, 10, 1000}) {
+    samples.AddSample(MakeResult("cycles", count));
+  }
+  EXPECT_EQ(samples.num_samples(), 5);
+  EXPECT_THAT(samples.Keys(), ElementsAre("cycles"));
+  EXPECT_TRUE(samples.HasCounter("cycles"));
+  EXPECT_FALSE(samples.HasCounter("instructions"));
+  EXPECT_DOUBLE_EQ(samples.GetMedianOrDie("cycles"), 10.0);
+  EXPECT_DOUBLE_EQ(samples.GetMedianAbsoluteDeviationOrDie("cycles"), 1.0);
+  EXPECT_NEAR(samples.GetConfidenceIntervalOrDie("cycles"), 1.63, 0.01);
+}
+
+TEST(PerfSamplesTest, MedianOfEvenNumberOfSamples) {
+  PerfSamples samples;
+  for (const uint64_t count : {4, 1, 3, 2}) {
+    samples.AddSample(MakeResult("uops", count));
+  }
+  EXPECT_DOUBLE_EQ(samples.GetMedianOrDie("uops"), 2.5);
+  EXPECT_DOUBLE_EQ(samples.GetMedianAbsoluteDeviationOrDie("uops"), 1.0);
+}
+
+TEST(PerfSamplesTest, IsStable) {
+  SamplingOptions options;
+  options.min_num_samples = 3;
+  options.max_num_samples = 6;
+  options.relative_precision = 0.01;
+  options.absolute_precision = 0.0;
+
+  PerfSamples stable;
+  for (int i = 0; i < 2; ++i) {
+    stable.AddSample(MakeResult("cycles", 100));
+    EXPECT_FALSE(stable.IsStable(options));
+  }
+  stable.AddSample(MakeResult("cycles", 100));
+  EXPECT_TRUE(stable.IsStable(options));
+
+  PerfSamples noisy;
+  for (const uint64_t count : {100, 150, 50, 120, 80}) {
+    noisy.AddSample(MakeResult("cycles", count));
+    EXPECT_FALSE(noisy.IsStable(options));
+  }
+  // Sampling always stops after max_num_samples samples.
+  noisy.AddSample(MakeResult("cycles", 100));
+  EXPECT_TRUE(noisy.IsStable(options));
+}
+
+}  // namespace
+}  // namespace exegesis
@@ -18,8 +18,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <x86intrin.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <utility>
 
@@ -27,6 +31,8 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "exegesis/base/host_cpu.h"
 #include "exegesis/base/microarchitecture.h"
 #include "glog/logging.h"
@@ -34,13 +40,30 @@
 #include "util/gtl/map_util.h"
 
 namespace exegesis {
+namespace {
+
+// Returns true if the event encoded in 'attr' is counted by a fixed counter
+// on the CPUs that have them, i.e. it does not use a general-purpose counter.
+bool IsFixedCounterEvent(const perf_event_attr& attr) {
+  if (attr.type != PERF_TYPE_HARDWARE) return false;
+  return attr.config == PERF_COUNT_HW_CPU_CYCLES ||
+         attr.config == PERF_COUNT_HW_INSTRUCTIONS ||
+         attr.config == PERF_COUNT_HW_REF_CPU_CYCLES;
+}
+
+// The event categories measured by StartCollectingAllEvents().
+constexpr const PerfSubsystem::EventCategory kAllEventCategories[] = {
+    &PerfEventsProto::cycle_events, &PerfEventsProto::computation_events,
+    &PerfEventsProto::memory_events, &PerfEventsProto::uops_events};
+
+}  // namespace
 
 double PerfResult::Scale(const TimingInfo& timing) const {
   if (timing.time_running == 0 || timing.time_enabled == 0) return 0.0;
-  // This scales the counter, taking into account the ratio of time the
-  // counter was enabled.
-  const double ratio = static_cast<double>(timing.time_running) /
-                       static_cast<double>(timing.time_enabled);
+  // This extrapolates the counter to the whole time it was enabled, taking
+  // into account the ratio of time it was actually counting.
+  const double ratio = static_cast<double>(timing.time_enabled) /
+                       static_cast<double>(timing.time_running);
   return ratio * static_cast<double>(timing.raw_count) /
          static_cast<double>(num_times_);
 }
@@ -74,13 +97,91 @@ std::vector<std::string> PerfResult::Keys() const {
   return result;
 }
 
+std::vector<std::string> PerfResult::GetUnscheduledEvents() const {
+  std::vector<std::string> result;
+  for (const auto& key_val : timings_) {
+    if (key_val.second.time_running == 0) result.push_back(key_val.first);
+  }
+  return result;
+}
+
+std::vector<int> PackEventsIntoGroups(
+    const std::vector<bool>& is_fixed_counter_event,
+    const int num_generic_counters) {
+  const int max_group_size = std::max(1, num_generic_counters - 1);
+  std::vector<int> groups;
+  groups.reserve(is_fixed_counter_event.size());
+  int num_groups = 0;
+  // The group being filled with generic events, or -1 if there is none.
+  int generic_group = -1;
+  int generic_group_size = 0;
+  for (const bool is_fixed : is_fixed_counter_event) {
+    if (is_fixed) {
+      groups.push_back(num_groups++);
+      continue;
+    }
+    if (generic_group < 0 || generic_group_size == max_group_size) {
+      generic_group = num_groups++;
+      generic_group_size = 0;
+    }
+    groups.push_back(generic_group);
+    ++generic_group_size;
+  }
+  return groups;
+}
+
+bool ReadCounterFromPage(const perf_event_mmap_page* const page,
+                         TimingInfo* const timing) {
+  if (page == nullptr) return false;
+  // This follows the protocol documented in <linux/perf_event.h>: the kernel
+  // increments 'lock' whenever it updates the page, e.g. when the counter is
+  // scheduled in or out, in which case the values must be read again.
+  uint32_t sequence;
+  do {
+    sequence = page->lock;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    if (!page->cap_bit0_is_deprecated || !page->cap_user_rdpmc ||
+        !page->cap_user_time) {
+      return false;
+    }
+    timing->time_enabled = page->time_enabled;
+    timing->time_running = page->time_running;
+    // The times in the page are only updated when the counter is scheduled
+    // in or out; add the time elapsed since then, converted from TSC cycles.
+    const uint64_t cycles = __rdtsc();
+    const uint16_t time_shift = page->time_shift;
+    const uint64_t time_mult = page->time_mult;
+    const uint64_t delta =
+        page->time_offset + (cycles >> time_shift) * time_mult +
+        (((cycles & ((uint64_t{1} << time_shift) - 1)) * time_mult) >>
+         time_shift);
+    // 'index' is 0 when the counter is not scheduled on the PMU, in which
+    // case 'offset' is the whole count.
+    const uint32_t pmc_index = page->index;
+    timing->time_enabled += delta;
+    timing->raw_count = page->offset;
+    if (pmc_index != 0) {
+      timing->time_running += delta;
+      // The value of the hardware counter is sign-extended from its width.
+      const int shift = 64 - page->pmc_width;
+      const int64_t pmc =
+          static_cast<int64_t>(__rdpmc(pmc_index - 1) << shift) >> shift;
+      timing->raw_count += pmc;
+    }
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  } while (page->lock != sequence);
+  return true;
+}
+
 PerfSubsystem::PerfSubsystem()
     : microarchitecture_(
           MicroArchitecture::FromIdOrDie(GetMicroArchitectureIdForCpuModelOrDie(
               HostCpuInfoOrDie().cpu_model_id()))) {
   counter_fds_.reserve(kMaxNumCounters);
   event_names_.reserve(kMaxNumCounters);
+  counter_pages_.reserve(kMaxNumCounters);
   timers_.resize(kMaxNumCounters);
+  start_timers_.resize(kMaxNumCounters);
 
   // Check the consistency between CPUs that p4lib and we detect.
   const std::string& cpu_id = microarchitecture_.proto().id();
@@ -91,11 +192,17 @@ PerfSubsystem::PerfSubsystem()
 PerfSubsystem::~PerfSubsystem() { CleanUp(); }
 
 void PerfSubsystem::CleanUp() {
+  for (perf_event_mmap_page* const page : counter_pages_) {
+    if (page != nullptr) munmap(page, getpagesize());
+  }
   for (const int fd : counter_fds_) {
     close(fd);
   }
+  counter_pages_.resize(0);
   counter_fds_.resize(0);
+  group_leader_indices_.resize(0);
   event_names_.resize(0);
+  all_events_open_ = false;
 }
 
 std::string PerfSubsystem::Info() const {
@@ -139,35 +246,112 @@ void PerfSubsystem::ListEvents() {
   }
 }
 
-int PerfSubsystem::AddEvent(const std::string& event_name) {
-  struct perf_event_attr attr = {0};
+perf_event_attr PerfSubsystem::GetEventAttributes(
+    const std::string& event_name) const {
+  perf_event_attr attr;
   memset(&attr, 0, sizeof(attr));
   attr.size = sizeof(attr);
   const int pfm_result = pfm_get_perf_event_encoding(
       event_name.c_str(), PFM_PLM3, &attr, nullptr, nullptr);
   CHECK_EQ(PFM_SUCCESS, pfm_result)
       << pfm_strerror(pfm_result) << " " << event_name << " " << Info();
-  attr.disabled = 1;
-  // attr.pinned;
-  attr.exclude_kernel = 1;
+  return attr;
+}
+
+int PerfSubsystem::OpenEvent(const std::string& event_name,
+                             perf_event_attr* attr, int group_leader_fd) {
+  // The members of a group are enabled and disabled with their leader.
+  attr->disabled = group_leader_fd < 0;
+  attr->exclude_kernel = 1;
 
   // Always collect stats for how often the collection was occurring.
-  attr.read_format =
+  attr->read_format =
       PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
-  const int fd = perf_event_open(&attr, getpid(), -1, -1, 0);
+  const int fd = perf_event_open(attr, getpid(), -1, group_leader_fd, 0);
   CHECK_LE(0, fd) << pfm_strerror(fd) << ": " << event_name;
   counter_fds_.push_back(fd);
   event_names_.push_back(event_name);
+  if (group_leader_fd < 0) {
+    group_leader_indices_.push_back(counter_fds_.size() - 1);
+  }
+  perf_event_mmap_page* page = nullptr;
+  if (use_user_space_reads_) {
+    void* const memory =
+        mmap(nullptr, getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+    LOG_IF(WARNING, memory == MAP_FAILED)
+        << "Could not map the perf_event page of " << event_name
+        << ", reading it with syscalls: " << strerror(errno);
+    if (memory != MAP_FAILED) {
+      page = static_cast<perf_event_mmap_page*>(memory);
+    }
+  }
+  counter_pages_.push_back(page);
   return counter_fds_.size() - 1;
 }
 
-void PerfSubsystem::StartCollecting() {
-  for (const int fd : counter_fds_) {
-    const int ret = ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+int PerfSubsystem::GetNumGenericCounters() const {
+  int num_counters = 0;
+  int i;
+  pfm_for_all_pmus(i) {
+    pfm_pmu_info_t pmu_info;
+    memset(&pmu_info, 0, sizeof(pmu_info));
+    pmu_info.size = sizeof(pmu_info);
+    const int pfm_result =
+        pfm_get_pmu_info(static_cast<pfm_pmu_t>(i), &pmu_info);
+    if (pfm_result != PFM_SUCCESS || !pmu_info.is_present ||
+        pmu_info.type != PFM_PMU_TYPE_CORE || pmu_info.num_cntrs <= 0) {
+      continue;
+    }
+    num_counters = num_counters == 0
+                       ? pmu_info.num_cntrs
+                       : std::min(num_counters, pmu_info.num_cntrs);
+  }
+  return num_counters == 0 ? kDefaultNumGenericCounters : num_counters;
+}
+
+int PerfSubsystem::AddEvent(const std::string& event_name) {
+  perf_event_attr attr = GetEventAttributes(event_name);
+  all_events_open_ = false;
+  return OpenEvent(event_name, &attr, /*group_leader_fd=*/-1);
+}
+
+void PerfSubsystem::EnableGroups() {
+  for (const int index : group_leader_indices_) {
+    const int fd = counter_fds_[index];
+    const int ret = ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
     CHECK_EQ(0, ret) << strerror(errno) << ", fd = " << fd;
   }
 }
 
+void PerfSubsystem::DisableGroups() {
+  for (const int index : group_leader_indices_) {
+    const int fd = counter_fds_[index];
+    const int ret = ioctl(fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    CHECK_EQ(0, ret) << strerror(errno) << " fd = " << fd;
+  }
+}
+
+void PerfSubsystem::StartCollecting() {
+  // The counters keep their values from the previous collections, so they are
+  // read when the collection starts and the result is the difference. The
+  // counters read with syscalls are read before enabling them, so that read()
+  // is not measured. The ones read from user space must be read while enabled,
+  // for the times to be extrapolated correctly.
+  const int num_fds = counter_fds_.size();
+  if (!use_user_space_reads_) {
+    for (int i = 0; i < num_fds; ++i) {
+      start_timers_[i] = ReadCounter(i);
+    }
+  }
+  EnableGroups();
+  collection_start_ = absl::Now();
+  if (use_user_space_reads_) {
+    for (int i = 0; i < num_fds; ++i) {
+      start_timers_[i] = ReadCounter(i);
+    }
+  }
+}
+
 void PerfSubsystem::StartCollectingEvents(EventCategory category) {
   CleanUp();
   const auto& events = (microarchitecture_.proto().perf_events().*(category))();
@@ -179,26 +363,102 @@ void PerfSubsystem::StartCollectingEvents(EventCategory category) {
   StartCollecting();
 }
 
+void PerfSubsystem::StartCollectingAllEvents() {
+  if (all_events_open_) {
+    StartCollecting();
+    return;
+  }
+  CleanUp();
+  const PerfEventsProto& perf_events = microarchitecture_.proto().perf_events();
+  std::vector<std::string> events;
+  std::vector<perf_event_attr> attrs;
+  std::vector<bool> is_fixed_counter_event;
+  for (const EventCategory category : kAllEventCategories) {
+    for (const std::string& event : (perf_events.*category)()) {
+      events.push_back(event);
+      attrs.push_back(GetEventAttributes(event));
+      is_fixed_counter_event.push_back(IsFixedCounterEvent(attrs.back()));
+    }
+  }
+  const std::vector<int> groups =
+      PackEventsIntoGroups(is_fixed_counter_event, GetNumGenericCounters());
+  // The file descriptor of the leader of each group.
+  std::vector<int> leader_fds;
+  for (int i = 0; i < events.size(); ++i) {
+    // Fixed counters are available all the time, they are never multiplexed.
+    if (is_fixed_counter_event[i]) attrs[i].pinned = 1;
+    const int group = groups[i];
+    if (group < leader_fds.size()) {
+      OpenEvent(events[i], &attrs[i], leader_fds[group]);
+    } else {
+      const int index =
+          OpenEvent(events[i], &attrs[i], /*group_leader_fd=*/-1);
+      leader_fds.push_back(counter_fds_[index]);
+    }
+  }
+  all_events_open_ = true;
+  StartCollecting();
+}
+
+bool PerfSubsystem::NeedsMoreRuns() {
+  // The counters are disabled while they are checked, so that the check is not
+  // counted in the measurement. The members of a group are scheduled with
+  // their leader, so only the leaders are read.
+  DisableGroups();
+  bool all_scheduled = true;
+  for (const int index : group_leader_indices_) {
+    if (ReadCounter(index).time_running <= start_timers_[index].time_running) {
+      all_scheduled = false;
+      break;
+    }
+  }
+  if (all_scheduled) {
+    EnableGroups();
+    return false;
+  }
+  if (absl::Now() - collection_start_ > kMaxMultiplexingDuration) {
+    LOG(WARNING) << "Some events were never scheduled after "
+                 << kMaxMultiplexingDuration;
+    EnableGroups();
+    return false;
+  }
+  EnableGroups();
+  return true;
+}
+
 void PerfSubsystem::StopCollecting() {
-  for (const int fd : counter_fds_) {
-    const int ret = ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
-    CHECK_EQ(0, ret) << strerror(errno) << " fd = " << fd;
+  if (use_user_space_reads_) {
+    const int num_fds = counter_fds_.size();
+    for (int i = 0; i < num_fds; ++i) {
+      timers_[i] = ReadCounter(i);
+    }
   }
+  DisableGroups();
+}
+
+TimingInfo PerfSubsystem::ReadCounter(int index) const {
+  TimingInfo timing;
+  if (ReadCounterFromPage(counter_pages_[index], &timing)) return timing;
+  const int bytes_to_read = sizeof(timing);
+  const int bytes_read = read(counter_fds_[index], &timing, bytes_to_read);
+  CHECK_EQ(bytes_to_read, bytes_read) << strerror(errno) << " i = " << index;
+  return timing;
 }
 
 PerfResult PerfSubsystem::ReadCounters() {
   const int num_fds = counter_fds_.size();
-  const int bytes_to_read = sizeof(TimingInfo);
-  for (int i = 0; i < num_fds; ++i) {
-    const int bytes_read =
-        read(counter_fds_[i], timers_.data() + i, bytes_to_read);
-    CHECK_EQ(bytes_to_read, bytes_read) << strerror(errno) << " i = " << i;
+  if (!use_user_space_reads_) {
+    for (int i = 0; i < num_fds; ++i) {
+      timers_[i] = ReadCounter(i);
+    }
   }
   // We copy the result to the resulting vector here to avoid polluting the
   // counters with the call to resize().
   std::map<std::string, TimingInfo> timings;
   for (int i = 0; i < num_fds; ++i) {
-    gtl::InsertOrDie(&timings, event_names_[i], timers_[i]);
+    TimingInfo timing = timers_[i];
+    timing.Subtract(start_timers_[i]);
+    gtl::InsertOrDie(&timings, event_names_[i], timing);
   }
   return PerfResult(std::move(timings));
 }
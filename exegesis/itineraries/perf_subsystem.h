@@ -21,12 +21,17 @@
 #include <vector>
 
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "exegesis/base/microarchitecture.h"
 #include "exegesis/proto/microarchitecture.pb.h"
 #include "glog/logging.h"
 #include "src/google/protobuf/repeated_field.h"
 #include "util/gtl/map_util.h"
 
+// From <linux/perf_event.h>.
+struct perf_event_attr;
+struct perf_event_mmap_page;
+
 namespace exegesis {
 // A minimalistic interface to the Linux kernel perf subsystem, based on
 // libpfm4.
@@ -39,7 +44,9 @@ struct TimingInfo {
 
   uint64_t raw_count;     // How many times the counter was incremented.
   uint64_t time_enabled;  // How much time the counter was enabled.
-  uint64_t time_running;  // How much time the profiled code has been running.
+  uint64_t time_running;  // How much time the counter was actually counting,
+                          // i.e. scheduled on the PMU. This is less than
+                          // 'time_enabled' when counters are multiplexed.
 
   TimingInfo& Accumulate(const TimingInfo& other) {
     raw_count += other.raw_count;
@@ -47,8 +54,22 @@ struct TimingInfo {
     time_running += other.time_running;
     return *this;
   }
+
+  // Subtracts an earlier snapshot of the same counter.
+  TimingInfo& Subtract(const TimingInfo& start) {
+    raw_count -= start.raw_count;
+    time_enabled -= start.time_enabled;
+    time_running -= start.time_running;
+    return *this;
+  }
 };
 
+// Reads a counter with rdpmc through its perf_event page, following the
+// protocol documented in <linux/perf_event.h>. Returns false if 'page' is null,
+// or if the kernel does not allow user-space reads of the counter, in which
+// case the counter must be read with read().
+bool ReadCounterFromPage(const perf_event_mmap_page* page, TimingInfo* timing);
+
 // Used to store the result of a profiled run.
 // The names of each event are stored in the map so that the object can
 // actually be used independently from a PerfSubsystem object.
@@ -83,6 +104,11 @@ class PerfResult {
   // Returns all keys.
   std::vector<std::string> Keys() const;
 
+  // Returns the events that were never scheduled on the PMU, e.g. because
+  // their group was not scheduled before NeedsMoreRuns() gave up. Their
+  // scaled value is meaningless.
+  std::vector<std::string> GetUnscheduledEvents() const;
+
  private:
   double Scale(const TimingInfo& info) const;
 
@@ -90,6 +116,17 @@ class PerfResult {
   uint64_t num_times_ = 1;
 };  // namespace exegesis
 
+// Assigns events to the groups created by
+// PerfSubsystem::StartCollectingAllEvents(). 'is_fixed_counter_event' tells,
+// for every event, whether it is counted by a fixed counter. Each of these
+// events gets its own group. The other events are packed in order into groups
+// of 'num_generic_counters' - 1 events, so that a group still fits when one
+// general-purpose counter is taken, e.g. by the NMI watchdog. Groups are
+// numbered from 0, in the order of their first event. Returns the group of
+// every event.
+std::vector<int> PackEventsIntoGroups(
+    const std::vector<bool>& is_fixed_counter_event, int num_generic_counters);
+
 // Not thread safe.
 class PerfSubsystem {
  public:
@@ -114,6 +151,16 @@ class PerfSubsystem {
   // Lists all the events supported by the running platform.
   void ListEvents();
 
+  // Reads the counters from user space with the rdpmc instruction, through
+  // the perf_event page mapped for each counter, instead of with read()
+  // syscalls. StartCollecting() and StopAndReadCounters() then take a snapshot
+  // of the counters after enabling and before disabling them, so that the
+  // measured code does not include any syscall, and StopAndReadCounters()
+  // returns the difference between the two snapshots. The counters for which
+  // the kernel does not allow user-space reads fall back to read(). Applies to
+  // the events added after this call.
+  void UseUserSpaceReads() { use_user_space_reads_ = true; }
+
   // Adds an event to be measured by the current object. Returns the index of
   // the newly added event.
   // Note: To enable instruction counting on machines running Debian, execute
@@ -128,16 +175,35 @@ class PerfSubsystem {
   // A short-cut that adds the events in 'category' and starts collecting.
   void StartCollectingEvents(EventCategory category);
 
-  // A short-cut that stops collecting and reads the counters.
+  // Adds the events of all categories and starts collecting. The events are
+  // packed into groups that fit in the general-purpose counters of the PMU, see
+  // PackEventsIntoGroups(), and the kernel multiplexes the groups when there is
+  // more than one of them.
+  // The events that can be counted by fixed counters (cycles, instructions)
+  // are pinned, so that they are counted all the time.
+  // The counters of each group are scaled by the ratio of time the group was
+  // scheduled, see PerfResult. The measured code should be run until
+  // NeedsMoreRuns() returns false, so that every group gets scheduled.
+  // The counters are only opened by the first call; the following calls reuse
+  // them until CleanUp() or AddEvent() is called, so that a function can be
+  // measured many times without reopening the counters.
+  void StartCollectingAllEvents();
+
+  // Returns true while some groups of events were not scheduled yet, i.e.
+  // when the measured code should be run again. Gives up after
+  // kMaxMultiplexingDuration, in which case the unscheduled events are
+  // reported by PerfResult::GetUnscheduledEvents(). The counters are disabled
+  // during the check, so that it does not count in the measurement.
+  bool NeedsMoreRuns();
+
+  // Stops collecting, reads the hardware counters and returns a PerfResult
+  // that contains all the useful information, independently of the
+  // PerfSubsystem.
   PerfResult StopAndReadCounters() {
     StopCollecting();
     return ReadCounters();
   }
 
-  // Reads the hardware counters and returns a PerfResult that contains all the
-  // useful information, independently of the PerfSubsystem.
-  PerfResult ReadCounters();
-
  private:
   // A class that ensures that we always manipulate libpfm initialization in a
   // thread-safe way, and that we do not initialize/terminate concurrently.
@@ -155,38 +221,82 @@ class PerfSubsystem {
   // time.
   static constexpr const int kMaxNumCounters = 128;
 
+  // The number of general-purpose counters assumed when libpfm does not know
+  // it.
+  static constexpr const int kDefaultNumGenericCounters = 4;
+
+  // The maximal duration during which NeedsMoreRuns() waits for all groups to
+  // be scheduled.
+  static constexpr absl::Duration kMaxMultiplexingDuration = absl::Seconds(1);
+
+  // Returns the encoding of 'event_name'.
+  perf_event_attr GetEventAttributes(const std::string& event_name) const;
+
+  // Opens a counter for 'attr' in the group of 'group_leader_fd', or in a new
+  // group when it is -1. Returns the index of the counter.
+  int OpenEvent(const std::string& event_name, perf_event_attr* attr,
+                int group_leader_fd);
+
+  // Returns the number of general-purpose counters of the core PMU.
+  int GetNumGenericCounters() const;
+
+  // Reads the counter at 'index', from user space when possible.
+  TimingInfo ReadCounter(int index) const;
+
+  // Enables or disables all the groups of counters.
+  void EnableGroups();
+  void DisableGroups();
+
   // Stops collecting data, i.e. hardware counters will be stop being updated
   // from here.
   void StopCollecting();
 
+  // Reads the counters after StopCollecting(), minus the snapshots taken by
+  // StartCollecting(). In user-space read mode, these are the snapshots taken
+  // by StopCollecting().
+  PerfResult ReadCounters();
+
   const MicroArchitecture& microarchitecture_;
   // File descriptor for each counter.
   std::vector<int> counter_fds_;
+  // Index of the leader of each group of counters. Counters added with
+  // AddEvent() are in their own group.
+  std::vector<int> group_leader_indices_;
+  // When the collection was last started.
+  absl::Time collection_start_;
   // Name as given by libpfm4, of the event for each counter.
   std::vector<std::string> event_names_;
+  // The perf_event page mapped for each counter, or nullptr when the counter
+  // is read with syscalls.
+  std::vector<perf_event_mmap_page*> counter_pages_;
+  bool use_user_space_reads_ = false;
   // Used to store the result of the profiling.
   std::vector<TimingInfo> timers_;
+  // The counters when the collection was started.
+  std::vector<TimingInfo> start_timers_;
+  // Whether the counters were opened by StartCollectingAllEvents().
+  bool all_events_open_ = false;
   ScopedLibPfmInitialization scoped_libpfm_;
 };
 
 }  // namespace exegesis
 
-#define EXEGESIS_MEASURE_LOOP(result, num_iter, s, events)          \
-  perf.StartCollectingEvents(&::exegesis::PerfEventsProto::events); \
-  for (int i = 0; i < num_iter; ++i) {                              \
-    s;                                                              \
-  }                                                                 \
-  (result)->Accumulate(perf.StopAndReadCounters());
-
-// A basic macro that measures a code snippet s.
-#define EXEGESIS_RUN_UNDER_PERF(result, num_iter, s)                \
-  {                                                                 \
-    ::exegesis::PerfSubsystem perf;                                 \
-    EXEGESIS_MEASURE_LOOP(result, num_iter, s, computation_events); \
-    EXEGESIS_MEASURE_LOOP(result, num_iter, s, memory_events);      \
-    EXEGESIS_MEASURE_LOOP(result, num_iter, s, cycle_events);       \
-    EXEGESIS_MEASURE_LOOP(result, num_iter, s, uops_events);        \
-    (result)->SetScaleFactor(num_iter);                             \
+// A basic macro that measures a code snippet s. All the events are measured
+// together, and s is run again while the groups of events are multiplexed.
+#define EXEGESIS_RUN_UNDER_PERF(result, num_iter, s)          \
+  {                                                           \
+    ::exegesis::PerfSubsystem perf;                           \
+    perf.UseUserSpaceReads();                                 \
+    perf.StartCollectingAllEvents();                          \
+    int num_runs = 0;                                         \
+    do {                                                      \
+      for (int i = 0; i < num_iter; ++i) {                    \
+        s;                                                    \
+      }                                                       \
+      ++num_runs;                                             \
+    } while (perf.NeedsMoreRuns());                           \
+    (result)->Accumulate(perf.StopAndReadCounters());         \
+    (result)->SetScaleFactor(num_iter * num_runs);            \
   }
 
 // A basic macro that counts 'event' on a code snippet s. Resets result.
@@ -14,7 +14,12 @@
 
 #include "exegesis/itineraries/perf_subsystem.h"
 
+#include <linux/perf_event.h>
+#include <string.h>
+
 #include <cstdint>
+#include <string>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
@@ -28,13 +33,13 @@ const uint64_t kIter = 1000;
 TEST(PerfSubsystemTest, Accumulate) {
   PerfResult r1({{"a", TimingInfo(1, 2, 3)}, {"b", TimingInfo(4, 5, 6)}});
   const std::string r1_string = r1.ToString();
-  EXPECT_EQ("a: 1.50, b: 4.80, (num_times: 1)", r1_string);
+  EXPECT_EQ("a: 0.67, b: 3.33, (num_times: 1)", r1_string);
   PerfResult r2({{"b", TimingInfo(4, 5, 6)}, {"c", TimingInfo(7, 8, 9)}});
   const std::string r2_string = r2.ToString();
-  EXPECT_EQ("b: 4.80, c: 7.88, (num_times: 1)", r2_string);
+  EXPECT_EQ("b: 3.33, c: 6.22, (num_times: 1)", r2_string);
   LOG(INFO) << r2_string;
   r2.Accumulate(r1);
-  EXPECT_EQ("a: 1.50, b: 9.60, c: 7.88, (num_times: 1)", r2.ToString());
+  EXPECT_EQ("a: 0.67, b: 6.67, c: 6.22, (num_times: 1)", r2.ToString());
   PerfResult r;
   r1.Accumulate(r);
   EXPECT_EQ(r1_string, r1.ToString());
@@ -42,6 +47,79 @@ TEST(PerfSubsystemTest, Accumulate) {
   EXPECT_EQ(r1_string, r.ToString());
 }
 
+TEST(PerfSubsystemTest, GetUnscheduledEvents) {
+  const PerfResult result(
+      {{"a", TimingInfo(1, 2, 2)}, {"b", TimingInfo(0, 5, 0)}});
+  EXPECT_EQ(result.GetUnscheduledEvents(), std::vector<std::string>({"b"}));
+}
+
+TEST(TimingInfoTest, Subtract) {
+  TimingInfo end(10, 200, 150);
+  end.Subtract(TimingInfo(4, 120, 100));
+  EXPECT_EQ(end.raw_count, 6);
+  EXPECT_EQ(end.time_enabled, 80);
+  EXPECT_EQ(end.time_running, 50);
+}
+
+// Returns a perf_event page that allows user-space reads, for a counter that
+// is not scheduled on the PMU, so that reading it does not execute rdpmc.
+perf_event_mmap_page MakeUnscheduledCounterPage() {
+  perf_event_mmap_page page;
+  memset(&page, 0, sizeof(page));
+  page.cap_bit0_is_deprecated = 1;
+  page.cap_user_rdpmc = 1;
+  page.cap_user_time = 1;
+  page.index = 0;
+  page.offset = 42;
+  page.time_enabled = 100;
+  page.time_running = 50;
+  page.time_offset = 7;
+  page.time_mult = 0;
+  return page;
+}
+
+TEST(ReadCounterFromPageTest, ReadsUnscheduledCounter) {
+  const perf_event_mmap_page page = MakeUnscheduledCounterPage();
+  TimingInfo timing;
+  ASSERT_TRUE(ReadCounterFromPage(&page, &timing));
+  EXPECT_EQ(timing.raw_count, 42);
+  // The time since the counter was scheduled out only counts as enabled.
+  EXPECT_EQ(timing.time_enabled, 107);
+  EXPECT_EQ(timing.time_running, 50);
+}
+
+TEST(ReadCounterFromPageTest, FallsBackToSyscalls) {
+  TimingInfo timing;
+  EXPECT_FALSE(ReadCounterFromPage(nullptr, &timing));
+
+  perf_event_mmap_page page = MakeUnscheduledCounterPage();
+  page.cap_user_rdpmc = 0;
+  EXPECT_FALSE(ReadCounterFromPage(&page, &timing));
+
+  page = MakeUnscheduledCounterPage();
+  page.cap_user_time = 0;
+  EXPECT_FALSE(ReadCounterFromPage(&page, &timing));
+}
+
+TEST(PackEventsIntoGroupsTest, LeavesOneGenericCounterFree) {
+  EXPECT_EQ(PackEventsIntoGroups({false, false, false, false, false, false,
+                                  false},
+                                 /*num_generic_counters=*/4),
+            std::vector<int>({0, 0, 0, 1, 1, 1, 2}));
+}
+
+TEST(PackEventsIntoGroupsTest, GivesFixedCounterEventsTheirOwnGroup) {
+  EXPECT_EQ(PackEventsIntoGroups({true, false, false, true, false},
+                                 /*num_generic_counters=*/3),
+            std::vector<int>({0, 1, 1, 2, 3}));
+}
+
+TEST(PackEventsIntoGroupsTest, UsesAtLeastOneCounter) {
+  EXPECT_EQ(PackEventsIntoGroups({false, false}, /*num_generic_counters=*/1),
+            std::vector<int>({0, 1}));
+  EXPECT_TRUE(PackEventsIntoGroups({}, /*num_generic_counters=*/4).empty());
+}
+
 namespace {
 int Fib(int n) {
   if (n < 2) return 1;
@@ -57,6 +135,49 @@ TEST(PerfSubsystemTest, Collect) {
   LOG(INFO) << result.ToString();
 }
 
+// Returns the number of instructions counted when NeedsMoreRuns() is called
+// 'num_checks' times on an empty measurement.
+double CountInstructionsOfChecks(int num_checks) {
+  PerfSubsystem perf;
+  perf.UseUserSpaceReads();
+  perf.StartCollectingAllEvents();
+  for (int i = 0; i < num_checks; ++i) {
+    perf.NeedsMoreRuns();
+  }
+  return perf.StopAndReadCounters().GetScaledOrDie("instructions");
+}
+
+TEST(PerfSubsystemTest, NeedsMoreRunsIsNotMeasured) {
+  const int kNumChecks = 1000;
+  const double one_check = CountInstructionsOfChecks(1);
+  const double many_checks = CountInstructionsOfChecks(kNumChecks);
+  // Only the few instructions around the syscalls that disable and enable the
+  // groups are counted, not the reads of the counters.
+  EXPECT_LT((many_checks - one_check) / (kNumChecks - 1), 100)
+      << one_check << " vs " << many_checks;
+}
+
+// Returns the number of instructions counted by 'perf' while computing Fib(20).
+double CountInstructionsOfFib(PerfSubsystem* perf) {
+  perf->StartCollectingAllEvents();
+  int k;
+  do {
+    k = Fib(20);
+  } while (perf->NeedsMoreRuns());
+  EXPECT_EQ(10946, k);
+  return perf->StopAndReadCounters().GetScaledOrDie("instructions");
+}
+
+TEST(PerfSubsystemTest, ReusesCountersAcrossCollections) {
+  PerfSubsystem perf;
+  perf.UseUserSpaceReads();
+  const double first = CountInstructionsOfFib(&perf);
+  // The counters are not reopened, and the second collection does not include
+  // the counts of the first one.
+  const double second = CountInstructionsOfFib(&perf);
+  EXPECT_LT(second, 1.5 * first) << first << " vs " << second;
+}
+
 TEST(PerfSubsystemTest, BasicInlineAsmSyntax) {
   asm volatile("movl %0,%%eax"
                :        /* output" */
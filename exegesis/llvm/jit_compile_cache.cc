@@ -0,0 +1,346 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exegesis/llvm/jit_compile_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "glog/logging.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CRC.h"
+
+namespace exegesis {
+namespace {
+
+// A persisted file starts with a file header, followed by the functions.
+struct PersistedFileHeader {
+  char magic[8];
+  // Incremented whenever the layout of the file changes.
+  uint32_t format_version;
+  // The version of LLVM that compiled the functions, padded with zeros.
+  char llvm_version[32];
+};
+
+constexpr char kPersistedFileMagic[] = "EXJITCC";
+static_assert(sizeof(kPersistedFileMagic) ==
+                  sizeof(PersistedFileHeader::magic),
+              "the magic must fill the magic field");
+constexpr uint32_t kPersistedFormatVersion = 1;
+
+// Returns the header of the files written by this binary.
+PersistedFileHeader MakePersistedFileHeader() {
+  PersistedFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kPersistedFileMagic, sizeof(header.magic));
+  header.format_version = kPersistedFormatVersion;
+  strncpy(header.llvm_version, LLVM_VERSION_STRING,
+          sizeof(header.llvm_version) - 1);
+  return header;
+}
+
+// A persisted function is a header followed by the key and the machine code.
+struct PersistedFunctionHeader {
+  uint32_t key_size;
+  uint32_t code_size;
+  // The CRC-32 of the key and the machine code.
+  uint32_t checksum;
+};
+
+uint32_t ComputeChecksum(absl::string_view key,
+                         llvm::ArrayRef<uint8_t> code) {
+  const uint32_t key_checksum = llvm::crc32(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t*>(key.data()), key.size()));
+  return llvm::crc32(key_checksum, code);
+}
+
+// Returns a key that identifies all the inputs of the compilation. Every field
+// is prefixed with its size so that different inputs never have the same key.
+std::string MakeKey(const std::string& mcpu,
+                    llvm::InlineAsm::AsmDialect dialect, int num_iterations,
+                    const std::string& init_code,
+                    const std::string& init_constraints,
+                    const std::string& loop_code,
+                    const std::string& loop_constraints,
+                    const std::string& cleanup_code,
+                    const std::string& cleanup_constraints) {
+  std::string key = absl::StrCat(static_cast<int>(dialect), ",",
+                                 num_iterations, ",");
+  for (const std::string* const field :
+       {&mcpu, &init_code, &init_constraints, &loop_code, &loop_constraints,
+        &cleanup_code, &cleanup_constraints}) {
+    absl::StrAppend(&key, field->size(), ":", *field);
+  }
+  return key;
+}
+
+// Writes 'size' bytes to 'fd', retrying on short writes. Returns false on
+// error.
+bool WriteFully(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+}  // namespace
+
+class JitCompileCache::ExecutableCode {
+ public:
+  // Copies 'size' bytes of machine code from 'code' to new executable memory.
+  static absl::StatusOr<std::unique_ptr<ExecutableCode>> Create(
+      const uint8_t* code, size_t size) {
+    void* const memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      return absl::ResourceExhaustedError(
+          absl::StrCat("mmap() failed: ", strerror(errno)));
+    }
+    memcpy(memory, code, size);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(memory, size);
+      return absl::InternalError(
+          absl::StrCat("mprotect() failed: ", strerror(errno)));
+    }
+    return absl::WrapUnique(
+        new ExecutableCode(static_cast<uint8_t*>(memory), size));
+  }
+
+  ~ExecutableCode() { munmap(data_, size_); }
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  VoidFunction AsFunction() const {
+    return VoidFunction(reinterpret_cast<VoidFunction::Pointer>(data_), size_);
+  }
+
+ private:
+  ExecutableCode(uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint8_t* const data_;
+  const size_t size_;
+};
+
+JitCompileCache::JitCompileCache(const std::string& mcpu,
+                                 size_t max_code_bytes)
+    : mcpu_(mcpu), max_code_bytes_(max_code_bytes) {}
+
+JitCompileCache::~JitCompileCache() {
+  if (file_fd_ >= 0) close(file_fd_);
+}
+
+absl::Status JitCompileCache::PersistToFile(const std::string& path) {
+  CHECK_LT(file_fd_, 0) << "The cache is already persisted to " << file_path_;
+  // Functions are always appended at the end of the file, so that processes
+  // forked after this call can share it.
+  const int fd =
+      open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return absl::InternalError(absl::StrCat("Could not open '", path,
+                                            "': ", strerror(errno)));
+  }
+  std::string data;
+  char buffer[1 << 16];
+  ssize_t num_read;
+  while ((num_read = read(fd, buffer, sizeof(buffer))) != 0) {
+    if (num_read < 0) {
+      if (errno == EINTR) continue;
+      const absl::Status status = absl::InternalError(
+          absl::StrCat("Could not read '", path, "': ", strerror(errno)));
+      close(fd);
+      return status;
+    }
+    data.append(buffer, num_read);
+  }
+
+  const PersistedFileHeader expected_file_header = MakePersistedFileHeader();
+  if (!data.empty()) {
+    PersistedFileHeader file_header;
+    if (data.size() < sizeof(file_header) ||
+        memcmp(data.data(), kPersistedFileMagic, sizeof(file_header.magic)) !=
+            0) {
+      close(fd);
+      return absl::FailedPreconditionError(
+          absl::StrCat("'", path, "' is not a JIT compile cache file"));
+    }
+    memcpy(&file_header, data.data(), sizeof(file_header));
+    if (file_header.format_version != kPersistedFormatVersion ||
+        memcmp(file_header.llvm_version, expected_file_header.llvm_version,
+               sizeof(file_header.llvm_version)) != 0) {
+      LOG(WARNING) << "Discarding the functions in " << path
+                   << ", which were written with format version "
+                   << file_header.format_version << " by LLVM "
+                   << std::string(file_header.llvm_version,
+                                  strnlen(file_header.llvm_version,
+                                          sizeof(file_header.llvm_version)));
+      data.clear();
+    }
+  }
+  if (data.empty()) {
+    if (ftruncate(fd, 0) != 0 ||
+        !WriteFully(fd, reinterpret_cast<const char*>(&expected_file_header),
+                    sizeof(expected_file_header))) {
+      const absl::Status status = absl::InternalError(
+          absl::StrCat("Could not write to '", path, "': ", strerror(errno)));
+      close(fd);
+      return status;
+    }
+    data.assign(reinterpret_cast<const char*>(&expected_file_header),
+                sizeof(expected_file_header));
+  }
+
+  absl::string_view remaining = data;
+  remaining.remove_prefix(sizeof(PersistedFileHeader));
+  int num_loaded = 0;
+  while (remaining.size() >= sizeof(PersistedFunctionHeader)) {
+    PersistedFunctionHeader header;
+    memcpy(&header, remaining.data(), sizeof(header));
+    if (remaining.size() <
+        sizeof(header) + header.key_size + header.code_size) {
+      break;
+    }
+    remaining.remove_prefix(sizeof(header));
+    const absl::string_view key = remaining.substr(0, header.key_size);
+    remaining.remove_prefix(header.key_size);
+    const llvm::ArrayRef<uint8_t> code(
+        reinterpret_cast<const uint8_t*>(remaining.data()), header.code_size);
+    remaining.remove_prefix(header.code_size);
+    if (ComputeChecksum(key, code) != header.checksum) {
+      LOG(WARNING) << "Dropping a corrupted function from " << path;
+      continue;
+    }
+    if (!entries_.contains(key)) {
+      AddEntry(std::string(key), absl::OkStatus(), code.data(), code.size());
+      ++num_loaded;
+    }
+  }
+  if (!remaining.empty()) {
+    LOG(WARNING) << "Dropping a truncated function at the end of " << path;
+    if (ftruncate(fd, data.size() - remaining.size()) != 0) {
+      const absl::Status status = absl::InternalError(absl::StrCat(
+          "Could not truncate '", path, "': ", strerror(errno)));
+      close(fd);
+      return status;
+    }
+  }
+  LOG(INFO) << "Loaded " << num_loaded << " compiled functions from " << path;
+  file_path_ = path;
+  file_fd_ = fd;
+  return absl::OkStatus();
+}
+
+absl::StatusOr<VoidFunction> JitCompileCache::CompileInlineAssemblyToFunction(
+    int num_iterations, const std::string& init_code,
+    const std::string& init_constraints, const std::string& loop_code,
+    const std::string& loop_constraints, const std::string& cleanup_code,
+    const std::string& cleanup_constraints,
+    llvm::InlineAsm::AsmDialect dialect) {
+  const std::string key =
+      MakeKey(mcpu_, dialect, num_iterations, init_code, init_constraints,
+              loop_code, loop_constraints, cleanup_code, cleanup_constraints);
+  const auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    ++num_hits_;
+    Entry& entry = it->second;
+    if (entry.code == nullptr) return entry.status;
+    lru_keys_.splice(lru_keys_.end(), lru_keys_, entry.lru_position);
+    return entry.code->AsFunction();
+  }
+
+  ++num_misses_;
+  // The compiler, and the memory of the code it generates, are released as
+  // soon as the code is copied to the cache.
+  JitCompiler jit(mcpu_);
+  const absl::StatusOr<VoidFunction> function =
+      jit.CompileInlineAssemblyToFunction(
+          num_iterations, init_code, init_constraints, loop_code,
+          loop_constraints, cleanup_code, cleanup_constraints, dialect);
+  if (!function.ok()) {
+    return AddEntry(key, function.status(), nullptr, 0)->status;
+  }
+  const Entry* const entry =
+      AddEntry(key, absl::OkStatus(),
+               reinterpret_cast<const uint8_t*>(function->ptr), function->size);
+  if (entry->code == nullptr) return entry->status;
+  AppendToFile(key, *entry->code);
+  return entry->code->AsFunction();
+}
+
+JitCompileCache::Entry* JitCompileCache::AddEntry(const std::string& key,
+                                                  absl::Status status,
+                                                  const uint8_t* const code,
+                                                  size_t code_size) {
+  if (code == nullptr) {
+    Entry& entry = entries_[key];
+    entry.status = std::move(status);
+    return &entry;
+  }
+
+  // Evict the least recently used functions before adding the new one.
+  while (!lru_keys_.empty() && code_bytes_ + code_size > max_code_bytes_) {
+    const auto victim = entries_.find(lru_keys_.front());
+    CHECK(victim != entries_.end());
+    code_bytes_ -= victim->second.code->size();
+    lru_keys_.pop_front();
+    entries_.erase(victim);
+  }
+  Entry& entry = entries_[key];
+  entry.status = std::move(status);
+  absl::StatusOr<std::unique_ptr<ExecutableCode>> executable_code =
+      ExecutableCode::Create(code, code_size);
+  if (!executable_code.ok()) {
+    entry.status = executable_code.status();
+    return &entry;
+  }
+  entry.code = std::move(executable_code).value();
+  code_bytes_ += code_size;
+  entry.lru_position = lru_keys_.insert(lru_keys_.end(), key);
+  return &entry;
+}
+
+void JitCompileCache::AppendToFile(const std::string& key,
+                                   const ExecutableCode& code) {
+  if (file_fd_ < 0) return;
+  PersistedFunctionHeader header;
+  header.key_size = key.size();
+  header.code_size = code.size();
+  header.checksum = ComputeChecksum(
+      key, llvm::ArrayRef<uint8_t>(code.data(), code.size()));
+  const std::string record = absl::StrCat(
+      absl::string_view(reinterpret_cast<const char*>(&header), sizeof(header)),
+      key,
+      absl::string_view(reinterpret_cast<const char*>(code.data()),
+                        code.size()));
+  // A failure to persist the function only loses it for the next runs.
+  LOG_IF(ERROR, !WriteFully(file_fd_, record.data(), record.size()))
+      << "Could not write to '" << file_path_ << "': " << strerror(errno);
+}
+
+}  // namespace exegesis
@@ -0,0 +1,123 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A content-addressed cache of the functions compiled by JitCompiler.
+//
+// Functions are keyed by everything that determines their machine code: the
+// CPU, the assembly dialect, the number of iterations, and the code and the
+// constraints of each block. The cache keeps a copy of the machine code in its
+// own executable memory, so that the LLVM compiler used to produce it can be
+// released. The failures to compile are cached too.
+//
+// The cache can optionally be persisted to a file, to which every new function
+// is appended as soon as it is compiled. The file starts with a header that
+// records the format version and the version of LLVM, and every function has a
+// checksum. Functions are copied as-is, which works because the functions built
+// by JitCompiler do not reference any symbol: they do not need to be relocated.
+// Note that the code passed to the cache often embeds addresses of buffers
+// (e.g. "movabs rsi,0x..."). Persisted functions are only reused by runs that
+// use the same addresses, so callers that persist the cache should map these
+// buffers at a fixed address, like ComputeItineraries() does.
+
+#ifndef EXEGESIS_LLVM_JIT_COMPILE_CACHE_H_
+#define EXEGESIS_LLVM_JIT_COMPILE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "exegesis/llvm/inline_asm.h"
+#include "llvm/IR/InlineAsm.h"
+
+namespace exegesis {
+
+class JitCompileCache {
+ public:
+  // The default maximal size of the machine code in the cache.
+  static constexpr size_t kDefaultMaxCodeBytes = 256 << 20;
+
+  // 'mcpu' is the CPU used for compiling the inline assembly, see
+  // JitCompiler. When the machine code in the cache exceeds 'max_code_bytes',
+  // the least recently used functions are evicted from memory.
+  explicit JitCompileCache(const std::string& mcpu,
+                           size_t max_code_bytes = kDefaultMaxCodeBytes);
+  ~JitCompileCache();
+
+  JitCompileCache(const JitCompileCache&) = delete;
+  JitCompileCache& operator=(const JitCompileCache&) = delete;
+
+  // Loads the functions persisted in 'path', and appends the functions
+  // compiled from now on to it. A missing file is created. A truncated
+  // function at the end of the file, e.g. because a previous run died while
+  // writing it, is dropped, and so is a function whose checksum does not
+  // match. A file written with another format or LLVM version is emptied.
+  // Returns an error if 'path' is not a cache file. Processes forked after
+  // this call keep appending to the file.
+  absl::Status PersistToFile(const std::string& path);
+
+  // Same as JitCompiler::CompileInlineAssemblyToFunction, but returns the
+  // cached function if the same code was already compiled. The returned
+  // function remains valid until the next call to this method, which may evict
+  // it.
+  absl::StatusOr<VoidFunction> CompileInlineAssemblyToFunction(
+      int num_iterations, const std::string& init_code,
+      const std::string& init_constraints, const std::string& loop_code,
+      const std::string& loop_constraints, const std::string& cleanup_code,
+      const std::string& cleanup_constraints,
+      llvm::InlineAsm::AsmDialect dialect);
+
+  const std::string& mcpu() const { return mcpu_; }
+  int num_hits() const { return num_hits_; }
+  int num_misses() const { return num_misses_; }
+
+ private:
+  // Machine code copied to executable memory.
+  class ExecutableCode;
+
+  struct Entry {
+    // The status of the compilation. 'code' is null if it failed.
+    absl::Status status;
+    std::unique_ptr<ExecutableCode> code;
+    // The position of the key in 'lru_keys_', if 'code' is not null.
+    std::list<std::string>::iterator lru_position;
+  };
+
+  // Adds a function to the cache, evicting other functions as needed.
+  Entry* AddEntry(const std::string& key, absl::Status status,
+                  const uint8_t* code, size_t code_size);
+
+  // Appends a function to the file of the cache, if any.
+  void AppendToFile(const std::string& key, const ExecutableCode& code);
+
+  const std::string mcpu_;
+  const size_t max_code_bytes_;
+  absl::flat_hash_map<std::string, Entry> entries_;
+  // The keys of the entries that have code, from the least to the most recently
+  // used.
+  std::list<std::string> lru_keys_;
+  size_t code_bytes_ = 0;
+  int num_hits_ = 0;
+  int num_misses_ = 0;
+  std::string file_path_;
+  int file_fd_ = -1;
+};
+
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_JIT_COMPILE_CACHE_H_
@@ -0,0 +1,156 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exegesis/llvm/jit_compile_cache.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "exegesis/testing/test_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace exegesis {
+namespace {
+
+using ::exegesis::testing::StatusIs;
+
+constexpr const char kGenericMcpu[] = "generic";
+
+// Returns code that increments the value at `counter` by one.
+std::string IncrementCode(const int64_t* counter) {
+  return absl::StrFormat("movabsq $$%d, %%rax\nincq (%%rax)",
+                         reinterpret_cast<intptr_t>(counter));
+}
+
+absl::StatusOr<VoidFunction> Compile(JitCompileCache* cache,
+                                     const std::string& loop_code,
+                                     int num_iterations) {
+  return cache->CompileInlineAssemblyToFunction(
+      num_iterations, "", "", loop_code, "~{rax}", "", "",
+      llvm::InlineAsm::AD_ATT);
+}
+
+TEST(JitCompileCacheTest, ReusesCompiledFunctions) {
+  int64_t counter = 0;
+  JitCompileCache cache(kGenericMcpu);
+  const auto function = Compile(&cache, IncrementCode(&counter), 3);
+  ASSERT_OK(function);
+  function->CallOrDie();
+  EXPECT_EQ(counter, 3);
+  EXPECT_EQ(cache.num_misses(), 1);
+
+  const auto cached_function = Compile(&cache, IncrementCode(&counter), 3);
+  ASSERT_OK(cached_function);
+  EXPECT_EQ(cached_function->ptr, function->ptr);
+  cached_function->CallOrDie();
+  EXPECT_EQ(counter, 6);
+  EXPECT_EQ(cache.num_hits(), 1);
+
+  // Any difference in the inputs is a different function.
+  ASSERT_OK(Compile(&cache, IncrementCode(&counter), 4));
+  EXPECT_EQ(cache.num_misses(), 2);
+}
+
+TEST(JitCompileCacheTest, CachesErrors) {
+  JitCompileCache cache(kGenericMcpu);
+  EXPECT_THAT(Compile(&cache, "this is not assembly", 1),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(Compile(&cache, "this is not assembly", 1),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_EQ(cache.num_misses(), 1);
+  EXPECT_EQ(cache.num_hits(), 1);
+}
+
+TEST(JitCompileCacheTest, EvictsLeastRecentlyUsedFunctions) {
+  int64_t counter = 0;
+  // The cache can only hold one function.
+  JitCompileCache cache(kGenericMcpu, /*max_code_bytes=*/1);
+  ASSERT_OK(Compile(&cache, IncrementCode(&counter), 1));
+  ASSERT_OK(Compile(&cache, IncrementCode(&counter), 2));
+  ASSERT_OK(Compile(&cache, IncrementCode(&counter), 2));
+  EXPECT_EQ(cache.num_hits(), 1);
+  const auto function = Compile(&cache, IncrementCode(&counter), 1);
+  ASSERT_OK(function);
+  EXPECT_EQ(cache.num_misses(), 3);
+  function->CallOrDie();
+  EXPECT_EQ(counter, 1);
+}
+
+TEST(JitCompileCacheTest, PersistsFunctions) {
+  const std::string path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/jit_compile_cache");
+  int64_t counter = 0;
+  {
+    JitCompileCache cache(kGenericMcpu);
+    ASSERT_OK(cache.PersistToFile(path));
+    ASSERT_OK(Compile(&cache, IncrementCode(&counter), 2));
+  }
+
+  // The function is loaded from the file, and is not compiled again.
+  JitCompileCache cache(kGenericMcpu);
+  ASSERT_OK(cache.PersistToFile(path));
+  const auto function = Compile(&cache, IncrementCode(&counter), 2);
+  ASSERT_OK(function);
+  EXPECT_EQ(cache.num_hits(), 1);
+  EXPECT_EQ(cache.num_misses(), 0);
+  function->CallOrDie();
+  EXPECT_EQ(counter, 2);
+}
+
+TEST(JitCompileCacheTest, DropsCorruptedFunctions) {
+  const std::string path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/jit_compile_cache_corrupted");
+  int64_t counter = 0;
+  {
+    JitCompileCache cache(kGenericMcpu);
+    ASSERT_OK(cache.PersistToFile(path));
+    ASSERT_OK(Compile(&cache, IncrementCode(&counter), 2));
+  }
+  // Flip the last byte of the machine code of the function.
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(-1, std::ios::end);
+    const char last_byte = file.get();
+    file.seekp(-1, std::ios::end);
+    file.put(~last_byte);
+    ASSERT_TRUE(file.good());
+  }
+
+  // The corrupted function is compiled again.
+  JitCompileCache cache(kGenericMcpu);
+  ASSERT_OK(cache.PersistToFile(path));
+  const auto function = Compile(&cache, IncrementCode(&counter), 2);
+  ASSERT_OK(function);
+  EXPECT_EQ(cache.num_misses(), 1);
+  function->CallOrDie();
+  EXPECT_EQ(counter, 2);
+}
+
+TEST(JitCompileCacheTest, RejectsOtherFiles) {
+  const std::string path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/jit_compile_cache_other");
+  std::ofstream(path) << "This is not a JIT compile cache.";
+  JitCompileCache cache(kGenericMcpu);
+  EXPECT_THAT(cache.PersistToFile(path),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+}  // namespace
+}  // namespace exegesis
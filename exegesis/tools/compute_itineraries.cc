@@ -19,10 +19,13 @@
 #include <functional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_split.h"
+#include "absl/time/time.h"
 #include "exegesis/base/init_main.h"
 #include "exegesis/base/microarchitecture.h"
 #include "exegesis/tools/architecture_flags.h"
@@ -40,11 +43,57 @@ ABSL_FLAG(std::string, exegesis_output_itineraries, "",
 ABSL_FLAG(int, exegesis_pin_to_core, 0,
           "Pin the process to the given core. This helps for getting more "
           "reliable results.");
+ABSL_FLAG(std::string, exegesis_parallel_cores, "",
+          "If provided, the itineraries are computed in parallel by one worker "
+          "process per core in this comma-separated list of core ids. Each "
+          "worker is pinned to its core. Use at most one core per physical "
+          "core, as hyperthreads disturb the measurements of each other.");
+ABSL_FLAG(std::string, exegesis_checkpoint_file, "",
+          "If provided, the itinerary of every instruction is appended to this "
+          "file as soon as it is computed.");
+ABSL_FLAG(bool, exegesis_resume_from_checkpoint, false,
+          "Do not measure again the instructions found in "
+          "--exegesis_checkpoint_file, and read their itineraries from it.");
+ABSL_FLAG(bool, exegesis_isolate_crashes, true,
+          "Measure every instruction in a child process, so that an "
+          "instruction that crashes is reported as failed instead of killing "
+          "the tool.");
+ABSL_FLAG(absl::Duration, exegesis_measurement_timeout, absl::Minutes(5),
+          "With --exegesis_isolate_crashes, the child process measuring an "
+          "instruction is killed after this time, and the instruction is "
+          "reported as failed.");
+ABSL_FLAG(std::string, exegesis_jit_cache_file, "",
+          "If provided, the compiled measurement code is persisted to this "
+          "file, and reused by the next runs instead of being compiled again. "
+          "The code embeds the addresses of the measurement buffers, so it is "
+          "only reused when they do not move, e.g. with ASLR disabled.");
+ABSL_FLAG(int, exegesis_min_samples, 5,
+          "The minimal number of times every instruction is measured.");
+ABSL_FLAG(int, exegesis_max_samples, 30,
+          "The maximal number of times every instruction is measured. The "
+          "measurements stop earlier once the median of every counter is "
+          "known within --exegesis_sampling_precision.");
+ABSL_FLAG(double, exegesis_sampling_precision, 0.01,
+          "The relative half-width of the 95% confidence interval of the "
+          "median of every counter at which measurements stop.");
+ABSL_FLAG(bool, exegesis_measure_latency, false,
+          "Also measure the latencies of the instructions, through chains of "
+          "dependent instances of each instruction.");
 
 namespace exegesis {
 
 void Main() {
-  SetCoreAffinity(absl::GetFlag(FLAGS_exegesis_pin_to_core));
+  std::vector<int> parallel_cores;
+  for (const absl::string_view core : absl::StrSplit(
+           absl::GetFlag(FLAGS_exegesis_parallel_cores), ',',
+           absl::SkipWhitespace())) {
+    int core_id = 0;
+    CHECK(absl::SimpleAtoi(core, &core_id)) << "Invalid core id: " << core;
+    parallel_cores.push_back(core_id);
+  }
+  if (parallel_cores.empty()) {
+    SetCoreAffinity(absl::GetFlag(FLAGS_exegesis_pin_to_core));
+  }
 
   const auto microarchitecture_data =
       GetMicroArchitectureDataFromCommandLineFlags();
@@ -68,7 +117,26 @@ void Main() {
                return !mnemonics.contains(itinerary->llvm_mnemonic());
              });
   }
-  LOG(ERROR) << itineraries::ComputeItineraries(instruction_set, &itineraries);
+  itineraries::ComputeItinerariesOptions options;
+  options.checkpoint_file = absl::GetFlag(FLAGS_exegesis_checkpoint_file);
+  options.resume_from_checkpoint =
+      absl::GetFlag(FLAGS_exegesis_resume_from_checkpoint);
+  options.isolate_crashes = absl::GetFlag(FLAGS_exegesis_isolate_crashes);
+  options.measurement_timeout =
+      absl::GetFlag(FLAGS_exegesis_measurement_timeout);
+  options.jit_cache_file = absl::GetFlag(FLAGS_exegesis_jit_cache_file);
+  options.sampling.min_num_samples = absl::GetFlag(FLAGS_exegesis_min_samples);
+  options.sampling.max_num_samples = absl::GetFlag(FLAGS_exegesis_max_samples);
+  options.sampling.relative_precision =
+      absl::GetFlag(FLAGS_exegesis_sampling_precision);
+  options.measure_latency = absl::GetFlag(FLAGS_exegesis_measure_latency);
+  if (parallel_cores.empty()) {
+    LOG(ERROR) << itineraries::ComputeItineraries(instruction_set,
+                                                  &itineraries, options);
+  } else {
+    LOG(ERROR) << itineraries::ComputeItinerariesInParallel(
+        instruction_set, parallel_cores, &itineraries, options);
+  }
 
   WriteTextProtoOrDie(absl::GetFlag(FLAGS_exegesis_output_itineraries),
                       itineraries);
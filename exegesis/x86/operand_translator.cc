@@ -15,8 +15,11 @@
 #include "exegesis/x86/operand_translator.h"
 
 #include <string>
+#include <utility>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "exegesis/util/instruction_syntax.h"
 #include "glog/logging.h"
@@ -169,9 +172,77 @@ InstructionOperand::Tag TranslateOperandTag(
   return code_tag;
 }
 
-}  // namespace
+// The kinds of registers that can be chained.
+enum class RegisterKind { kGeneralPurpose, kVector, kMmx, kOther };
 
-InstructionFormat InstantiateOperands(const InstructionProto& instruction) {
+RegisterKind GetRegisterKind(const std::string& register_name) {
+  const std::string name = absl::AsciiStrToLower(register_name);
+  if (absl::StartsWith(name, "xmm") || absl::StartsWith(name, "ymm") ||
+      absl::StartsWith(name, "zmm")) {
+    return RegisterKind::kVector;
+  }
+  if (absl::StartsWith(name, "mm")) return RegisterKind::kMmx;
+  if (absl::StartsWith(name, "k") || absl::StartsWith(name, "st") ||
+      absl::StartsWith(name, "bnd") || absl::StartsWith(name, "cr") ||
+      absl::StartsWith(name, "dr") || name == "cs" || name.empty()) {
+    return RegisterKind::kOther;
+  }
+  return RegisterKind::kGeneralPurpose;
+}
+
+bool IsRegisterOperand(const InstructionOperand& operand) {
+  return operand.addressing_mode() == InstructionOperand::DIRECT_ADDRESSING;
+}
+
+bool IsRead(const InstructionOperand& operand) {
+  return operand.usage() == InstructionOperand::USAGE_READ ||
+         operand.usage() == InstructionOperand::USAGE_READ_WRITE;
+}
+
+bool IsWritten(const InstructionOperand& operand) {
+  return operand.usage() == InstructionOperand::USAGE_WRITE ||
+         operand.usage() == InstructionOperand::USAGE_READ_WRITE;
+}
+
+// Implicit operands are part of the instruction, they can't be changed.
+bool CanBeRenamed(const InstructionOperand& operand) {
+  return operand.encoding() != InstructionOperand::IMPLICIT_ENCODING;
+}
+
+// Returns a register of the given kind and size that is not used by 'code', or
+// an empty string if there is none. The candidates are only read by the
+// instruction, so they do not need to be clobbered.
+std::string FindUnusedRegister(const InstructionFormat& code,
+                               RegisterKind kind, int size_bits) {
+  static const auto* const kCandidates =
+      new absl::flat_hash_map<std::pair<RegisterKind, int>,
+                              std::vector<std::string>>({
+          {{RegisterKind::kGeneralPurpose, 8}, {"al", "bl", "cl", "dl"}},
+          {{RegisterKind::kGeneralPurpose, 16}, {"ax", "bx", "cx", "dx"}},
+          {{RegisterKind::kGeneralPurpose, 32}, {"eax", "ebx", "ecx", "edx"}},
+          {{RegisterKind::kGeneralPurpose, 64}, {"rax", "rbx", "rcx", "rdx"}},
+          {{RegisterKind::kVector, 128}, {"xmm2", "xmm3", "xmm4", "xmm6"}},
+          {{RegisterKind::kVector, 256}, {"ymm2", "ymm3", "ymm4", "ymm6"}},
+          {{RegisterKind::kVector, 512}, {"zmm2", "zmm3", "zmm4", "zmm6"}},
+          {{RegisterKind::kMmx, 64}, {"mm2", "mm3", "mm4", "mm7"}},
+      });
+  const auto it = kCandidates->find(std::make_pair(kind, size_bits));
+  if (it == kCandidates->end()) return "";
+  for (const std::string& candidate : it->second) {
+    bool is_used = false;
+    for (const InstructionOperand& operand : code.operands()) {
+      is_used = is_used || absl::EqualsIgnoreCase(operand.name(), candidate);
+    }
+    if (!is_used) return candidate;
+  }
+  return "";
+}
+
+// Same as InstantiateOperands(), but also returns the index of the
+// instantiated operand for every operand of the vendor syntax, or -1 when the
+// operand does not appear in the code.
+InstructionFormat InstantiateOperandsWithIndices(
+    const InstructionProto& instruction, std::vector<int>* operand_indices) {
   InstructionFormat result;
   // Deal with the fact that the LLVM assembler cannot assemble MOV r64,imm64.
   const InstructionFormat& vendor_syntax =
@@ -179,6 +250,7 @@ InstructionFormat InstantiateOperands(const InstructionProto& instruction) {
   const bool is_movabs = vendor_syntax.mnemonic() == "MOV" &&
                          vendor_syntax.operands(1).name() == "imm64";
   result.set_mnemonic(is_movabs ? "MOVABS" : vendor_syntax.mnemonic());
+  operand_indices->clear();
   for (const auto& operand : vendor_syntax.operands()) {
     std::string code_operand = TranslateOperand(operand.name());
     if (code_operand == operand.name()) {
@@ -190,6 +262,7 @@ InstructionFormat InstantiateOperands(const InstructionProto& instruction) {
     // AVX-512 instructions, where {sae} and the embedded rounding tags are
     // separated from other operands by a comma.
     if (!code_operand.empty() || !operand.tags().empty()) {
+      operand_indices->push_back(result.operands_size());
       InstructionOperand* const instantiated_operand = result.add_operands();
       instantiated_operand->set_name(code_operand);
       for (const InstructionOperand::Tag& tag : operand.tags()) {
@@ -198,10 +271,97 @@ InstructionFormat InstantiateOperands(const InstructionProto& instruction) {
     } else {
       CHECK_EQ(operand.name(), "<XMM0>")
           << "\"" << operand.name() << "\" could not be translated.";
+      operand_indices->push_back(-1);
     }
   }
   return result;
 }
 
+}  // namespace
+
+InstructionFormat InstantiateOperands(const InstructionProto& instruction) {
+  std::vector<int> operand_indices;
+  return InstantiateOperandsWithIndices(instruction, &operand_indices);
+}
+
+std::vector<DependencyChain> InstantiateDependencyChains(
+    const InstructionProto& instruction) {
+  const InstructionFormat& vendor_syntax =
+      GetVendorSyntaxWithMostOperandsOrDie(instruction);
+  std::vector<int> operand_indices;
+  const InstructionFormat base_code =
+      InstantiateOperandsWithIndices(instruction, &operand_indices);
+  // Returns true if the operand at 'index' is a register that appears in the
+  // code.
+  const auto is_register = [&](int index) {
+    return operand_indices[index] >= 0 &&
+           IsRegisterOperand(vendor_syntax.operands(index)) &&
+           !base_code.operands(operand_indices[index]).name().empty();
+  };
+
+  std::vector<DependencyChain> chains;
+  const int num_operands = vendor_syntax.operands_size();
+  for (int output = 0; output < num_operands; ++output) {
+    const InstructionOperand& output_operand = vendor_syntax.operands(output);
+    if (!is_register(output) || !IsWritten(output_operand)) continue;
+    const RegisterKind kind =
+        GetRegisterKind(base_code.operands(operand_indices[output]).name());
+    if (kind == RegisterKind::kOther) continue;
+    for (int input = 0; input < num_operands; ++input) {
+      const InstructionOperand& input_operand = vendor_syntax.operands(input);
+      if (!is_register(input) || !IsRead(input_operand) ||
+          input_operand.value_size_bits() != output_operand.value_size_bits() ||
+          input_operand.register_class() != output_operand.register_class() ||
+          GetRegisterKind(base_code.operands(operand_indices[input]).name()) !=
+              kind) {
+        continue;
+      }
+      DependencyChain chain;
+      chain.output_operand_index = output;
+      chain.input_operand_index = input;
+      chain.code = base_code;
+      InstructionOperand* const code_output =
+          chain.code.mutable_operands(operand_indices[output]);
+      InstructionOperand* const code_input =
+          chain.code.mutable_operands(operand_indices[input]);
+      if (CanBeRenamed(input_operand)) {
+        code_input->set_name(code_output->name());
+      } else if (CanBeRenamed(output_operand)) {
+        code_output->set_name(code_input->name());
+      } else if (!absl::EqualsIgnoreCase(code_input->name(),
+                                         code_output->name())) {
+        continue;
+      }
+      const std::string chained_register = code_output->name();
+
+      // Move the other inputs away from the chained register.
+      bool is_isolated = true;
+      for (int other = 0; other < num_operands && is_isolated; ++other) {
+        if (other == input || other == output || !is_register(other) ||
+            !IsRead(vendor_syntax.operands(other))) {
+          continue;
+        }
+        InstructionOperand* const code_other =
+            chain.code.mutable_operands(operand_indices[other]);
+        if (!absl::EqualsIgnoreCase(code_other->name(), chained_register)) {
+          continue;
+        }
+        const std::string unused_register =
+            CanBeRenamed(vendor_syntax.operands(other))
+                ? FindUnusedRegister(chain.code, kind,
+                                     output_operand.value_size_bits())
+                : "";
+        if (unused_register.empty()) {
+          is_isolated = false;
+        } else {
+          code_other->set_name(unused_register);
+        }
+      }
+      if (is_isolated) chains.push_back(std::move(chain));
+    }
+  }
+  return chains;
+}
+
 }  // namespace x86
 }  // namespace exegesis
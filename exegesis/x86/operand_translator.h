@@ -21,6 +21,8 @@
 #ifndef EXEGESIS_X86_OPERAND_TRANSLATOR_H_
 #define EXEGESIS_X86_OPERAND_TRANSLATOR_H_
 
+#include <vector>
+
 #include "absl/status/statusor.h"
 #include "exegesis/proto/instructions.pb.h"
 
@@ -30,6 +32,28 @@ namespace x86 {
 // Instanciates all operands in the instructions.
 InstructionFormat InstantiateOperands(const InstructionProto& instruction);
 
+// An instance of an instruction where one of its outputs is also one of its
+// inputs, so that repeating the instruction creates a serial chain of
+// dependent instructions.
+struct DependencyChain {
+  // The indices of the output and of the input operand in the vendor syntax
+  // with the most operands.
+  int output_operand_index = 0;
+  int input_operand_index = 0;
+  // The instantiated instruction.
+  InstructionFormat code;
+};
+
+// Returns a dependency chain for every pair of an output register operand and
+// an input register operand of the same kind and size. The other inputs are
+// assigned registers that are not written by the instruction, so that the
+// chain only goes from the input to the output. Note that when the output is
+// also read, the chain also goes from the output to itself. Pairs that can not
+// be isolated this way, e.g. because both operands are implicit and different,
+// are skipped.
+std::vector<DependencyChain> InstantiateDependencyChains(
+    const InstructionProto& instruction);
+
 }  // namespace x86
 }  // namespace exegesis
 
@@ -24,6 +24,8 @@ namespace x86 {
 namespace {
 
 using ::exegesis::testing::EqualsProto;
+using ::testing::ElementsAre;
+using ::testing::Field;
 
 TEST(OperandTranslatorTest, Works) {
   const auto instruction = ParseProtoFromStringOrDie<InstructionProto>(R"pb(
@@ -144,6 +146,131 @@ TEST(OperandTranslatorTest, Avx512StaticRounding) {
   EXPECT_THAT(InstantiateOperands(instruction), EqualsProto(kExpectedFormat));
 }
 
+// Matches a DependencyChain.
+::testing::Matcher<DependencyChain> IsChain(int output, int input,
+                                            const char* code) {
+  return ::testing::AllOf(
+      Field(&DependencyChain::output_operand_index, output),
+      Field(&DependencyChain::input_operand_index, input),
+      Field(&DependencyChain::code, EqualsProto(code)));
+}
+
+TEST(InstantiateDependencyChainsTest, ReadWriteOperand) {
+  const auto instruction = ParseProtoFromStringOrDie<InstructionProto>(R"pb(
+    legacy_instruction: true
+    vendor_syntax {
+      mnemonic: 'ADD'
+      operands {
+        addressing_mode: DIRECT_ADDRESSING
+        encoding: MODRM_RM_ENCODING
+        value_size_bits: 32
+        name: 'r32'
+        usage: USAGE_READ_WRITE
+      }
+      operands {
+        addressing_mode: DIRECT_ADDRESSING
+        encoding: MODRM_REG_ENCODING
+        value_size_bits: 32
+        name: 'r32'
+        usage: USAGE_READ
+      }
+    })pb");
+  // The first chain only goes through the first operand: the second operand
+  // is moved to another register.
+  EXPECT_THAT(
+      InstantiateDependencyChains(instruction),
+      ElementsAre(IsChain(0, 0, R"pb(
+                    mnemonic: 'ADD'
+                    operands { name: 'ecx' }
+                    operands { name: 'eax' })pb"),
+                  IsChain(0, 1, R"pb(
+                    mnemonic: 'ADD'
+                    operands { name: 'ecx' }
+                    operands { name: 'ecx' })pb")));
+}
+
+TEST(InstantiateDependencyChainsTest, Avx512) {
+  const auto instruction = ParseProtoFromStringOrDie<InstructionProto>(R"pb(
+    vendor_syntax {
+      mnemonic: "VADDPD"
+      operands {
+        addressing_mode: DIRECT_ADDRESSING
+        encoding: MODRM_REG_ENCODING
+        value_size_bits: 512
+        name: "zmm1"
+        tags { name: "k1" }
+        tags { name: "z" }
+        usage: USAGE_WRITE
+      }
+      operands {
+        addressing_mode: DIRECT_ADDRESSING
+        encoding: VEX_V_ENCODING
+        value_size_bits: 512
+        name: "zmm2"
+        usage: USAGE_READ
+      }
+      operands {
+        addressing_mode: DIRECT_ADDRESSING
+        encoding: MODRM_RM_ENCODING
+        value_size_bits: 512
+        name: "zmm3"
+        usage: USAGE_READ
+      }
+      operands {
+        addressing_mode: NO_ADDRESSING
+        encoding: X86_STATIC_PROPERTY_ENCODING
+        usage: USAGE_READ
+        tags { name: "er" }
+      }
+    }
+    available_in_64_bit: true
+    raw_encoding_specification: "EVEX.NDS.512.66.0F.W1 58 /r")pb");
+  EXPECT_THAT(InstantiateDependencyChains(instruction),
+              ElementsAre(IsChain(0, 1, R"pb(
+                            mnemonic: "VADDPD"
+                            operands {
+                              name: "zmm1"
+                              tags { name: "k1" }
+                              tags { name: "z" }
+                            }
+                            operands { name: "zmm1" }
+                            operands { name: "zmm3" }
+                            operands { tags { name: "rn-sae" } })pb"),
+                          IsChain(0, 2, R"pb(
+                            mnemonic: "VADDPD"
+                            operands {
+                              name: "zmm1"
+                              tags { name: "k1" }
+                              tags { name: "z" }
+                            }
+                            operands { name: "zmm2" }
+                            operands { name: "zmm1" }
+                            operands { tags { name: "rn-sae" } })pb")));
+}
+
+TEST(InstantiateDependencyChainsTest, NoChainWithoutMatchingOperands) {
+  const auto instruction = ParseProtoFromStringOrDie<InstructionProto>(R"pb(
+    legacy_instruction: true
+    vendor_syntax {
+      mnemonic: 'CVTSI2SD'
+      operands {
+        addressing_mode: DIRECT_ADDRESSING
+        encoding: MODRM_REG_ENCODING
+        value_size_bits: 128
+        name: 'xmm'
+        usage: USAGE_WRITE
+      }
+      operands {
+        addressing_mode: DIRECT_ADDRESSING
+        encoding: MODRM_RM_ENCODING
+        value_size_bits: 64
+        name: 'r64'
+        usage: USAGE_READ
+      }
+    })pb");
+  EXPECT_THAT(InstantiateDependencyChains(instruction), ::testing::IsEmpty());
+}
+
 }  // namespace
 }  // namespace x86
 }  // namespace exegesis
@@ -66,6 +66,26 @@ InverseThroughputAnalysis ComputeInverseThroughput(
   return Result;
 }
 
+void InverseThroughputObserver::Init(
+    const BlockContext& BlockContext,
+    const std::vector<BufferDescription>& BufferDescriptions) {
+  PrevEndCycle_ = 0;
+  Result_ = InverseThroughputAnalysis();
+}
+
+void InverseThroughputObserver::OnIterationEnd(
+    size_t Iteration, const SimulationLog::IterationStats& Stats) {
+  if (Iteration >= NumSkippedIterations_) {
+    assert(Stats.EndCycle >= PrevEndCycle_ && "not in order");
+    const unsigned InvThroughput = Stats.EndCycle - PrevEndCycle_;
+    Result_.Min = std::min(Result_.Min, InvThroughput);
+    Result_.Max = std::max(Result_.Max, InvThroughput);
+    ++Result_.NumIterations;
+    Result_.TotalNumCycles += InvThroughput;
+  }
+  PrevEndCycle_ = Stats.EndCycle;
+}
+
 std::vector<unsigned> ComputeInverseThroughputs(
     const BlockContext& BlockContext, const SimulationLog& Log) {
   std::vector<unsigned> Throughputs;
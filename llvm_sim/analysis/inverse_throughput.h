@@ -48,6 +48,38 @@ InverseThroughputAnalysis ComputeInverseThroughput(
 std::vector<unsigned> ComputeInverseThroughputs(
     const BlockContext& BlockContext, const SimulationLog& Log);
 
+// The log events that the inverse throughput analyses need: none, they only
+// use the iteration stats.
+constexpr LogEventMask kInverseThroughputLogEvents = LogEventMask();
+
+// Computes the inverse throughput while the simulation runs. The total number
+// of iterations is not known upfront, so instead of skipping the first half of
+// the iterations like ComputeInverseThroughput(), this skips the first
+// `NumSkippedIterations` iterations.
+class InverseThroughputObserver : public SimulationObserver {
+ public:
+  explicit InverseThroughputObserver(size_t NumSkippedIterations)
+      : NumSkippedIterations_(NumSkippedIterations) {}
+
+  LogEventMask GetSubscriptions() const override {
+    return kInverseThroughputLogEvents;
+  }
+
+  void Init(const BlockContext& BlockContext,
+            const std::vector<BufferDescription>& BufferDescriptions) override;
+
+  void OnIterationEnd(size_t Iteration,
+                      const SimulationLog::IterationStats& Stats) override;
+
+  // Returns the analysis for the iterations completed so far.
+  const InverseThroughputAnalysis& GetResult() const { return Result_; }
+
+ private:
+  const size_t NumSkippedIterations_;
+  unsigned PrevEndCycle_ = 0;
+  InverseThroughputAnalysis Result_;
+};
+
 }  // namespace simulator
 }  // namespace exegesis
 
@@ -79,6 +79,31 @@ TEST(DispatchPortTest, Works) {
   }
 }
 
+TEST(InverseThroughputObserverTest, Works) {
+  std::vector<llvm::MCInst> Instructions;
+  const BlockContext BlockContext(Instructions, true);
+  std::vector<BufferDescription> BufferDescriptions(4);
+
+  InverseThroughputObserver Observer(/*NumSkippedIterations=*/2);
+  Observer.Init(BlockContext, BufferDescriptions);
+  Observer.OnIterationEnd(0, {/*EndCycle=*/2});
+  Observer.OnIterationEnd(1, {/*EndCycle=*/15});
+  EXPECT_EQ(Observer.GetResult().NumIterations, 0);
+  Observer.OnIterationEnd(2, {/*EndCycle=*/42});
+  Observer.OnIterationEnd(3, {/*EndCycle=*/44});
+  // Same as ComputeInverseThroughput() for 4 iterations.
+  const InverseThroughputAnalysis& Result = Observer.GetResult();
+  EXPECT_EQ(Result.Min, 2);
+  EXPECT_EQ(Result.Max, 27);
+  EXPECT_EQ(Result.NumIterations, 2);
+  EXPECT_EQ(Result.TotalNumCycles, 29);
+
+  // Init() resets the observer.
+  Observer.Init(BlockContext, BufferDescriptions);
+  EXPECT_EQ(Observer.GetResult().NumIterations, 0);
+  EXPECT_EQ(Observer.GetResult().TotalNumCycles, 0);
+}
+
 TEST(ComputeInverseThroughputsTest, SanityCheck) {
   std::vector<llvm::MCInst> Instructions;
   const BlockContext BlockContext(Instructions, true);
@@ -14,69 +14,121 @@
 
 #include "llvm_sim/analysis/port_pressure.h"
 
-#include "llvm/ADT/Optional.h"
-
 namespace exegesis {
 namespace simulator {
 
-PortPressureAnalysis ComputePortPressure(const BlockContext& BlockContext,
-                                         const SimulationLog& Log) {
-  std::vector<llvm::Optional<std::vector<float>>> TotalCyclesByInstByBuffer(
-      Log.BufferDescriptions.size());
+void PortPressureObserver::Init(
+    const BlockContext& BlockContext,
+    const std::vector<BufferDescription>& BufferDescriptions) {
+  NumInstructions_ = BlockContext.GetNumBasicBlockInstructions();
+  NumCompleteIterations_ = 0;
+  NumPorts_ = 0;
+  PortIndexByBuffer_.assign(BufferDescriptions.size(), -1);
+  TotalCycles_.clear();
+  while (!PendingCycles_.empty()) {
+    FreePendingCycles_.push_back(std::move(PendingCycles_.front()));
+    PendingCycles_.pop_front();
+  }
+}
 
-  for (const auto& Line : Log.Lines) {
-    if (Line.MsgTag != "PortPressure") {
-      continue;
+std::vector<float>& PortPressureObserver::GetPendingCycles(size_t Iteration) {
+  assert(Iteration >= NumCompleteIterations_);
+  while (PendingCycles_.size() <= Iteration - NumCompleteIterations_) {
+    if (FreePendingCycles_.empty()) {
+      PendingCycles_.emplace_back();
+    } else {
+      PendingCycles_.push_back(std::move(FreePendingCycles_.back()));
+      FreePendingCycles_.pop_back();
     }
-    auto& CyclesByInst = TotalCyclesByInstByBuffer[Line.BufferIndex];
-    if (Line.Msg == "init") {
-      // Initialize the port if needed.
-      assert(!CyclesByInst.hasValue() && "initialized twice");
-      CyclesByInst =
-          std::vector<float>(BlockContext.GetNumBasicBlockInstructions());
+    PendingCycles_.back().assign(TotalCycles_.size(), 0.0f);
+  }
+  return PendingCycles_[Iteration - NumCompleteIterations_];
+}
+
+void PortPressureObserver::OnEvent(const SimulationLog::Event& Event) {
+  int& PortIndex = PortIndexByBuffer_[Event.GetBufferIndex()];
+  if (Event.GetKind() == LogEventKind::kPortPressureInit) {
+    assert(PortIndex < 0 && "initialized twice");
+    assert(PendingCycles_.empty() && "initialized after first use");
+    PortIndex = NumPorts_++;
+    TotalCycles_.resize(TotalCycles_.size() + NumInstructions_, 0.0f);
+  } else if (Event.GetKind() == LogEventKind::kPortPressure) {
+    assert(PortIndex >= 0 && "port pressure before init");
+    const InstructionIndex::Type Instr = Event.GetInstructionIndex();
+    assert(Instr.BBIndex < NumInstructions_);
+    const size_t Index = PortIndex * NumInstructions_ + Instr.BBIndex;
+    // Pressure of incomplete iterations is only counted when they complete,
+    // to avoid biasing the numbers.
+    if (Instr.Iteration < NumCompleteIterations_) {
+      TotalCycles_[Index] += Event.GetPortPressureCycles();
     } else {
-      // `Msg` is "<iteration>,<inst index>,<pressure_in_cycles>".
-      llvm::StringRef Msg = Line.Msg;
-      InstructionIndex::Type Instr;
-      if (InstructionIndex::Consume(Msg, Instr)) {
-        llvm::errs() << Msg << "\n";
-        llvm_unreachable("invalid PortPressure message");
-      }
-      if (Instr.Iteration >= Log.GetNumCompleteIterations()) {
-        // Ignore any incomplete iteration to avoid biasing the numbers.
-        continue;
-      }
-      assert(Instr.BBIndex < BlockContext.GetNumBasicBlockInstructions());
-      assert(!Msg.empty() && Msg.front() == ',');
-      Msg = Msg.drop_front();
-      double Cycles;
-      if (Msg.getAsDouble(Cycles)) {
-        llvm_unreachable("invalid PortPressure message");
-      }
-      (*CyclesByInst)[Instr.BBIndex] += Cycles;
+      GetPendingCycles(Instr.Iteration)[Index] +=
+          Event.GetPortPressureCycles();
     }
   }
+}
+
+void PortPressureObserver::OnIterationEnd(
+    size_t Iteration, const SimulationLog::IterationStats& Stats) {
+  assert(Iteration == NumCompleteIterations_ && "not in order");
+  ++NumCompleteIterations_;
+  if (PendingCycles_.empty()) {
+    return;  // No port pressure for this iteration.
+  }
+  std::vector<float>& Cycles = PendingCycles_.front();
+  for (size_t I = 0; I < Cycles.size(); ++I) {
+    TotalCycles_[I] += Cycles[I];
+  }
+  FreePendingCycles_.push_back(std::move(Cycles));
+  PendingCycles_.pop_front();
+}
 
-  // Collect results.
+PortPressureAnalysis PortPressureObserver::GetResult() const {
   PortPressureAnalysis Result;
-  for (int BufferIdx = 0; BufferIdx < Log.BufferDescriptions.size();
-       ++BufferIdx) {
-    auto& CyclesByInst = TotalCyclesByInstByBuffer[BufferIdx];
-    if (!CyclesByInst.hasValue()) {
+  for (int BufferIdx = 0; BufferIdx < PortIndexByBuffer_.size(); ++BufferIdx) {
+    const int PortIndex = PortIndexByBuffer_[BufferIdx];
+    if (PortIndex < 0) {
       continue;  // Not a port.
     }
     PortPressureAnalysis::PortPressure Pressure;
     Pressure.BufferIndex = BufferIdx;
-    for (const float Cycles : *CyclesByInst) {
-      Pressure.CyclesPerIterationByMCInst.push_back(
-          Cycles / Log.GetNumCompleteIterations());
+    for (size_t I = 0; I < NumInstructions_; ++I) {
+      const float Cycles = TotalCycles_[PortIndex * NumInstructions_ + I];
+      Pressure.CyclesPerIterationByMCInst.push_back(Cycles /
+                                                    NumCompleteIterations_);
       Pressure.CyclesPerIteration += Cycles;
     }
-    Pressure.CyclesPerIteration /= Log.GetNumCompleteIterations();
+    Pressure.CyclesPerIteration /= NumCompleteIterations_;
     Result.Pressures.push_back(std::move(Pressure));
   }
   return Result;
 }
 
+PortPressureAnalysis ComputePortPressure(const BlockContext& BlockContext,
+                                         const SimulationLog& Log) {
+  // Replay the log.
+  PortPressureObserver Observer;
+  Observer.Init(BlockContext, Log.BufferDescriptions);
+  const size_t NumIterations = Log.GetNumCompleteIterations();
+  size_t Iteration = 0;
+  for (const auto& Event : Log.Events) {
+    // Like in the simulation, iterations end after all the events of the cycle
+    // when they end, so that the observer does not keep the pressure of all
+    // iterations pending.
+    for (; Iteration < NumIterations &&
+           Log.Iterations[Iteration].EndCycle < Event.GetCycle();
+         ++Iteration) {
+      Observer.OnIterationEnd(Iteration, Log.Iterations[Iteration]);
+    }
+    if (Observer.GetSubscriptions().Contains(Event.GetKind())) {
+      Observer.OnEvent(Event);
+    }
+  }
+  for (; Iteration < NumIterations; ++Iteration) {
+    Observer.OnIterationEnd(Iteration, Log.Iterations[Iteration]);
+  }
+  return Observer.GetResult();
+}
+
 }  // namespace simulator
 }  // namespace exegesis
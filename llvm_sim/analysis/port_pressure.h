@@ -18,6 +18,7 @@
 #ifndef EXEGESIS_LLVM_SIM_ANALYSIS_PORT_PRESSURE_H_
 #define EXEGESIS_LLVM_SIM_ANALYSIS_PORT_PRESSURE_H_
 
+#include <deque>
 #include <vector>
 
 #include "llvm_sim/framework/context.h"
@@ -48,6 +49,52 @@ class PortPressureAnalysis {
 PortPressureAnalysis ComputePortPressure(const BlockContext& BlockContext,
                                          const SimulationLog& Log);
 
+// The log events that ComputePortPressure() needs.
+constexpr LogEventMask kPortPressureLogEvents =
+    LogEventMask()
+        .With(LogEventKind::kPortPressureInit)
+        .With(LogEventKind::kPortPressure);
+
+// Computes the port pressure while the simulation runs. The state is
+// proportional to the number of ports times the number of instructions in the
+// block (plus the iterations that are in flight), and does not depend on the
+// number of simulated iterations.
+class PortPressureObserver : public SimulationObserver {
+ public:
+  LogEventMask GetSubscriptions() const override {
+    return kPortPressureLogEvents;
+  }
+
+  void Init(const BlockContext& BlockContext,
+            const std::vector<BufferDescription>& BufferDescriptions) override;
+
+  void OnEvent(const SimulationLog::Event& Event) override;
+
+  void OnIterationEnd(size_t Iteration,
+                      const SimulationLog::IterationStats& Stats) override;
+
+  // Returns the port pressure over the iterations completed so far.
+  PortPressureAnalysis GetResult() const;
+
+ private:
+  // Returns the cycles of in-flight iteration `Iteration`.
+  std::vector<float>& GetPendingCycles(size_t Iteration);
+
+  size_t NumInstructions_ = 0;
+  size_t NumCompleteIterations_ = 0;
+  int NumPorts_ = 0;
+  // The index of the port of each buffer, or -1 if the buffer is not a port.
+  std::vector<int> PortIndexByBuffer_;
+  // The cycles of all complete iterations, indexed by
+  // `PortIndex * NumInstructions_ + BBIndex`.
+  std::vector<float> TotalCycles_;
+  // The cycles of the iterations in flight, starting with iteration
+  // `NumCompleteIterations_`. Same indexing as `TotalCycles_`.
+  std::deque<std::vector<float>> PendingCycles_;
+  // Recycled elements of `PendingCycles_`.
+  std::vector<std::vector<float>> FreePendingCycles_;
+};
+
 }  // namespace simulator
 }  // namespace exegesis
 
@@ -52,24 +52,25 @@ TEST(DispatchPortTest, Works) {
   // Initialization: buffers 0, 1, and 3 have port pressure data. Note that
   // port 0 should be present in the output with pressure 0 even if it never
   // gets used.
-  Log.Lines.push_back({/*Cycle=*/0, /*BufferIndex=*/0, "PortPressure", "init"});
-  Log.Lines.push_back({/*Cycle=*/0, /*BufferIndex=*/1, "PortPressure", "init"});
-  Log.Lines.push_back({/*Cycle=*/0, /*BufferIndex=*/3, "PortPressure", "init"});
+  using Event = SimulationLog::Event;
+  Log.Events.push_back(Event::PortPressureInit(/*Cycle=*/0, /*BufferIndex=*/0));
+  Log.Events.push_back(Event::PortPressureInit(/*Cycle=*/0, /*BufferIndex=*/1));
+  Log.Events.push_back(Event::PortPressureInit(/*Cycle=*/0, /*BufferIndex=*/3));
   // Add sparse port pressure data at various cycles.
-  Log.Lines.push_back(
-      {/*Cycle=*/0, /*BufferIndex=*/1, "PortPressure", "0,0,1"});
-  Log.Lines.push_back(
-      {/*Cycle=*/0, /*BufferIndex=*/3, "PortPressure", "0,0,1"});
-  Log.Lines.push_back(
-      {/*Cycle=*/1, /*BufferIndex=*/3, "PortPressure", "0,1,0.5"});
-  Log.Lines.push_back(
-      {/*Cycle=*/2, /*BufferIndex=*/3, "PortPressure", "1,2,0.5"});
+  Log.Events.push_back(
+      Event::PortPressure(/*Cycle=*/0, /*BufferIndex=*/1, {0, 0}, 1.0f));
+  Log.Events.push_back(
+      Event::PortPressure(/*Cycle=*/0, /*BufferIndex=*/3, {0, 0}, 1.0f));
+  Log.Events.push_back(
+      Event::PortPressure(/*Cycle=*/1, /*BufferIndex=*/3, {1, 0}, 0.5f));
+  Log.Events.push_back(
+      Event::PortPressure(/*Cycle=*/2, /*BufferIndex=*/3, {2, 1}, 0.5f));
   // This is not port pressure data, ignore.
   Log.Lines.push_back({/*Cycle=*/0, /*BufferIndex=*/0, "Ignored", "N/A"});
-  Log.Lines.push_back({/*Cycle=*/0, /*BufferIndex=*/2, "Ignored", "N/A"});
+  Log.Events.push_back(Event::Stall(/*Cycle=*/0, /*BufferIndex=*/2, 1));
   // This is an incomplete iteration, ignore.
-  Log.Lines.push_back(
-      {/*Cycle=*/2, /*BufferIndex=*/0, "PortPressure", "2,1,1"});
+  Log.Events.push_back(
+      Event::PortPressure(/*Cycle=*/2, /*BufferIndex=*/0, {1, 2}, 1.0f));
 
   const PortPressureAnalysis Result = ComputePortPressure(BlockContext, Log);
   EXPECT_THAT(Result.Pressures,
@@ -86,6 +87,48 @@ TEST(DispatchPortTest, Works) {
               ElementsAre(0.5f, 0.25f, 0.25f));
 }
 
+TEST(PortPressureObserverTest, Works) {
+  std::vector<llvm::MCInst> Instructions(3);
+  const BlockContext BlockContext(Instructions, true);
+  std::vector<BufferDescription> BufferDescriptions(4);
+
+  // Same data as above, streamed with the iteration ends.
+  using Event = SimulationLog::Event;
+  PortPressureObserver Observer;
+  Observer.Init(BlockContext, BufferDescriptions);
+  Observer.OnEvent(Event::PortPressureInit(/*Cycle=*/0, /*BufferIndex=*/0));
+  Observer.OnEvent(Event::PortPressureInit(/*Cycle=*/0, /*BufferIndex=*/1));
+  Observer.OnEvent(Event::PortPressureInit(/*Cycle=*/0, /*BufferIndex=*/3));
+  Observer.OnEvent(
+      Event::PortPressure(/*Cycle=*/0, /*BufferIndex=*/1, {0, 0}, 1.0f));
+  Observer.OnEvent(
+      Event::PortPressure(/*Cycle=*/0, /*BufferIndex=*/3, {0, 0}, 1.0f));
+  Observer.OnEvent(
+      Event::PortPressure(/*Cycle=*/1, /*BufferIndex=*/3, {2, 1}, 0.5f));
+  Observer.OnIterationEnd(0, {/*EndCycle=*/2});
+  // Iteration 1 has not completed yet, and is not taken into account.
+  EXPECT_THAT(Observer.GetResult().Pressures[2].CyclesPerIterationByMCInst,
+              ElementsAre(1.0f, 0.0f, 0.0f));
+  // A late event for the complete iteration 0.
+  Observer.OnEvent(
+      Event::PortPressure(/*Cycle=*/2, /*BufferIndex=*/3, {1, 0}, 0.5f));
+  // This is an incomplete iteration, ignore.
+  Observer.OnEvent(
+      Event::PortPressure(/*Cycle=*/2, /*BufferIndex=*/0, {1, 2}, 1.0f));
+  Observer.OnIterationEnd(1, {/*EndCycle=*/3});
+
+  const PortPressureAnalysis Result = Observer.GetResult();
+  EXPECT_THAT(Result.Pressures,
+              ElementsAre(EqPortPressure(0, 0.0f), EqPortPressure(1, 0.5f),
+                          EqPortPressure(3, 1.0f)));
+  EXPECT_THAT(Result.Pressures[0].CyclesPerIterationByMCInst,
+              ElementsAre(0.0f, 0.0f, 0.0f));
+  EXPECT_THAT(Result.Pressures[1].CyclesPerIterationByMCInst,
+              ElementsAre(0.5f, 0.0f, 0.0f));
+  EXPECT_THAT(Result.Pressures[2].CyclesPerIterationByMCInst,
+              ElementsAre(0.5f, 0.25f, 0.25f));
+}
+
 }  // namespace
 }  // namespace simulator
 }  // namespace exegesis
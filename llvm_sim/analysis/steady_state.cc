@@ -0,0 +1,117 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/analysis/steady_state.h"
+
+#include <cassert>
+
+#include "absl/hash/hash.h"
+
+namespace exegesis {
+namespace simulator {
+
+SteadyStateObserver::SteadyStateObserver(const Config& Config)
+    : Config_(Config) {
+  assert(Config_.MaxPeriodIterations > 0);
+  assert(Config_.MinRepetitions > 1);
+}
+
+void SteadyStateObserver::Init(
+    const BlockContext& BlockContext,
+    const std::vector<BufferDescription>& BufferDescriptions) {
+  NumCompleteIterations_ = 0;
+  PendingDispatches_.clear();
+  Signatures_.clear();
+  EndCycles_.clear();
+  PrevEndCycle_ = 0;
+  Result_ = SteadyStateAnalysis();
+}
+
+void SteadyStateObserver::OnEvent(const SimulationLog::Event& Event) {
+  if (Event.GetKind() != LogEventKind::kPortPressure) {
+    return;
+  }
+  const InstructionIndex::Type Instr = Event.GetInstructionIndex();
+  assert(Instr.Iteration >= NumCompleteIterations_ &&
+         "dispatch for an iteration that already completed");
+  const size_t Offset = Instr.Iteration - NumCompleteIterations_;
+  if (PendingDispatches_.size() <= Offset) {
+    PendingDispatches_.resize(Offset + 1);
+  }
+  PendingDispatches_[Offset].emplace_back(Event.GetBufferIndex(),
+                                          Instr.BBIndex, Event.GetCycle());
+}
+
+void SteadyStateObserver::OnIterationEnd(
+    size_t Iteration, const SimulationLog::IterationStats& Stats) {
+  assert(Iteration == NumCompleteIterations_ && "not in order");
+  ++NumCompleteIterations_;
+
+  // Make the dispatch cycles relative to the end of the iteration so that the
+  // signatures of identical iterations match.
+  std::vector<Dispatch> Dispatches;
+  if (!PendingDispatches_.empty()) {
+    Dispatches = std::move(PendingDispatches_.front());
+    PendingDispatches_.pop_front();
+  }
+  for (Dispatch& D : Dispatches) {
+    std::get<2>(D) = Stats.EndCycle - std::get<2>(D);
+  }
+  const unsigned NumCycles = Stats.EndCycle - PrevEndCycle_;
+  Signatures_.push_back(
+      absl::Hash<std::tuple<unsigned, std::vector<Dispatch>>>()(
+          std::make_tuple(NumCycles, std::move(Dispatches))));
+  EndCycles_.push_back(Stats.EndCycle);
+  PrevEndCycle_ = Stats.EndCycle;
+  if (Signatures_.size() >
+      Config_.MaxPeriodIterations * Config_.MinRepetitions) {
+    Signatures_.pop_front();
+    EndCycles_.pop_front();
+  }
+
+  if (Result_.IsSteady) {
+    return;
+  }
+  const size_t Period = FindPeriod();
+  if (Period == 0) {
+    return;
+  }
+  Result_.IsSteady = true;
+  Result_.FirstIteration =
+      NumCompleteIterations_ - Period * Config_.MinRepetitions;
+  Result_.PeriodIterations = Period;
+  Result_.PeriodCycles =
+      EndCycles_.back() - EndCycles_[EndCycles_.size() - 1 - Period];
+}
+
+size_t SteadyStateObserver::FindPeriod() const {
+  for (size_t Period = 1; Period <= Config_.MaxPeriodIterations; ++Period) {
+    const size_t NumSignatures = Period * Config_.MinRepetitions;
+    if (NumSignatures > Signatures_.size()) {
+      return 0;
+    }
+    bool IsPeriodic = true;
+    for (size_t I = Signatures_.size() - NumSignatures + Period;
+         I < Signatures_.size() && IsPeriodic; ++I) {
+      IsPeriodic = Signatures_[I] == Signatures_[I - Period];
+    }
+    if (IsPeriodic) {
+      return Period;
+    }
+  }
+  return 0;
+}
+
+}  // namespace simulator
+}  // namespace exegesis
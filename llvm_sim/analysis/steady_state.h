@@ -0,0 +1,108 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Steady state detection. Once the pipeline is warmed up, the execution of a
+// loop body becomes periodic: every `Period` iterations, the instructions are
+// dispatched to the same ports at the same cycles relative to the end of their
+// iteration. This analysis detects that state while the simulation runs, so
+// that the simulation can stop as soon as it is reached.
+
+#ifndef EXEGESIS_LLVM_SIM_ANALYSIS_STEADY_STATE_H_
+#define EXEGESIS_LLVM_SIM_ANALYSIS_STEADY_STATE_H_
+
+#include <cstdint>
+#include <deque>
+#include <tuple>
+#include <vector>
+
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/log.h"
+
+namespace exegesis {
+namespace simulator {
+
+struct SteadyStateAnalysis {
+  // Whether the steady state was reached.
+  bool IsSteady = false;
+  // The first iteration of the first steady-state period.
+  size_t FirstIteration = 0;
+  // The length of a period, in iterations.
+  size_t PeriodIterations = 0;
+  // The length of a period, in cycles.
+  unsigned PeriodCycles = 0;
+
+  // The exact steady-state inverse throughput.
+  double GetCyclesPerIteration() const {
+    return static_cast<double>(PeriodCycles) / PeriodIterations;
+  }
+};
+
+// Detects the steady state while the simulation runs, and stops the simulation
+// when it is reached.
+// Each iteration gets a signature made of its duration and of the (port,
+// instruction, cycle relative to the end of the iteration) tuples of all its
+// dispatches. The steady state is reached when the sequence of signatures has
+// repeated with some period for `MinRepetitions` consecutive periods.
+class SteadyStateObserver : public SimulationObserver {
+ public:
+  struct Config {
+    // The maximum period to look for, in iterations.
+    size_t MaxPeriodIterations;
+    // The number of consecutive identical periods that define the steady
+    // state.
+    size_t MinRepetitions;
+  };
+
+  explicit SteadyStateObserver(const Config& Config);
+
+  LogEventMask GetSubscriptions() const override {
+    return LogEventMask().With(LogEventKind::kPortPressure);
+  }
+
+  void Init(const BlockContext& BlockContext,
+            const std::vector<BufferDescription>& BufferDescriptions) override;
+
+  void OnEvent(const SimulationLog::Event& Event) override;
+
+  void OnIterationEnd(size_t Iteration,
+                      const SimulationLog::IterationStats& Stats) override;
+
+  bool ShouldStop() const override { return Result_.IsSteady; }
+
+  const SteadyStateAnalysis& GetResult() const { return Result_; }
+
+ private:
+  // (buffer index, BBIndex, cycle).
+  using Dispatch = std::tuple<size_t, size_t, unsigned>;
+
+  // Returns the period of the last signatures, or 0 if they are not periodic.
+  size_t FindPeriod() const;
+
+  const Config Config_;
+  size_t NumCompleteIterations_ = 0;
+  // The dispatches of the iterations in flight, starting with iteration
+  // `NumCompleteIterations_`.
+  std::deque<std::vector<Dispatch>> PendingDispatches_;
+  // The signatures and end cycles of the last complete iterations, at most
+  // `MaxPeriodIterations * MinRepetitions`.
+  std::deque<uint64_t> Signatures_;
+  std::deque<unsigned> EndCycles_;
+  unsigned PrevEndCycle_ = 0;
+  SteadyStateAnalysis Result_;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_ANALYSIS_STEADY_STATE_H_
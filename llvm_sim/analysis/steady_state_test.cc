@@ -0,0 +1,98 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/analysis/steady_state.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/log.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+class SteadyStateObserverTest : public ::testing::Test {
+ protected:
+  SteadyStateObserverTest()
+      : BlockContext_(Instructions_, true),
+        BufferDescriptions_(4),
+        Observer_({/*MaxPeriodIterations=*/4, /*MinRepetitions=*/3}) {
+    Observer_.Init(BlockContext_, BufferDescriptions_);
+  }
+
+  // Ends iteration `Iteration` at cycle `EndCycle`, after dispatching its
+  // first instruction on buffer `BufferIndex` one cycle earlier.
+  void EndIteration(size_t Iteration, unsigned EndCycle, size_t BufferIndex) {
+    InstructionIndex::Type Instr;
+    Instr.BBIndex = 0;
+    Instr.Iteration = Iteration;
+    Observer_.OnEvent(SimulationLog::Event::PortPressure(
+        EndCycle - 1, BufferIndex, Instr, 1.0f));
+    Observer_.OnIterationEnd(Iteration, {EndCycle});
+  }
+
+  const std::vector<llvm::MCInst> Instructions_ =
+      std::vector<llvm::MCInst>(2);
+  const BlockContext BlockContext_;
+  const std::vector<BufferDescription> BufferDescriptions_;
+  SteadyStateObserver Observer_;
+};
+
+TEST_F(SteadyStateObserverTest, DetectsPeriod) {
+  // Iterations take 5, 4, 2, 3, 2, 3, 2, 3 cycles.
+  const unsigned EndCycles[] = {5, 9, 11, 14, 16, 19, 21};
+  for (size_t I = 0; I < 7; ++I) {
+    EndIteration(I, EndCycles[I], 0);
+    EXPECT_FALSE(Observer_.ShouldStop()) << I;
+  }
+  EndIteration(7, 24, 0);
+  EXPECT_TRUE(Observer_.ShouldStop());
+
+  const SteadyStateAnalysis& Result = Observer_.GetResult();
+  EXPECT_TRUE(Result.IsSteady);
+  EXPECT_EQ(Result.FirstIteration, 2);
+  EXPECT_EQ(Result.PeriodIterations, 2);
+  EXPECT_EQ(Result.PeriodCycles, 5);
+  EXPECT_EQ(Result.GetCyclesPerIteration(), 2.5);
+}
+
+TEST_F(SteadyStateObserverTest, DispatchesArePartOfTheState) {
+  // All iterations take 2 cycles, but dispatch to different ports.
+  const size_t Ports[] = {0, 1, 2, 3, 3};
+  for (size_t I = 0; I < 5; ++I) {
+    EndIteration(I, 2 * (I + 1), Ports[I]);
+    EXPECT_FALSE(Observer_.ShouldStop()) << I;
+  }
+  EndIteration(5, 12, 3);
+  EXPECT_TRUE(Observer_.ShouldStop());
+  EXPECT_EQ(Observer_.GetResult().FirstIteration, 3);
+  EXPECT_EQ(Observer_.GetResult().PeriodIterations, 1);
+  EXPECT_EQ(Observer_.GetResult().PeriodCycles, 2);
+}
+
+TEST_F(SteadyStateObserverTest, NoPeriod) {
+  // Iterations take 1, 2, 3, ... cycles.
+  unsigned EndCycle = 0;
+  for (size_t I = 0; I < 20; ++I) {
+    EndCycle += I + 1;
+    EndIteration(I, EndCycle, 0);
+  }
+  EXPECT_FALSE(Observer_.ShouldStop());
+  EXPECT_FALSE(Observer_.GetResult().IsSteady);
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
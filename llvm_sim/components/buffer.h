@@ -15,16 +15,46 @@
 #ifndef EXEGESIS_LLVM_SIM_COMPONENTS_BUFFER_H_
 #define EXEGESIS_LLVM_SIM_COMPONENTS_BUFFER_H_
 
-#include <deque>
+#include <vector>
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/Support/Compiler.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm_sim/components/common.h"
+#include "llvm_sim/components/ring_buffer.h"
 #include "llvm_sim/framework/component.h"
 #include "llvm_sim/framework/log_levels.h"
+#include "llvm_sim/framework/state.h"
 
 namespace exegesis {
 namespace simulator {
 
+namespace internal {
+
+// Serializes the elements of `Queue` from front to back.
+template <typename T>
+void SaveQueue(StateWriter* Writer, const RingBuffer<T>& Queue) {
+  Writer->Write<uint64_t>(Queue.size());
+  for (const T& Elem : Queue) {
+    Writer->Write(Elem);
+  }
+}
+
+// Restores a queue saved by `SaveQueue()`.
+template <typename T>
+void RestoreQueue(StateReader* Reader, RingBuffer<T>* Queue) {
+  std::vector<T> Elems(Reader->Read<uint64_t>());
+  for (T& Elem : Elems) {
+    Reader->Read(&Elem);
+  }
+  Queue->clear();
+  for (auto It = Elems.rbegin(); It != Elems.rend(); ++It) {
+    Queue->push_front(*It);
+  }
+}
+
+}  // namespace internal
+
 // A buffer of elements of type `InputTag::Type`. The buffer holds elements and
 // has a staging area for elements added during the current cycle, which will be
 // added during the next Propagate().
@@ -34,6 +64,10 @@ namespace simulator {
 template <typename InputTag>
 class BufferImpl : public Buffer, public Sink<InputTag> {
  public:
+  // `MaxNumPending` is the maximum number of elements in the staging area, if
+  // known. This is only used to size the queue upfront.
+  explicit BufferImpl(size_t MaxNumPending) : Pending_(MaxNumPending) {}
+
   ~BufferImpl() override {}
 
   void Init(Logger* Log) override {
@@ -41,11 +75,21 @@ class BufferImpl : public Buffer, public Sink<InputTag> {
     NumCyclesSinceLastPropagation_ = 0;
   }
 
+  void SaveState(StateWriter* Writer) const override {
+    Writer->Write(NumCyclesSinceLastPropagation_);
+    internal::SaveQueue(Writer, Pending_);
+  }
+
+  void RestoreState(StateReader* Reader) override {
+    Reader->Read(&NumCyclesSinceLastPropagation_);
+    internal::RestoreQueue(Reader, &Pending_);
+  }
+
   // Adds an input in the buffer in FIFO manner. The input will be made
   // available on the next Propagate() call.
   // [a,b|c,d,e], Elems:[f,g]  ->  [g,f,a,b|c,d,e]
   LLVM_NODISCARD bool PushMany(
-      const std::vector<typename InputTag::Type>& Elems) final {
+      llvm::ArrayRef<typename InputTag::Type> Elems) final {
     if (!CanPush(Elems.size(), Pending_.size())) {
       return false;
     }
@@ -55,29 +99,39 @@ class BufferImpl : public Buffer, public Sink<InputTag> {
     return true;
   }
 
+  // Returns true if PushMany() would currently accept `N` elements.
+  bool CanPushMany(size_t N) const { return CanPush(N, Pending_.size()); }
+
   // On propagation, the inputs pushed in the current cycle are made available
   // for consumption if possible.
   // [a,b|c,d,e]  ->  [|a,b,c,d,e]
   void Propagate(Logger* Log) final {
     if (!CanPropagate()) {
       ++NumCyclesSinceLastPropagation_;
-      Log->Log("PStall", llvm::Twine(NumCyclesSinceLastPropagation_).str());
+      Log->LogStall(NumCyclesSinceLastPropagation_);
       if (NumCyclesSinceLastPropagation_ > 500) {
-        std::string Str = "stalled for too long, this is likely a bug.";
+        if (Log->IsSubscribed(LogEventKind::kMessage)) {
+          std::string Str = "stalled for too long, this is likely a bug.";
 #if !defined(NDEBUG) || defined(LLVM_ENABLE_DUMP)
-        llvm::raw_string_ostream OS(Str);
-        OS << " Contents: ";
-        print(OS);
-        OS.flush();
+          llvm::raw_string_ostream OS(Str);
+          OS << " Contents: ";
+          print(OS);
+          OS.flush();
 #endif
-        Log->Log(LogLevels::kWarning, std::move(Str));
+          Log->Log(LogLevels::kWarning, std::move(Str));
+        } else if (NumCyclesSinceLastPropagation_ == 501) {
+          // Nobody listens to messages: still report the likely deadlock, but
+          // only once per stall.
+          llvm::errs() << "warning: buffer stalled for too long, this is "
+                          "likely a bug.\n";
+        }
       }
       return;
     }
     NumCyclesSinceLastPropagation_ = 0;
     PrePropagate(Log, Pending_);
     while (!Pending_.empty()) {
-      Log->Log(InputTag::kTagName, InputTag::Format(Pending_.back()));
+      LogElement<InputTag>(Log, Pending_.back());
       PropagateImpl(Pending_.back());
       Pending_.pop_back();
     }
@@ -88,7 +142,7 @@ class BufferImpl : public Buffer, public Sink<InputTag> {
 #endif
 
  protected:
-  using QueueT = std::deque<typename InputTag::Type>;
+  using QueueT = RingBuffer<typename InputTag::Type>;
 
   bool IsStalled() const { return NumCyclesSinceLastPropagation_ > 0; }
 
@@ -118,13 +172,24 @@ class BufferImpl : public Buffer, public Sink<InputTag> {
 template <typename ElemTag>
 class FifoBufferBase : public BufferImpl<ElemTag>, public Source<ElemTag> {
  public:
-  explicit FifoBufferBase(size_t Capacity) : Capacity_(Capacity) {}
+  explicit FifoBufferBase(size_t Capacity)
+      : BufferImpl<ElemTag>(Capacity), Capacity_(Capacity), Fifo_(Capacity) {}
 
   void Init(Logger* Log) override {
     BufferImpl<ElemTag>::Init(Log);
     Fifo_.clear();
   }
 
+  void SaveState(StateWriter* Writer) const override {
+    BufferImpl<ElemTag>::SaveState(Writer);
+    internal::SaveQueue(Writer, Fifo_);
+  }
+
+  void RestoreState(StateReader* Reader) override {
+    BufferImpl<ElemTag>::RestoreState(Reader);
+    internal::RestoreQueue(Reader, &Fifo_);
+  }
+
   // [a,b|c,d,e]  returns &e
   // [a,b|]       returns nullptr
   const typename ElemTag::Type* Peek() const final {
@@ -154,7 +219,7 @@ class FifoBufferBase : public BufferImpl<ElemTag>, public Source<ElemTag> {
   }
 
   const size_t Capacity_;
-  std::deque<typename ElemTag::Type> Fifo_;
+  RingBuffer<typename ElemTag::Type> Fifo_;
 };
 
 // A Simple FIFO buffer. Elements are made available in the order in which they
@@ -205,6 +270,8 @@ class LinkBuffer : public FifoBufferBase<ElemTag> {
 template <typename InputTag>
 class DevNullBuffer : public BufferImpl<InputTag> {
  public:
+  DevNullBuffer() : BufferImpl<InputTag>(0) {}
+
   ~DevNullBuffer() override {}
 
  private:
@@ -24,6 +24,7 @@ namespace exegesis {
 namespace simulator {
 namespace {
 
+using testing::_;
 using testing::Eq;
 using testing::Pointee;
 
@@ -236,6 +237,43 @@ TEST(LinkBufferTest, PushAgainBeforeAllConsumed) {
   CHECK_BUFFER_CONTENTS(Link, "[(6)|(3)]");
 }
 
+TEST(LinkBufferTest, SaveAndRestoreState) {
+  LinkBuffer<TestInputTag> Link(3);
+  {
+    MockLogger Log;
+    Link.Init(&Log);
+  }
+  ASSERT_TRUE(Link.Push(1));
+  ASSERT_TRUE(Link.Push(2));
+  {
+    MockLogger Log;
+    EXPECT_CALL(Log, Log(Eq("TestTag"), _)).Times(2);
+    Link.Propagate(&Log);
+  }
+  Link.Pop();
+  ASSERT_TRUE(Link.Push(3));
+  {
+    MockLogger Log;
+    Link.Propagate(&Log);
+  }
+  CHECK_BUFFER_CONTENTS(Link, "[(3)|(2)]");
+  StateWriter Writer;
+  Link.SaveState(&Writer);
+
+  LinkBuffer<TestInputTag> Restored(3);
+  {
+    MockLogger Log;
+    Restored.Init(&Log);
+  }
+  StateReader Reader(Writer.GetBlob());
+  Restored.RestoreState(&Reader);
+  EXPECT_TRUE(Reader.AtEnd());
+  CHECK_BUFFER_CONTENTS(Restored, "[(3)|(2)]");
+  ASSERT_THAT(Restored.Peek(), Pointee(Eq(2)));
+  // The stall is restored too.
+  ASSERT_FALSE(Restored.Push(4));
+}
+
 TEST(DevNullBufferTest, Works) {
   DevNullBuffer<TestInputTag> DevNull;
 
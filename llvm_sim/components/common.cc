@@ -16,6 +16,9 @@
 
 #include <string>
 
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCInstrInfo.h"
+
 namespace exegesis {
 namespace simulator {
 
@@ -24,5 +27,28 @@ std::string RenamedUopId::Format(const Type& Elem) {
 }
 const char RenamedUopId::kTagName[] = "UopId";
 
+std::vector<unsigned> ComputeInstructionSizes(
+    const GlobalContext& Context, const BlockContext& BlockContext) {
+  std::vector<unsigned> InstrSizes(
+      BlockContext.GetNumBasicBlockInstructions());
+  llvm::SmallVector<llvm::MCFixup, 4> Fixups;
+  for (size_t I = 0; I < InstrSizes.size(); ++I) {
+    const llvm::MCInst& Inst = BlockContext.GetInstruction(I);
+    unsigned& InstrBytes = InstrSizes[I];
+    InstrBytes = Context.InstrInfo->get(Inst.getOpcode()).getSize();
+    if (InstrBytes > 0) {
+      continue;
+    }
+    // If the instruction has variable size, we encode it to compute its size.
+    std::string EncodedInstr;
+    llvm::raw_string_ostream OS(EncodedInstr);
+    Context.CodeEmitter->encodeInstruction(Inst, OS, Fixups,
+                                           *Context.SubtargetInfo);
+    InstrBytes = OS.str().size();
+    assert(InstrBytes > 0);
+  }
+  return InstrSizes;
+}
+
 }  // namespace simulator
 }  // namespace exegesis
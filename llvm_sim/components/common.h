@@ -15,8 +15,12 @@
 #ifndef EXEGESIS_LLVM_SIM_COMPONENTS_COMMON_H_
 #define EXEGESIS_LLVM_SIM_COMPONENTS_COMMON_H_
 
+#include <vector>
+
 #include "llvm/Support/Compiler.h"
 #include "llvm_sim/framework/component.h"
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/state.h"
 
 namespace exegesis {
 namespace simulator {
@@ -35,8 +39,28 @@ struct RenamedUopId {
   static const InstructionIndex::Type& GetInstructionIndex(const Type& Elem) {
     return Elem.Uop.InstrIndex;
   }
+  static const UopId::Type& GetUopId(const Type& Elem) { return Elem.Uop; }
+};
+
+template <>
+struct StateTraits<RenamedUopId::Type> {
+  static void Save(StateWriter* Writer, const RenamedUopId::Type& Elem) {
+    Writer->Write(Elem.Uop);
+    Writer->Write(Elem.Uses);
+    Writer->Write(Elem.Defs);
+  }
+  static void Restore(StateReader* Reader, RenamedUopId::Type* Elem) {
+    Reader->Read(&Elem->Uop);
+    Reader->Read(&Elem->Uses);
+    Reader->Read(&Elem->Defs);
+  }
 };
 
+// Returns the encoded sizes of the instructions of `BlockContext`, indexed by
+// BBIndex.
+std::vector<unsigned> ComputeInstructionSizes(const GlobalContext& Context,
+                                              const BlockContext& BlockContext);
+
 }  // namespace simulator
 }  // namespace exegesis
 
@@ -14,6 +14,7 @@
 
 #include "llvm_sim/components/decoder.h"
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/MC/MCInstrItineraries.h"
 
 namespace exegesis {
@@ -32,10 +33,10 @@ void InstructionDecoder::Tick(const BlockContext* BlockContext) {
 
   while (RemainingInstructions > 0 && Source_->Peek()) {
     const auto InstrIndex = *Source_->Peek();
-    const auto& Decomposition = Context.GetInstructionDecomposition(
-        BlockContext->GetInstruction(InstrIndex.BBIndex));
-    const auto NumUops = Decomposition.Uops.size();
-    std::vector<UopId::Type> UopIds(NumUops);
+    const auto NumUops =
+        BlockContext->GetLoweredInstruction(Context, InstrIndex.BBIndex)
+            .Uops.size();
+    llvm::SmallVector<UopId::Type, 8> UopIds(NumUops);
     for (size_t I = 0; I < NumUops; ++I) {
       UopIds[I] = {InstrIndex, I};
     }
@@ -37,18 +37,16 @@ class DispatchPort : public LinkBuffer<ElemTag> {
   void Init(Logger* Log) override {
     LinkBuffer<ElemTag>::Init(Log);
     // Tell the port pressure analysis that we generate pressure information.
-    Log->Log("PortPressure", "init");
+    Log->LogPortPressureInit();
   }
 
   void PrePropagate(Logger* Log,
                     const typename LinkBuffer<ElemTag>::QueueT& Pending) final {
+    if (!Log->IsSubscribed(LogEventKind::kPortPressure)) {
+      return;
+    }
     for (const auto& Elem : Pending) {
-      const auto& InstrId = ElemTag::GetInstructionIndex(Elem);
-      Log->Log("PortPressure", llvm::Twine(InstrId.Iteration)
-                                   .concat(",")
-                                   .concat(llvm::Twine(InstrId.BBIndex))
-                                   .concat(",1")
-                                   .str());
+      Log->LogPortPressure(ElemTag::GetInstructionIndex(Elem), 1.0f);
     }
   }
 };
@@ -53,6 +53,18 @@ class NonPipelinedExecutionUnit : public Component {
 
   // Component API.
   void Init() final { CurStage_ = -1; }
+  void SaveState(StateWriter* Writer) const final {
+    Writer->Write(CurStage_);
+    if (CurStage_ >= 0) {
+      Writer->Write(Elem_);
+    }
+  }
+  void RestoreState(StateReader* Reader) final {
+    Reader->Read(&CurStage_);
+    if (CurStage_ >= 0) {
+      Reader->Read(&Elem_);
+    }
+  }
   void Tick(const BlockContext* BlockContext) final {
     if (CurStage_ < 0) {
       // No executing element.
@@ -130,6 +142,8 @@ class PipelinedExecutionUnit : public Component {
   // Component API.
   void Init() final;
   void Tick(const BlockContext* BlockContext) final;
+  void SaveState(StateWriter* Writer) const final;
+  void RestoreState(StateReader* Reader) final;
 
  private:
   const Config Config_;
@@ -153,6 +167,29 @@ void PipelinedExecutionUnit<ElemTag>::Init() {
   CurStageCycle_ = Config_.NumCyclesPerStage - 1;
 }
 
+template <typename ElemTag>
+void PipelinedExecutionUnit<ElemTag>::SaveState(StateWriter* Writer) const {
+  // The pipeline always has `NumStages` elements.
+  for (const auto& Elem : Pipeline_) {
+    Writer->Write(Elem.IsBubble);
+    if (!Elem.IsBubble) {
+      Writer->Write(Elem.Elem);
+    }
+  }
+  Writer->Write(CurStageCycle_);
+}
+
+template <typename ElemTag>
+void PipelinedExecutionUnit<ElemTag>::RestoreState(StateReader* Reader) {
+  for (auto& Elem : Pipeline_) {
+    Reader->Read(&Elem.IsBubble);
+    if (!Elem.IsBubble) {
+      Reader->Read(&Elem.Elem);
+    }
+  }
+  Reader->Read(&CurStageCycle_);
+}
+
 template <typename ElemTag>
 void PipelinedExecutionUnit<ElemTag>::Tick(const BlockContext* BlockContext) {
   // Each NumCyclesPerStage ticks, resources can progress in the pipeline.
@@ -16,7 +16,8 @@
 
 #include <limits>
 
-#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm_sim/components/common.h"
+#include "llvm_sim/framework/block_trace.h"
 
 namespace exegesis {
 namespace simulator {
@@ -29,30 +30,40 @@ Fetcher::~Fetcher() {}
 
 void Fetcher::Init() {
   InstructionIndex_ = {0, 0};
+  BlockEnd_ = 0;
+  NumTraceBlocks_ = 0;
+  TraceNeedsSeek_ = true;
   InstrSizes_.clear();
 }
 
 void Fetcher::Tick(const BlockContext* BlockContext) {
   if (InstrSizes_.empty()) {
-    ComputeInstructionSizes(BlockContext);
+    InstrSizes_ = ComputeInstructionSizes(Context, *BlockContext);
   }
 
   // Build a block of instructions such that the cumulative size is less than
   // MaxBytesPerCycle.
   int RemainingBytes = Config_.MaxBytesPerCycle;
-  const auto NumBBInstrs = BlockContext->GetNumBasicBlockInstructions();
-  if (InstructionIndex_.BBIndex >= NumBBInstrs) {
-    if (BlockContext->IsLoop()) {
-      // Start the next iteration.
-      InstructionIndex_.BBIndex = 0;
-      ++InstructionIndex_.Iteration;
-    } else {
+  if (BlockContext->GetTrace() != nullptr) {
+    if (InstructionIndex_.BBIndex >= BlockEnd_ &&
+        !StartNextTraceBlock(BlockContext)) {
       return;  // We're done with the fetching.
     }
+  } else {
+    BlockEnd_ = BlockContext->GetNumBasicBlockInstructions();
+    if (InstructionIndex_.BBIndex >= BlockEnd_) {
+      if (BlockContext->IsLoop()) {
+        // Start the next iteration.
+        InstructionIndex_.BBIndex = 0;
+        ++InstructionIndex_.Iteration;
+      } else {
+        return;  // We're done with the fetching.
+      }
+    }
   }
   // The Fetcher has a fixed-size window over the code and cannot `see` the
-  // looping instructions in the same cycle.
-  while (RemainingBytes > 0 && InstructionIndex_.BBIndex < NumBBInstrs) {
+  // looping instructions or the next block of the trace in the same cycle.
+  while (RemainingBytes > 0 && InstructionIndex_.BBIndex < BlockEnd_) {
     const unsigned InstrBytes = InstrSizes_[InstructionIndex_.BBIndex];
     if (InstrBytes > RemainingBytes) {
       return;
@@ -65,24 +76,40 @@ void Fetcher::Tick(const BlockContext* BlockContext) {
   }
 }
 
-void Fetcher::ComputeInstructionSizes(const BlockContext* BlockContext) {
-  InstrSizes_.resize(BlockContext->GetNumBasicBlockInstructions());
-  llvm::SmallVector<llvm::MCFixup, 4> Fixups;
-  for (size_t I = 0; I < BlockContext->GetNumBasicBlockInstructions(); ++I) {
-    const llvm::MCInst& Inst = BlockContext->GetInstruction(I);
-    unsigned& InstrBytes = InstrSizes_[I];
-    InstrBytes = Context.InstrInfo->get(Inst.getOpcode()).getSize();
-    if (InstrBytes > 0) {
-      continue;
+bool Fetcher::StartNextTraceBlock(const BlockContext* BlockContext) {
+  BlockTrace* const Trace = BlockContext->GetTrace();
+  if (TraceNeedsSeek_) {
+    Trace->Rewind();
+    size_t BlockId;
+    while (Trace->GetPosition() < NumTraceBlocks_ && Trace->Next(&BlockId)) {
     }
-    // If the instruction has variable size, we encode it to compute its size.
-    std::string EncodedInstr;
-    llvm::raw_string_ostream OS(EncodedInstr);
-    Context.CodeEmitter->encodeInstruction(Inst, OS, Fixups,
-                                           *Context.SubtargetInfo);
-    InstrBytes = OS.str().size();
-    assert(InstrBytes > 0);
+    TraceNeedsSeek_ = false;
+  }
+  size_t BlockId;
+  if (!Trace->Next(&BlockId)) {
+    return false;
   }
+  assert(BlockId < BlockContext->GetNumBlocks());
+  InstructionIndex_.Iteration = NumTraceBlocks_++;
+  InstructionIndex_.BBIndex = BlockContext->GetBlockBegin(BlockId);
+  BlockEnd_ = BlockContext->GetBlockEnd(BlockId);
+  return true;
+}
+
+void Fetcher::SaveState(StateWriter* Writer) const {
+  Writer->Write(InstructionIndex_);
+  Writer->Write(BlockEnd_);
+  Writer->Write(NumTraceBlocks_);
+}
+
+// The instruction sizes are a cache, they are recomputed on the next Tick().
+// The trace is not part of the state: it is replayed up to the restored
+// position when the next block is needed.
+void Fetcher::RestoreState(StateReader* Reader) {
+  Reader->Read(&InstructionIndex_);
+  Reader->Read(&BlockEnd_);
+  Reader->Read(&NumTraceBlocks_);
+  TraceNeedsSeek_ = true;
 }
 
 }  // namespace simulator
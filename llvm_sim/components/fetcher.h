@@ -14,6 +14,9 @@
 
 // An instruction fetcher fetches a block instructions from memory. The block of
 // instructions should have a total encoded size smaller than MaxBytesPerCycle.
+// When the context has a block trace, the fetcher follows the trace through
+// the basic blocks of the region; like for loops, the fetcher does not see
+// past the end of a basic block within a cycle.
 
 #ifndef EXEGESIS_LLVM_SIM_COMPONENTS_FETCHER_H_
 #define EXEGESIS_LLVM_SIM_COMPONENTS_FETCHER_H_
@@ -41,14 +44,25 @@ class Fetcher : public Component {
 
   void Init() override;
   void Tick(const BlockContext* BlockContext) override;
+  void SaveState(StateWriter* Writer) const override;
+  void RestoreState(StateReader* Reader) override;
 
  private:
-  void ComputeInstructionSizes(const BlockContext* BlockContext);
+  // Moves to the next block of the trace. Returns false at the end of the
+  // trace.
+  bool StartNextTraceBlock(const BlockContext* BlockContext);
 
   const Config Config_;
   Sink<InstructionIndex>* const Sink_;
   // The index of the next instruction to fetch.
   InstructionIndex::Type InstructionIndex_;
+  // The end of the basic block that is being fetched.
+  size_t BlockEnd_;
+  // The number of blocks read from the trace.
+  size_t NumTraceBlocks_;
+  // Whether the trace must be moved to `NumTraceBlocks_` before reading from
+  // it, because the simulation starts or resumes from a snapshot.
+  bool TraceNeedsSeek_;
   // A cache of instruction sizes.
   std::vector<unsigned> InstrSizes_;
 };
@@ -21,6 +21,7 @@
 #include "llvm/MC/MCInstrDesc.h"
 #include "llvm/MC/MCInstrInfo.h"
 #include "llvm_sim/components/testing.h"
+#include "llvm_sim/framework/block_trace.h"
 #include "llvm_sim/framework/context.h"
 
 namespace exegesis {
@@ -157,6 +158,49 @@ TEST_F(FetcherTest, LoopContext) {
   ASSERT_THAT(Sink.Buffer_, ElementsAre(EqInstrIndex(1, 2)));
 }
 
+TEST_F(FetcherTest, TraceContext) {
+  Fetcher::Config Config;
+  Config.MaxBytesPerCycle = 9;
+
+  TestSink<InstructionIndex> Sink;
+  Fetcher Fetcher(&Context_, Config, &Sink);
+  // Block 0 is instructions [0, 1), block 1 is [1, 4).
+  std::vector<llvm::MCInst> Instructions = {Inst1ByteVariable_, Inst4ByteFixed_,
+                                            Inst4ByteFixed_, Inst4ByteFixed_};
+  const std::vector<size_t> BlockEnds = {1, 4};
+  VectorBlockTrace Trace({1, 0, 0});
+  const BlockContext BlockContext(Instructions, BlockEnds, &Trace);
+  Fetcher.Init();
+
+  Fetcher.Tick(&BlockContext);
+  ASSERT_THAT(Sink.Buffer_,
+              ElementsAre(EqInstrIndex(0, 1), EqInstrIndex(0, 2)));
+
+  Sink.Buffer_.clear();
+  Fetcher.Tick(&BlockContext);
+  // Moving to the next block has to wait for the next cycle.
+  ASSERT_THAT(Sink.Buffer_, ElementsAre(EqInstrIndex(0, 3)));
+
+  Sink.Buffer_.clear();
+  Fetcher.Tick(&BlockContext);
+  ASSERT_THAT(Sink.Buffer_, ElementsAre(EqInstrIndex(1, 0)));
+
+  Sink.Buffer_.clear();
+  Fetcher.Tick(&BlockContext);
+  ASSERT_THAT(Sink.Buffer_, ElementsAre(EqInstrIndex(2, 0)));
+
+  // End of the trace.
+  Sink.Buffer_.clear();
+  Fetcher.Tick(&BlockContext);
+  ASSERT_THAT(Sink.Buffer_, ElementsAre());
+
+  // Init() starts again from the beginning of the trace.
+  Fetcher.Init();
+  Fetcher.Tick(&BlockContext);
+  ASSERT_THAT(Sink.Buffer_,
+              ElementsAre(EqInstrIndex(0, 1), EqInstrIndex(0, 2)));
+}
+
 TEST_F(FetcherTest, FullSink) {
   Fetcher::Config Config;
   Config.MaxBytesPerCycle = 9;
@@ -26,6 +26,8 @@ namespace {
 // No reordering: the best port is the first port (in `PossiblePort` order).
 class GreedyIssuePolicy final : public IssuePolicy {
   void Reset() final {}
+  void SaveState(StateWriter*) const final {}
+  void RestoreState(StateReader*) final {}
   void SignalIssued(size_t) final {}
   void ComputeBestOrder(const llvm::MutableArrayRef<size_t>) final {}
 };
@@ -35,6 +37,10 @@ class GreedyIssuePolicy final : public IssuePolicy {
 class LeastLoadedIssuePolicy final : public IssuePolicy {
   void Reset() final { PortLoads_.clear(); }
 
+  void SaveState(StateWriter* Writer) const final { Writer->Write(PortLoads_); }
+
+  void RestoreState(StateReader* Reader) final { Reader->Read(&PortLoads_); }
+
   void SignalIssued(size_t I) final {
     if (I >= PortLoads_.size()) {
       PortLoads_.resize(I + 1);
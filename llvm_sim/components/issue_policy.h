@@ -18,6 +18,7 @@
 #define EXEGESIS_LLVM_SIM_COMPONENTS_ISSUE_POLICY_H_
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm_sim/framework/state.h"
 
 namespace exegesis {
 namespace simulator {
@@ -35,6 +36,10 @@ class IssuePolicy {
   // Resets the state of the policy.
   virtual void Reset() = 0;
 
+  // Serializes the state of the policy, see `Component::SaveState()`.
+  virtual void SaveState(StateWriter* Writer) const = 0;
+  virtual void RestoreState(StateReader* Reader) = 0;
+
   // Signals that a uop has been issued on port I.
   virtual void SignalIssued(size_t I) = 0;
 
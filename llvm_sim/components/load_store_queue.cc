@@ -0,0 +1,207 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/components/load_store_queue.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "llvm/MC/MCInstrDesc.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+
+namespace exegesis {
+namespace simulator {
+
+LoadStoreQueue::LoadStoreQueue(const GlobalContext* Context,
+                               const Config& Config)
+    : Config_(Config),
+      InstrInfo_(*Context->InstrInfo),
+      RegisterInfo_(*Context->RegisterInfo) {
+  assert(Config.NumLoadEntries > 0);
+  assert(Config.NumStoreEntries > 0);
+  Reset();
+}
+
+bool LoadStoreQueue::AccessesMemory(const llvm::MCInst& Inst) const {
+  const auto& InstrDesc = InstrInfo_.get(Inst.getOpcode());
+  return InstrDesc.mayLoad() || InstrDesc.mayStore();
+}
+
+std::vector<unsigned> LoadStoreQueue::GetLoadProcResIdxs(
+    const GlobalContext& Context, const llvm::MCInst& Load) {
+  assert(Context.InstrInfo->get(Load.getOpcode()).mayLoad());
+  std::vector<unsigned> Result;
+  for (const auto& Uop : Context.GetInstructionDecomposition(Load).Uops) {
+    if (Uop.ProcResIdx != 0 &&
+        std::find(Result.begin(), Result.end(), Uop.ProcResIdx) ==
+            Result.end()) {
+      Result.push_back(Uop.ProcResIdx);
+    }
+  }
+  return Result;
+}
+
+size_t LoadStoreQueue::GetLoadUopIndex(
+    llvm::ArrayRef<InstrUopDecomposition::Uop> Uops) const {
+  for (size_t I = 0; I < Uops.size(); ++I) {
+    if (std::find(Config_.LoadProcResIdxs.begin(),
+                  Config_.LoadProcResIdxs.end(),
+                  Uops[I].ProcResIdx) != Config_.LoadProcResIdxs.end()) {
+      return I;
+    }
+  }
+  return 0;
+}
+
+void LoadStoreQueue::Reset() {
+  Entries_.clear();
+  NumLoads_ = 0;
+  NumStores_ = 0;
+  RegUnitVersions_.assign(RegisterInfo_.getNumRegUnits(), 0);
+}
+
+void LoadStoreQueue::SaveState(StateWriter* Writer) const {
+  Writer->Write<uint64_t>(Entries_.size());
+  for (const Entry& Entry : Entries_) {
+    Writer->Write(Entry.IsLoad);
+    Writer->Write(Entry.IsStore);
+    Writer->Write(Entry.Address);
+    Writer->Write(Entry.HasStoreROBEntry);
+    Writer->Write(Entry.StoreROBEntryIndex);
+  }
+  Writer->Write(RegUnitVersions_);
+}
+
+void LoadStoreQueue::RestoreState(StateReader* Reader) {
+  Reset();
+  Entries_.resize(Reader->Read<uint64_t>());
+  for (Entry& Entry : Entries_) {
+    Reader->Read(&Entry.IsLoad);
+    Reader->Read(&Entry.IsStore);
+    Reader->Read(&Entry.Address);
+    Reader->Read(&Entry.HasStoreROBEntry);
+    Reader->Read(&Entry.StoreROBEntryIndex);
+    NumLoads_ += Entry.IsLoad;
+    NumStores_ += Entry.IsStore;
+  }
+  Reader->Read(&RegUnitVersions_);
+}
+
+LoadStoreQueue::AddressKey LoadStoreQueue::GetAddressKey(
+    const llvm::MCInst& Inst) const {
+  const auto& InstrDesc = InstrInfo_.get(Inst.getOpcode());
+  AddressKey Key;
+  for (unsigned I = 0; I < Inst.getNumOperands() && I < InstrDesc.NumOperands;
+       ++I) {
+    if (InstrDesc.OpInfo[I].OperandType != llvm::MCOI::OPERAND_MEMORY) {
+      continue;
+    }
+    const llvm::MCOperand& Op = Inst.getOperand(I);
+    if (Op.isReg()) {
+      // A register is identified by its name and the versions of its units.
+      Key.push_back(Op.getReg());
+      if (Op.getReg() != 0) {
+        for (llvm::MCRegUnitIterator Unit(Op.getReg(), &RegisterInfo_);
+             Unit.isValid(); ++Unit) {
+          Key.push_back(RegUnitVersions_[*Unit]);
+        }
+      }
+    } else if (Op.isImm()) {
+      Key.push_back(Op.getImm());
+    } else {
+      // Symbolic displacements cannot be compared.
+      return {};
+    }
+  }
+  return Key;
+}
+
+void LoadStoreQueue::UpdateRegisterVersions(const llvm::MCInst& Inst) {
+  const auto& InstrDesc = InstrInfo_.get(Inst.getOpcode());
+  const auto BumpVersions = [this](const unsigned Reg) {
+    for (llvm::MCRegUnitIterator Unit(Reg, &RegisterInfo_); Unit.isValid();
+         ++Unit) {
+      ++RegUnitVersions_[*Unit];
+    }
+  };
+  // Explicit defs.
+  for (unsigned I = 0; I < InstrDesc.getNumDefs(); ++I) {
+    const llvm::MCOperand& Op = Inst.getOperand(I);
+    if (Op.isReg() && Op.getReg() != 0) {
+      BumpVersions(Op.getReg());
+    }
+  }
+  // Implicit defs.
+  for (const llvm::MCPhysReg* Reg = InstrDesc.getImplicitDefs();
+       Reg && *Reg != 0; ++Reg) {
+    BumpVersions(*Reg);
+  }
+}
+
+bool LoadStoreQueue::Allocate(const llvm::MCInst& Inst,
+                              llvm::Optional<Forwarding>* Forwarding) {
+  *Forwarding = llvm::None;
+  const auto& InstrDesc = InstrInfo_.get(Inst.getOpcode());
+  const bool IsLoad = InstrDesc.mayLoad();
+  const bool IsStore = InstrDesc.mayStore();
+  if ((IsLoad && NumLoads_ == Config_.NumLoadEntries) ||
+      (IsStore && NumStores_ == Config_.NumStoreEntries)) {
+    return false;
+  }
+  if (IsLoad || IsStore) {
+    // The address is computed from the registers before the instruction
+    // writes them.
+    Entry NewEntry;
+    NewEntry.IsLoad = IsLoad;
+    NewEntry.IsStore = IsStore;
+    NewEntry.Address = GetAddressKey(Inst);
+    if (IsLoad && !NewEntry.Address.empty()) {
+      // Forward from the youngest older store to the same address.
+      for (auto It = Entries_.rbegin(); It != Entries_.rend(); ++It) {
+        if (It->IsStore && It->Address == NewEntry.Address) {
+          assert(It->HasStoreROBEntry);
+          *Forwarding = LoadStoreQueue::Forwarding{It->StoreROBEntryIndex};
+          break;
+        }
+      }
+    }
+    NumLoads_ += IsLoad;
+    NumStores_ += IsStore;
+    Entries_.push_back(std::move(NewEntry));
+  }
+  UpdateRegisterVersions(Inst);
+  return true;
+}
+
+void LoadStoreQueue::SetStoreEntry(const size_t ROBEntryIndex) {
+  assert(!Entries_.empty());
+  Entry& Entry = Entries_.back();
+  assert(Entry.IsStore);
+  Entry.HasStoreROBEntry = true;
+  Entry.StoreROBEntryIndex = ROBEntryIndex;
+}
+
+void LoadStoreQueue::Release() {
+  assert(!Entries_.empty());
+  const Entry& Entry = Entries_.front();
+  assert(NumLoads_ >= Entry.IsLoad);
+  assert(NumStores_ >= Entry.IsStore);
+  NumLoads_ -= Entry.IsLoad;
+  NumStores_ -= Entry.IsStore;
+  Entries_.pop_front();
+}
+
+}  // namespace simulator
+}  // namespace exegesis
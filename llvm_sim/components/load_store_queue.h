@@ -0,0 +1,147 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The load/store queue tracks the memory accesses of the instructions in the
+// reorder buffer, which consults it before sending uops to the load and store
+// ports. It models:
+//   - The capacity of the load and store buffers: instructions that access
+//     memory get entries when they enter the reorder buffer, and release them
+//     when they retire. The reorder buffer stalls when the buffers are full.
+//   - Store-to-load forwarding: a load from the address of an older store that
+//     has not retired yet depends on the store, and gets its data with the
+//     forwarding latency.
+// Addresses are not known statically, so they are compared symbolically: two
+// memory operands have the same address if they have the same displacement and
+// scale, and the same base and index registers, which were not written in
+// between. Memory disambiguation is assumed to be perfect: loads never wait
+// for older stores to other addresses.
+
+#ifndef EXEGESIS_LLVM_SIM_COMPONENTS_LOAD_STORE_QUEUE_H_
+#define EXEGESIS_LLVM_SIM_COMPONENTS_LOAD_STORE_QUEUE_H_
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/state.h"
+
+namespace exegesis {
+namespace simulator {
+
+class LoadStoreQueue {
+ public:
+  struct Config {
+    // The number of entries in the load buffer.
+    unsigned NumLoadEntries;
+    // The number of entries in the store buffer.
+    unsigned NumStoreEntries;
+    // The latency of a load that gets its data from an older store.
+    unsigned StoreForwardingLatency;
+    // The proc resources of the load ports, see `GetLoadUopIndex()`.
+    std::vector<unsigned> LoadProcResIdxs = {};
+  };
+
+  // A load that gets its data from an older store.
+  struct Forwarding {
+    // The reorder buffer entry of the last uop of the store.
+    size_t StoreROBEntryIndex;
+  };
+
+  LoadStoreQueue(const GlobalContext* Context, const Config& Config);
+
+  const Config& GetConfig() const { return Config_; }
+
+  // Returns true if `Inst` reads or writes memory.
+  bool AccessesMemory(const llvm::MCInst& Inst) const;
+
+  // Returns the proc resources used by the uops of `Load`, which must be a
+  // plain load from memory. These are the load ports of the scheduling model.
+  static std::vector<unsigned> GetLoadProcResIdxs(const GlobalContext& Context,
+                                                  const llvm::MCInst& Load);
+
+  // Returns the index of the uop that reads memory among the uops of a load,
+  // i.e. the first uop that uses a load port. Uops are ordered by proc
+  // resource, so this is not necessarily the first uop. Returns 0 if no uop
+  // uses a load port, e.g. when the load ports are not configured.
+  size_t GetLoadUopIndex(
+      llvm::ArrayRef<InstrUopDecomposition::Uop> Uops) const;
+
+  // Empties the queue.
+  void Reset();
+
+  // Serializes the state of the queue, see `Component::SaveState()`.
+  void SaveState(StateWriter* Writer) const;
+  void RestoreState(StateReader* Reader);
+
+  // Allocates the entries of `Inst`, which is entering the reorder buffer.
+  // This must be called in program order for every instruction, including the
+  // ones that do not access memory, which can change the address registers.
+  // Returns false without changing the queue if the buffers are full. If the
+  // instruction loads from an older store, `*Forwarding` is set to it.
+  bool Allocate(const llvm::MCInst& Inst,
+                llvm::Optional<Forwarding>* Forwarding);
+
+  // Records that the store of the last allocated instruction completes with
+  // the uop in reorder buffer entry `ROBEntryIndex`. This must be called when
+  // the last uop of an instruction that writes memory enters the reorder
+  // buffer.
+  void SetStoreEntry(size_t ROBEntryIndex);
+
+  // Releases the entries of the oldest instruction that accesses memory. This
+  // must be called when its last uop retires.
+  void Release();
+
+ private:
+  // The symbolic address of a memory access (see top comment).
+  using AddressKey = std::vector<int64_t>;
+
+  // The accesses of an instruction.
+  struct Entry {
+    bool IsLoad = false;
+    bool IsStore = false;
+    AddressKey Address;
+    // The reorder buffer entry of the last uop of a store, if it has entered
+    // the reorder buffer.
+    bool HasStoreROBEntry = false;
+    size_t StoreROBEntryIndex = 0;
+  };
+
+  // Returns the symbolic address of the memory operands of `Inst`, or an empty
+  // key if the address cannot be represented (e.g. implicit memory operands).
+  AddressKey GetAddressKey(const llvm::MCInst& Inst) const;
+
+  // Records that `Inst` writes its def registers.
+  void UpdateRegisterVersions(const llvm::MCInst& Inst);
+
+  const Config Config_;
+  const llvm::MCInstrInfo& InstrInfo_;
+  const llvm::MCRegisterInfo& RegisterInfo_;
+
+  // The memory accesses of the in-flight instructions, in program order.
+  // Queues are small, so forwarding stores are found by a linear scan.
+  std::deque<Entry> Entries_;
+  unsigned NumLoads_ = 0;
+  unsigned NumStores_ = 0;
+  // The number of writes to each register unit, which distinguishes the
+  // successive values of the address registers.
+  std::vector<uint64_t> RegUnitVersions_;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_COMPONENTS_LOAD_STORE_QUEUE_H_
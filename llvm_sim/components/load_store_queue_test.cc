@@ -0,0 +1,225 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/components/load_store_queue.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/state.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+using ::testing::Contains;
+using ::testing::Not;
+
+class LoadStoreQueueTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    LLVMInitializeX86Target();
+    LLVMInitializeX86TargetInfo();
+    LLVMInitializeX86TargetMC();
+    Context_ = GlobalContext::Create("x86_64", "haswell");
+  }
+
+  static void TearDownTestSuite() { Context_.reset(); }
+
+  static unsigned Opcode(llvm::StringRef Name) {
+    for (unsigned I = 0; I < Context_->InstrInfo->getNumOpcodes(); ++I) {
+      if (Context_->InstrInfo->getName(I) == Name) {
+        return I;
+      }
+    }
+    ADD_FAILURE() << "unknown opcode " << Name.str();
+    return 0;
+  }
+
+  static unsigned Reg(llvm::StringRef Name) {
+    for (unsigned I = 0; I < Context_->RegisterInfo->getNumRegs(); ++I) {
+      if (Context_->RegisterInfo->getName(I) == Name) {
+        return I;
+      }
+    }
+    ADD_FAILURE() << "unknown register " << Name.str();
+    return 0;
+  }
+
+  // mov dword ptr [Base + Disp], Src
+  static llvm::MCInst Store(unsigned Base, int64_t Disp, unsigned Src) {
+    return llvm::MCInstBuilder(Opcode("MOV32mr"))
+        .addReg(Base)
+        .addImm(1)
+        .addReg(0)
+        .addImm(Disp)
+        .addReg(0)
+        .addReg(Src);
+  }
+
+  // mov Dst, dword ptr [Base + Disp]
+  static llvm::MCInst Load(unsigned Dst, unsigned Base, int64_t Disp) {
+    return llvm::MCInstBuilder(Opcode("MOV32rm"))
+        .addReg(Dst)
+        .addReg(Base)
+        .addImm(1)
+        .addReg(0)
+        .addImm(Disp)
+        .addReg(0);
+  }
+
+  // add Reg, Imm
+  static llvm::MCInst AddImm(unsigned Reg, int64_t Imm) {
+    return llvm::MCInstBuilder(Opcode("ADD64ri8"))
+        .addReg(Reg)
+        .addReg(Reg)
+        .addImm(Imm);
+  }
+
+  static std::unique_ptr<const GlobalContext> Context_;
+};
+
+std::unique_ptr<const GlobalContext> LoadStoreQueueTest::Context_;
+
+TEST_F(LoadStoreQueueTest, ForwardsFromYoungestStoreToSameAddress) {
+  LoadStoreQueue LSQ(Context_.get(), {4, 4, 5});
+  const unsigned RSI = Reg("RSI");
+  const unsigned EAX = Reg("EAX");
+  const unsigned EBX = Reg("EBX");
+  llvm::Optional<LoadStoreQueue::Forwarding> Forwarding;
+
+  ASSERT_TRUE(LSQ.Allocate(Store(RSI, 8, EAX), &Forwarding));
+  EXPECT_FALSE(Forwarding.hasValue());
+  LSQ.SetStoreEntry(3);
+  ASSERT_TRUE(LSQ.Allocate(Store(RSI, 8, EBX), &Forwarding));
+  LSQ.SetStoreEntry(5);
+  // Different displacement.
+  ASSERT_TRUE(LSQ.Allocate(Load(EAX, RSI, 16), &Forwarding));
+  EXPECT_FALSE(Forwarding.hasValue());
+  // Same address: forward from the youngest store.
+  ASSERT_TRUE(LSQ.Allocate(Load(EAX, RSI, 8), &Forwarding));
+  ASSERT_TRUE(Forwarding.hasValue());
+  EXPECT_EQ(Forwarding->StoreROBEntryIndex, 5);
+}
+
+TEST_F(LoadStoreQueueTest, AddressRegisterWrites) {
+  LoadStoreQueue LSQ(Context_.get(), {4, 4, 5});
+  const unsigned RSI = Reg("RSI");
+  const unsigned EAX = Reg("EAX");
+  llvm::Optional<LoadStoreQueue::Forwarding> Forwarding;
+
+  ASSERT_TRUE(LSQ.Allocate(Store(RSI, 0, EAX), &Forwarding));
+  LSQ.SetStoreEntry(0);
+  // `rsi` changes, so the load reads another address.
+  ASSERT_TRUE(LSQ.Allocate(AddImm(RSI, 4), &Forwarding));
+  EXPECT_FALSE(Forwarding.hasValue());
+  ASSERT_TRUE(LSQ.Allocate(Load(EAX, RSI, 0), &Forwarding));
+  EXPECT_FALSE(Forwarding.hasValue());
+}
+
+TEST_F(LoadStoreQueueTest, Capacity) {
+  LoadStoreQueue LSQ(Context_.get(), {1, 2, 5});
+  const unsigned RSI = Reg("RSI");
+  const unsigned EAX = Reg("EAX");
+  llvm::Optional<LoadStoreQueue::Forwarding> Forwarding;
+
+  ASSERT_TRUE(LSQ.Allocate(Store(RSI, 0, EAX), &Forwarding));
+  LSQ.SetStoreEntry(0);
+  ASSERT_TRUE(LSQ.Allocate(Load(EAX, RSI, 4), &Forwarding));
+  ASSERT_TRUE(LSQ.Allocate(Store(RSI, 8, EAX), &Forwarding));
+  LSQ.SetStoreEntry(1);
+  // The load buffer is full.
+  EXPECT_FALSE(LSQ.Allocate(Load(EAX, RSI, 8), &Forwarding));
+  // The store buffer is full.
+  EXPECT_FALSE(LSQ.Allocate(Store(RSI, 12, EAX), &Forwarding));
+  // Instructions that do not access memory are not limited.
+  EXPECT_TRUE(LSQ.Allocate(AddImm(RSI, 4), &Forwarding));
+
+  // Release the first store.
+  LSQ.Release();
+  ASSERT_TRUE(LSQ.Allocate(Store(RSI, 12, EAX), &Forwarding));
+  LSQ.SetStoreEntry(2);
+  EXPECT_FALSE(LSQ.Allocate(Store(RSI, 16, EAX), &Forwarding));
+  // Release the load.
+  LSQ.Release();
+  EXPECT_TRUE(LSQ.Allocate(Load(EAX, RSI, 12), &Forwarding));
+  ASSERT_TRUE(Forwarding.hasValue());
+  EXPECT_EQ(Forwarding->StoreROBEntryIndex, 2);
+}
+
+TEST_F(LoadStoreQueueTest, LoadUopIndex) {
+  const unsigned RSI = Reg("RSI");
+  const unsigned EAX = Reg("EAX");
+  const std::vector<unsigned> LoadProcResIdxs =
+      LoadStoreQueue::GetLoadProcResIdxs(*Context_, Load(EAX, RSI, 0));
+  ASSERT_FALSE(LoadProcResIdxs.empty());
+
+  // add eax, dword ptr [rsi]: one ALU uop and one load uop, ordered by proc
+  // resource.
+  const llvm::MCInst AddLoad = llvm::MCInstBuilder(Opcode("ADD32rm"))
+                                   .addReg(EAX)
+                                   .addReg(EAX)
+                                   .addReg(RSI)
+                                   .addImm(1)
+                                   .addReg(0)
+                                   .addImm(0)
+                                   .addReg(0);
+  const auto& Uops = Context_->GetInstructionDecomposition(AddLoad).Uops;
+  ASSERT_EQ(Uops.size(), 2);
+  const LoadStoreQueue LSQ(Context_.get(), {4, 4, 5, LoadProcResIdxs});
+  const size_t LoadUopIndex = LSQ.GetLoadUopIndex(Uops);
+  ASSERT_LT(LoadUopIndex, Uops.size());
+  EXPECT_THAT(LoadProcResIdxs, Contains(Uops[LoadUopIndex].ProcResIdx));
+  EXPECT_THAT(LoadProcResIdxs,
+              Not(Contains(Uops[1 - LoadUopIndex].ProcResIdx)));
+
+  // Without load ports, the first uop is assumed to read memory.
+  const LoadStoreQueue NoLoadPorts(Context_.get(), {4, 4, 5});
+  EXPECT_EQ(NoLoadPorts.GetLoadUopIndex(Uops), 0);
+}
+
+TEST_F(LoadStoreQueueTest, SaveAndRestore) {
+  LoadStoreQueue LSQ(Context_.get(), {4, 1, 5});
+  const unsigned RSI = Reg("RSI");
+  const unsigned EAX = Reg("EAX");
+  llvm::Optional<LoadStoreQueue::Forwarding> Forwarding;
+  ASSERT_TRUE(LSQ.Allocate(AddImm(RSI, 4), &Forwarding));
+  ASSERT_TRUE(LSQ.Allocate(Store(RSI, 0, EAX), &Forwarding));
+  LSQ.SetStoreEntry(7);
+
+  StateWriter Writer;
+  LSQ.SaveState(&Writer);
+
+  LoadStoreQueue Restored(Context_.get(), {4, 1, 5});
+  StateReader Reader(Writer.GetBlob());
+  Restored.RestoreState(&Reader);
+  EXPECT_TRUE(Reader.AtEnd());
+  // The store buffer is still full.
+  EXPECT_FALSE(Restored.Allocate(Store(RSI, 4, EAX), &Forwarding));
+  // The register versions are restored.
+  ASSERT_TRUE(Restored.Allocate(Load(EAX, RSI, 0), &Forwarding));
+  ASSERT_TRUE(Forwarding.hasValue());
+  EXPECT_EQ(Forwarding->StoreROBEntryIndex, 7);
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
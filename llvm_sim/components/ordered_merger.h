@@ -0,0 +1,99 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// An ordered merger lets the components of a group (see
+// `Simulator::AddComponentGroup()`) push to the same buffer while they are
+// ticked concurrently. Each component pushes to its own lane, and the merger,
+// which must be added right after the group, forwards the elements of the
+// lanes to the buffer in lane order. This is the order in which the components
+// would have pushed the elements if they had been ticked sequentially.
+//
+// A lane accepts elements if the buffer would accept them together with the
+// other elements of the lane. Elements of the other lanes are not taken into
+// account, so the merger behaves exactly like the shared buffer only if the
+// buffer accepts or rejects elements regardless of the number of elements
+// pushed in the cycle, e.g. a LinkBuffer with infinite capacity.
+
+#ifndef EXEGESIS_LLVM_SIM_COMPONENTS_ORDERED_MERGER_H_
+#define EXEGESIS_LLVM_SIM_COMPONENTS_ORDERED_MERGER_H_
+
+#include <cassert>
+#include <vector>
+
+#include "llvm_sim/components/buffer.h"
+#include "llvm_sim/framework/component.h"
+
+namespace exegesis {
+namespace simulator {
+
+template <typename Tag>
+class OrderedMerger : public Component {
+ public:
+  OrderedMerger(const GlobalContext* Context, size_t NumLanes,
+                BufferImpl<Tag>* Target)
+      : Component(Context), Lanes_(NumLanes, Lane(Target)), Target_(Target) {}
+
+  ~OrderedMerger() override {}
+
+  // Returns the sink for the `I`-th component of the group.
+  Sink<Tag>* GetLane(size_t I) { return &Lanes_[I]; }
+
+  void Init() final {
+    for (Lane& Lane : Lanes_) {
+      Lane.Elems.clear();
+    }
+  }
+
+  // Forwards the elements of the lanes. The lanes are therefore empty at the
+  // end of each cycle, and the merger has no state to save.
+  void Tick(const BlockContext* BlockContext) final {
+    for (Lane& Lane : Lanes_) {
+      if (Lane.Elems.empty()) {
+        continue;
+      }
+      const bool Pushed = Target_->PushMany(Lane.Elems);
+      assert(Pushed && "the target depends on the number of pushed elements");
+      (void)Pushed;
+      Lane.Elems.clear();
+    }
+  }
+
+ private:
+  class Lane : public Sink<Tag> {
+   public:
+    explicit Lane(const BufferImpl<Tag>* Target) : Target_(Target) {}
+
+    LLVM_NODISCARD bool PushMany(
+        llvm::ArrayRef<typename Tag::Type> NewElems) final {
+      if (!Target_->CanPushMany(Elems.size() + NewElems.size())) {
+        return false;
+      }
+      Elems.insert(Elems.end(), NewElems.begin(), NewElems.end());
+      return true;
+    }
+
+    std::vector<typename Tag::Type> Elems;
+
+   private:
+    const BufferImpl<Tag>* Target_;
+  };
+
+  std::vector<Lane> Lanes_;
+  BufferImpl<Tag>* const Target_;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_COMPONENTS_ORDERED_MERGER_H_
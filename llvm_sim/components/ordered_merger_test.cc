@@ -0,0 +1,74 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/components/ordered_merger.h"
+
+#include <limits>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm_sim/components/testing.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+constexpr size_t kInfiniteCapacity = std::numeric_limits<size_t>::max();
+
+TEST(OrderedMergerTest, ForwardsInLaneOrder) {
+  const GlobalContext Context;
+  LinkBuffer<TestInputTag> Target(kInfiniteCapacity);
+  OrderedMerger<TestInputTag> Merger(&Context, 3, &Target);
+  {
+    MockLogger Log;
+    Target.Init(&Log);
+  }
+  Merger.Init();
+
+  // Lanes are filled in any order.
+  ASSERT_TRUE(Merger.GetLane(2)->Push(5));
+  ASSERT_TRUE(Merger.GetLane(0)->PushMany({1, 2}));
+  ASSERT_TRUE(Merger.GetLane(2)->Push(6));
+  ASSERT_TRUE(Merger.GetLane(1)->Push(3));
+  Merger.Tick(nullptr);
+  CHECK_BUFFER_CONTENTS(Target, "[(6),(5),(3),(2),(1)|]");
+
+  // Lanes are empty after forwarding.
+  Merger.Tick(nullptr);
+  CHECK_BUFFER_CONTENTS(Target, "[(6),(5),(3),(2),(1)|]");
+}
+
+TEST(OrderedMergerTest, RejectsWhenTargetRejects) {
+  const GlobalContext Context;
+  LinkBuffer<TestInputTag> Target(2);
+  OrderedMerger<TestInputTag> Merger(&Context, 2, &Target);
+  {
+    MockLogger Log;
+    Target.Init(&Log);
+  }
+  Merger.Init();
+
+  // Each lane accepts as many elements as the target. Forwarding would fail
+  // here: the merger must only be used with targets that do not depend on the
+  // number of elements.
+  ASSERT_TRUE(Merger.GetLane(0)->Push(1));
+  ASSERT_TRUE(Merger.GetLane(0)->Push(2));
+  ASSERT_FALSE(Merger.GetLane(0)->Push(3));
+  ASSERT_TRUE(Merger.GetLane(1)->Push(4));
+  ASSERT_FALSE(Merger.GetLane(1)->PushMany({5, 6}));
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
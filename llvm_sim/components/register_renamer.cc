@@ -49,6 +49,13 @@ class RegisterNameTrackerImpl : public RegisterNameTracker {
 
   void Reset() override { std::fill(Names_.begin(), Names_.end(), 0); }
 
+  void SaveState(StateWriter* Writer) const override { Writer->Write(Names_); }
+
+  void RestoreState(StateReader* Reader) override {
+    Reader->Read(&Names_);
+    assert(Names_.size() == RegisterInfo_.getNumRegUnits());
+  }
+
  private:
   const llvm::MCRegisterInfo& RegisterInfo_;
   // Names, indexed by register, or 0 if there is no active name for this
@@ -92,6 +99,26 @@ void RegisterRenamer::Init() {
   Tracker_->Reset();
 }
 
+void RegisterRenamer::SaveState(StateWriter* Writer) const {
+  Writer->Write(PhysicalRegistersFreelist_);
+  Writer->Write(NumAllocatedPhysicalRegisters_);
+  Writer->Write(HasPendingUop_);
+  if (HasPendingUop_) {
+    Writer->Write(RenamedUop_);
+  }
+  Tracker_->SaveState(Writer);
+}
+
+void RegisterRenamer::RestoreState(StateReader* Reader) {
+  Reader->Read(&PhysicalRegistersFreelist_);
+  Reader->Read(&NumAllocatedPhysicalRegisters_);
+  Reader->Read(&HasPendingUop_);
+  if (HasPendingUop_) {
+    Reader->Read(&RenamedUop_);
+  }
+  Tracker_->RestoreState(Reader);
+}
+
 void RegisterRenamer::Tick(const BlockContext* BlockContext) {
   // TODO(courbet): This is where `XOR EAX, EAX` detection is implemented.
   // Also: XOR, SUB, PXOR, XORPS, XORPD, VXORPS, VXORPD and all variants
@@ -136,87 +163,57 @@ bool RegisterRenamer::PopulateUop(const BlockContext* BlockContext,
     HandleFirstUop(BlockContext);
   }
 
-  const auto& Decomposition = Context.GetInstructionDecomposition(
-      BlockContext->GetInstruction(Uop.InstrIndex.BBIndex));
-  assert(!Decomposition.Uops.empty());
-  if (Uop.UopIndex == Decomposition.Uops.size() - 1) {
+  const auto& Uops =
+      BlockContext->GetLoweredInstruction(Context, Uop.InstrIndex.BBIndex).Uops;
+  assert(!Uops.empty());
+  if (Uop.UopIndex == Uops.size() - 1) {
     return HandleLastUop(BlockContext);
   }
   return true;
 }
 
 void RegisterRenamer::HandleFirstUop(const BlockContext* BlockContext) {
-  const llvm::MCInst& Inst =
-      BlockContext->GetInstruction(RenamedUop_.Uop.InstrIndex.BBIndex);
-  const auto& InstrDesc = Context.InstrInfo->get(Inst.getOpcode());
-
-  const auto AddUse = [this](const unsigned Reg) {
+  // Explicit and implicit uses.
+  for (const unsigned Reg :
+       BlockContext
+           ->GetLoweredInstruction(Context, RenamedUop_.Uop.InstrIndex.BBIndex)
+           .Uses) {
     for (const size_t Name : Tracker_->GetNameDeps(Reg)) {
       if (std::find(RenamedUop_.Uses.begin(), RenamedUop_.Uses.end(), Name) ==
           RenamedUop_.Uses.end()) {
         RenamedUop_.Uses.push_back(Name);
       }
     }
-  };
-
-  // Explicit uses. LLVM store explicit defs, then explicit uses. We just skip
-  // over defs.
-  for (unsigned I = InstrDesc.getNumDefs(); I < Inst.getNumOperands(); ++I) {
-    const llvm::MCOperand& Op = Inst.getOperand(I);
-    assert(Op.isValid());
-    if (Op.isReg() && Op.getReg() != 0) {
-      AddUse(Op.getReg());
-    }
-  }
-  // Implicit uses:
-  for (const llvm::MCPhysReg* Reg = InstrDesc.getImplicitUses();
-       Reg && *Reg != 0; ++Reg) {
-    AddUse(*Reg);
   }
 }
 
 bool RegisterRenamer::HandleLastUop(const BlockContext* BlockContext) {
-  const llvm::MCInst& Inst =
-      BlockContext->GetInstruction(RenamedUop_.Uop.InstrIndex.BBIndex);
-  const auto& InstrDesc = Context.InstrInfo->get(Inst.getOpcode());
-
-  const auto ForEachRegisterDef =
-      [&Inst, &InstrDesc](const std::function<void(unsigned Reg)>& Callback) {
-        // Explicit defs.
-        for (unsigned I = 0; I < InstrDesc.getNumDefs(); ++I) {
-          const llvm::MCOperand& Op = Inst.getOperand(I);
-          assert(Op.isValid());
-          if (Op.isReg()) {
-            Callback(Op.getReg());
-          }
-        }
-        // Implicit defs:
-        for (const llvm::MCPhysReg* Reg = InstrDesc.getImplicitDefs();
-             Reg && *Reg != 0; ++Reg) {
-          Callback(*Reg);
-        }
-      };
+  // Explicit and implicit defs.
+  const llvm::ArrayRef<unsigned> Defs =
+      BlockContext
+          ->GetLoweredInstruction(Context, RenamedUop_.Uop.InstrIndex.BBIndex)
+          .Defs;
 
   // First pass to gather how many registers we need to handle the uops. We only
   // want to start modifying the state of this class when we can finish the
   // uop.
   unsigned NumRenames = 0;
-  ForEachRegisterDef([this, &NumRenames](unsigned Reg) {
+  for (const unsigned Reg : Defs) {
     if (CanBeRenamed(Reg)) {
       ++NumRenames;
     }
-  });
+  }
   if (!HasAtLeastFreePhysicalRegisterIds(NumRenames)) {
     return false;
   }
   // Second pass to actually do the renames.
-  ForEachRegisterDef([this](unsigned Reg) {
+  for (const unsigned Reg : Defs) {
     const size_t PhysReg =
         CanBeRenamed(Reg) ? GetFreePhysicalRegisterId() : Reg;
     assert(PhysReg > 0);
     Tracker_->SetName(Reg, PhysReg);
     RenamedUop_.Defs.push_back(PhysReg);
-  });
+  }
   return true;
 }
 
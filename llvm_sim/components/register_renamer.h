@@ -92,6 +92,10 @@ class RegisterNameTracker {
   virtual llvm::SmallVector<size_t, 4> GetNameDeps(unsigned Reg) const = 0;
 
   virtual void Reset() {}
+
+  // Serializes the names of the registers, see `Component::SaveState()`.
+  virtual void SaveState(StateWriter* Writer) const {}
+  virtual void RestoreState(StateReader* Reader) {}
 };
 
 class RegisterRenamer : public Component {
@@ -115,6 +119,8 @@ class RegisterRenamer : public Component {
 
   void Init() override;
   void Tick(const BlockContext* BlockContext) override;
+  void SaveState(StateWriter* Writer) const override;
+  void RestoreState(StateReader* Reader) override;
 
  private:
   // Returns a free physical register id, or 0 if none are available.
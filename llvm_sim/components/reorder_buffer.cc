@@ -27,15 +27,19 @@ std::string ROBUopId::Format(const Type& Elem) {
 
 ReorderBuffer::Buffer::Buffer(size_t Size) : Entries_(Size) {
   assert(Size > 0);
+  // The dependency bitsets are allocated once and reused across uops.
+  for (auto& Entry : Entries_) {
+    Entry.UnsatisfiedDependencies.resize(Size);
+    Entry.DependentEntries.resize(Size);
+  }
   Reset();
 }
 
 void ReorderBuffer::Buffer::Reset() {
   // Mark all entries as empty.
-  const size_t Size = Entries_.size();
-  Entries_.clear();
-  Entries_.resize(Size);
-  for (size_t I = 0; I < Size; ++I) {
+  for (size_t I = 0; I < Entries_.size(); ++I) {
+    Entries_[I].Clear();
+    Entries_[I].ROBUop = ROBUopId::Type();
     Entries_[I].ROBUop.ROBEntryIndex = I;
   }
   FirstEmptyEntryIndex_ = 0;
@@ -80,10 +84,53 @@ ReorderBuffer::ROBEntry* ReorderBuffer::Buffer::ReserveEntry() {
 
 void ReorderBuffer::ROBEntry::Clear() {
   State = ROBEntry::StateE::kEmpty;
-  UnsatisfiedDependencies.empty();
+  UnsatisfiedDependencies.reset();
   Defs.clear();
   PossiblePorts.clear();
-  DependentEntries.clear();
+  DependentEntries.reset();
+}
+
+void ReorderBuffer::ROBEntry::SaveState(StateWriter* Writer) const {
+  Writer->Write(State);
+  if (State == StateE::kEmpty) {
+    return;
+  }
+  Writer->Write(ROBUop);
+  Writer->Write(Defs);
+  Writer->Write(PossiblePorts);
+  Writer->Write(UnsatisfiedDependencies);
+  Writer->Write(DependentEntries);
+}
+
+void ReorderBuffer::ROBEntry::RestoreState(StateReader* Reader) {
+  assert(State == StateE::kEmpty);
+  Reader->Read(&State);
+  if (State == StateE::kEmpty) {
+    return;
+  }
+  Reader->Read(&ROBUop);
+  Reader->Read(&Defs);
+  Reader->Read(&PossiblePorts);
+  Reader->Read(&UnsatisfiedDependencies);
+  Reader->Read(&DependentEntries);
+}
+
+void ReorderBuffer::Buffer::SaveState(StateWriter* Writer) const {
+  for (const ROBEntry& Entry : Entries_) {
+    Entry.SaveState(Writer);
+  }
+  Writer->Write(FirstEmptyEntryIndex_);
+  Writer->Write(NumEmptyEntries_);
+  Writer->Write(FirstRetirableEntryIndex_);
+}
+
+void ReorderBuffer::Buffer::RestoreState(StateReader* Reader) {
+  for (ROBEntry& Entry : Entries_) {
+    Entry.RestoreState(Reader);
+  }
+  Reader->Read(&FirstEmptyEntryIndex_);
+  Reader->Read(&NumEmptyEntries_);
+  Reader->Read(&FirstRetirableEntryIndex_);
 }
 
 void ReorderBuffer::Buffer::ReleaseOldestEntry() {
@@ -122,7 +169,8 @@ ReorderBuffer::ReorderBuffer(
     Source<RenamedUopId>* UopSource, Source<ROBUopId>* AvailableDepsSource,
     Source<ROBUopId>* WritebackSource, Source<ROBUopId>* RetiredSource,
     Sink<ROBUopId>* IssuedSink, std::vector<Sink<ROBUopId>*> PortSinks,
-    Sink<ROBUopId>* RetirementSink, std::unique_ptr<IssuePolicy> IssuePolicy)
+    Sink<ROBUopId>* RetirementSink, std::unique_ptr<IssuePolicy> IssuePolicy,
+    std::unique_ptr<LoadStoreQueue> LoadStoreQueue)
     : Component(Context),
       Config_(Config),
       UopSource_(UopSource),
@@ -133,21 +181,68 @@ ReorderBuffer::ReorderBuffer(
       PortSinks_(std::move(PortSinks)),
       RetirementSink_(RetirementSink),
       IssuePolicy_(std::move(IssuePolicy)),
-      Entries_(Config.NumROBEntries) {}
+      LoadStoreQueue_(std::move(LoadStoreQueue)),
+      Entries_(Config.NumROBEntries),
+      ReadyToExecuteEntries_(Config.NumROBEntries) {}
 
 ReorderBuffer::~ReorderBuffer() {}
 
 void ReorderBuffer::Init() {
   Entries_.Reset();
+  ReadyToExecuteEntries_.reset();
   IssuePolicy_->Reset();
+  if (LoadStoreQueue_) {
+    LoadStoreQueue_->Reset();
+  }
   InFlightRegisterDefs_.clear();
+  PendingForwarding_ = llvm::None;
+  PendingForwardingUopIndex_ = 0;
+}
+
+void ReorderBuffer::SaveState(StateWriter* Writer) const {
+  Entries_.SaveState(Writer);
+  Writer->Write(ReadyToExecuteEntries_);
+  Writer->Write<uint64_t>(InFlightRegisterDefs_.size());
+  for (const auto& RegAndEntryIndex : InFlightRegisterDefs_) {
+    Writer->Write(RegAndEntryIndex.first);
+    Writer->Write(RegAndEntryIndex.second);
+  }
+  IssuePolicy_->SaveState(Writer);
+  if (LoadStoreQueue_) {
+    LoadStoreQueue_->SaveState(Writer);
+    Writer->Write(PendingForwarding_.hasValue());
+    if (PendingForwarding_) {
+      Writer->Write(PendingForwarding_->StoreROBEntryIndex);
+      Writer->Write(PendingForwardingUopIndex_);
+    }
+  }
+}
+
+void ReorderBuffer::RestoreState(StateReader* Reader) {
+  Entries_.RestoreState(Reader);
+  Reader->Read(&ReadyToExecuteEntries_);
+  const uint64_t NumInFlightRegisterDefs = Reader->Read<uint64_t>();
+  for (uint64_t I = 0; I < NumInFlightRegisterDefs; ++I) {
+    const size_t Reg = Reader->Read<size_t>();
+    InFlightRegisterDefs_[Reg] = Reader->Read<size_t>();
+  }
+  IssuePolicy_->RestoreState(Reader);
+  if (LoadStoreQueue_) {
+    LoadStoreQueue_->RestoreState(Reader);
+    PendingForwarding_ = llvm::None;
+    if (Reader->Read<bool>()) {
+      PendingForwarding_ =
+          LoadStoreQueue::Forwarding{Reader->Read<size_t>()};
+      Reader->Read(&PendingForwardingUopIndex_);
+    }
+  }
 }
 
 void ReorderBuffer::Tick(const BlockContext* BlockContext) {
   // Free entries for the uops that were retired by the Reservation Station
   // during the previous cycle. This cannot stall and happens before all other
   // stages.
-  DeleteRetiredUops();
+  DeleteRetiredUops(BlockContext);
 
   // Read uops from the source. This can only add new entries.
   ReadNewUops(BlockContext);
@@ -183,25 +278,40 @@ void ReorderBuffer::SendUopsForRetirement() {
 }
 
 void ReorderBuffer::SendUopsForExecution() {
-  for (auto& Entry : Entries_) {
-    if (Entry.State == ROBEntry::StateE::kReadyToExecute) {
-      auto OrderedPorts = Entry.PossiblePorts;
-      if (OrderedPorts.empty()) {
-        // The uop does not use an execution unit.
-        Entry.State = ROBEntry::StateE::kReadyToRetire;
-        UpdateDependentEntries(Entry);
-      } else {
-        // Try pushing on the best possible ports until one is available.
-        IssuePolicy_->ComputeBestOrder(OrderedPorts);
-        for (const size_t Port : OrderedPorts) {
-          if (PortSinks_[Port]->Push(Entry.ROBUop)) {
-            IssuePolicy_->SignalIssued(Port);
-            const bool IssuedPush = IssuedSink_->Push(Entry.ROBUop);
-            assert(IssuedPush);
-            (void)IssuedPush;
-            Entry.State = ROBEntry::StateE::kIssued;
-            break;
-          }
+  // Entries are considered from the oldest to the youngest, i.e. in circular
+  // order starting from the oldest entry.
+  const size_t Oldest = Entries_.GetOldestEntryIndex();
+  SendUopsForExecution(Oldest, Entries_.Size());
+  SendUopsForExecution(0, Oldest);
+}
+
+void ReorderBuffer::SendUopsForExecution(const size_t Begin, const size_t End) {
+  // Note that entries can become ready during the scan when a uop that does
+  // not use an execution unit wakes up its dependents. Dependents are always
+  // younger, so they are picked up later in the scan.
+  for (int Index = ReadyToExecuteEntries_.find_first_in(Begin, End);
+       Index != -1;
+       Index = ReadyToExecuteEntries_.find_first_in(Index + 1, End)) {
+    auto& Entry = Entries_[Index];
+    assert(Entry.State == ROBEntry::StateE::kReadyToExecute);
+    auto OrderedPorts = Entry.PossiblePorts;
+    if (OrderedPorts.empty()) {
+      // The uop does not use an execution unit.
+      ReadyToExecuteEntries_.reset(Index);
+      Entry.State = ROBEntry::StateE::kReadyToRetire;
+      UpdateDependentEntries(Entry);
+    } else {
+      // Try pushing on the best possible ports until one is available.
+      IssuePolicy_->ComputeBestOrder(OrderedPorts);
+      for (const size_t Port : OrderedPorts) {
+        if (PortSinks_[Port]->Push(Entry.ROBUop)) {
+          IssuePolicy_->SignalIssued(Port);
+          const bool IssuedPush = IssuedSink_->Push(Entry.ROBUop);
+          assert(IssuedPush);
+          (void)IssuedPush;
+          ReadyToExecuteEntries_.reset(Index);
+          Entry.State = ROBEntry::StateE::kIssued;
+          break;
         }
       }
     }
@@ -230,20 +340,26 @@ void ReorderBuffer::UpdateWrittenBackUops() {
 
 // Update the state of dependent uops.
 void ReorderBuffer::UpdateDependentEntries(const ROBEntry& Entry) {
-  for (const size_t DepIndex : Entry.DependentEntries) {
+  const size_t Index = Entry.ROBUop.ROBEntryIndex;
+  for (const unsigned DepIndex : Entry.DependentEntries.set_bits()) {
     auto& Dep = Entries_[DepIndex];
     assert(Dep.State == ROBEntry::StateE::kWaitingForInputs);
-    assert(Dep.UnsatisfiedDependencies.count(Entry.ROBUop.ROBEntryIndex));
+    assert(Dep.UnsatisfiedDependencies.test(Index));
     // Mark this dep as satisfied.
-    Dep.UnsatisfiedDependencies.erase(Entry.ROBUop.ROBEntryIndex);
+    Dep.UnsatisfiedDependencies.reset(Index);
     // If there are no remaining deps, the entry becomes ready for execution.
-    if (Dep.UnsatisfiedDependencies.empty()) {
-      Dep.State = ROBEntry::StateE::kReadyToExecute;
+    if (Dep.UnsatisfiedDependencies.none()) {
+      SetReadyToExecute(&Dep);
     }
   }
 }
 
-void ReorderBuffer::DeleteRetiredUops() {
+void ReorderBuffer::SetReadyToExecute(ROBEntry* const Entry) {
+  Entry->State = ROBEntry::StateE::kReadyToExecute;
+  ReadyToExecuteEntries_.set(Entry->ROBUop.ROBEntryIndex);
+}
+
+void ReorderBuffer::DeleteRetiredUops(const BlockContext* BlockContext) {
   while (const ROBUopId::Type* Retired = RetiredSource_->Peek()) {
     Entries_[Retired->ROBEntryIndex].State = ROBEntry::StateE::kRetired;
     // When uops retire, the register defs are removed from the "in flight" list
@@ -252,6 +368,20 @@ void ReorderBuffer::DeleteRetiredUops() {
     for (const size_t Def : Entries_[Retired->ROBEntryIndex].Defs) {
       InFlightRegisterDefs_.erase(Def);
     }
+    // Memory accesses leave the load/store queue when the instruction retires.
+    if (LoadStoreQueue_ &&
+        IsLastUopOfInstruction(BlockContext, Retired->Uop) &&
+        LoadStoreQueue_->AccessesMemory(BlockContext->GetInstruction(
+            Retired->Uop.InstrIndex.BBIndex))) {
+      LoadStoreQueue_->Release();
+    }
+    // A load whose uop that reads memory has not entered the ROB yet cannot
+    // forward from a store that retired: the data is in the cache, and the
+    // entry of the store may be reused by the uops of the load.
+    if (PendingForwarding_ &&
+        PendingForwarding_->StoreROBEntryIndex == Retired->ROBEntryIndex) {
+      PendingForwarding_ = llvm::None;
+    }
     // Release the entry.
     Entries_.ReleaseOldestEntry();
     RetiredSource_->Pop();
@@ -260,20 +390,47 @@ void ReorderBuffer::DeleteRetiredUops() {
 
 void ReorderBuffer::ReadNewUops(const BlockContext* BlockContext) {
   while (const RenamedUopId::Type* Uop = UopSource_->Peek()) {
-    ROBEntry* Entry = Entries_.ReserveEntry();
-    if (!Entry) {
+    if (Entries_.IsFull()) {
       return;  // No more free entries.
     }
+    // Instructions get their load/store queue entries with their first uop.
+    // Forwarding applies to the uop that reads memory.
+    const llvm::MCInst& Inst =
+        BlockContext->GetInstruction(Uop->Uop.InstrIndex.BBIndex);
+    if (LoadStoreQueue_ && Uop->Uop.UopIndex == 0) {
+      llvm::Optional<LoadStoreQueue::Forwarding> Forwarding;
+      if (!LoadStoreQueue_->Allocate(Inst, &Forwarding)) {
+        return;  // No more free load or store buffer entries.
+      }
+      PendingForwarding_ = Forwarding;
+      if (Forwarding) {
+        PendingForwardingUopIndex_ = LoadStoreQueue_->GetLoadUopIndex(
+            BlockContext
+                ->GetLoweredInstruction(Context, Uop->Uop.InstrIndex.BBIndex)
+                .Uops);
+      }
+    }
+    ROBEntry* Entry = Entries_.ReserveEntry();
+    assert(Entry);
     Entry->State = ROBEntry::StateE::kWaitingForInputs;
     Entry->ROBUop.Uop = Uop->Uop;
     Entry->Defs = Uop->Defs;
     SetPossiblePortsAndLatencies(BlockContext, Entry);
     SetInputDependencies(BlockContext, Uop->Uses, Entry);
+    if (PendingForwarding_ &&
+        Uop->Uop.UopIndex == PendingForwardingUopIndex_) {
+      SetStoreForwarding(*PendingForwarding_, Entry);
+      PendingForwarding_ = llvm::None;
+    }
+    if (LoadStoreQueue_ && IsLastUopOfInstruction(BlockContext, Uop->Uop) &&
+        Context.InstrInfo->get(Inst.getOpcode()).mayStore()) {
+      LoadStoreQueue_->SetStoreEntry(Entry->ROBUop.ROBEntryIndex);
+    }
     for (const size_t Def : Uop->Defs) {
       InFlightRegisterDefs_.emplace(Def, Entry->ROBUop.ROBEntryIndex);
     }
-    if (Entry->UnsatisfiedDependencies.empty()) {
-      Entry->State = ROBEntry::StateE::kReadyToExecute;
+    if (Entry->UnsatisfiedDependencies.none()) {
+      SetReadyToExecute(Entry);
     }
     UopSource_->Pop();
   }
@@ -282,10 +439,9 @@ void ReorderBuffer::ReadNewUops(const BlockContext* BlockContext) {
 void ReorderBuffer::SetPossiblePortsAndLatencies(
     const BlockContext* BlockContext, ROBEntry* const Entry) const {
   const auto InstrIndex = Entry->ROBUop.Uop.InstrIndex;
-  const auto& Uop = Context
-                        .GetInstructionDecomposition(
-                            BlockContext->GetInstruction(InstrIndex.BBIndex))
-                        .Uops[Entry->ROBUop.Uop.UopIndex];
+  const auto& Uop =
+      BlockContext->GetLoweredInstruction(Context, InstrIndex.BBIndex)
+          .Uops[Entry->ROBUop.Uop.UopIndex];
 
   Entry->ROBUop.Latency = Uop.GetLatency();
   if (Uop.ProcResIdx == 0) {
@@ -332,16 +488,10 @@ void ReorderBuffer::SetInputDependencies(const BlockContext* BlockContext,
     }
     // Case 3: The register will be modified by a µop that is not yet done
     // executing, we need to create a dependency. It's possible that a µop
-    // modifies more than one register we depend on; when this happens, we add
-    // only one dependency. Otherwise, removing the µop index from
-    // DependentEntries and setting its state to kReadyToExecute would result in
-    // DependentEntries unexpectedly containing an index of a kReadyToExecute
-    // µop.
-    const size_t DeferEntryROBIndex = DeferEntry.ROBUop.ROBEntryIndex;
-    if (Entry->UnsatisfiedDependencies.count(DeferEntryROBIndex) == 0) {
-      Entry->UnsatisfiedDependencies.insert(DeferEntryROBIndex);
-      DeferEntry.DependentEntries.push_back(Entry->ROBUop.ROBEntryIndex);
-    }
+    // modifies more than one register we depend on; since dependencies are
+    // bitsets, this still results in a single dependency.
+    Entry->UnsatisfiedDependencies.set(DeferEntry.ROBUop.ROBEntryIndex);
+    DeferEntry.DependentEntries.set(Entry->ROBUop.ROBEntryIndex);
   }
   // TODO(courbet): Better model intra-instruction uop dependencies. Right now
   // we assume that each uop depends on the previous one.
@@ -353,12 +503,37 @@ void ReorderBuffer::SetInputDependencies(const BlockContext* BlockContext,
     if (!(PrevEntry.State == ROBEntry::StateE::kOutputsAvailableNextCycle ||
           PrevEntry.State == ROBEntry::StateE::kReadyToRetire ||
           PrevEntry.State == ROBEntry::StateE::kSentForRetirement)) {
-      Entry->UnsatisfiedDependencies.insert(PrevEntry.ROBUop.ROBEntryIndex);
-      PrevEntry.DependentEntries.push_back(Entry->ROBUop.ROBEntryIndex);
+      Entry->UnsatisfiedDependencies.set(PrevEntry.ROBUop.ROBEntryIndex);
+      PrevEntry.DependentEntries.set(Entry->ROBUop.ROBEntryIndex);
     }
   }
 }
 
+void ReorderBuffer::SetStoreForwarding(
+    const LoadStoreQueue::Forwarding& Forwarding, ROBEntry* const Entry) {
+  ROBEntry& StoreEntry = Entries_[Forwarding.StoreROBEntryIndex];
+  // Forwardings from retired stores are dropped in `DeleteRetiredUops()`.
+  assert(StoreEntry.State != ROBEntry::StateE::kEmpty &&
+         StoreEntry.State != ROBEntry::StateE::kRetired);
+  assert(StoreEntry.ROBUop.ROBEntryIndex != Entry->ROBUop.ROBEntryIndex);
+  // The data is read from the store buffer instead of the cache.
+  Entry->ROBUop.Latency = LoadStoreQueue_->GetConfig().StoreForwardingLatency;
+  // Only add the dependency if the store is not already done executing.
+  if (!(StoreEntry.State == ROBEntry::StateE::kOutputsAvailableNextCycle ||
+        StoreEntry.State == ROBEntry::StateE::kReadyToRetire ||
+        StoreEntry.State == ROBEntry::StateE::kSentForRetirement)) {
+    Entry->UnsatisfiedDependencies.set(StoreEntry.ROBUop.ROBEntryIndex);
+    StoreEntry.DependentEntries.set(Entry->ROBUop.ROBEntryIndex);
+  }
+}
+
+bool ReorderBuffer::IsLastUopOfInstruction(const BlockContext* BlockContext,
+                                           const UopId::Type& Uop) const {
+  return Uop.UopIndex + 1 ==
+         BlockContext->GetLoweredInstruction(Context, Uop.InstrIndex.BBIndex)
+             .Uops.size();
+}
+
 template <typename BufferT, typename ElemT>
 ReorderBuffer::Buffer::IteratorBase<BufferT, ElemT>::IteratorBase(
     BufferT* Container, size_t Index)
@@ -448,7 +623,7 @@ void ReorderBuffer::ROBEntry::DebugPrint(llvm::raw_ostream& OS) const {
        << ", BBIndex:" << ROBUop.Uop.InstrIndex.BBIndex
        << ", UopIndex:" << ROBUop.Uop.UopIndex << "}\n";
     OS << "  DependentEntries:";
-    for (const auto Dep : DependentEntries) {
+    for (const auto Dep : DependentEntries.set_bits()) {
       OS << " " << Dep;
     }
     OS << "\n";
@@ -456,7 +631,7 @@ void ReorderBuffer::ROBEntry::DebugPrint(llvm::raw_ostream& OS) const {
   switch (State) {
     case StateE::kWaitingForInputs:
       OS << "  UnsatisfiedDeps:";
-      for (const auto Dep : UnsatisfiedDependencies) {
+      for (const auto Dep : UnsatisfiedDependencies.set_bits()) {
         OS << " " << Dep;
       }
       OS << "\n";
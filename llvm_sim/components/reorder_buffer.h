@@ -16,11 +16,11 @@
 #ifndef EXEGESIS_LLVM_SIM_COMPONENTS_REORDER_BUFFER_H_
 #define EXEGESIS_LLVM_SIM_COMPONENTS_REORDER_BUFFER_H_
 
-#include <set>
-
 #include "absl/container/flat_hash_map.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm_sim/components/common.h"
 #include "llvm_sim/components/issue_policy.h"
+#include "llvm_sim/components/load_store_queue.h"
 #include "llvm_sim/framework/component.h"
 
 namespace exegesis {
@@ -39,6 +39,7 @@ struct ROBUopId {
   static const InstructionIndex::Type& GetInstructionIndex(const Type& Elem) {
     return Elem.Uop.InstrIndex;
   }
+  static const UopId::Type& GetUopId(const Type& Elem) { return Elem.Uop; }
 };
 
 class ReorderBuffer : public Component {
@@ -55,12 +56,15 @@ class ReorderBuffer : public Component {
                 Source<ROBUopId>* RetiredSource, Sink<ROBUopId>* IssuedSink,
                 std::vector<Sink<ROBUopId>*> PortSinks,
                 Sink<ROBUopId>* RetirementSink,
-                std::unique_ptr<IssuePolicy> IssuePolicy);
+                std::unique_ptr<IssuePolicy> IssuePolicy,
+                std::unique_ptr<LoadStoreQueue> LoadStoreQueue = nullptr);
 
   ~ReorderBuffer() override;
 
   void Init() override;
   void Tick(const BlockContext* BlockContext) override;
+  void SaveState(StateWriter* Writer) const override;
+  void RestoreState(StateReader* Reader) override;
 
   // Prints the state of the ROB.
   std::string DebugString() const;
@@ -89,6 +93,10 @@ class ReorderBuffer : public Component {
 
     void Clear();
     void DebugPrint(llvm::raw_ostream& OS) const;
+    // Only non-empty entries carry state. RestoreState() expects a cleared
+    // entry.
+    void SaveState(StateWriter* Writer) const;
+    void RestoreState(StateReader* Reader);
 
     StateE State = StateE::kEmpty;
     ROBUopId::Type ROBUop;
@@ -96,13 +104,13 @@ class ReorderBuffer : public Component {
     llvm::SmallVector<size_t, 8> Defs;
     // The list of PortSinks indices on which the Uop can schedule.
     llvm::SmallVector<size_t, 8> PossiblePorts;
-    // The ROB entry indices on which this entry depends. The entry can be
-    // dispatched only when these are done executing. Note that this does not
-    // include uops that have already retired (the data for these has already
-    // been written back to the register file).
-    std::set<size_t> UnsatisfiedDependencies;
-    // The ROB entries that depend on this entry.
-    llvm::SmallVector<size_t, 8> DependentEntries;
+    // The ROB entry indices on which this entry depends, as a bitset indexed
+    // by ROB entry index. The entry can be dispatched only when these are done
+    // executing. Note that this does not include uops that have already retired
+    // (the data for these has already been written back to the register file).
+    llvm::BitVector UnsatisfiedDependencies;
+    // The ROB entries that depend on this entry, indexed by ROB entry index.
+    llvm::BitVector DependentEntries;
   };
 
   // Read uops from the source and populate entries until we stall on any
@@ -115,14 +123,22 @@ class ReorderBuffer : public Component {
   void UpdateWrittenBackUops();
   // Update the state of the entries that depend on `Entry`.
   void UpdateDependentEntries(const ROBEntry& Entry);
+  // Sets the state of `Entry` to kReadyToExecute.
+  void SetReadyToExecute(ROBEntry* Entry);
   // Delete entries corresponding to fully retired uops.
-  void DeleteRetiredUops();
+  void DeleteRetiredUops(const BlockContext* BlockContext);
+  // Returns true if `Uop` is the last uop of its instruction.
+  bool IsLastUopOfInstruction(const BlockContext* BlockContext,
+                              const UopId::Type& Uop) const;
 
   // Sends uops for retirement. Note that entries stay in the ROB until they are
   // fully retired (i.e. they appear in RetiredSource_).
   void SendUopsForRetirement();
   // Sends uops to issue ports for execution. Entries stay in the ROB.
   void SendUopsForExecution();
+  // Tries to send the kReadyToExecute entries in [Begin, End) for execution,
+  // in order.
+  void SendUopsForExecution(size_t Begin, size_t End);
 
   // Determines which ports the uop can be issued to.
   void SetPossiblePortsAndLatencies(const BlockContext* BlockContext,
@@ -130,6 +146,9 @@ class ReorderBuffer : public Component {
   // Computes the input dependencies of the entry.
   void SetInputDependencies(const BlockContext* BlockContext,
                             llvm::ArrayRef<size_t> Uses, ROBEntry* const Entry);
+  // Makes the entry of a load depend on the store it gets its data from.
+  void SetStoreForwarding(const LoadStoreQueue::Forwarding& Forwarding,
+                          ROBEntry* const Entry);
 
   const Config Config_;
 
@@ -160,7 +179,8 @@ class ReorderBuffer : public Component {
 
   // The sinks to dispatch uops to issue ports: one sink per port
   // (a.k.a ProcResource in the scheduling model), indexed by
-  // `ProcResourceIdx - 1`.
+  // `ProcResourceIdx - 1`. Uops are only dispatched to unit resources, so the
+  // sinks of ProcResGroups can be null.
   const std::vector<Sink<ROBUopId>*> PortSinks_;
   // The sink to send uops for retirement.
   Sink<ROBUopId>* const RetirementSink_;
@@ -168,6 +188,10 @@ class ReorderBuffer : public Component {
   // The policy for issuing uops to ports.
   const std::unique_ptr<IssuePolicy> IssuePolicy_;
 
+  // The load and store buffers, or nullptr if memory accesses are not
+  // modeled.
+  const std::unique_ptr<LoadStoreQueue> LoadStoreQueue_;
+
   // The buffer. Note that because retirement happens in order, and entries
   // remain in the ROB until they are fully retired, this is a circular buffer.
   class Buffer {
@@ -176,6 +200,11 @@ class ReorderBuffer : public Component {
 
     void Reset();
     size_t Size() const { return Entries_.size(); }
+    bool IsFull() const { return NumEmptyEntries_ == 0; }
+
+    // RestoreState() expects a buffer that was just Reset().
+    void SaveState(StateWriter* Writer) const;
+    void RestoreState(StateReader* Reader);
 
     // Subscript operators accept indices from `-1` to `Size()` so as to accept
     // previous and next element:
@@ -238,9 +267,21 @@ class ReorderBuffer : public Component {
   };
   Buffer Entries_;
 
+  // The set of kReadyToExecute entries, indexed by ROB entry index. This
+  // allows SendUopsForExecution() to skip the entries that are waiting for
+  // their inputs or that have already been issued.
+  llvm::BitVector ReadyToExecuteEntries_;
+
   // A map of microarchitectural register to the last live (not retired) entry
   // index that defs it.
   absl::flat_hash_map<size_t, size_t> InFlightRegisterDefs_;
+
+  // The forwarding of the instruction whose uops are entering the ROB. It is
+  // found when the first uop of the instruction allocates its load/store queue
+  // entries, and applies to the uop that reads memory, which may come later.
+  // It is dropped if the store retires in between.
+  llvm::Optional<LoadStoreQueue::Forwarding> PendingForwarding_;
+  size_t PendingForwardingUopIndex_ = 0;
 };
 
 }  // namespace simulator
@@ -16,7 +16,10 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/Support/TargetSelect.h"
 #include "llvm_sim/components/common.h"
+#include "llvm_sim/components/load_store_queue.h"
 #include "llvm_sim/components/testing.h"
 #include "llvm_sim/framework/context.h"
 
@@ -131,7 +134,7 @@ class ReorderBufferTest : public ::testing::Test {
 
   static constexpr const int kTestNumROBEntries = 5;
 
-  std::array<llvm::MCInstrDesc, 5> InstrDesc_;
+  std::array<llvm::MCInstrDesc, 6> InstrDesc_ = {};
   std::array<llvm::MCProcResourceDesc, 3> ProcResources_;
   llvm::MCSchedModel SchedModel_;
   std::vector<llvm::MCInst> Instructions_;
@@ -520,6 +523,48 @@ TEST_F(ReorderBufferTest, OldestFirst) {
   EXPECT_THAT(Port0Sink_.Buffer_, ElementsAre(HasROBEntryIndex(1)));
 }
 
+// Tests that dependencies are tracked correctly when a uop depends on a uop in
+// a later ROB entry after the circular buffer wraps around.
+TEST_F(ReorderBufferTest, DependencyAcrossWrapAround) {
+  ReorderBuffer::Config Config;
+  Config.NumROBEntries = 2;
+  const auto ROB = absl::make_unique<ReorderBuffer>(
+      &Context_, Config, &UopSource_, &AvailableDepsSource_, &WritebackSource_,
+      &RetiredSource_, &IssuedSink_,
+      std::vector<Sink<ROBUopId>*>{&Port0Sink_, &Port1Sink_}, &RetirementSink_,
+      IssuePolicy::Greedy());
+
+  llvm::MCInst Inst;
+  Inst.setOpcode(1);
+  Instructions_ = {Inst, Inst, Inst};
+  const BlockContext BlockContext(Instructions_, false);
+  ROB->Init();
+
+  const auto Uop0 = RenamedUopIdBuilder().WithUop(0, 0).Build();
+  const auto Uop1 = RenamedUopIdBuilder().WithUop(1, 0).AddDef(42).Build();
+  const auto Uop2 = RenamedUopIdBuilder().WithUop(2, 0).AddUse(42).Build();
+  UopSource_.Buffer_ = {Uop0, Uop1, Uop2};
+  ROB->Tick(&BlockContext);
+  ASSERT_THAT(Port0Sink_.Buffer_, ElementsAre(HasROBEntryIndex(0)));
+
+  // Fully execute and retire Uop0.
+  AvailableDepsSource_.Buffer_ = {Port0Sink_.Buffer_[0]};
+  WritebackSource_.Buffer_ = {Port0Sink_.Buffer_[0]};
+  ROB->Tick(&BlockContext);
+  RetiredSource_.Buffer_ = {Port0Sink_.Buffer_[0]};
+  Port0Sink_.Buffer_.clear();
+
+  // Uop2 goes to entry 0 and depends on Uop1 in entry 1, which gets issued.
+  ROB->Tick(&BlockContext);
+  ASSERT_THAT(Port0Sink_.Buffer_, ElementsAre(HasROBEntryIndex(1)));
+  AvailableDepsSource_.Buffer_ = {Port0Sink_.Buffer_[0]};
+  Port0Sink_.Buffer_.clear();
+
+  // Uop1 outputs are available next cycle, Uop2 can be issued.
+  ROB->Tick(&BlockContext);
+  EXPECT_THAT(Port0Sink_.Buffer_, ElementsAre(EqROBUopId(0, Uop2.Uop)));
+}
+
 // Tests that the ROB can deal with a uop depending on another uop through more
 // than one register.
 TEST_F(ReorderBufferTest, MultipleDependencies) {
@@ -548,6 +593,155 @@ TEST_F(ReorderBufferTest, MultipleDependencies) {
               ElementsAre(HasROBEntryIndex(0), HasROBEntryIndex(1)));
 }
 
+// Tests the ROB with a load/store queue, on real x86 instructions.
+class ReorderBufferLoadStoreQueueTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    LLVMInitializeX86Target();
+    LLVMInitializeX86TargetInfo();
+    LLVMInitializeX86TargetMC();
+    Context_ = GlobalContext::Create("x86_64", "haswell");
+  }
+
+  static void TearDownTestSuite() { Context_.reset(); }
+
+  static unsigned Opcode(llvm::StringRef Name) {
+    for (unsigned I = 0; I < Context_->InstrInfo->getNumOpcodes(); ++I) {
+      if (Context_->InstrInfo->getName(I) == Name) {
+        return I;
+      }
+    }
+    ADD_FAILURE() << "unknown opcode " << Name.str();
+    return 0;
+  }
+
+  static unsigned Reg(llvm::StringRef Name) {
+    for (unsigned I = 0; I < Context_->RegisterInfo->getNumRegs(); ++I) {
+      if (Context_->RegisterInfo->getName(I) == Name) {
+        return I;
+      }
+    }
+    ADD_FAILURE() << "unknown register " << Name.str();
+    return 0;
+  }
+
+  static unsigned ProcResIdx(llvm::StringRef Name) {
+    const auto& SchedModel = *Context_->SchedModel;
+    for (unsigned I = 1; I < SchedModel.getNumProcResourceKinds(); ++I) {
+      if (Name == SchedModel.getProcResource(I)->Name) {
+        return I;
+      }
+    }
+    ADD_FAILURE() << "unknown proc resource " << Name.str();
+    return 0;
+  }
+
+  static std::unique_ptr<const GlobalContext> Context_;
+};
+
+std::unique_ptr<const GlobalContext> ReorderBufferLoadStoreQueueTest::Context_;
+
+// Tests that a load does not forward from a store that retires while the ROB
+// is stalled between the first uop of the load and the uop that reads memory.
+// The entry of the store is then reused by the uop that reads memory, which
+// must not depend on itself.
+TEST_F(ReorderBufferLoadStoreQueueTest, StoreRetiresDuringLoadStall) {
+  const unsigned RSI = Reg("RSI");
+  const unsigned EAX = Reg("EAX");
+  const unsigned P0 = ProcResIdx("HWPort0");
+  const unsigned P2 = ProcResIdx("HWPort2");
+  // mov dword ptr [rsi], eax
+  const llvm::MCInst Store = llvm::MCInstBuilder(Opcode("MOV32mr"))
+                                 .addReg(RSI)
+                                 .addImm(1)
+                                 .addReg(0)
+                                 .addImm(0)
+                                 .addReg(0)
+                                 .addReg(EAX);
+  // add eax, dword ptr [rsi]
+  const llvm::MCInst AddLoad = llvm::MCInstBuilder(Opcode("ADD32rm"))
+                                   .addReg(EAX)
+                                   .addReg(EAX)
+                                   .addReg(RSI)
+                                   .addImm(1)
+                                   .addReg(0)
+                                   .addImm(0)
+                                   .addReg(0);
+  {
+    // 1 cycle on P0.
+    auto Decomposition = absl::make_unique<InstrUopDecomposition>();
+    Decomposition->Uops.resize(1);
+    Decomposition->Uops[0].ProcResIdx = P0;
+    Decomposition->Uops[0].StartCycle = 0;
+    Decomposition->Uops[0].EndCycle = 1;
+    Context_->SetInstructionDecomposition(Store, std::move(Decomposition));
+  }
+  {
+    // 1 cycle on P0, then a load on P2 with latency 4.
+    auto Decomposition = absl::make_unique<InstrUopDecomposition>();
+    Decomposition->Uops.resize(2);
+    Decomposition->Uops[0].ProcResIdx = P0;
+    Decomposition->Uops[0].StartCycle = 0;
+    Decomposition->Uops[0].EndCycle = 1;
+    Decomposition->Uops[1].ProcResIdx = P2;
+    Decomposition->Uops[1].StartCycle = 0;
+    Decomposition->Uops[1].EndCycle = 4;
+    Context_->SetInstructionDecomposition(AddLoad, std::move(Decomposition));
+  }
+
+  TestSource<RenamedUopId> UopSource;
+  TestSource<ROBUopId> AvailableDepsSource;
+  TestSource<ROBUopId> WritebackSource;
+  TestSource<ROBUopId> RetiredSource;
+  TestSink<ROBUopId> IssuedSink;
+  TestSink<ROBUopId> RetirementSink;
+  std::vector<TestSink<ROBUopId>> PortSinks(
+      Context_->SchedModel->getNumProcResourceKinds());
+  std::vector<Sink<ROBUopId>*> PortSinkPtrs;
+  for (auto& PortSink : PortSinks) {
+    PortSink.SetInfiniteCapacity();
+    PortSinkPtrs.push_back(&PortSink);
+  }
+  ReorderBuffer::Config Config;
+  Config.NumROBEntries = 2;
+  ReorderBuffer ROB(Context_.get(), Config, &UopSource, &AvailableDepsSource,
+                    &WritebackSource, &RetiredSource, &IssuedSink,
+                    std::move(PortSinkPtrs), &RetirementSink,
+                    IssuePolicy::Greedy(),
+                    absl::make_unique<LoadStoreQueue>(
+                        Context_.get(), LoadStoreQueue::Config{4, 4, 5, {P2}}));
+  const std::vector<llvm::MCInst> Instructions = {Store, AddLoad};
+  const BlockContext BlockContext(Instructions, false);
+  ROB.Init();
+
+  // The store and the first uop of the load fill the ROB. The load forwards
+  // from the store.
+  UopSource.Buffer_ = {RenamedUopIdBuilder().WithUop(0, 0).Build(),
+                       RenamedUopIdBuilder().WithUop(1, 0).Build(),
+                       RenamedUopIdBuilder().WithUop(1, 1).Build()};
+  ROB.Tick(&BlockContext);
+  EXPECT_THAT(UopSource.Buffer_,
+              ElementsAre(Field(&RenamedUopId::Type::Uop, EqUopId(0, 1, 1))));
+  ASSERT_THAT(IssuedSink.Buffer_,
+              ElementsAre(HasROBEntryIndex(0), HasROBEntryIndex(1)));
+
+  // Both uops are done executing.
+  AvailableDepsSource.Buffer_ = {IssuedSink.Buffer_[0], IssuedSink.Buffer_[1]};
+  WritebackSource.Buffer_ = {IssuedSink.Buffer_[0], IssuedSink.Buffer_[1]};
+  ROB.Tick(&BlockContext);
+  EXPECT_THAT(RetirementSink.Buffer_,
+              ElementsAre(HasROBEntryIndex(0), HasROBEntryIndex(1)));
+
+  // The store retires, and the uop that reads memory gets its entry. It reads
+  // from the cache, and executes right away.
+  RetiredSource.Buffer_ = {IssuedSink.Buffer_[0]};
+  ROB.Tick(&BlockContext);
+  EXPECT_THAT(UopSource.Buffer_, ElementsAre());
+  EXPECT_THAT(PortSinks[P2 - 1].Buffer_,
+              ElementsAre(AllOf(HasROBEntryIndex(0),
+                                Field(&ROBUopId::Type::Latency, Eq(4)))));
+}
+
 }  // namespace
 }  // namespace simulator
 }  // namespace exegesis
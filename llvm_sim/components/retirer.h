@@ -57,9 +57,10 @@ class Retirer : public Component {
         return;
       }
       const auto Uop = GetOpId_(*Elem);
-      const auto& Decomposition = Context.GetInstructionDecomposition(
-          BlockContext->GetInstruction(Uop.InstrIndex.BBIndex));
-      if (Uop.UopIndex + 1 == Decomposition.Uops.size()) {
+      const auto NumUops =
+          BlockContext->GetLoweredInstruction(Context, Uop.InstrIndex.BBIndex)
+              .Uops.size();
+      if (Uop.UopIndex + 1 == NumUops) {
         // This is the last uop in the instruction.
         const bool Pushed = RetiredInstructionsSink_->Push(Uop.InstrIndex);
         assert(Pushed);
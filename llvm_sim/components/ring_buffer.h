@@ -0,0 +1,136 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A contiguous ring buffer used as the queue of buffers. Compared to a
+// std::deque, it never allocates in steady state: storage is allocated upfront
+// and slots are reused.
+
+#ifndef EXEGESIS_LLVM_SIM_COMPONENTS_RING_BUFFER_H_
+#define EXEGESIS_LLVM_SIM_COMPONENTS_RING_BUFFER_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "llvm/Support/MathExtras.h"
+
+namespace exegesis {
+namespace simulator {
+
+// A queue of elements of type `T`. Elements enter at the front and exit at the
+// back, and iteration goes from front to back. This is the subset of the
+// std::deque interface that buffers use.
+// `T` must be default-constructible and copy-assignable. Popped elements are
+// not destroyed, their slot is overwritten by a subsequent push, which allows
+// reusing the memory of elements such as llvm::SmallVector.
+template <typename T>
+class RingBuffer {
+ public:
+  // Buffers with a larger capacity (e.g. infinite capacity) start with this
+  // many slots and grow on demand.
+  static constexpr size_t kMaxPreallocatedCapacity = 256;
+
+  // Preallocates storage for `Capacity` elements.
+  explicit RingBuffer(size_t Capacity)
+      : Slots_(llvm::PowerOf2Ceil(std::max<size_t>(
+            1, std::min(Capacity, kMaxPreallocatedCapacity)))) {}
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator(const RingBuffer* Buffer, size_t Index)
+        : Buffer_(Buffer), Index_(Index) {}
+    const T& operator*() const { return (*Buffer_)[Index_]; }
+    const T* operator->() const { return &(*Buffer_)[Index_]; }
+    const_iterator& operator++() {
+      ++Index_;
+      return *this;
+    }
+    bool operator==(const const_iterator& Other) const {
+      return Index_ == Other.Index_;
+    }
+    bool operator!=(const const_iterator& Other) const {
+      return Index_ != Other.Index_;
+    }
+
+   private:
+    const RingBuffer* Buffer_;
+    size_t Index_;
+  };
+
+  bool empty() const { return Size_ == 0; }
+  size_t size() const { return Size_; }
+  void clear() { Size_ = 0; }
+
+  // Returns the `I`-th element, starting from the front.
+  const T& operator[](size_t I) const {
+    assert(I < Size_);
+    return Slots_[(Front_ + I) & GetMask()];
+  }
+
+  const T& front() const { return (*this)[0]; }
+  const T& back() const { return (*this)[Size_ - 1]; }
+  T& back() {
+    assert(Size_ > 0);
+    return Slots_[(Front_ + Size_ - 1) & GetMask()];
+  }
+
+  void push_front(const T& Elem) {
+    if (Size_ == Slots_.size()) {
+      Grow();
+    }
+    Front_ = (Front_ - 1) & GetMask();
+    Slots_[Front_] = Elem;
+    ++Size_;
+  }
+
+  void pop_back() {
+    assert(Size_ > 0);
+    --Size_;
+  }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, Size_); }
+
+ private:
+  size_t GetMask() const { return Slots_.size() - 1; }
+
+  // Doubles the number of slots.
+  void Grow() {
+    std::vector<T> Slots(2 * Slots_.size());
+    for (size_t I = 0; I < Size_; ++I) {
+      Slots[I] = std::move(Slots_[(Front_ + I) & GetMask()]);
+    }
+    Slots_ = std::move(Slots);
+    Front_ = 0;
+  }
+
+  // The number of slots is always a power of two.
+  std::vector<T> Slots_;
+  // The slot of the front element.
+  size_t Front_ = 0;
+  size_t Size_ = 0;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_COMPONENTS_RING_BUFFER_H_
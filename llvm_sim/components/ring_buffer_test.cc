@@ -0,0 +1,95 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/components/ring_buffer.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+template <typename T>
+std::vector<T> Contents(const RingBuffer<T>& Buffer) {
+  return std::vector<T>(Buffer.begin(), Buffer.end());
+}
+
+TEST(RingBufferTest, PushAndPop) {
+  RingBuffer<int> Buffer(3);
+  EXPECT_TRUE(Buffer.empty());
+  EXPECT_THAT(Contents(Buffer), IsEmpty());
+
+  Buffer.push_front(1);
+  Buffer.push_front(2);
+  Buffer.push_front(3);
+  EXPECT_FALSE(Buffer.empty());
+  EXPECT_EQ(Buffer.size(), 3);
+  EXPECT_EQ(Buffer.front(), 3);
+  EXPECT_EQ(Buffer.back(), 1);
+  EXPECT_EQ(Buffer[1], 2);
+  EXPECT_THAT(Contents(Buffer), ElementsAre(3, 2, 1));
+
+  Buffer.pop_back();
+  EXPECT_THAT(Contents(Buffer), ElementsAre(3, 2));
+  Buffer.back() = 5;
+  EXPECT_THAT(Contents(Buffer), ElementsAre(3, 5));
+
+  Buffer.clear();
+  EXPECT_TRUE(Buffer.empty());
+}
+
+TEST(RingBufferTest, WrapsAround) {
+  RingBuffer<int> Buffer(4);
+  // Pushing and popping one element at a time goes around the buffer several
+  // times.
+  for (int I = 0; I < 10; ++I) {
+    Buffer.push_front(I);
+    Buffer.push_front(I + 100);
+    EXPECT_THAT(Contents(Buffer), ElementsAre(I + 100, I)) << I;
+    Buffer.pop_back();
+    Buffer.pop_back();
+  }
+}
+
+TEST(RingBufferTest, GrowsBeyondCapacity) {
+  RingBuffer<int> Buffer(2);
+  Buffer.push_front(0);
+  Buffer.pop_back();
+  // The front is now in the middle of the storage when growing.
+  for (int I = 1; I <= 5; ++I) {
+    Buffer.push_front(I);
+  }
+  EXPECT_THAT(Contents(Buffer), ElementsAre(5, 4, 3, 2, 1));
+  Buffer.pop_back();
+  Buffer.push_front(6);
+  EXPECT_THAT(Contents(Buffer), ElementsAre(6, 5, 4, 3, 2));
+}
+
+TEST(RingBufferTest, ZeroCapacity) {
+  // A capacity of zero means that the capacity is not known upfront.
+  RingBuffer<int> Buffer(0);
+  Buffer.push_front(1);
+  Buffer.push_front(2);
+  EXPECT_THAT(Contents(Buffer), ElementsAre(2, 1));
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
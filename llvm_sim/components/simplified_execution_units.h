@@ -48,6 +48,8 @@ class SimplifiedExecutionUnits : public Component {
 
   void Init() { Elements_.clear(); }
   void Tick(const BlockContext* BlockContext) final;
+  void SaveState(StateWriter* Writer) const final { Writer->Write(Elements_); }
+  void RestoreState(StateReader* Reader) final { Reader->Read(&Elements_); }
 
  private:
   const Config Config_;
@@ -71,8 +73,18 @@ class ExecDepsBuffer : public Buffer,
     ReadyElements_.clear();
   }
 
+  void SaveState(StateWriter* Writer) const override {
+    Writer->Write(PendingElements_);
+    Writer->Write(ReadyElements_);
+  }
+
+  void RestoreState(StateReader* Reader) override {
+    Reader->Read(&PendingElements_);
+    Reader->Read(&ReadyElements_);
+  }
+
   LLVM_NODISCARD bool PushMany(
-      const std::vector<typename ElemTag::Type>& Elems) final {
+      llvm::ArrayRef<typename ElemTag::Type> Elems) final {
     for (const auto& Elem : Elems) {
       PendingElements_.push_back(Elem);
     }
@@ -143,7 +155,7 @@ void ExecDepsBuffer<ElemTag>::Propagate(Logger* Log) {
   internal::DecreaseLatencies(&PendingElements_);
   internal::PopZeroLatencyElementsWhile(
       &PendingElements_, [this, Log](const typename ElemTag::Type& E) {
-        Log->Log(ElemTag::kTagName, ElemTag::Format(E));
+        LogElement<ElemTag>(Log, E);
         ReadyElements_.push_back(E);
         return true;
       });
@@ -33,7 +33,7 @@ class TestSink : public Sink<Tag> {
  public:
   TestSink() { SetInfiniteCapacity(); }
 
-  bool PushMany(const std::vector<typename Tag::Type>& Elems) override {
+  bool PushMany(llvm::ArrayRef<typename Tag::Type> Elems) override {
     if (Buffer_.size() + Elems.size() > Capacity_) {
       return false;
     }
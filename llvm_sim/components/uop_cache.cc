@@ -0,0 +1,227 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/components/uop_cache.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "llvm/ADT/SmallVector.h"
+
+namespace exegesis {
+namespace simulator {
+
+UopCache::UopCache(const GlobalContext* Context, const Config& Config,
+                   Source<InstructionIndex>* FetchSource,
+                   Sink<InstructionIndex>* LegacySink,
+                   Source<UopId>* DecodedSource, Sink<UopId>* UopSink)
+    : Component(Context),
+      Config_(Config),
+      FetchSource_(FetchSource),
+      LegacySink_(LegacySink),
+      DecodedSource_(DecodedSource),
+      UopSink_(UopSink) {
+  assert(Config.UopsPerCycle > 0);
+  assert(Config.WindowBytes > 0);
+  assert(Config.NumLines == 0 ||
+         (Config.UopsPerLine > 0 &&
+          Config.MaxLinesPerWindow <= Config.NumLines));
+}
+
+UopCache::~UopCache() {}
+
+void UopCache::Init() {
+  NumLegacyInstructions_ = 0;
+  LastLegacyInstruction_ = {0, 0};
+  WindowLastUse_.clear();
+  UseClock_ = 0;
+  NumUsedLines_ = 0;
+  InstrSizes_.clear();
+  InstrWindows_.clear();
+  WindowLines_.clear();
+  NumRegionUops_ = 0;
+}
+
+void UopCache::SaveState(StateWriter* Writer) const {
+  Writer->Write(NumLegacyInstructions_);
+  Writer->Write(LastLegacyInstruction_);
+  Writer->Write(WindowLastUse_);
+  Writer->Write(UseClock_);
+  Writer->Write(NumUsedLines_);
+}
+
+// The static properties of the region are a cache, they are recomputed on the
+// next Tick().
+void UopCache::RestoreState(StateReader* Reader) {
+  Reader->Read(&NumLegacyInstructions_);
+  Reader->Read(&LastLegacyInstruction_);
+  Reader->Read(&WindowLastUse_);
+  Reader->Read(&UseClock_);
+  Reader->Read(&NumUsedLines_);
+}
+
+void UopCache::ComputeWindows(const BlockContext* BlockContext) {
+  InstrSizes_ = ComputeInstructionSizes(Context, *BlockContext);
+  InstrWindows_.resize(InstrSizes_.size());
+  std::vector<size_t> WindowUops;
+  NumRegionUops_ = 0;
+  size_t Offset = 0;
+  for (size_t I = 0; I < InstrSizes_.size(); ++I) {
+    const size_t Window = Offset / Config_.WindowBytes;
+    InstrWindows_[I] = Window;
+    WindowUops.resize(Window + 1, 0);
+    const size_t NumUops =
+        BlockContext->GetLoweredInstruction(Context, I).Uops.size();
+    WindowUops[Window] += NumUops;
+    NumRegionUops_ += NumUops;
+    Offset += InstrSizes_[I];
+  }
+  WindowLines_.resize(WindowUops.size());
+  for (size_t Window = 0; Window < WindowUops.size(); ++Window) {
+    WindowLines_[Window] =
+        Config_.NumLines == 0
+            ? 0
+            : (WindowUops[Window] + Config_.UopsPerLine - 1) /
+                  Config_.UopsPerLine;
+  }
+  // This keeps the restored cache contents, if any.
+  WindowLastUse_.resize(WindowLines_.size(), 0);
+}
+
+void UopCache::Tick(const BlockContext* BlockContext) {
+  if (InstrWindows_.empty()) {
+    ComputeWindows(BlockContext);
+  }
+
+  ForwardDecodedUops(BlockContext);
+
+  unsigned RemainingUops = Config_.UopsPerCycle;
+  unsigned RemainingLegacyBytes = Config_.LegacyBytesPerCycle;
+  while (const InstructionIndex::Type* InstrIndex = FetchSource_->Peek()) {
+    const size_t NumUops =
+        BlockContext->GetLoweredInstruction(Context, InstrIndex->BBIndex)
+            .Uops.size();
+    if (IsStreamed(BlockContext, *InstrIndex) &&
+        !ContinuesLegacyWindow(*InstrIndex)) {
+      // Switching from the legacy pipeline waits until it is empty.
+      if (NumLegacyInstructions_ > 0) {
+        return;
+      }
+      // Instructions with more uops than the streaming width take a whole
+      // cycle.
+      if (NumUops > RemainingUops && RemainingUops < Config_.UopsPerCycle) {
+        return;
+      }
+      llvm::SmallVector<UopId::Type, 8> UopIds(NumUops);
+      for (size_t I = 0; I < NumUops; ++I) {
+        UopIds[I] = {*InstrIndex, I};
+      }
+      if (!UopSink_->PushMany(UopIds)) {
+        return;
+      }
+      RemainingUops -= std::min<size_t>(NumUops, RemainingUops);
+      if (Config_.NumLines > 0) {
+        TouchWindow(InstrWindows_[InstrIndex->BBIndex]);
+      }
+      FetchSource_->Pop();
+      if (RemainingUops == 0) {
+        return;
+      }
+      continue;
+    }
+    // The instruction goes through the legacy pipeline, and its window is
+    // cached on the way.
+    const unsigned InstrBytes = InstrSizes_[InstrIndex->BBIndex];
+    if (InstrBytes > RemainingLegacyBytes) {
+      return;
+    }
+    if (!LegacySink_->Push(*InstrIndex)) {
+      return;
+    }
+    RemainingLegacyBytes -= InstrBytes;
+    LastLegacyInstruction_ = *InstrIndex;
+    // Instructions without uops do not come back.
+    if (NumUops > 0) {
+      ++NumLegacyInstructions_;
+    }
+    if (Config_.NumLines > 0) {
+      TouchWindow(InstrWindows_[InstrIndex->BBIndex]);
+    }
+    FetchSource_->Pop();
+  }
+}
+
+void UopCache::ForwardDecodedUops(const BlockContext* BlockContext) {
+  while (const UopId::Type* Uop = DecodedSource_->Peek()) {
+    if (!UopSink_->Push(*Uop)) {
+      return;
+    }
+    if (Uop->UopIndex + 1 ==
+        BlockContext->GetLoweredInstruction(Context, Uop->InstrIndex.BBIndex)
+            .Uops.size()) {
+      assert(NumLegacyInstructions_ > 0);
+      --NumLegacyInstructions_;
+    }
+    DecodedSource_->Pop();
+  }
+}
+
+bool UopCache::IsStreamed(const BlockContext* BlockContext,
+                          const InstructionIndex::Type& InstrIndex) const {
+  // The loop stream detector locks on the loop after its first iteration.
+  if (Config_.LoopBufferSize > 0 && BlockContext->IsLoop() &&
+      BlockContext->GetTrace() == nullptr &&
+      NumRegionUops_ <= Config_.LoopBufferSize && InstrIndex.Iteration > 0) {
+    return true;
+  }
+  return Config_.NumLines > 0 &&
+         WindowLastUse_[InstrWindows_[InstrIndex.BBIndex]] != 0;
+}
+
+bool UopCache::ContinuesLegacyWindow(
+    const InstructionIndex::Type& InstrIndex) const {
+  return NumLegacyInstructions_ > 0 &&
+         InstrIndex.Iteration == LastLegacyInstruction_.Iteration &&
+         InstrIndex.BBIndex == LastLegacyInstruction_.BBIndex + 1 &&
+         InstrWindows_[InstrIndex.BBIndex] ==
+             InstrWindows_[LastLegacyInstruction_.BBIndex];
+}
+
+void UopCache::TouchWindow(const size_t Window) {
+  const unsigned NumLines = WindowLines_[Window];
+  if (NumLines > Config_.MaxLinesPerWindow) {
+    return;  // The window is not cacheable.
+  }
+  if (WindowLastUse_[Window] == 0) {
+    // Evict the least recently used windows until the window fits.
+    while (NumUsedLines_ + NumLines > Config_.NumLines) {
+      size_t Victim = 0;
+      for (size_t I = 0; I < WindowLastUse_.size(); ++I) {
+        if (WindowLastUse_[I] != 0 &&
+            (WindowLastUse_[Victim] == 0 ||
+             WindowLastUse_[I] < WindowLastUse_[Victim])) {
+          Victim = I;
+        }
+      }
+      assert(WindowLastUse_[Victim] != 0);
+      WindowLastUse_[Victim] = 0;
+      NumUsedLines_ -= WindowLines_[Victim];
+    }
+    NumUsedLines_ += NumLines;
+  }
+  WindowLastUse_[Window] = ++UseClock_;
+}
+
+}  // namespace simulator
+}  // namespace exegesis
@@ -0,0 +1,126 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The uop cache (a.k.a. "Decoded Stream Buffer", "DSB", "op cache") and the
+// loop stream detector ("LSD") deliver already decoded uops to the Instruction
+// Decode Queue, bypassing the legacy decode pipeline (fetch bandwidth,
+// pre-decoder and decoders).
+//
+// The component sits between the fetcher and the legacy pipeline: fetched
+// instructions are either sent to the legacy pipeline, or streamed as uops to
+// the Instruction Decode Queue. The uops decoded by the legacy pipeline come
+// back through this component, so that the queue receives all uops in program
+// order: uops are only streamed once the legacy pipeline is empty.
+//
+// The code is split into fixed-size windows, starting at the beginning of the
+// region. The instructions of a window are cached together when the window goes
+// through the legacy pipeline. Windows use one or more lines, and are evicted
+// in least-recently-used order. Windows that need too many lines are never
+// cached. The loop stream detector holds the whole body of a loop if it is
+// small enough, and streams it from the second iteration on.
+
+#ifndef EXEGESIS_LLVM_SIM_COMPONENTS_UOP_CACHE_H_
+#define EXEGESIS_LLVM_SIM_COMPONENTS_UOP_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm_sim/components/common.h"
+#include "llvm_sim/framework/component.h"
+
+namespace exegesis {
+namespace simulator {
+
+// See top comment.
+class UopCache : public Component {
+ public:
+  struct Config {
+    // The number of uops streamed to the Instruction Decode Queue per cycle.
+    unsigned UopsPerCycle;
+    // The number of instruction bytes sent to the legacy pipeline per cycle.
+    unsigned LegacyBytesPerCycle;
+    // The size of the code windows, in bytes.
+    unsigned WindowBytes;
+    // The number of lines in the uop cache. Zero disables the uop cache.
+    unsigned NumLines;
+    // The number of uops in a line.
+    unsigned UopsPerLine;
+    // The maximal number of lines of a window.
+    unsigned MaxLinesPerWindow;
+    // The number of uops of the loop stream detector. Zero disables it.
+    unsigned LoopBufferSize;
+  };
+
+  UopCache(const GlobalContext* Context, const Config& Config,
+           Source<InstructionIndex>* FetchSource,
+           Sink<InstructionIndex>* LegacySink, Source<UopId>* DecodedSource,
+           Sink<UopId>* UopSink);
+
+  ~UopCache() override;
+
+  void Init() override;
+  void Tick(const BlockContext* BlockContext) override;
+  void SaveState(StateWriter* Writer) const override;
+  void RestoreState(StateReader* Reader) override;
+
+ private:
+  // Computes the windows of the instructions of the region.
+  void ComputeWindows(const BlockContext* BlockContext);
+
+  // Forwards the uops decoded by the legacy pipeline.
+  void ForwardDecodedUops(const BlockContext* BlockContext);
+
+  // Returns true if the instruction can be streamed from the loop stream
+  // detector or the uop cache.
+  bool IsStreamed(const BlockContext* BlockContext,
+                  const InstructionIndex::Type& InstrIndex) const;
+
+  // Returns true if the instruction directly follows the last instruction sent
+  // to the legacy pipeline in the same window: the window is decoded as a
+  // whole, even if it has just been cached.
+  bool ContinuesLegacyWindow(const InstructionIndex::Type& InstrIndex) const;
+
+  // Marks the window as the most recently used one, and inserts it if needed.
+  void TouchWindow(size_t Window);
+
+  const Config Config_;
+  Source<InstructionIndex>* const FetchSource_;
+  Sink<InstructionIndex>* const LegacySink_;
+  Source<UopId>* const DecodedSource_;
+  Sink<UopId>* const UopSink_;
+
+  // The number of instructions in the legacy pipeline whose uops have not come
+  // back yet.
+  size_t NumLegacyInstructions_;
+  // The last instruction sent to the legacy pipeline.
+  InstructionIndex::Type LastLegacyInstruction_;
+  // The time of last use of each window, or zero if it is not cached.
+  std::vector<uint64_t> WindowLastUse_;
+  uint64_t UseClock_;
+  // The number of lines used by the cached windows.
+  unsigned NumUsedLines_;
+
+  // A cache of the static properties of the region: the size and window of
+  // each instruction, the number of lines of each window and the number of
+  // uops of the region.
+  std::vector<unsigned> InstrSizes_;
+  std::vector<size_t> InstrWindows_;
+  std::vector<unsigned> WindowLines_;
+  size_t NumRegionUops_;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_COMPONENTS_UOP_CACHE_H_
@@ -0,0 +1,241 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/components/uop_cache.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrDesc.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm_sim/components/common.h"
+#include "llvm_sim/components/testing.h"
+#include "llvm_sim/framework/context.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+class UopCacheTest : public ::testing::Test {
+ protected:
+  UopCacheTest() {
+    // Two 16-byte instructions with 2 and 1 uops.
+    llvm::MCInst Inst1;
+    llvm::MCInst Inst2;
+    Inst1.setOpcode(1);
+    Inst2.setOpcode(2);
+    InstrDesc_[1].Size = 16;
+    InstrDesc_[2].Size = 16;
+    auto InstrInfo = absl::make_unique<llvm::MCInstrInfo>();
+    InstrInfo->InitMCInstrInfo(InstrDesc_.data(), nullptr, nullptr, nullptr,
+                               nullptr, InstrDesc_.size());
+    Context_.InstrInfo = std::move(InstrInfo);
+    {
+      auto Decomposition = absl::make_unique<InstrUopDecomposition>();
+      Decomposition->Uops.resize(2);
+      Context_.SetInstructionDecomposition(Inst1, std::move(Decomposition));
+    }
+    {
+      auto Decomposition = absl::make_unique<InstrUopDecomposition>();
+      Decomposition->Uops.resize(1);
+      Context_.SetInstructionDecomposition(Inst2, std::move(Decomposition));
+    }
+    // The first window has Inst1 and Inst2, the second one has Inst1.
+    Instructions_ = {Inst1, Inst2, Inst1};
+  }
+
+  static UopCache::Config MakeConfig() {
+    UopCache::Config Config;
+    Config.UopsPerCycle = 4;
+    Config.LegacyBytesPerCycle = 16;
+    Config.WindowBytes = 32;
+    Config.NumLines = 8;
+    Config.UopsPerLine = 6;
+    Config.MaxLinesPerWindow = 3;
+    Config.LoopBufferSize = 0;
+    return Config;
+  }
+
+  // Feeds the fetch source with `NumIterations` iterations of the region.
+  void Fetch(size_t NumIterations) {
+    for (size_t Iteration = 0; Iteration < NumIterations; ++Iteration) {
+      for (size_t I = 0; I < Instructions_.size(); ++I) {
+        FetchSource_.Buffer_.push_back({I, Iteration});
+      }
+    }
+  }
+
+  // Decodes the instructions of the legacy sink.
+  void Decode() {
+    for (const auto& InstrIndex : LegacySink_.Buffer_) {
+      const auto& Decomposition = Context_.GetInstructionDecomposition(
+          Instructions_[InstrIndex.BBIndex]);
+      for (size_t I = 0; I < Decomposition.Uops.size(); ++I) {
+        DecodedSource_.Buffer_.push_back({InstrIndex, I});
+      }
+    }
+    LegacySink_.Buffer_.clear();
+  }
+
+  std::array<llvm::MCInstrDesc, 3> InstrDesc_ = {};
+  GlobalContext Context_;
+  std::vector<llvm::MCInst> Instructions_;
+  TestSource<InstructionIndex> FetchSource_;
+  TestSink<InstructionIndex> LegacySink_;
+  TestSource<UopId> DecodedSource_;
+  TestSink<UopId> UopSink_;
+};
+
+TEST_F(UopCacheTest, StreamsCachedWindows) {
+  UopCache Cache(&Context_, MakeConfig(), &FetchSource_, &LegacySink_,
+                 &DecodedSource_, &UopSink_);
+  const BlockContext BlockContext(Instructions_, true);
+  Cache.Init();
+  Fetch(2);
+
+  // The first iteration goes through the legacy pipeline, 16 bytes per cycle.
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(LegacySink_.Buffer_, ElementsAre(EqInstrIndex(0, 0)));
+  Cache.Tick(&BlockContext);
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(LegacySink_.Buffer_,
+              ElementsAre(EqInstrIndex(0, 0), EqInstrIndex(0, 1),
+                          EqInstrIndex(0, 2)));
+  // The second iteration waits for the legacy pipeline.
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(UopSink_.Buffer_, IsEmpty());
+  EXPECT_EQ(LegacySink_.Buffer_.size(), 3);
+
+  // The decoded uops are forwarded first, then the cached instructions are
+  // streamed, 4 uops per cycle.
+  Decode();
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(UopSink_.Buffer_,
+              ElementsAre(EqUopId(0, 0, 0), EqUopId(0, 0, 1), EqUopId(0, 1, 0),
+                          EqUopId(0, 2, 0), EqUopId(0, 2, 1), EqUopId(1, 0, 0),
+                          EqUopId(1, 0, 1), EqUopId(1, 1, 0)));
+  UopSink_.Buffer_.clear();
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(UopSink_.Buffer_,
+              ElementsAre(EqUopId(1, 2, 0), EqUopId(1, 2, 1)));
+  EXPECT_THAT(LegacySink_.Buffer_, IsEmpty());
+}
+
+TEST_F(UopCacheTest, EvictsLeastRecentlyUsedWindows) {
+  UopCache::Config Config = MakeConfig();
+  Config.NumLines = 1;
+  Config.MaxLinesPerWindow = 1;
+  UopCache Cache(&Context_, Config, &FetchSource_, &LegacySink_,
+                 &DecodedSource_, &UopSink_);
+  const BlockContext BlockContext(Instructions_, true);
+  Cache.Init();
+  Fetch(2);
+
+  for (int I = 0; I < 3; ++I) {
+    Cache.Tick(&BlockContext);
+  }
+  Decode();
+  // The second window evicted the first one.
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(LegacySink_.Buffer_, ElementsAre(EqInstrIndex(1, 0)));
+}
+
+TEST_F(UopCacheTest, DoesNotCacheLargeWindows) {
+  UopCache::Config Config = MakeConfig();
+  Config.UopsPerLine = 2;
+  Config.MaxLinesPerWindow = 1;
+  UopCache Cache(&Context_, Config, &FetchSource_, &LegacySink_,
+                 &DecodedSource_, &UopSink_);
+  const BlockContext BlockContext(Instructions_, true);
+  Cache.Init();
+  Fetch(2);
+
+  for (int I = 0; I < 3; ++I) {
+    Cache.Tick(&BlockContext);
+  }
+  Decode();
+  // The first window has 3 uops and needs 2 lines.
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(LegacySink_.Buffer_, ElementsAre(EqInstrIndex(1, 0)));
+  EXPECT_THAT(UopSink_.Buffer_,
+              ElementsAre(EqUopId(0, 0, 0), EqUopId(0, 0, 1), EqUopId(0, 1, 0),
+                          EqUopId(0, 2, 0), EqUopId(0, 2, 1)));
+}
+
+TEST_F(UopCacheTest, LoopStreamDetector) {
+  UopCache::Config Config = MakeConfig();
+  Config.NumLines = 0;
+  Config.LoopBufferSize = 5;
+  UopCache Cache(&Context_, Config, &FetchSource_, &LegacySink_,
+                 &DecodedSource_, &UopSink_);
+  const BlockContext BlockContext(Instructions_, true);
+  Cache.Init();
+  Fetch(2);
+
+  for (int I = 0; I < 3; ++I) {
+    Cache.Tick(&BlockContext);
+  }
+  Decode();
+  Cache.Tick(&BlockContext);
+  EXPECT_THAT(LegacySink_.Buffer_, IsEmpty());
+  EXPECT_THAT(UopSink_.Buffer_,
+              ElementsAre(EqUopId(0, 0, 0), EqUopId(0, 0, 1), EqUopId(0, 1, 0),
+                          EqUopId(0, 2, 0), EqUopId(0, 2, 1), EqUopId(1, 0, 0),
+                          EqUopId(1, 0, 1), EqUopId(1, 1, 0)));
+
+  // Non-loops are not streamed.
+  const class BlockContext NotLoop(Instructions_, false);
+  UopCache OtherCache(&Context_, Config, &FetchSource_, &LegacySink_,
+                      &DecodedSource_, &UopSink_);
+  OtherCache.Init();
+  FetchSource_.Buffer_ = {{0, 1}};
+  OtherCache.Tick(&NotLoop);
+  EXPECT_THAT(LegacySink_.Buffer_, ElementsAre(EqInstrIndex(1, 0)));
+}
+
+TEST_F(UopCacheTest, SaveAndRestore) {
+  UopCache Cache(&Context_, MakeConfig(), &FetchSource_, &LegacySink_,
+                 &DecodedSource_, &UopSink_);
+  const BlockContext BlockContext(Instructions_, true);
+  Cache.Init();
+  Fetch(1);
+  for (int I = 0; I < 3; ++I) {
+    Cache.Tick(&BlockContext);
+  }
+  StateWriter Writer;
+  Cache.SaveState(&Writer);
+
+  UopCache Restored(&Context_, MakeConfig(), &FetchSource_, &LegacySink_,
+                    &DecodedSource_, &UopSink_);
+  Restored.Init();
+  StateReader Reader(Writer.GetBlob());
+  Restored.RestoreState(&Reader);
+  EXPECT_TRUE(Reader.AtEnd());
+
+  Decode();
+  FetchSource_.Buffer_ = {{0, 1}};
+  Restored.Tick(&BlockContext);
+  EXPECT_THAT(LegacySink_.Buffer_, IsEmpty());
+  EXPECT_THAT(UopSink_.Buffer_,
+              ElementsAre(EqUopId(0, 0, 0), EqUopId(0, 0, 1), EqUopId(0, 1, 0),
+                          EqUopId(0, 2, 0), EqUopId(0, 2, 1), EqUopId(1, 0, 0),
+                          EqUopId(1, 0, 1)));
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
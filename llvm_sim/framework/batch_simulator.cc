@@ -0,0 +1,148 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/batch_simulator.h"
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+namespace exegesis {
+namespace simulator {
+
+namespace {
+
+// A range of block indices [Begin, End) that is owned by a worker. The owner
+// takes blocks from the front, and idle workers steal from the back.
+class WorkRange {
+ public:
+  void Reset(size_t Begin, size_t End) {
+    std::lock_guard<std::mutex> Lock(Mutex_);
+    Begin_ = Begin;
+    End_ = End;
+  }
+
+  // Takes the first block of the range. Returns false if the range is empty.
+  bool PopFront(size_t* Index) {
+    std::lock_guard<std::mutex> Lock(Mutex_);
+    if (Begin_ == End_) {
+      return false;
+    }
+    *Index = Begin_++;
+    return true;
+  }
+
+  // Removes the second half of the range (rounded up) and returns it in
+  // [*Begin, *End). Returns false if the range is empty.
+  bool StealHalf(size_t* Begin, size_t* End) {
+    std::lock_guard<std::mutex> Lock(Mutex_);
+    if (Begin_ == End_) {
+      return false;
+    }
+    *End = End_;
+    End_ = Begin_ + (End_ - Begin_) / 2;
+    *Begin = End_;
+    return true;
+  }
+
+ private:
+  std::mutex Mutex_;
+  size_t Begin_ = 0;
+  size_t End_ = 0;
+};
+
+}  // namespace
+
+BatchSimulator::BatchSimulator(const GlobalContext* Context,
+                               const SimulatorFactory& Factory,
+                               unsigned NumThreads)
+    : Context_(*Context) {
+  if (NumThreads == 0) {
+    NumThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned I = 0; I < NumThreads; ++I) {
+    Simulators_.push_back(Factory(Context_));
+  }
+}
+
+BatchSimulator::~BatchSimulator() {}
+
+void BatchSimulator::Run(llvm::ArrayRef<BlockContext> Blocks,
+                         unsigned MaxNumIterations, unsigned MaxNumCycles,
+                         const LogCallback& Callback) const {
+  Run(Blocks, MaxNumIterations, MaxNumCycles,
+      [](size_t BlockIndex) { return std::vector<SimulationObserver*>(); },
+      Callback);
+}
+
+void BatchSimulator::Run(llvm::ArrayRef<BlockContext> Blocks,
+                         unsigned MaxNumIterations, unsigned MaxNumCycles,
+                         const ObserversCallback& GetObservers,
+                         const LogCallback& Callback) const {
+  // Compute all decompositions before starting the workers so that they only
+  // ever hit the cache of the shared context.
+  for (const BlockContext& Block : Blocks) {
+    Context_.WarmUpInstructionDecompositions(Block.GetInstructions());
+  }
+
+  const size_t NumWorkers =
+      std::min<size_t>(Simulators_.size(), std::max<size_t>(1, Blocks.size()));
+  std::vector<WorkRange> Ranges(NumWorkers);
+  for (size_t W = 0; W < NumWorkers; ++W) {
+    Ranges[W].Reset(Blocks.size() * W / NumWorkers,
+                    Blocks.size() * (W + 1) / NumWorkers);
+  }
+
+  const auto Work = [this, &Blocks, MaxNumIterations, MaxNumCycles,
+                     &GetObservers, &Callback, &Ranges,
+                     NumWorkers](const size_t W) {
+    const Simulator& Sim = *Simulators_[W];
+    while (true) {
+      size_t Index;
+      if (Ranges[W].PopFront(&Index)) {
+        const auto Log = Sim.Run(Blocks[Index], MaxNumIterations,
+                                 MaxNumCycles, GetObservers(Index));
+        Callback(Index, Blocks[Index], *Log);
+        continue;
+      }
+      // Our range is exhausted, steal from the other workers. Work is never
+      // created, only moved between ranges, so when there is nothing left to
+      // steal all remaining blocks are being simulated by other workers.
+      bool Stole = false;
+      for (size_t I = 1; I < NumWorkers && !Stole; ++I) {
+        size_t Begin, End;
+        if (Ranges[(W + I) % NumWorkers].StealHalf(&Begin, &End)) {
+          Ranges[W].Reset(Begin, End);
+          Stole = true;
+        }
+      }
+      if (!Stole) {
+        return;
+      }
+    }
+  };
+
+  // The calling thread acts as worker 0.
+  std::vector<std::thread> Threads;
+  for (size_t W = 1; W < NumWorkers; ++W) {
+    Threads.emplace_back(Work, W);
+  }
+  Work(0);
+  for (auto& Thread : Threads) {
+    Thread.join();
+  }
+}
+
+}  // namespace simulator
+}  // namespace exegesis
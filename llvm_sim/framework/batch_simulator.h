@@ -0,0 +1,107 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Simulates a corpus of independent basic blocks on several threads.
+//
+// A `Simulator` holds the state of its components and buffers and can only
+// simulate one block at a time, so each worker thread owns its own simulator.
+// All simulators share the same (read-only) `GlobalContext`. Blocks are
+// distributed to workers in contiguous chunks, and idle workers steal half of
+// the remaining work of other workers.
+
+#ifndef EXEGESIS_LLVM_SIM_FRAMEWORK_BATCH_SIMULATOR_H_
+#define EXEGESIS_LLVM_SIM_FRAMEWORK_BATCH_SIMULATOR_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/log.h"
+#include "llvm_sim/framework/simulator.h"
+
+namespace exegesis {
+namespace simulator {
+
+class BatchSimulator {
+ public:
+  // Creates a simulator for the given context, e.g. `CreateHaswellSimulator`.
+  using SimulatorFactory =
+      std::function<std::unique_ptr<Simulator>(const GlobalContext& Context)>;
+
+  // Called once per block, on the worker thread that simulated the block.
+  // `Log` is valid only during the duration of the call. The callback is
+  // called concurrently for different blocks and must be thread-safe.
+  using LogCallback = std::function<void(
+      size_t BlockIndex, const BlockContext& BlockContext,
+      const SimulationLog& Log)>;
+
+  // Called once per block, on the worker thread that simulates the block and
+  // before simulating it. Returns the observers of the simulation of the block
+  // (see `Simulator::Run`), which must stay alive until the `LogCallback` call
+  // for the block returns. Must be thread-safe.
+  using ObserversCallback =
+      std::function<std::vector<SimulationObserver*>(size_t BlockIndex)>;
+
+  // Creates `NumThreads` simulators using `Factory`. If `NumThreads` is 0, uses
+  // one thread per hardware thread.
+  BatchSimulator(const GlobalContext* Context, const SimulatorFactory& Factory,
+                 unsigned NumThreads);
+
+  ~BatchSimulator();
+
+  unsigned GetNumThreads() const { return Simulators_.size(); }
+
+  // Simulates all `Blocks` (see `Simulator::Run` for the meaning of
+  // `MaxNumIterations` and `MaxNumCycles`) and calls `Callback` with the log of
+  // each block. Returns when all blocks have been simulated.
+  void Run(llvm::ArrayRef<BlockContext> Blocks, unsigned MaxNumIterations,
+           unsigned MaxNumCycles, const LogCallback& Callback) const;
+
+  // Same as above, but each block is also reported to the observers returned
+  // by `GetObservers` for the block. The observers can then compute analyses
+  // with empty log subscriptions (see `Simulator::SetLogSubscriptions`).
+  void Run(llvm::ArrayRef<BlockContext> Blocks, unsigned MaxNumIterations,
+           unsigned MaxNumCycles, const ObserversCallback& GetObservers,
+           const LogCallback& Callback) const;
+
+  // Same as above, but returns `Analyze(BlockContext, Log)` for each block, in
+  // the order of `Blocks`. `Analyze` is called on the worker threads.
+  template <typename ResultT>
+  std::vector<ResultT> RunAndCollect(
+      llvm::ArrayRef<BlockContext> Blocks, unsigned MaxNumIterations,
+      unsigned MaxNumCycles,
+      const std::function<ResultT(const BlockContext& BlockContext,
+                                  const SimulationLog& Log)>& Analyze) const {
+    std::vector<ResultT> Results(Blocks.size());
+    // Each block writes to its own slot, so no synchronization is required.
+    Run(Blocks, MaxNumIterations, MaxNumCycles,
+        [&Results, &Analyze](size_t BlockIndex,
+                             const BlockContext& BlockContext,
+                             const SimulationLog& Log) {
+          Results[BlockIndex] = Analyze(BlockContext, Log);
+        });
+    return Results;
+  }
+
+ private:
+  const GlobalContext& Context_;
+  std::vector<std::unique_ptr<Simulator>> Simulators_;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_FRAMEWORK_BATCH_SIMULATOR_H_
@@ -0,0 +1,163 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/batch_simulator.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm_sim/framework/component.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+using ::testing::ElementsAre;
+
+// A component that completes one instruction per cycle.
+class OneInstructionPerCycle : public Component {
+ public:
+  OneInstructionPerCycle(const GlobalContext* Context,
+                         Sink<InstructionIndex>* Sink)
+      : Component(Context), Sink_(Sink) {}
+
+  void Init() override { Next_ = {0, 0}; }
+
+  void Tick(const BlockContext* BlockContext) override {
+    EXPECT_TRUE(Sink_->Push(Next_));
+    if (++Next_.BBIndex == BlockContext->GetNumBasicBlockInstructions()) {
+      Next_.BBIndex = 0;
+      ++Next_.Iteration;
+    }
+  }
+
+ private:
+  Sink<InstructionIndex>* const Sink_;
+  InstructionIndex::Type Next_;
+};
+
+std::unique_ptr<Simulator> CreateTestSimulator(const GlobalContext& Context) {
+  auto Sim = absl::make_unique<Simulator>();
+  Sim->AddComponent(absl::make_unique<OneInstructionPerCycle>(
+      &Context, Sim->GetInstructionSink()));
+  return Sim;
+}
+
+constexpr unsigned kMaxNumIterations = 3;
+
+class BatchSimulatorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // All test instructions are the default MCInst.
+    Context_.SetInstructionDecomposition(
+        llvm::MCInst(), absl::make_unique<InstrUopDecomposition>());
+  }
+
+  GlobalContext Context_;
+};
+
+TEST_F(BatchSimulatorTest, ResultsAreInInputOrder) {
+  constexpr size_t kNumBlocks = 100;
+  // Block `I` has `I % 7 + 1` instructions.
+  const std::vector<llvm::MCInst> Instructions(7);
+  std::vector<BlockContext> Blocks;
+  for (size_t I = 0; I < kNumBlocks; ++I) {
+    Blocks.emplace_back(
+        llvm::ArrayRef<llvm::MCInst>(Instructions).take_front(I % 7 + 1),
+        true);
+  }
+
+  const BatchSimulator Batch(&Context_, &CreateTestSimulator,
+                             /*NumThreads=*/4);
+  EXPECT_EQ(Batch.GetNumThreads(), 4);
+  const std::vector<unsigned> NumCycles = Batch.RunAndCollect<unsigned>(
+      Blocks, kMaxNumIterations, /*MaxNumCycles=*/0,
+      [](const BlockContext& BlockContext, const SimulationLog& Log) {
+        EXPECT_EQ(Log.GetNumCompleteIterations(), kMaxNumIterations);
+        return Log.NumCycles;
+      });
+
+  ASSERT_EQ(NumCycles.size(), kNumBlocks);
+  for (size_t I = 0; I < kNumBlocks; ++I) {
+    EXPECT_EQ(NumCycles[I], kMaxNumIterations * (I % 7 + 1)) << I;
+  }
+}
+
+TEST_F(BatchSimulatorTest, MoreThreadsThanBlocks) {
+  const std::vector<llvm::MCInst> Instructions(2);
+  const std::vector<BlockContext> Blocks = {BlockContext(Instructions, true)};
+
+  const BatchSimulator Batch(&Context_, &CreateTestSimulator,
+                             /*NumThreads=*/8);
+  const std::vector<unsigned> NumCycles = Batch.RunAndCollect<unsigned>(
+      Blocks, /*MaxNumIterations=*/5, /*MaxNumCycles=*/0,
+      [](const BlockContext& BlockContext, const SimulationLog& Log) {
+        return Log.NumCycles;
+      });
+  EXPECT_THAT(NumCycles, ElementsAre(10));
+}
+
+// Counts the iterations of the block it observes.
+class IterationCounter : public SimulationObserver {
+ public:
+  LogEventMask GetSubscriptions() const override { return LogEventMask(); }
+
+  void OnIterationEnd(size_t Iteration,
+                      const SimulationLog::IterationStats& Stats) override {
+    ++NumIterations;
+  }
+
+  size_t NumIterations = 0;
+};
+
+TEST_F(BatchSimulatorTest, ObserversSeeTheirBlock) {
+  constexpr size_t kNumBlocks = 20;
+  const std::vector<llvm::MCInst> Instructions(1);
+  const std::vector<BlockContext> Blocks(kNumBlocks,
+                                         BlockContext(Instructions, true));
+
+  const BatchSimulator Batch(&Context_, &CreateTestSimulator,
+                             /*NumThreads=*/4);
+  std::vector<IterationCounter> Counters(kNumBlocks);
+  std::vector<size_t> NumIterationsInCallback(kNumBlocks);
+  Batch.Run(
+      Blocks, kMaxNumIterations, /*MaxNumCycles=*/0,
+      [&Counters](size_t BlockIndex) {
+        return std::vector<SimulationObserver*>{&Counters[BlockIndex]};
+      },
+      [&Counters, &NumIterationsInCallback](size_t BlockIndex,
+                                            const BlockContext& BlockContext,
+                                            const SimulationLog& Log) {
+        NumIterationsInCallback[BlockIndex] =
+            Counters[BlockIndex].NumIterations;
+      });
+
+  for (size_t I = 0; I < kNumBlocks; ++I) {
+    EXPECT_EQ(NumIterationsInCallback[I], kMaxNumIterations) << I;
+  }
+}
+
+TEST_F(BatchSimulatorTest, NoBlocks) {
+  const BatchSimulator Batch(&Context_, &CreateTestSimulator,
+                             /*NumThreads=*/2);
+  const std::vector<unsigned> NumCycles = Batch.RunAndCollect<unsigned>(
+      {}, /*MaxNumIterations=*/5, /*MaxNumCycles=*/0,
+      [](const BlockContext& BlockContext, const SimulationLog& Log) {
+        return Log.NumCycles;
+      });
+  EXPECT_TRUE(NumCycles.empty());
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
@@ -0,0 +1,85 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/block_trace.h"
+
+#include <utility>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace exegesis {
+namespace simulator {
+
+BlockTrace::~BlockTrace() {}
+
+VectorBlockTrace::VectorBlockTrace(std::vector<size_t> BlockIds)
+    : BlockIds_(std::move(BlockIds)) {}
+
+void VectorBlockTrace::DoRewind() { NextIndex_ = 0; }
+
+bool VectorBlockTrace::DoNext(size_t* BlockId) {
+  if (NextIndex_ >= BlockIds_.size()) {
+    return false;
+  }
+  *BlockId = BlockIds_[NextIndex_++];
+  return true;
+}
+
+llvm::Expected<std::unique_ptr<FileBlockTrace>> FileBlockTrace::Open(
+    const std::string& FileName, size_t NumBlocks) {
+  std::unique_ptr<FileBlockTrace> Trace(
+      new FileBlockTrace(FileName, NumBlocks));
+  if (!Trace->File_) {
+    return llvm::make_error<llvm::StringError>(
+        "cannot read '" + FileName + "'", llvm::inconvertibleErrorCode());
+  }
+  return std::move(Trace);
+}
+
+FileBlockTrace::FileBlockTrace(const std::string& FileName, size_t NumBlocks)
+    : FileName_(FileName), NumBlocks_(NumBlocks), File_(FileName) {}
+
+llvm::Error FileBlockTrace::TakeError() {
+  if (Error_.empty()) {
+    return llvm::Error::success();
+  }
+  auto Error = llvm::make_error<llvm::StringError>(
+      std::move(Error_), llvm::inconvertibleErrorCode());
+  Error_.clear();
+  return Error;
+}
+
+void FileBlockTrace::DoRewind() {
+  File_.clear();
+  File_.seekg(0);
+  Error_.clear();
+}
+
+bool FileBlockTrace::DoNext(size_t* BlockId) {
+  if (!(File_ >> Token_)) {
+    return false;
+  }
+  unsigned long long Id = 0;
+  if (llvm::StringRef(Token_).getAsInteger(10, Id) || Id >= NumBlocks_) {
+    Error_ = FileName_ + ": invalid block id '" + Token_ + "' at position " +
+             std::to_string(GetPosition()) + ", the region has " +
+             std::to_string(NumBlocks_) + " blocks";
+    return false;
+  }
+  *BlockId = Id;
+  return true;
+}
+
+}  // namespace simulator
+}  // namespace exegesis
@@ -0,0 +1,112 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A block trace is the sequence of basic blocks executed by a program, e.g.
+// recorded from a hot region with taken branches. The simulator follows the
+// trace through the blocks of a multi-block `BlockContext` instead of looping
+// over a single block. Traces are read incrementally, so they can be much
+// larger than the memory.
+
+#ifndef EXEGESIS_LLVM_SIM_FRAMEWORK_BLOCK_TRACE_H_
+#define EXEGESIS_LLVM_SIM_FRAMEWORK_BLOCK_TRACE_H_
+
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+
+namespace exegesis {
+namespace simulator {
+
+class BlockTrace {
+ public:
+  virtual ~BlockTrace();
+
+  // Restarts the trace from the beginning.
+  void Rewind() {
+    DoRewind();
+    Position_ = 0;
+    AtEnd_ = false;
+  }
+
+  // Reads the id of the next block of the trace into `BlockId`. Returns false
+  // at the end of the trace.
+  bool Next(size_t* BlockId) {
+    if (AtEnd_ || !DoNext(BlockId)) {
+      AtEnd_ = true;
+      return false;
+    }
+    ++Position_;
+    return true;
+  }
+
+  // Returns the number of blocks read since the last rewind.
+  size_t GetPosition() const { return Position_; }
+
+  // Returns true if Next() has reached the end of the trace.
+  bool AtEnd() const { return AtEnd_; }
+
+ private:
+  virtual void DoRewind() = 0;
+  virtual bool DoNext(size_t* BlockId) = 0;
+
+  size_t Position_ = 0;
+  bool AtEnd_ = false;
+};
+
+// A trace held in memory.
+class VectorBlockTrace : public BlockTrace {
+ public:
+  explicit VectorBlockTrace(std::vector<size_t> BlockIds);
+
+ private:
+  void DoRewind() override;
+  bool DoNext(size_t* BlockId) override;
+
+  const std::vector<size_t> BlockIds_;
+  size_t NextIndex_ = 0;
+};
+
+// A trace read from a text file with whitespace-separated decimal block ids,
+// typically one per line.
+class FileBlockTrace : public BlockTrace {
+ public:
+  // Opens the trace in `FileName`, for a region with `NumBlocks` blocks.
+  static llvm::Expected<std::unique_ptr<FileBlockTrace>> Open(
+      const std::string& FileName, size_t NumBlocks);
+
+  // Returns the error that ended the trace early, e.g. an invalid block id,
+  // or success.
+  llvm::Error TakeError();
+
+ private:
+  FileBlockTrace(const std::string& FileName, size_t NumBlocks);
+
+  void DoRewind() override;
+  bool DoNext(size_t* BlockId) override;
+
+  const std::string FileName_;
+  const size_t NumBlocks_;
+  std::ifstream File_;
+  std::string Token_;
+  std::string Error_;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_FRAMEWORK_BLOCK_TRACE_H_
@@ -0,0 +1,94 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/block_trace.h"
+
+#include <fstream>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+using testing::ElementsAre;
+using testing::HasSubstr;
+
+// Reads all the remaining blocks of `Trace`.
+std::vector<size_t> ReadAll(BlockTrace* Trace) {
+  std::vector<size_t> BlockIds;
+  size_t BlockId;
+  while (Trace->Next(&BlockId)) {
+    BlockIds.push_back(BlockId);
+  }
+  return BlockIds;
+}
+
+std::string WriteTempFile(const std::string& Name,
+                          const std::string& Contents) {
+  const std::string FileName = testing::TempDir() + "/" + Name;
+  std::ofstream(FileName) << Contents;
+  return FileName;
+}
+
+TEST(VectorBlockTraceTest, Works) {
+  VectorBlockTrace Trace({0, 2, 1});
+  size_t BlockId;
+  ASSERT_TRUE(Trace.Next(&BlockId));
+  EXPECT_EQ(BlockId, 0);
+  EXPECT_EQ(Trace.GetPosition(), 1);
+  EXPECT_FALSE(Trace.AtEnd());
+  EXPECT_THAT(ReadAll(&Trace), ElementsAre(2, 1));
+  EXPECT_EQ(Trace.GetPosition(), 3);
+  EXPECT_TRUE(Trace.AtEnd());
+
+  Trace.Rewind();
+  EXPECT_EQ(Trace.GetPosition(), 0);
+  EXPECT_FALSE(Trace.AtEnd());
+  EXPECT_THAT(ReadAll(&Trace), ElementsAre(0, 2, 1));
+}
+
+TEST(FileBlockTraceTest, Works) {
+  auto Trace = FileBlockTrace::Open(
+      WriteTempFile("block_trace_works.txt", "0\n2\n1 1\n\n0\n"),
+      /*NumBlocks=*/3);
+  ASSERT_TRUE(static_cast<bool>(Trace)) << llvm::toString(Trace.takeError());
+  EXPECT_THAT(ReadAll(Trace->get()), ElementsAre(0, 2, 1, 1, 0));
+  EXPECT_FALSE(static_cast<bool>((*Trace)->TakeError()));
+
+  (*Trace)->Rewind();
+  EXPECT_THAT(ReadAll(Trace->get()), ElementsAre(0, 2, 1, 1, 0));
+}
+
+TEST(FileBlockTraceTest, InvalidBlockId) {
+  auto Trace = FileBlockTrace::Open(
+      WriteTempFile("block_trace_invalid.txt", "0\n1\n3\n0\n"),
+      /*NumBlocks=*/3);
+  ASSERT_TRUE(static_cast<bool>(Trace)) << llvm::toString(Trace.takeError());
+  EXPECT_THAT(ReadAll(Trace->get()), ElementsAre(0, 1));
+  EXPECT_THAT(llvm::toString((*Trace)->TakeError()),
+              HasSubstr("invalid block id '3' at position 2"));
+}
+
+TEST(FileBlockTraceTest, MissingFile) {
+  auto Trace = FileBlockTrace::Open(testing::TempDir() + "/does_not_exist",
+                                    /*NumBlocks=*/3);
+  ASSERT_FALSE(static_cast<bool>(Trace));
+  EXPECT_THAT(llvm::toString(Trace.takeError()), HasSubstr("cannot read"));
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
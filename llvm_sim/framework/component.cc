@@ -14,6 +14,8 @@
 
 #include "llvm_sim/framework/component.h"
 
+#include <sstream>
+
 namespace exegesis {
 namespace simulator {
 
@@ -25,6 +27,28 @@ Buffer::~Buffer() {}
 
 Logger::~Logger() {}
 
+void Logger::DoLogInstruction(const InstructionIndex::Type& Instr) {
+  Log(InstructionIndex::kTagName, InstructionIndex::Format(Instr));
+}
+
+void Logger::DoLogUop(const UopId::Type& Uop) {
+  Log(UopId::kTagName, UopId::Format(Uop));
+}
+
+void Logger::DoLogPortPressureInit() { Log("PortPressure", "init"); }
+
+void Logger::DoLogPortPressure(const InstructionIndex::Type& Instr,
+                               float Cycles) {
+  // "<iteration>,<inst index>,<pressure_in_cycles>".
+  std::ostringstream Msg;
+  Msg << InstructionIndex::Format(Instr) << "," << Cycles;
+  Log("PortPressure", Msg.str());
+}
+
+void Logger::DoLogStall(unsigned NumCycles) {
+  Log("PStall", llvm::Twine(NumCycles).str());
+}
+
 std::string InstructionIndex::Format(const Type& Elem) {
   return llvm::Twine(Elem.Iteration)
       .concat(",")
@@ -15,7 +15,11 @@
 #ifndef EXEGESIS_LLVM_SIM_FRAMEWORK_COMPONENT_H_
 #define EXEGESIS_LLVM_SIM_FRAMEWORK_COMPONENT_H_
 
+#include <cstdint>
+#include <type_traits>
+
 #include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/state.h"
 
 namespace exegesis {
 namespace simulator {
@@ -37,6 +41,13 @@ class Component {
   // write from inputs/outputs.
   virtual void Tick(const BlockContext* BlockContext) = 0;
 
+  // Serializes the state of the component at the end of a cycle. Components
+  // that keep state across cycles must override both functions; the defaults
+  // are for stateless components. RestoreState() is called after Init(), and
+  // must read exactly what SaveState() wrote.
+  virtual void SaveState(StateWriter* Writer) const {}
+  virtual void RestoreState(StateReader* Reader) {}
+
  protected:
   const GlobalContext& Context;
 };
@@ -61,13 +72,11 @@ class Buffer {
   // for consumption.
   // `Log` is valid only during the duration of the call.
   virtual void Propagate(Logger* Log) = 0;
-};
 
-// The interface used by buffers to report state changes.
-class Logger {
- public:
-  virtual ~Logger();
-  virtual void Log(std::string MsgTag, std::string Msg) = 0;
+  // Serializes the contents of the buffer at the end of a cycle, see
+  // `Component::SaveState()`. RestoreState() is called after Init().
+  virtual void SaveState(StateWriter* Writer) const {}
+  virtual void RestoreState(StateReader* Reader) {}
 };
 
 // The interfaces for pushing elements to a component or buffer. `Tag` is the
@@ -78,6 +87,9 @@ class Logger {
 //   - a type `Type`
 //   - a name for `kTagName`.
 //   - `static std:string Format(const Type&)` that formats a type for logging.
+// Tags whose elements represent a uop can additionally define
+// `static const UopId::Type& GetUopId(const Type&)`, in which case their
+// elements are logged as typed uop events (see `LogElement` below).
 
 template <typename Tag>
 class Sink {
@@ -86,13 +98,13 @@ class Sink {
 
   // Returns true if the element was pushed.
   LLVM_NODISCARD bool Push(const typename Tag::Type& Elem) {
-    return PushMany({Elem});
+    return PushMany(Elem);
   }
 
   // Atomically push a bunch of elements (either all or no elements are pushed).
   // Returns true if all the elements were pushed.
   LLVM_NODISCARD virtual bool PushMany(
-      const std::vector<typename Tag::Type>& Elems) = 0;
+      llvm::ArrayRef<typename Tag::Type> Elems) = 0;
 };
 
 template <typename Tag>
@@ -136,10 +148,144 @@ struct UopId {
   static const InstructionIndex::Type& GetInstructionIndex(const Type& Elem) {
     return Elem.InstrIndex;
   }
+  static const Type& GetUopId(const Type& Elem) { return Elem; }
   // Consumes an element from `Input`. Returns false on success.
   static bool Consume(llvm::StringRef& Input, Type& Elem);
 };
 
+// The kinds of events that buffers report to a `Logger`.
+enum class LogEventKind : uint8_t {
+  kInstruction,       // An instruction went through the buffer.
+  kUop,               // A uop went through the buffer.
+  kPortPressureInit,  // The buffer is a port with port pressure information.
+  kPortPressure,      // An instruction used the port.
+  kStall,             // The buffer is stalled.
+  kMessage,           // A free-form message, see `Logger::Log()`.
+};
+
+// A set of `LogEventKind`s.
+class LogEventMask {
+ public:
+  constexpr LogEventMask() {}
+
+  static constexpr LogEventMask All() { return LogEventMask(~0u); }
+
+  constexpr LogEventMask With(LogEventKind Kind) const {
+    return LogEventMask(Bits_ | GetBit(Kind));
+  }
+
+  constexpr LogEventMask operator|(LogEventMask Other) const {
+    return LogEventMask(Bits_ | Other.Bits_);
+  }
+
+  constexpr bool Contains(LogEventKind Kind) const {
+    return (Bits_ & GetBit(Kind)) != 0;
+  }
+
+ private:
+  constexpr explicit LogEventMask(uint32_t Bits) : Bits_(Bits) {}
+
+  static constexpr uint32_t GetBit(LogEventKind Kind) {
+    return uint32_t{1} << static_cast<unsigned>(Kind);
+  }
+
+  uint32_t Bits_ = 0;
+};
+
+// The interface used by buffers to report state changes. The state changes
+// that analyses rely on are reported through typed functions, so that the
+// simulator can record them without formatting.
+// A logger only records the kinds of events it is subscribed to. Typed events
+// of other kinds are dropped before any work is done; callers of Log() must
+// check IsSubscribed(LogEventKind::kMessage) before building the message.
+class Logger {
+ public:
+  explicit Logger(LogEventMask Subscriptions = LogEventMask::All())
+      : Subscriptions_(Subscriptions) {}
+
+  virtual ~Logger();
+
+  bool IsSubscribed(LogEventKind Kind) const {
+    return Subscriptions_.Contains(Kind);
+  }
+
+  // Logs a free-form message.
+  virtual void Log(std::string MsgTag, std::string Msg) = 0;
+
+  // An instruction went through the buffer.
+  void LogInstruction(const InstructionIndex::Type& Instr) {
+    if (IsSubscribed(LogEventKind::kInstruction)) {
+      DoLogInstruction(Instr);
+    }
+  }
+
+  // A uop went through the buffer.
+  void LogUop(const UopId::Type& Uop) {
+    if (IsSubscribed(LogEventKind::kUop)) {
+      DoLogUop(Uop);
+    }
+  }
+
+  // The buffer is a port that generates port pressure information.
+  void LogPortPressureInit() {
+    if (IsSubscribed(LogEventKind::kPortPressureInit)) {
+      DoLogPortPressureInit();
+    }
+  }
+
+  // Instruction `Instr` used the port for `Cycles` cycles.
+  void LogPortPressure(const InstructionIndex::Type& Instr, float Cycles) {
+    if (IsSubscribed(LogEventKind::kPortPressure)) {
+      DoLogPortPressure(Instr, Cycles);
+    }
+  }
+
+  // The buffer has been stalled for `NumCycles` cycles.
+  void LogStall(unsigned NumCycles) {
+    if (IsSubscribed(LogEventKind::kStall)) {
+      DoLogStall(NumCycles);
+    }
+  }
+
+ protected:
+  // Implementations of the typed events. The default implementations format
+  // the event and forward it to Log().
+  virtual void DoLogInstruction(const InstructionIndex::Type& Instr);
+  virtual void DoLogUop(const UopId::Type& Uop);
+  virtual void DoLogPortPressureInit();
+  virtual void DoLogPortPressure(const InstructionIndex::Type& Instr,
+                                 float Cycles);
+  virtual void DoLogStall(unsigned NumCycles);
+
+ private:
+  const LogEventMask Subscriptions_;
+};
+
+namespace internal {
+
+template <typename Tag, typename = void>
+struct HasUopId : std::false_type {};
+
+template <typename Tag>
+struct HasUopId<Tag, decltype(void(Tag::GetUopId(
+                         std::declval<const typename Tag::Type&>())))>
+    : std::true_type {};
+
+}  // namespace internal
+
+// Logs an element of type `Tag::Type`: instructions and uops are logged as
+// typed events, other elements are formatted with `Tag::Format()`.
+template <typename Tag>
+void LogElement(Logger* Log, const typename Tag::Type& Elem) {
+  if constexpr (std::is_same<Tag, InstructionIndex>::value) {
+    Log->LogInstruction(Elem);
+  } else if constexpr (internal::HasUopId<Tag>::value) {
+    Log->LogUop(Tag::GetUopId(Elem));
+  } else if (Log->IsSubscribed(LogEventKind::kMessage)) {
+    Log->Log(Tag::kTagName, Tag::Format(Elem));
+  }
+}
+
 }  // namespace simulator
 }  // namespace exegesis
 
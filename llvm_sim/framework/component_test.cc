@@ -80,6 +80,18 @@ TEST(ComponentTest, UopIdFormatFail) {
   ASSERT_TRUE(UopId::Consume(Input, Out));
 }
 
+TEST(ComponentTest, LogEventMask) {
+  constexpr LogEventMask Mask =
+      LogEventMask().With(LogEventKind::kUop) |
+      LogEventMask().With(LogEventKind::kStall);
+  EXPECT_TRUE(Mask.Contains(LogEventKind::kUop));
+  EXPECT_TRUE(Mask.Contains(LogEventKind::kStall));
+  EXPECT_FALSE(Mask.Contains(LogEventKind::kInstruction));
+  EXPECT_FALSE(Mask.Contains(LogEventKind::kMessage));
+  EXPECT_FALSE(LogEventMask().Contains(LogEventKind::kUop));
+  EXPECT_TRUE(LogEventMask::All().Contains(LogEventKind::kMessage));
+}
+
 }  // namespace
 }  // namespace simulator
 }  // namespace exegesis
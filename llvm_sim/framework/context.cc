@@ -14,6 +14,12 @@
 
 #include "llvm_sim/framework/context.h"
 
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+
+#include "absl/synchronization/mutex.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/MC/MCCodeEmitter.h"
@@ -85,6 +91,69 @@ GlobalContext::ResourceHierarchy::ResourceHierarchy(
   }
 }
 
+// A concurrent map from MCInst to decomposition. The map is split into shards
+// that are guarded by their own reader/writer lock, so that concurrent lookups
+// of different instructions never contend, and concurrent lookups of the same
+// instruction only take a shared lock. Decompositions are never removed, so
+// references to them remain valid after the lock is released.
+class GlobalContext::DecompositionCache {
+ public:
+  // Returns the decomposition for `Inst`, or nullptr if there is none.
+  const InstrUopDecomposition* Find(const llvm::MCInst& Inst) const {
+    const Shard& S = GetShard(Inst);
+    absl::ReaderMutexLock Lock(&S.Mutex);
+    const auto It = S.Map.find(Inst);
+    return It == S.Map.end() ? nullptr : It->second.get();
+  }
+
+  // Inserts `Decomposition` if there is no decomposition for `Inst` yet.
+  // Returns the decomposition for `Inst`.
+  const InstrUopDecomposition& Insert(
+      const llvm::MCInst& Inst,
+      std::unique_ptr<InstrUopDecomposition> Decomposition) {
+    Shard& S = GetShard(Inst);
+    absl::MutexLock Lock(&S.Mutex);
+    // If another thread inserted the decomposition in the meantime, keep
+    // theirs: references to it might already have been handed out.
+    return *S.Map.try_emplace(Inst, std::move(Decomposition)).first->second;
+  }
+
+  // Replaces the decomposition for `Inst`.
+  void Set(const llvm::MCInst& Inst,
+           std::unique_ptr<InstrUopDecomposition> Decomposition) {
+    Shard& S = GetShard(Inst);
+    absl::MutexLock Lock(&S.Mutex);
+    S.Map[Inst] = std::move(Decomposition);
+  }
+
+ private:
+  static constexpr int kShardBits = 4;
+  static constexpr size_t kNumShards = size_t{1} << kShardBits;
+
+  struct Shard {
+    mutable absl::Mutex Mutex;
+    absl::flat_hash_map<llvm::MCInst, std::unique_ptr<InstrUopDecomposition>,
+                        absl::Hash<llvm::MCInst>, MCInstEq>
+        Map ABSL_GUARDED_BY(Mutex);
+  };
+
+  // The flat_hash_map uses the low bits of the hash to select its slots, so we
+  // use the top kShardBits bits to select the shard, whatever the width of
+  // size_t.
+  size_t GetShardIndex(const llvm::MCInst& Inst) const {
+    const size_t Hash = absl::Hash<llvm::MCInst>()(Inst);
+    return Hash >> (std::numeric_limits<size_t>::digits - kShardBits);
+  }
+  Shard& GetShard(const llvm::MCInst& Inst) {
+    return Shards_[GetShardIndex(Inst)];
+  }
+  const Shard& GetShard(const llvm::MCInst& Inst) const {
+    return Shards_[GetShardIndex(Inst)];
+  }
+
+  std::array<Shard, kNumShards> Shards_;
+};
+
 std::unique_ptr<const GlobalContext> GlobalContext::Create(
     llvm::StringRef TripleName, llvm::StringRef CpuName) {
   return CreateMutable(TripleName, CpuName);
@@ -123,7 +192,8 @@ std::unique_ptr<GlobalContext> GlobalContext::CreateMutable(
   return Context;
 }
 
-GlobalContext::GlobalContext() {}
+GlobalContext::GlobalContext()
+    : DecompositionCache_(absl::make_unique<DecompositionCache>()) {}
 
 GlobalContext::~GlobalContext() {}
 
@@ -205,10 +275,25 @@ void GlobalContext::ComputeInstructionUops(
     if (NumCycles == 0) {
       continue;
     }
-    // Un-denormalize resource usage to avoid double-counting.
+    // Un-denormalize resource usage to avoid double-counting. Some scheduling
+    // models (e.g. znver2) do not denormalize usage to all super resources, so
+    // make sure that we do not underflow.
     for (const unsigned SuperProcResIdx :
          ResourceHierarchy_->GetSuperResources(ProcResIdx)) {
-      assert(ProcResIdxToCycles[SuperProcResIdx] >= NumCycles);
+      if (ProcResIdxToCycles[SuperProcResIdx] < NumCycles) {
+#if !defined(NDEBUG)
+        // These are TD inconsistencies that should be fixed in LLVM.
+        llvm::errs() << InstrInfo->getName(Inst.getOpcode())
+                     << ": super resource "
+                     << SchedModel->getProcResource(SuperProcResIdx)->Name
+                     << " has " << ProcResIdxToCycles[SuperProcResIdx]
+                     << " cycles but its sub resource "
+                     << SchedModel->getProcResource(ProcResIdx)->Name
+                     << " has " << NumCycles << ", clamping\n";
+#endif
+        ProcResIdxToCycles[SuperProcResIdx] = 0;
+        continue;
+      }
       ProcResIdxToCycles[SuperProcResIdx] -= NumCycles;
     }
     // Emit `NumCycles` Uops that consume this resource during one cycle.
@@ -304,26 +389,147 @@ void GlobalContext::ComputeUopLatencies(
 
 const InstrUopDecomposition& GlobalContext::GetInstructionDecomposition(
     const llvm::MCInst& Inst) const {
-  auto& Result = DecompositionCache_[Inst];
-  if (Result) {
-    return *Result;
+  if (const InstrUopDecomposition* const Cached =
+          DecompositionCache_->Find(Inst)) {
+    return *Cached;
   }
-  // The decomposition is not cached; compute it.
-  if (!ResourceHierarchy_) {
+  // The decomposition is not cached; compute it. This happens without holding
+  // any lock: several threads might compute the same decomposition, but only
+  // the first one to finish gets cached.
+  absl::call_once(ResourceHierarchyOnce_, [this]() {
     assert(SchedModel && "instruction decomposition requires a SchedModel");
     ResourceHierarchy_ = absl::make_unique<ResourceHierarchy>(*SchedModel);
-  }
+  });
 
-  Result = absl::make_unique<InstrUopDecomposition>();
+  auto Result = absl::make_unique<InstrUopDecomposition>();
   ComputeInstructionUops(Inst, &Result->Uops);
   ComputeUopLatencies(Inst, &Result->Uops);
-  return *Result;
+  return DecompositionCache_->Insert(Inst, std::move(Result));
+}
+
+void GlobalContext::WarmUpInstructionDecompositions(
+    llvm::ArrayRef<llvm::MCInst> Instructions) const {
+  for (const llvm::MCInst& Inst : Instructions) {
+    GetInstructionDecomposition(Inst);
+  }
+}
+
+void GlobalContext::SetInstructionDecomposition(
+    const llvm::MCInst& Inst,
+    std::unique_ptr<InstrUopDecomposition> Decomposition) const {
+  DecompositionCache_->Set(Inst, std::move(Decomposition));
+}
+
+LoweredBlock::LoweredBlock(const GlobalContext& Context,
+                           llvm::ArrayRef<llvm::MCInst> Instructions) {
+  // Offsets of the uops, uses and defs of each instruction.
+  struct Offsets {
+    size_t UopsBegin;
+    size_t UopsEnd;
+    size_t UsesBegin;
+    size_t DefsBegin;
+    size_t DefsEnd;
+  };
+  std::vector<Offsets> InstrOffsets;
+  InstrOffsets.reserve(Instructions.size());
+  for (const llvm::MCInst& Inst : Instructions) {
+    Offsets InstrOffset;
+    InstrOffset.UopsBegin = Uops_.size();
+    const auto& Decomposition = Context.GetInstructionDecomposition(Inst);
+    Uops_.insert(Uops_.end(), Decomposition.Uops.begin(),
+                 Decomposition.Uops.end());
+    InstrOffset.UopsEnd = Uops_.size();
+
+    InstrOffset.UsesBegin = Registers_.size();
+    InstrOffset.DefsBegin = Registers_.size();
+    // Test contexts might not describe instructions, which then have no
+    // registers.
+    if (Context.InstrInfo) {
+      const auto& InstrDesc = Context.InstrInfo->get(Inst.getOpcode());
+      // LLVM stores explicit defs, then explicit uses.
+      for (unsigned I = InstrDesc.getNumDefs(); I < Inst.getNumOperands();
+           ++I) {
+        const llvm::MCOperand& Op = Inst.getOperand(I);
+        assert(Op.isValid());
+        if (Op.isReg() && Op.getReg() != 0) {
+          Registers_.push_back(Op.getReg());
+        }
+      }
+      for (const llvm::MCPhysReg* Reg = InstrDesc.getImplicitUses();
+           Reg && *Reg != 0; ++Reg) {
+        Registers_.push_back(*Reg);
+      }
+      InstrOffset.DefsBegin = Registers_.size();
+      for (unsigned I = 0; I < InstrDesc.getNumDefs(); ++I) {
+        const llvm::MCOperand& Op = Inst.getOperand(I);
+        assert(Op.isValid());
+        if (Op.isReg()) {
+          Registers_.push_back(Op.getReg());
+        }
+      }
+      for (const llvm::MCPhysReg* Reg = InstrDesc.getImplicitDefs();
+           Reg && *Reg != 0; ++Reg) {
+        Registers_.push_back(*Reg);
+      }
+    }
+    InstrOffset.DefsEnd = Registers_.size();
+    InstrOffsets.push_back(InstrOffset);
+  }
+
+  // The tables do not move anymore.
+  Instructions_.resize(Instructions.size());
+  for (size_t I = 0; I < Instructions.size(); ++I) {
+    const Offsets& InstrOffset = InstrOffsets[I];
+    Instruction& Instr = Instructions_[I];
+    Instr.Uops =
+        llvm::makeArrayRef(Uops_.data() + InstrOffset.UopsBegin,
+                           InstrOffset.UopsEnd - InstrOffset.UopsBegin);
+    Instr.Uses =
+        llvm::makeArrayRef(Registers_.data() + InstrOffset.UsesBegin,
+                           InstrOffset.DefsBegin - InstrOffset.UsesBegin);
+    Instr.Defs =
+        llvm::makeArrayRef(Registers_.data() + InstrOffset.DefsBegin,
+                           InstrOffset.DefsEnd - InstrOffset.DefsBegin);
+  }
 }
 
 BlockContext::BlockContext(llvm::ArrayRef<llvm::MCInst> Instructions,
                            bool IsLoop)
     : Instructions_(Instructions), IsLoop_(IsLoop) {}
 
+BlockContext::BlockContext(llvm::ArrayRef<llvm::MCInst> Instructions,
+                           llvm::ArrayRef<size_t> BlockEnds, BlockTrace* Trace)
+    : Instructions_(Instructions),
+      IsLoop_(false),
+      BlockEnds_(BlockEnds),
+      Trace_(Trace) {
+  assert(Trace_ != nullptr);
+  assert(!BlockEnds_.empty() && BlockEnds_.back() == Instructions_.size() &&
+         "the blocks must cover the instructions");
+  assert(std::adjacent_find(BlockEnds_.begin(), BlockEnds_.end(),
+                            std::greater_equal<size_t>()) ==
+             BlockEnds_.end() &&
+         BlockEnds_.front() > 0 && "blocks must not be empty");
+}
+
+const LoweredBlock& BlockContext::GetLoweredBlock(
+    const GlobalContext& Context) const {
+  absl::call_once(Lowered_->Once, [this, &Context]() {
+    Lowered_->Block = absl::make_unique<LoweredBlock>(Context, Instructions_);
+    Lowered_->Context = &Context;
+  });
+  assert(Lowered_->Context == &Context &&
+         "the block was lowered for another context");
+  return *Lowered_->Block;
+}
+
+bool BlockContext::IsLastInstructionOfBlock(size_t BBIndex) const {
+  if (Trace_ == nullptr) {
+    return BBIndex + 1 == Instructions_.size();
+  }
+  return std::binary_search(BlockEnds_.begin(), BlockEnds_.end(), BBIndex + 1);
+}
+
 bool GlobalContext::MCInstEq::operator()(const llvm::MCInst& A,
                                          const llvm::MCInst& B) const {
   if (A.getOpcode() != B.getOpcode()) {
@@ -19,8 +19,10 @@
 #ifndef EXEGESIS_LLVM_SIM_FRAMEWORK_CONTEXT_H_
 #define EXEGESIS_LLVM_SIM_FRAMEWORK_CONTEXT_H_
 
+#include <memory>
 #include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/container/flat_hash_map.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
@@ -99,10 +101,18 @@ class GlobalContext {
       const llvm::MCInst& Inst) const;
 
   // Returns the decomposition of an instruction in uops. The decomposition is
-  // computed lazily and cached until the context is destroyed.
+  // computed lazily and cached until the context is destroyed. This is
+  // thread-safe, and the returned reference is valid for the lifetime of the
+  // context.
   virtual const InstrUopDecomposition& GetInstructionDecomposition(
       const llvm::MCInst& Inst) const;
 
+  // Computes and caches the decompositions of `Instructions` ahead of time, so
+  // that subsequent calls to GetInstructionDecomposition() for these
+  // instructions are pure cache lookups.
+  void WarmUpInstructionDecompositions(
+      llvm::ArrayRef<llvm::MCInst> Instructions) const;
+
   llvm::Triple Triple;
   const llvm::Target* Target = nullptr;
 
@@ -115,18 +125,18 @@ class GlobalContext {
   std::unique_ptr<const llvm::MCCodeEmitter> CodeEmitter;
   const llvm::MCSchedModel* SchedModel = nullptr;
 
-  // For tests.
+  // For tests. Must not be called concurrently with
+  // GetInstructionDecomposition() for the same instruction.
   void SetInstructionDecomposition(
       const llvm::MCInst& Inst,
-      std::unique_ptr<InstrUopDecomposition> Decomposition) const {
-    DecompositionCache_[Inst] = std::move(Decomposition);
-  }
+      std::unique_ptr<InstrUopDecomposition> Decomposition) const;
 
   struct MCInstEq {
     bool operator()(const llvm::MCInst& A, const llvm::MCInst& B) const;
   };
 
  private:
+  class DecompositionCache;
   class ResourceHierarchy;
 
   // Creates a (mutable) GlobalContext for the given LLVM triple and the CPU
@@ -142,13 +152,11 @@ class GlobalContext {
       const llvm::MCInst& Inst,
       llvm::SmallVectorImpl<InstrUopDecomposition::Uop>* Uops) const;
 
-  // A cache for GetResourceUnitsForUop.
-  mutable absl::flat_hash_map<llvm::MCInst,
-                              std::unique_ptr<InstrUopDecomposition>,
-                              absl::Hash<llvm::MCInst>, MCInstEq>
-      DecompositionCache_;
+  // A cache for GetInstructionDecomposition.
+  const std::unique_ptr<DecompositionCache> DecompositionCache_;
 
   // Mutable because lazily initialized.
+  mutable absl::once_flag ResourceHierarchyOnce_;
   mutable std::unique_ptr<ResourceHierarchy> ResourceHierarchy_;
 
   friend std::unique_ptr<GlobalContext> CreateGlobalContextForClif(
@@ -169,26 +177,123 @@ class GlobalContext {
 std::unique_ptr<GlobalContext> CreateGlobalContextForClif(
     const std::string& LlvmTriple, const std::string& CpuName);
 
+class BlockTrace;
+
+// The instructions of a block lowered to flat tables: the uops and the
+// registers of an instruction are indexed by BBIndex, instead of being looked
+// up by MCInst in the GlobalContext on every access.
+class LoweredBlock {
+ public:
+  struct Instruction {
+    // The uops of the instruction, see `InstrUopDecomposition`.
+    llvm::ArrayRef<InstrUopDecomposition::Uop> Uops;
+    // The registers read by the instruction: explicit uses, then implicit
+    // uses. Null registers are skipped.
+    llvm::ArrayRef<unsigned> Uses;
+    // The registers written by the instruction: explicit defs, then implicit
+    // defs.
+    llvm::ArrayRef<unsigned> Defs;
+  };
+
+  LoweredBlock(const GlobalContext& Context,
+               llvm::ArrayRef<llvm::MCInst> Instructions);
+
+  LoweredBlock(const LoweredBlock&) = delete;
+  LoweredBlock& operator=(const LoweredBlock&) = delete;
+
+  const Instruction& GetInstruction(size_t BBIndex) const {
+    assert(BBIndex < Instructions_.size());
+    return Instructions_[BBIndex];
+  }
+
+ private:
+  // The uops and registers of all instructions, which `Instructions_` point
+  // into.
+  std::vector<InstrUopDecomposition::Uop> Uops_;
+  std::vector<unsigned> Registers_;
+  std::vector<Instruction> Instructions_;
+};
+
 // This is the block context which is valid for a single basic block simulation.
+//
+// The context can also describe a region made of several basic blocks, which
+// the simulator follows in the order given by a `BlockTrace`. Each block of
+// the trace is then an iteration: `InstructionIndex::Iteration` is the
+// position of the block in the trace, and `InstructionIndex::BBIndex` is the
+// index of the instruction in the instructions of the region.
 class BlockContext {
  public:
   BlockContext(llvm::ArrayRef<llvm::MCInst> Instructions, bool IsLoop);
 
-  // Returns the number of instructions in the basic block.
+  // Creates the context of a region with several basic blocks. `Instructions`
+  // is the concatenation of the blocks, and block `I` ends before instruction
+  // `BlockEnds[I]`. Blocks must not be empty. `Trace` is consumed by the
+  // simulation, and rewound when it starts.
+  BlockContext(llvm::ArrayRef<llvm::MCInst> Instructions,
+               llvm::ArrayRef<size_t> BlockEnds, BlockTrace* Trace);
+
+  // Returns the number of instructions in the basic block, or in all the
+  // basic blocks of the region.
   size_t GetNumBasicBlockInstructions() const { return Instructions_.size(); }
 
   // Returns true if this is a perfectly predicted loop body.
   bool IsLoop() const { return IsLoop_; }
 
+  // Returns the trace to follow, or nullptr for a single basic block.
+  BlockTrace* GetTrace() const { return Trace_; }
+
+  // Returns the number of basic blocks.
+  size_t GetNumBlocks() const {
+    return Trace_ == nullptr ? 1 : BlockEnds_.size();
+  }
+
+  // Returns the range of instructions of the `BlockId`-th block.
+  size_t GetBlockBegin(size_t BlockId) const {
+    return BlockId == 0 ? 0 : GetBlockEnd(BlockId - 1);
+  }
+  size_t GetBlockEnd(size_t BlockId) const {
+    assert(BlockId < GetNumBlocks());
+    return Trace_ == nullptr ? Instructions_.size() : BlockEnds_[BlockId];
+  }
+
+  // Returns true if the `BBIndex`-th instruction is the last instruction of
+  // its basic block, i.e. if an iteration ends when it retires.
+  bool IsLastInstructionOfBlock(size_t BBIndex) const;
+
+  // Returns the instructions in the basic block.
+  llvm::ArrayRef<llvm::MCInst> GetInstructions() const { return Instructions_; }
+
   // Return the MCInst for the `BBIndex`-th instruction.
   const llvm::MCInst& GetInstruction(size_t BBIndex) const {
     assert(BBIndex < Instructions_.size());
     return Instructions_[BBIndex];
   }
 
+  // Returns the instructions lowered for `Context`. The instructions are
+  // lowered on the first call, which must happen after their decompositions
+  // are final; all calls must use the same context. This is thread-safe, and
+  // copies of the context share the lowered instructions.
+  const LoweredBlock& GetLoweredBlock(const GlobalContext& Context) const;
+
+  // Shorthand for GetLoweredBlock(Context).GetInstruction(BBIndex).
+  const LoweredBlock::Instruction& GetLoweredInstruction(
+      const GlobalContext& Context, size_t BBIndex) const {
+    return GetLoweredBlock(Context).GetInstruction(BBIndex);
+  }
+
  private:
+  struct LazyLoweredBlock {
+    absl::once_flag Once;
+    std::unique_ptr<const LoweredBlock> Block;
+    const GlobalContext* Context = nullptr;
+  };
+
   const llvm::ArrayRef<llvm::MCInst> Instructions_;
   const bool IsLoop_;
+  const llvm::ArrayRef<size_t> BlockEnds_;
+  BlockTrace* const Trace_ = nullptr;
+  const std::shared_ptr<LazyLoweredBlock> Lowered_ =
+      std::make_shared<LazyLoweredBlock>();
 };
 
 }  // namespace simulator
@@ -14,8 +14,11 @@
 
 #include "llvm_sim/framework/context.h"
 
+#include <thread>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "llvm_sim/framework/block_trace.h"
 
 namespace exegesis {
 namespace simulator {
@@ -188,6 +191,106 @@ TEST(ContextTest, Decomposition) {
   }
 }
 
+// Sets up a fake target where all instructions have one uop on P0.
+class SingleUopContextTest : public ::testing::Test {
+ protected:
+  static constexpr unsigned kNumOpcodes = 64;
+
+  void SetUp() override {
+    auto InstrInfo = absl::make_unique<llvm::MCInstrInfo>();
+    for (unsigned Opcode = 1; Opcode < kNumOpcodes; ++Opcode) {
+      InstrDesc_[Opcode].SchedClass = 1;
+    }
+    InstrInfo->InitMCInstrInfo(InstrDesc_.data(), InstrNameIndices_.data(),
+                               "I", nullptr, nullptr, InstrDesc_.size());
+    Context_.InstrInfo = std::move(InstrInfo);
+
+    ProcResources_[1].NumUnits = 1;
+    ProcResources_[1].SubUnitsIdxBegin = nullptr;
+    SchedModel_.ProcResourceTable = ProcResources_.data();
+    SchedModel_.NumProcResourceKinds = ProcResources_.size();
+    SchedClasses_[1].NumMicroOps = 1;
+    SchedClasses_[1].WriteProcResIdx = 1;
+    SchedClasses_[1].NumWriteProcResEntries = 1;
+    SchedModel_.SchedClassTable = SchedClasses_.data();
+    SchedModel_.NumSchedClasses = SchedClasses_.size();
+    SchedModel_.InstrItineraries = nullptr;
+    Context_.SchedModel = &SchedModel_;
+
+    WriteProcResEntries_[1].ProcResourceIdx = 1;
+    WriteProcResEntries_[1].Cycles = 1;
+    Context_.SubtargetInfo = absl::make_unique<llvm::MCSubtargetInfo>(
+        llvm::Triple(), /*CPU=*/"", /*TuneCPU=*/"", /*FeatureString=*/"",
+        llvm::ArrayRef<llvm::SubtargetFeatureKV>(),
+        llvm::ArrayRef<llvm::SubtargetSubTypeKV>(),
+        WriteProcResEntries_.data(), WriteLatencyEntries_.data(),
+        /*ReadAdvanceEntries=*/nullptr, /*InstrStages=*/nullptr,
+        /*OperandCycles=*/nullptr, /*ForwardingPaths=*/nullptr);
+  }
+
+  static llvm::MCInst MakeInst(unsigned Opcode) {
+    llvm::MCInst Inst;
+    Inst.setOpcode(Opcode);
+    return Inst;
+  }
+
+  GlobalContext Context_;
+
+ private:
+  std::array<llvm::MCInstrDesc, kNumOpcodes> InstrDesc_ = {};
+  std::array<unsigned, kNumOpcodes> InstrNameIndices_ = {};
+  llvm::MCSchedModel SchedModel_ = {};
+  std::array<llvm::MCProcResourceDesc, 2> ProcResources_ = {};
+  std::array<llvm::MCSchedClassDesc, 2> SchedClasses_ = {};
+  std::array<llvm::MCWriteProcResEntry, 2> WriteProcResEntries_ = {};
+  std::array<llvm::MCWriteLatencyEntry, 1> WriteLatencyEntries_ = {};
+};
+
+TEST_F(SingleUopContextTest, ConcurrentDecomposition) {
+  constexpr int kNumThreads = 8;
+  // Each thread queries all instructions, in a different order.
+  std::vector<std::vector<const InstrUopDecomposition*>> Results(
+      kNumThreads,
+      std::vector<const InstrUopDecomposition*>(kNumOpcodes, nullptr));
+  std::vector<std::thread> Threads;
+  for (int T = 0; T < kNumThreads; ++T) {
+    Threads.emplace_back([this, T, &Results]() {
+      for (unsigned I = 0; I < kNumOpcodes - 1; ++I) {
+        const unsigned Opcode = 1 + (I + 7 * T) % (kNumOpcodes - 1);
+        Results[T][Opcode] =
+            &Context_.GetInstructionDecomposition(MakeInst(Opcode));
+      }
+    });
+  }
+  for (auto& Thread : Threads) {
+    Thread.join();
+  }
+
+  // All threads must see the same decomposition.
+  for (unsigned Opcode = 1; Opcode < kNumOpcodes; ++Opcode) {
+    const InstrUopDecomposition* const Decomposition =
+        &Context_.GetInstructionDecomposition(MakeInst(Opcode));
+    ASSERT_THAT(Decomposition->Uops,
+                ElementsAre(Field(&InstrUopDecomposition::Uop::ProcResIdx,
+                                  Eq(1u))));
+    for (int T = 0; T < kNumThreads; ++T) {
+      EXPECT_EQ(Results[T][Opcode], Decomposition) << Opcode;
+    }
+  }
+}
+
+TEST_F(SingleUopContextTest, WarmUp) {
+  const std::vector<llvm::MCInst> Instructions = {MakeInst(1), MakeInst(2),
+                                                  MakeInst(1)};
+  Context_.WarmUpInstructionDecompositions(Instructions);
+  const InstrUopDecomposition* const Decomposition =
+      &Context_.GetInstructionDecomposition(MakeInst(1));
+  EXPECT_EQ(Decomposition,
+            &Context_.GetInstructionDecomposition(Instructions[2]));
+  EXPECT_NE(Decomposition,
+            &Context_.GetInstructionDecomposition(Instructions[1]));
+}
+
 TEST(BlockContextTest, GetInstruction) {
   std::vector<llvm::MCInst> Instructions(2);
   const BlockContext BlockContext(Instructions, false);
@@ -196,6 +299,95 @@ TEST(BlockContextTest, GetInstruction) {
   ASSERT_NE(&BlockContext.GetInstruction(0), &BlockContext.GetInstruction(1));
 }
 
+TEST(BlockContextTest, Blocks) {
+  std::vector<llvm::MCInst> Instructions(5);
+  {
+    const BlockContext BlockContext(Instructions, true);
+    EXPECT_EQ(BlockContext.GetTrace(), nullptr);
+    EXPECT_EQ(BlockContext.GetNumBlocks(), 1);
+    EXPECT_EQ(BlockContext.GetBlockBegin(0), 0);
+    EXPECT_EQ(BlockContext.GetBlockEnd(0), 5);
+    EXPECT_FALSE(BlockContext.IsLastInstructionOfBlock(3));
+    EXPECT_TRUE(BlockContext.IsLastInstructionOfBlock(4));
+  }
+  {
+    const std::vector<size_t> BlockEnds = {2, 3, 5};
+    VectorBlockTrace Trace({});
+    const BlockContext BlockContext(Instructions, BlockEnds, &Trace);
+    EXPECT_FALSE(BlockContext.IsLoop());
+    EXPECT_EQ(BlockContext.GetTrace(), &Trace);
+    EXPECT_EQ(BlockContext.GetNumBasicBlockInstructions(), 5);
+    EXPECT_EQ(BlockContext.GetNumBlocks(), 3);
+    EXPECT_EQ(BlockContext.GetBlockBegin(1), 2);
+    EXPECT_EQ(BlockContext.GetBlockEnd(1), 3);
+    EXPECT_EQ(BlockContext.GetBlockBegin(2), 3);
+    EXPECT_EQ(BlockContext.GetBlockEnd(2), 5);
+    EXPECT_FALSE(BlockContext.IsLastInstructionOfBlock(0));
+    EXPECT_TRUE(BlockContext.IsLastInstructionOfBlock(1));
+    EXPECT_TRUE(BlockContext.IsLastInstructionOfBlock(2));
+    EXPECT_FALSE(BlockContext.IsLastInstructionOfBlock(3));
+    EXPECT_TRUE(BlockContext.IsLastInstructionOfBlock(4));
+  }
+}
+
+TEST(BlockContextTest, LoweredBlock) {
+  GlobalContext Context;
+  // Opcode 1 defines its first operand, reads register 7 and writes register 8.
+  const llvm::MCPhysReg ImplicitUses[] = {7, 0};
+  const llvm::MCPhysReg ImplicitDefs[] = {8, 0};
+  std::array<llvm::MCInstrDesc, 3> InstrDesc = {};
+  InstrDesc[1].NumDefs = 1;
+  InstrDesc[1].ImplicitUses = ImplicitUses;
+  InstrDesc[1].ImplicitDefs = ImplicitDefs;
+  auto InstrInfo = absl::make_unique<llvm::MCInstrInfo>();
+  InstrInfo->InitMCInstrInfo(InstrDesc.data(), nullptr, nullptr, nullptr,
+                             nullptr, InstrDesc.size());
+  Context.InstrInfo = std::move(InstrInfo);
+
+  std::vector<llvm::MCInst> Instructions(2);
+  Instructions[0].setOpcode(1);
+  Instructions[0].addOperand(llvm::MCOperand::createReg(3));
+  Instructions[0].addOperand(llvm::MCOperand::createReg(4));
+  Instructions[0].addOperand(llvm::MCOperand::createReg(0));
+  Instructions[0].addOperand(llvm::MCOperand::createImm(5));
+  Instructions[1].setOpcode(2);
+  {
+    auto Decomposition = absl::make_unique<InstrUopDecomposition>();
+    Decomposition->Uops.resize(1);
+    Decomposition->Uops[0].ProcResIdx = 1;
+    Context.SetInstructionDecomposition(Instructions[0],
+                                        std::move(Decomposition));
+  }
+  {
+    auto Decomposition = absl::make_unique<InstrUopDecomposition>();
+    Decomposition->Uops.resize(2);
+    Decomposition->Uops[0].ProcResIdx = 2;
+    Decomposition->Uops[1].ProcResIdx = 3;
+    Context.SetInstructionDecomposition(Instructions[1],
+                                        std::move(Decomposition));
+  }
+
+  const BlockContext BlockContext(Instructions, true);
+  const LoweredBlock& Lowered = BlockContext.GetLoweredBlock(Context);
+  const auto& Instr0 = Lowered.GetInstruction(0);
+  EXPECT_THAT(Instr0.Uops, ElementsAre(Field(
+                               &InstrUopDecomposition::Uop::ProcResIdx, 1u)));
+  EXPECT_THAT(Instr0.Uses, ElementsAre(4u, 7u));
+  EXPECT_THAT(Instr0.Defs, ElementsAre(3u, 8u));
+  const auto& Instr1 = Lowered.GetInstruction(1);
+  EXPECT_THAT(Instr1.Uops,
+              ElementsAre(Field(&InstrUopDecomposition::Uop::ProcResIdx, 2u),
+                          Field(&InstrUopDecomposition::Uop::ProcResIdx, 3u)));
+  EXPECT_THAT(Instr1.Uses, ElementsAre());
+  EXPECT_THAT(Instr1.Defs, ElementsAre());
+
+  // The block is lowered once, and copies share it.
+  EXPECT_EQ(&BlockContext.GetLoweredBlock(Context), &Lowered);
+  const class BlockContext Copy = BlockContext;
+  EXPECT_EQ(&Copy.GetLoweredBlock(Context), &Lowered);
+  EXPECT_EQ(&Copy.GetLoweredInstruction(Context, 1), &Instr1);
+}
+
 TEST(BlockContextTest, MCInstEqHash) {
   const GlobalContext::MCInstEq InstEq;
   const absl::Hash<llvm::MCInst> InstHash;
@@ -20,6 +20,92 @@
 namespace exegesis {
 namespace simulator {
 
+namespace {
+
+// A logger that stores the last message in a log line.
+class LineFormatter : public Logger {
+ public:
+  explicit LineFormatter(SimulationLog::Line* Line) : Line_(Line) {}
+
+  void Log(std::string MsgTag, std::string Msg) override {
+    Line_->MsgTag = std::move(MsgTag);
+    Line_->Msg = std::move(Msg);
+  }
+
+ private:
+  SimulationLog::Line* const Line_;
+};
+
+}  // namespace
+
+SimulationLog::Event SimulationLog::Event::Instruction(
+    unsigned Cycle, size_t BufferIndex, const InstructionIndex::Type& Instr) {
+  Event Result(KindE::kInstruction, Cycle, BufferIndex);
+  Result.Iteration_ = Instr.Iteration;
+  Result.BBIndex_ = Instr.BBIndex;
+  return Result;
+}
+
+SimulationLog::Event SimulationLog::Event::Uop(unsigned Cycle,
+                                               size_t BufferIndex,
+                                               const UopId::Type& Uop) {
+  Event Result(KindE::kUop, Cycle, BufferIndex);
+  Result.Iteration_ = Uop.InstrIndex.Iteration;
+  Result.BBIndex_ = Uop.InstrIndex.BBIndex;
+  Result.Payload_.UopIndex = Uop.UopIndex;
+  return Result;
+}
+
+SimulationLog::Event SimulationLog::Event::PortPressureInit(
+    unsigned Cycle, size_t BufferIndex) {
+  return Event(KindE::kPortPressureInit, Cycle, BufferIndex);
+}
+
+SimulationLog::Event SimulationLog::Event::PortPressure(
+    unsigned Cycle, size_t BufferIndex, const InstructionIndex::Type& Instr,
+    float Cycles) {
+  Event Result(KindE::kPortPressure, Cycle, BufferIndex);
+  Result.Iteration_ = Instr.Iteration;
+  Result.BBIndex_ = Instr.BBIndex;
+  Result.Payload_.PortPressureCycles = Cycles;
+  return Result;
+}
+
+SimulationLog::Event SimulationLog::Event::Stall(unsigned Cycle,
+                                                 size_t BufferIndex,
+                                                 unsigned NumCycles) {
+  Event Result(KindE::kStall, Cycle, BufferIndex);
+  Result.Payload_.NumStallCycles = NumCycles;
+  return Result;
+}
+
+SimulationLog::Line SimulationLog::Event::ToLine() const {
+  Line Result;
+  Result.Cycle = Cycle_;
+  Result.BufferIndex = BufferIndex_;
+  LineFormatter Formatter(&Result);
+  switch (Kind_) {
+    case KindE::kInstruction:
+      Formatter.LogInstruction(GetInstructionIndex());
+      break;
+    case KindE::kUop:
+      Formatter.LogUop(GetUopId());
+      break;
+    case KindE::kPortPressureInit:
+      Formatter.LogPortPressureInit();
+      break;
+    case KindE::kPortPressure:
+      Formatter.LogPortPressure(GetInstructionIndex(), GetPortPressureCycles());
+      break;
+    case KindE::kStall:
+      Formatter.LogStall(GetNumStallCycles());
+      break;
+    case KindE::kMessage:
+      llvm_unreachable("events are never messages");
+  }
+  return Result;
+}
+
 SimulationLog::SimulationLog(
     const std::vector<BufferDescription>& BufferDescriptions)
     : BufferDescriptions(BufferDescriptions) {}
@@ -27,6 +113,9 @@ SimulationLog::SimulationLog(
 std::string SimulationLog::DebugString() const {
   std::stringstream Out;
   auto SortedLines = Lines;
+  for (const auto& Event : Events) {
+    SortedLines.push_back(Event.ToLine());
+  }
   std::sort(SortedLines.begin(), SortedLines.end(),
             [](const Line& A, const Line& B) {
               return std::tie(A.Cycle, A.BufferIndex, A.Msg) <
@@ -49,5 +138,7 @@ size_t SimulationLog::GetNumCompleteIterations() const {
   return Iterations.size();
 }
 
+SimulationObserver::~SimulationObserver() {}
+
 }  // namespace simulator
 }  // namespace exegesis
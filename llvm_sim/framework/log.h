@@ -16,7 +16,9 @@
 #ifndef EXEGESIS_LLVM_SIM_FRAMEWORK_LOG_H_
 #define EXEGESIS_LLVM_SIM_FRAMEWORK_LOG_H_
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "llvm_sim/framework/component.h"
 
@@ -49,6 +51,80 @@ class SimulationLog {
     std::string Msg;
   };
 
+  // A fixed-size record for the typed events of `Logger` (instructions and
+  // uops going through buffers, port pressure, stalls). Events are cheap to
+  // record, and analyses read them through the typed accessors below instead of
+  // parsing messages.
+  class Event {
+   public:
+    // Events are never of kind kMessage.
+    using KindE = LogEventKind;
+
+    static Event Instruction(unsigned Cycle, size_t BufferIndex,
+                             const InstructionIndex::Type& Instr);
+    static Event Uop(unsigned Cycle, size_t BufferIndex,
+                     const UopId::Type& Uop);
+    static Event PortPressureInit(unsigned Cycle, size_t BufferIndex);
+    static Event PortPressure(unsigned Cycle, size_t BufferIndex,
+                              const InstructionIndex::Type& Instr,
+                              float Cycles);
+    static Event Stall(unsigned Cycle, size_t BufferIndex, unsigned NumCycles);
+
+    KindE GetKind() const { return Kind_; }
+    unsigned GetCycle() const { return Cycle_; }
+    size_t GetBufferIndex() const { return BufferIndex_; }
+
+    // Valid for kInstruction, kUop and kPortPressure.
+    InstructionIndex::Type GetInstructionIndex() const {
+      assert(Kind_ == KindE::kInstruction || Kind_ == KindE::kUop ||
+             Kind_ == KindE::kPortPressure);
+      InstructionIndex::Type Instr;
+      Instr.BBIndex = BBIndex_;
+      Instr.Iteration = Iteration_;
+      return Instr;
+    }
+
+    // Valid for kUop.
+    UopId::Type GetUopId() const {
+      assert(Kind_ == KindE::kUop);
+      UopId::Type Uop;
+      Uop.InstrIndex = GetInstructionIndex();
+      Uop.UopIndex = Payload_.UopIndex;
+      return Uop;
+    }
+
+    // Valid for kPortPressure.
+    float GetPortPressureCycles() const {
+      assert(Kind_ == KindE::kPortPressure);
+      return Payload_.PortPressureCycles;
+    }
+
+    // Valid for kStall.
+    unsigned GetNumStallCycles() const {
+      assert(Kind_ == KindE::kStall);
+      return Payload_.NumStallCycles;
+    }
+
+    // Returns the event formatted as a log line, as the default `Logger`
+    // implementation would have logged it.
+    Line ToLine() const;
+
+   private:
+    Event(KindE Kind, unsigned Cycle, size_t BufferIndex)
+        : Kind_(Kind), BufferIndex_(BufferIndex), Cycle_(Cycle) {}
+
+    KindE Kind_;
+    uint32_t BufferIndex_;
+    uint32_t Cycle_;
+    uint32_t Iteration_ = 0;
+    uint32_t BBIndex_ = 0;
+    union {
+      uint32_t UopIndex;
+      float PortPressureCycles;
+      uint32_t NumStallCycles;
+    } Payload_ = {0};
+  };
+
   // Statistics about iterations.
   struct IterationStats {
     // Cycle when the last instruction completed.
@@ -60,15 +136,48 @@ class SimulationLog {
 
   std::string DebugString() const;
 
-  // Buffer descriptions, one per buffer. Line::BufferIndex refers to these.
+  // Buffer descriptions, one per buffer. Line::BufferIndex and
+  // Event::GetBufferIndex() refer to these.
   const std::vector<BufferDescription> BufferDescriptions;
-  // Log lines. Lines are guaranteed to be sorted by increasing cycle.
+  // Free-form log lines, e.g. warnings. Lines are guaranteed to be sorted by
+  // increasing cycle.
   std::vector<Line> Lines;
+  // Typed events. Events are guaranteed to be sorted by increasing cycle.
+  std::vector<Event> Events;
 
   std::vector<IterationStats> Iterations;
   unsigned NumCycles = 0;
 };
 
+// Observes a simulation while it runs (see `Simulator::Run`). This allows
+// computing analyses incrementally, without materializing the events in a
+// `SimulationLog`.
+class SimulationObserver {
+ public:
+  virtual ~SimulationObserver();
+
+  // Returns the kinds of events that the observer needs.
+  virtual LogEventMask GetSubscriptions() const = 0;
+
+  // Called before simulating a basic block.
+  virtual void Init(const BlockContext& BlockContext,
+                    const std::vector<BufferDescription>& BufferDescriptions) {}
+
+  // Called for each event of a subscribed kind, in increasing cycle order.
+  virtual void OnEvent(const SimulationLog::Event& Event) {}
+
+  // Called when the last instruction of iteration `Iteration` completes, in
+  // iteration order. Note that some events of the iteration can still be
+  // reported afterwards (e.g. the retirement of its last uops).
+  virtual void OnIterationEnd(size_t Iteration,
+                              const SimulationLog::IterationStats& Stats) {}
+
+  // Returns true if the simulation can stop, e.g. because the observer has
+  // detected that simulating more iterations does not bring any information.
+  // Called after each OnIterationEnd().
+  virtual bool ShouldStop() const { return false; }
+};
+
 }  // namespace simulator
 }  // namespace exegesis
 
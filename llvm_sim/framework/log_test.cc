@@ -0,0 +1,58 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/log.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+using ::testing::HasSubstr;
+
+MATCHER_P2(IsLine, MsgTag, Msg, "") {
+  return arg.MsgTag == MsgTag && arg.Msg == Msg;
+}
+
+TEST(SimulationLogTest, EventToLine) {
+  using Event = SimulationLog::Event;
+  EXPECT_THAT(Event::Instruction(1, 2, {3, 4}).ToLine(),
+              IsLine("InstructionIndex", "4,3"));
+  EXPECT_THAT(Event::Uop(1, 2, {{3, 4}, 5}).ToLine(),
+              IsLine("UopId", "4,3,5"));
+  EXPECT_THAT(Event::PortPressureInit(1, 2).ToLine(),
+              IsLine("PortPressure", "init"));
+  EXPECT_THAT(Event::PortPressure(1, 2, {3, 4}, 0.5f).ToLine(),
+              IsLine("PortPressure", "4,3,0.5"));
+  EXPECT_THAT(Event::Stall(1, 2, 7).ToLine(), IsLine("PStall", "7"));
+
+  const SimulationLog::Line Line = Event::Stall(1, 2, 7).ToLine();
+  EXPECT_EQ(Line.Cycle, 1);
+  EXPECT_EQ(Line.BufferIndex, 2);
+}
+
+TEST(SimulationLogTest, DebugStringHasEventsAndLines) {
+  SimulationLog Log({BufferDescription("B0"), BufferDescription("B1")});
+  Log.Events.push_back(SimulationLog::Event::Uop(0, 1, {{3, 4}, 5}));
+  Log.Lines.push_back({0, 0, "TestTag", "A"});
+  const std::string DebugString = Log.DebugString();
+  EXPECT_THAT(DebugString, HasSubstr("\"B1\" (1)   MsgTag: \"UopId\""));
+  EXPECT_THAT(DebugString, HasSubstr("\"B0\" (0)   MsgTag: \"TestTag\""));
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
@@ -14,25 +14,71 @@
 
 #include "llvm_sim/framework/simulator.h"
 
+#include <algorithm>
+
+#include "llvm_sim/framework/block_trace.h"
 #include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/state.h"
 
 namespace exegesis {
 namespace simulator {
 
 namespace {
 
-// A Logger that writes to a SimulationLog.
+// A Logger that writes to a SimulationLog and forwards events to observers.
 class LoggerImpl : public Logger {
  public:
-  LoggerImpl(SimulationLog* Log, size_t BufferIndex, unsigned Cycle)
-      : Log_(Log), BufferIndex_(BufferIndex), Cycle_(Cycle) {}
+  LoggerImpl(LogEventMask Subscriptions, LogEventMask LogSubscriptions,
+             llvm::ArrayRef<SimulationObserver*> Observers, SimulationLog* Log,
+             size_t BufferIndex, unsigned Cycle)
+      : Logger(Subscriptions),
+        LogSubscriptions_(LogSubscriptions),
+        Observers_(Observers),
+        Log_(Log),
+        BufferIndex_(BufferIndex),
+        Cycle_(Cycle) {}
 
   void Log(std::string MsgTag, std::string Msg) override {
     Log_->Lines.push_back(
         {Cycle_, BufferIndex_, std::move(MsgTag), std::move(Msg)});
   }
 
+  void DoLogInstruction(const InstructionIndex::Type& Instr) override {
+    Record(SimulationLog::Event::Instruction(Cycle_, BufferIndex_, Instr));
+  }
+
+  void DoLogUop(const UopId::Type& Uop) override {
+    Record(SimulationLog::Event::Uop(Cycle_, BufferIndex_, Uop));
+  }
+
+  void DoLogPortPressureInit() override {
+    Record(SimulationLog::Event::PortPressureInit(Cycle_, BufferIndex_));
+  }
+
+  void DoLogPortPressure(const InstructionIndex::Type& Instr,
+                         float Cycles) override {
+    Record(SimulationLog::Event::PortPressure(Cycle_, BufferIndex_, Instr,
+                                              Cycles));
+  }
+
+  void DoLogStall(unsigned NumCycles) override {
+    Record(SimulationLog::Event::Stall(Cycle_, BufferIndex_, NumCycles));
+  }
+
  private:
+  void Record(const SimulationLog::Event& Event) {
+    if (LogSubscriptions_.Contains(Event.GetKind())) {
+      Log_->Events.push_back(Event);
+    }
+    for (SimulationObserver* Observer : Observers_) {
+      if (Observer->GetSubscriptions().Contains(Event.GetKind())) {
+        Observer->OnEvent(Event);
+      }
+    }
+  }
+
+  const LogEventMask LogSubscriptions_;
+  const llvm::ArrayRef<SimulationObserver*> Observers_;
   SimulationLog* const Log_;
   const size_t BufferIndex_;
   const unsigned Cycle_;
@@ -43,7 +89,7 @@ class LoggerImpl : public Logger {
 class Simulator::IterationCounterSink : public Sink<InstructionIndex> {
  public:
   LLVM_NODISCARD bool PushMany(
-      const std::vector<InstructionIndex::Type>& Elems) final {
+      llvm::ArrayRef<InstructionIndex::Type> Elems) final {
     Elems_.insert(Elems_.end(), Elems.begin(), Elems.end());
     return true;
   }
@@ -55,6 +101,11 @@ class Simulator::IterationCounterSink : public Sink<InstructionIndex> {
     return Tmp;
   }
 
+  void Clear() { Elems_.clear(); }
+
+  void SaveState(StateWriter* Writer) const { Writer->Write(Elems_); }
+  void RestoreState(StateReader* Reader) { Reader->Read(&Elems_); }
+
  private:
   std::vector<InstructionIndex::Type> Elems_;
 };
@@ -70,10 +121,46 @@ void Simulator::AddBuffer(std::unique_ptr<Buffer> Buf,
   BufferDescriptions_.push_back(BufferDescription);
 }
 
+void Simulator::SetLogSubscriptions(LogEventMask Subscriptions) {
+  LogSubscriptions_ = Subscriptions;
+}
+
 void Simulator::AddComponent(std::unique_ptr<Component> Comp) {
+  ComponentGroups_.push_back({Components_.size(), Components_.size() + 1});
   Components_.push_back(std::move(Comp));
 }
 
+void Simulator::AddComponentGroup(
+    std::vector<std::unique_ptr<Component>> Comps) {
+  ComponentGroups_.push_back(
+      {Components_.size(), Components_.size() + Comps.size()});
+  for (auto& Comp : Comps) {
+    Components_.push_back(std::move(Comp));
+  }
+}
+
+void Simulator::SetNumTickThreads(unsigned NumThreads) {
+  if (NumThreads <= 1) {
+    TickThreadPool_.reset();
+  } else if (!TickThreadPool_ ||
+             TickThreadPool_->GetNumThreads() != NumThreads) {
+    TickThreadPool_ = absl::make_unique<TickThreadPool>(NumThreads);
+  }
+}
+
+void Simulator::Tick(const ComponentGroup& Group,
+                     const BlockContext& BlockContext) const {
+  if (TickThreadPool_ && Group.End - Group.Begin > 1) {
+    TickThreadPool_->Run(Group.End - Group.Begin, [&](size_t I) {
+      Components_[Group.Begin + I]->Tick(&BlockContext);
+    });
+    return;
+  }
+  for (size_t I = Group.Begin; I < Group.End; ++I) {
+    Components_[I]->Tick(&BlockContext);
+  }
+}
+
 Sink<InstructionIndex>* Simulator::GetInstructionSink() const {
   return InstructionSink_.get();
 }
@@ -81,49 +168,193 @@ Sink<InstructionIndex>* Simulator::GetInstructionSink() const {
 std::unique_ptr<SimulationLog> Simulator::Run(const BlockContext& BlockContext,
                                               unsigned MaxNumIterations,
                                               unsigned MaxNumCycles) const {
-  assert((MaxNumIterations > 0 || MaxNumCycles > 0) && "running forever ?");
+  return Run(BlockContext, MaxNumIterations, MaxNumCycles, {});
+}
+
+std::unique_ptr<SimulationLog> Simulator::Run(
+    const BlockContext& BlockContext, unsigned MaxNumIterations,
+    unsigned MaxNumCycles,
+    llvm::ArrayRef<SimulationObserver*> Observers) const {
+  assert((MaxNumIterations > 0 || MaxNumCycles > 0 ||
+          BlockContext.GetTrace() != nullptr) &&
+         "running forever ?");
+
+  auto Result = absl::make_unique<SimulationLog>(BufferDescriptions_);
+  const LogEventMask Subscriptions = InitObservers(BlockContext, Observers);
+  InitComponentsAndBuffers(Subscriptions, Observers, Result.get());
+  Simulate(BlockContext, MaxNumIterations, MaxNumCycles, Subscriptions,
+           Observers, Result.get());
+  return Result;
+}
+
+SimulatorSnapshot Simulator::TakeSnapshot(const BlockContext& BlockContext,
+                                          const SimulationLog& Log) const {
+  SimulatorSnapshot Snapshot;
+  Snapshot.NumBasicBlockInstructions =
+      BlockContext.GetNumBasicBlockInstructions();
+  Snapshot.NumCycles = Log.NumCycles;
+  Snapshot.Iterations = Log.Iterations;
+  StateWriter Writer;
+  for (const auto& Component : Components_) {
+    Component->SaveState(&Writer);
+  }
+  for (const auto& Buffer : Buffers_) {
+    Buffer->SaveState(&Writer);
+  }
+  InstructionSink_->SaveState(&Writer);
+  Snapshot.State = Writer.TakeBlob();
+  return Snapshot;
+}
+
+std::unique_ptr<SimulationLog> Simulator::Resume(
+    const BlockContext& BlockContext, const SimulatorSnapshot& Snapshot,
+    unsigned MaxNumIterations, unsigned MaxNumCycles,
+    llvm::ArrayRef<SimulationObserver*> Observers) const {
+  assert((MaxNumIterations > 0 || MaxNumCycles > 0 ||
+          BlockContext.GetTrace() != nullptr) &&
+         "running forever ?");
+  assert(Snapshot.NumBasicBlockInstructions ==
+             BlockContext.GetNumBasicBlockInstructions() &&
+         "the snapshot is for another block");
 
   auto Result = absl::make_unique<SimulationLog>(BufferDescriptions_);
+  Result->NumCycles = Snapshot.NumCycles;
+  const LogEventMask Subscriptions = InitObservers(BlockContext, Observers);
+  // Init() first, so that buffers emit their initialization events (e.g.
+  // kPortPressureInit), then overwrite the state.
+  InitComponentsAndBuffers(Subscriptions, Observers, Result.get());
+  StateReader Reader(Snapshot.State);
+  for (const auto& Component : Components_) {
+    Component->RestoreState(&Reader);
+  }
+  for (const auto& Buffer : Buffers_) {
+    Buffer->RestoreState(&Reader);
+  }
+  InstructionSink_->RestoreState(&Reader);
+  assert(Reader.AtEnd() && "the snapshot is for another simulator");
+
+  bool Stop = false;
+  for (size_t I = 0; I < Snapshot.Iterations.size(); ++I) {
+    Stop |= EndIteration(I, Snapshot.Iterations[I].EndCycle, MaxNumIterations,
+                         Observers, Result.get());
+  }
+  // The simulation that produced the snapshot might have stopped before
+  // processing all the instructions retired during its last cycle.
+  if (Stop || (MaxNumCycles > 0 && Result->NumCycles >= MaxNumCycles) ||
+      (Result->NumCycles > 0 &&
+       ProcessRetiredInstructions(BlockContext, Result->NumCycles - 1,
+                                  MaxNumIterations, Observers,
+                                  Result.get()))) {
+    return Result;
+  }
+  Simulate(BlockContext, MaxNumIterations, MaxNumCycles, Subscriptions,
+           Observers, Result.get());
+  return Result;
+}
+
+LogEventMask Simulator::InitObservers(
+    const BlockContext& BlockContext,
+    llvm::ArrayRef<SimulationObserver*> Observers) const {
+  // The logger is subscribed to the events needed by the log or any observer.
+  LogEventMask Subscriptions = LogSubscriptions_;
+  for (SimulationObserver* Observer : Observers) {
+    Subscriptions = Subscriptions | Observer->GetSubscriptions();
+    Observer->Init(BlockContext, BufferDescriptions_);
+  }
+  return Subscriptions;
+}
+
+void Simulator::InitComponentsAndBuffers(
+    LogEventMask Subscriptions, llvm::ArrayRef<SimulationObserver*> Observers,
+    SimulationLog* Result) const {
+  // Blocks simulated by the same simulator tend to produce a similar number of
+  // events, preallocate the events storage accordingly.
+  Result->Events.reserve(NumEventsHint_);
 
-  // Set up components.
   for (const auto& Component : Components_) {
     Component->Init();
   }
   for (size_t BufferId = 0; BufferId < Buffers_.size(); ++BufferId) {
-    LoggerImpl Logger(Result.get(), BufferId, 0);
+    LoggerImpl Logger(Subscriptions, LogSubscriptions_, Observers, Result,
+                      BufferId, Result->NumCycles);
     Buffers_[BufferId]->Init(&Logger);
   }
+  InstructionSink_->Clear();
+}
 
-  // Run simulation.
-  for (Result->NumCycles = 0;
-       MaxNumCycles == 0 || Result->NumCycles < MaxNumCycles;
+bool Simulator::EndIteration(size_t Iteration, unsigned Cycle,
+                             unsigned MaxNumIterations,
+                             llvm::ArrayRef<SimulationObserver*> Observers,
+                             SimulationLog* Result) const {
+  assert(Iteration == Result->Iterations.size() &&
+         "simulation is not in order");
+  SimulationLog::IterationStats Stats;
+  Stats.EndCycle = Cycle;
+  Result->Iterations.push_back(Stats);
+  bool ObserverStop = false;
+  for (SimulationObserver* Observer : Observers) {
+    Observer->OnIterationEnd(Iteration, Stats);
+    ObserverStop = ObserverStop || Observer->ShouldStop();
+  }
+  // Stop simulation if the max number of iterations has been reached, or if an
+  // observer does not need more iterations.
+  return (MaxNumIterations > 0 && Iteration + 1 >= MaxNumIterations) ||
+         ObserverStop;
+}
+
+bool Simulator::ProcessRetiredInstructions(
+    const BlockContext& BlockContext, unsigned Cycle, unsigned MaxNumIterations,
+    llvm::ArrayRef<SimulationObserver*> Observers,
+    SimulationLog* Result) const {
+  const std::vector<InstructionIndex::Type> Instrs =
+      InstructionSink_->RetrieveElems();
+  for (size_t I = 0; I < Instrs.size(); ++I) {
+    const InstructionIndex::Type& Instr = Instrs[I];
+    if (BlockContext.IsLastInstructionOfBlock(Instr.BBIndex) &&
+        EndIteration(Instr.Iteration, Cycle, MaxNumIterations, Observers,
+                     Result)) {
+      // Keep the instructions retired after the end of the iteration, so that
+      // they are accounted for when resuming from a snapshot.
+      const bool Pushed = InstructionSink_->PushMany(
+          llvm::makeArrayRef(Instrs).drop_front(I + 1));
+      assert(Pushed);
+      (void)Pushed;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Simulator::IsEndOfTrace(const BlockContext& BlockContext,
+                             const SimulationLog& Result) const {
+  const BlockTrace* const Trace = BlockContext.GetTrace();
+  return Trace != nullptr && Trace->AtEnd() &&
+         Result.Iterations.size() == Trace->GetPosition();
+}
+
+void Simulator::Simulate(const BlockContext& BlockContext,
+                         unsigned MaxNumIterations, unsigned MaxNumCycles,
+                         LogEventMask Subscriptions,
+                         llvm::ArrayRef<SimulationObserver*> Observers,
+                         SimulationLog* Result) const {
+  for (; MaxNumCycles == 0 || Result->NumCycles < MaxNumCycles;
        ++Result->NumCycles) {
-    for (const auto& Component : Components_) {
-      Component->Tick(&BlockContext);
+    for (const ComponentGroup& Group : ComponentGroups_) {
+      Tick(Group, BlockContext);
     }
     for (size_t BufferId = 0; BufferId < Buffers_.size(); ++BufferId) {
-      LoggerImpl Logger(Result.get(), BufferId, Result->NumCycles);
+      LoggerImpl Logger(Subscriptions, LogSubscriptions_, Observers, Result,
+                        BufferId, Result->NumCycles);
       Buffers_[BufferId]->Propagate(&Logger);
     }
-
-    // Update iteration stats.
-    for (const auto& Instr : InstructionSink_->RetrieveElems()) {
-      if (Instr.BBIndex == BlockContext.GetNumBasicBlockInstructions() - 1) {
-        assert(Instr.Iteration == Result->Iterations.size() &&
-               "simulation is not in order");
-        SimulationLog::IterationStats Iteration;
-        Iteration.EndCycle = Result->NumCycles;
-        Result->Iterations.push_back(Iteration);
-        // Stop simulation if the max number of iterations has been reached.
-        if (MaxNumIterations > 0 && Instr.Iteration + 1 >= MaxNumIterations) {
-          ++Result->NumCycles;
-          return Result;
-        }
-      }
+    if (ProcessRetiredInstructions(BlockContext, Result->NumCycles,
+                                   MaxNumIterations, Observers, Result) ||
+        IsEndOfTrace(BlockContext, *Result)) {
+      ++Result->NumCycles;
+      break;
     }
   }
-
-  return Result;
+  NumEventsHint_ = std::max(NumEventsHint_, Result->Events.size());
 }
 
 }  // namespace simulator
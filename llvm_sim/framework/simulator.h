@@ -16,17 +16,33 @@
 #define EXEGESIS_LLVM_SIM_FRAMEWORK_SIMULATOR_H_
 
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/MC/MCInst.h"
 #include "llvm/MC/TargetRegistry.h"
 #include "llvm_sim/framework/component.h"
 #include "llvm_sim/framework/context.h"
 #include "llvm_sim/framework/log.h"
+#include "llvm_sim/framework/tick_thread_pool.h"
 
 namespace exegesis {
 namespace simulator {
 
+// The state of a simulation at the end of a cycle, see
+// `Simulator::TakeSnapshot()`.
+struct SimulatorSnapshot {
+  // The number of instructions in the simulated block.
+  size_t NumBasicBlockInstructions = 0;
+  // The number of cycles simulated so far.
+  unsigned NumCycles = 0;
+  // The stats of the iterations completed so far.
+  std::vector<SimulationLog::IterationStats> Iterations;
+  // The serialized state of the components and buffers (see `StateWriter`).
+  std::string State;
+};
+
 class Simulator {
  public:
   Simulator();
@@ -37,6 +53,26 @@ class Simulator {
                  const BufferDescription& BufferDescription);
   void AddComponent(std::unique_ptr<Component> Comp);
 
+  // Adds components that are independent within a cycle: their Tick()s do not
+  // access the same buffers or any other shared mutable state, e.g. the
+  // execution units of different ports. Components that need to push to the
+  // same buffer can do it through an `OrderedMerger`. The components of the
+  // group are ticked after the components that were added before, and before
+  // the components that are added after.
+  void AddComponentGroup(std::vector<std::unique_ptr<Component>> Comps);
+
+  // Ticks the components of each group on up to `NumThreads` threads. The
+  // default, 1, ticks all components sequentially on the calling thread. The
+  // results do not depend on the number of threads, but ticking concurrently
+  // only pays off when the groups have a lot of work per cycle.
+  void SetNumTickThreads(unsigned NumThreads);
+
+  // Only records the events in `Subscriptions` in the simulation logs. By
+  // default, all events are recorded. Simulating with only the events that the
+  // analyses need avoids the cost of logging, e.g. the inverse throughput
+  // analysis does not need any event.
+  void SetLogSubscriptions(LogEventMask Subscriptions);
+
   // Returns a sink that receives instructions that are done executing. This is
   // used by the simulator to count iterations. Typically used as last step of a
   // simulation pipeline. Owned by the simulator. The Sink's PushMany()
@@ -44,7 +80,8 @@ class Simulator {
   Sink<InstructionIndex>* GetInstructionSink() const;
 
   // Runs the simulator until either the max number of iterations or cycles has
-  // been reached (`0` means no limit)
+  // been reached (`0` means no limit), or until the end of the trace for
+  // multi-block contexts (see `BlockContext`).
   // TODO(courbet): Should the simulator work on a MachineBasicBlock rather than
   // a vector<MCInst> ? Right now we don't really know where we're going to get
   // our data from, so we use vector<MCInst> (which is the common denominator).
@@ -52,12 +89,98 @@ class Simulator {
                                      unsigned MaxNumIterations,
                                      unsigned MaxNumCycles) const;
 
+  // Same as above, but additionally reports the events and iterations to
+  // `Observers` as the simulation runs, and stops early if any of the
+  // observers requests it (see `SimulationObserver::ShouldStop`). Observers
+  // receive the events they are subscribed to even if they are not recorded in
+  // the returned log, so analyses implemented as observers can run with empty
+  // log subscriptions: the log then only holds the per-iteration stats.
+  std::unique_ptr<SimulationLog> Run(
+      const BlockContext& BlockContext, unsigned MaxNumIterations,
+      unsigned MaxNumCycles,
+      llvm::ArrayRef<SimulationObserver*> Observers) const;
+
+  // Returns the state of the simulator at the end of the simulation that
+  // produced `Log`, which must be the last call to Run() or Resume(). For
+  // example, a block can be simulated for a few warm-up iterations, and the
+  // simulation can then be resumed several times from the warm pipeline.
+  SimulatorSnapshot TakeSnapshot(const BlockContext& BlockContext,
+                                 const SimulationLog& Log) const;
+
+  // Resumes simulating `BlockContext` from `Snapshot`. The snapshot can come
+  // from this simulator or from any simulator that was built in the same way
+  // (e.g. by the same factory), and must be for the same block.
+  // `MaxNumIterations` and `MaxNumCycles` include the iterations and cycles of
+  // the snapshot. The returned log starts with the iterations of the snapshot,
+  // which are also reported to `Observers`, but it only has the events that
+  // happened after the snapshot: analyses of events (e.g. port pressure) only
+  // make sense on a log that starts from an empty pipeline.
+  std::unique_ptr<SimulationLog> Resume(
+      const BlockContext& BlockContext, const SimulatorSnapshot& Snapshot,
+      unsigned MaxNumIterations, unsigned MaxNumCycles,
+      llvm::ArrayRef<SimulationObserver*> Observers = {}) const;
+
  private:
   class IterationCounterSink;
+
+  // A range of `Components_` that are ticked concurrently.
+  struct ComponentGroup {
+    size_t Begin;
+    size_t End;
+  };
+
+  // Ticks the components of `Group`.
+  void Tick(const ComponentGroup& Group,
+            const BlockContext& BlockContext) const;
+
+  // Calls Init() on the observers, and returns the events the loggers must
+  // be subscribed to.
+  LogEventMask InitObservers(
+      const BlockContext& BlockContext,
+      llvm::ArrayRef<SimulationObserver*> Observers) const;
+
+  // Calls Init() on all components and buffers. `Result->NumCycles` is the
+  // current cycle.
+  void InitComponentsAndBuffers(LogEventMask Subscriptions,
+                                llvm::ArrayRef<SimulationObserver*> Observers,
+                                SimulationLog* Result) const;
+
+  // Records the end of iteration `Iteration` at cycle `Cycle` and returns
+  // true if the simulation should stop.
+  bool EndIteration(size_t Iteration, unsigned Cycle,
+                    unsigned MaxNumIterations,
+                    llvm::ArrayRef<SimulationObserver*> Observers,
+                    SimulationLog* Result) const;
+
+  // Updates the iteration stats with the instructions that were retired
+  // during cycle `Cycle`, and returns true if the simulation should stop.
+  bool ProcessRetiredInstructions(const BlockContext& BlockContext,
+                                  unsigned Cycle, unsigned MaxNumIterations,
+                                  llvm::ArrayRef<SimulationObserver*> Observers,
+                                  SimulationLog* Result) const;
+
+  // Returns true if all the blocks of the trace of `BlockContext` have been
+  // fetched and retired.
+  bool IsEndOfTrace(const BlockContext& BlockContext,
+                    const SimulationLog& Result) const;
+
+  // Simulates cycles starting at `Result->NumCycles`.
+  void Simulate(const BlockContext& BlockContext, unsigned MaxNumIterations,
+                unsigned MaxNumCycles, LogEventMask Subscriptions,
+                llvm::ArrayRef<SimulationObserver*> Observers,
+                SimulationLog* Result) const;
+
   const std::unique_ptr<IterationCounterSink> InstructionSink_;
   std::vector<std::unique_ptr<Buffer>> Buffers_;
   std::vector<BufferDescription> BufferDescriptions_;
   std::vector<std::unique_ptr<Component>> Components_;
+  // Partitions `Components_` in tick order. Components that were not added as
+  // part of a group are in their own group.
+  std::vector<ComponentGroup> ComponentGroups_;
+  std::unique_ptr<TickThreadPool> TickThreadPool_;
+  LogEventMask LogSubscriptions_ = LogEventMask::All();
+  // The maximum number of events logged by a previous run.
+  mutable size_t NumEventsHint_ = 0;
 };
 
 }  // namespace simulator
@@ -28,8 +28,10 @@ using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::Field;
 using ::testing::Invoke;
+using ::testing::InvokeWithoutArgs;
 using ::testing::NotNull;
 using ::testing::Property;
+using ::testing::Return;
 using ::testing::WithArg;
 
 class TestBuffer : public Buffer {
@@ -62,6 +64,11 @@ MATCHER_P4(EqLine, BufferIndex, Cycle, MsgTag, Msg, "") {
   return false;
 }
 
+MATCHER_P3(EqUopId, Iteration, BBIndex, UopIndex, "") {
+  return arg.InstrIndex.Iteration == Iteration &&
+         arg.InstrIndex.BBIndex == BBIndex && arg.UopIndex == UopIndex;
+}
+
 TEST(SimulatorTest, Works) {
   const GlobalContext Context;
   auto Component1 = absl::make_unique<TestComponent>(&Context);
@@ -112,6 +119,124 @@ TEST(SimulatorTest, Works) {
                           Field(&BufferDescription::DisplayName, Eq("BD2"))));
 }
 
+TEST(SimulatorTest, TypedEvents) {
+  const GlobalContext Context;
+  auto Buffer = absl::make_unique<TestBuffer>();
+  EXPECT_CALL(*Buffer, Init(NotNull()))
+      .WillOnce(Invoke([](Logger* Log) { Log->LogPortPressureInit(); }));
+  EXPECT_CALL(*Buffer, Propagate(NotNull()))
+      .WillOnce(Invoke([](Logger* Log) {
+        Log->LogUop({{3, 2}, 1});
+        Log->Log("TestTag", "A");
+      }))
+      .WillOnce(Invoke([](Logger* Log) { Log->LogStall(1); }));
+
+  Simulator Simulator;
+  Simulator.AddBuffer(std::move(Buffer), BufferDescription("BD"));
+  std::vector<llvm::MCInst> Instructions;
+  const BlockContext BlockContext(Instructions, false);
+  const auto Result = Simulator.Run(BlockContext, 0, /*MaxNumCycles=*/2);
+
+  // Typed events are recorded as events, free-form messages as lines.
+  EXPECT_THAT(Result->Lines, ElementsAre(EqLine(0, 0, "TestTag", "A")));
+  ASSERT_EQ(Result->Events.size(), 3);
+  EXPECT_EQ(Result->Events[0].GetKind(),
+            SimulationLog::Event::KindE::kPortPressureInit);
+  EXPECT_EQ(Result->Events[1].GetKind(), SimulationLog::Event::KindE::kUop);
+  EXPECT_EQ(Result->Events[1].GetCycle(), 0);
+  EXPECT_THAT(Result->Events[1].GetUopId(), EqUopId(2, 3, 1));
+  EXPECT_EQ(Result->Events[2].GetKind(), SimulationLog::Event::KindE::kStall);
+  EXPECT_EQ(Result->Events[2].GetCycle(), 1);
+  EXPECT_EQ(Result->Events[2].GetNumStallCycles(), 1);
+}
+
+TEST(SimulatorTest, LogSubscriptions) {
+  const GlobalContext Context;
+  auto Buffer = absl::make_unique<TestBuffer>();
+  EXPECT_CALL(*Buffer, Init(NotNull()));
+  EXPECT_CALL(*Buffer, Propagate(NotNull()))
+      .WillOnce(Invoke([](Logger* Log) {
+        EXPECT_TRUE(Log->IsSubscribed(LogEventKind::kUop));
+        EXPECT_FALSE(Log->IsSubscribed(LogEventKind::kStall));
+        EXPECT_FALSE(Log->IsSubscribed(LogEventKind::kMessage));
+        Log->LogUop({{3, 2}, 1});
+        Log->LogStall(1);
+      }));
+
+  Simulator Simulator;
+  Simulator.AddBuffer(std::move(Buffer), BufferDescription("BD"));
+  Simulator.SetLogSubscriptions(LogEventMask().With(LogEventKind::kUop));
+  std::vector<llvm::MCInst> Instructions;
+  const BlockContext BlockContext(Instructions, false);
+  const auto Result = Simulator.Run(BlockContext, 0, /*MaxNumCycles=*/1);
+
+  ASSERT_EQ(Result->Events.size(), 1);
+  EXPECT_EQ(Result->Events[0].GetKind(), LogEventKind::kUop);
+}
+
+class TestObserver : public SimulationObserver {
+ public:
+  MOCK_CONST_METHOD0(GetSubscriptions, LogEventMask());
+  MOCK_METHOD2(Init, void(const BlockContext& BlockContext,
+                          const std::vector<BufferDescription>&));
+  MOCK_METHOD1(OnEvent, void(const SimulationLog::Event& Event));
+  MOCK_METHOD2(OnIterationEnd,
+               void(size_t Iteration,
+                    const SimulationLog::IterationStats& Stats));
+};
+
+TEST(SimulatorTest, Observers) {
+  const GlobalContext Context;
+  std::vector<llvm::MCInst> Instructions(1);
+  const BlockContext BlockContext(Instructions, true);
+
+  Simulator Simulator;
+  auto Component = absl::make_unique<TestComponent>(&Context);
+  EXPECT_CALL(*Component, Init());
+  // Completes one iteration per cycle.
+  size_t Iteration = 0;
+  EXPECT_CALL(*Component, Tick(NotNull()))
+      .WillRepeatedly(InvokeWithoutArgs([&Simulator, &Iteration]() {
+        EXPECT_TRUE(Simulator.GetInstructionSink()->Push({0, Iteration++}));
+      }));
+  auto Buffer = absl::make_unique<TestBuffer>();
+  EXPECT_CALL(*Buffer, Init(NotNull()));
+  EXPECT_CALL(*Buffer, Propagate(NotNull()))
+      .WillRepeatedly(Invoke([](Logger* Log) {
+        Log->LogUop({{0, 0}, 0});
+        Log->LogStall(1);
+      }));
+  Simulator.AddComponent(std::move(Component));
+  Simulator.AddBuffer(std::move(Buffer), BufferDescription("BD"));
+  // Nothing is recorded in the log.
+  Simulator.SetLogSubscriptions(LogEventMask());
+
+  TestObserver Observer;
+  EXPECT_CALL(Observer, GetSubscriptions())
+      .WillRepeatedly(Return(LogEventMask().With(LogEventKind::kUop)));
+  testing::Sequence Seq;
+  EXPECT_CALL(Observer, Init(_, ElementsAre(Field(
+                                    &BufferDescription::DisplayName, "BD"))))
+      .InSequence(Seq);
+  EXPECT_CALL(Observer, OnEvent(Property(&SimulationLog::Event::GetCycle, 0)))
+      .InSequence(Seq);
+  EXPECT_CALL(Observer,
+              OnIterationEnd(0, Field(&SimulationLog::IterationStats::EndCycle,
+                                      Eq(0))))
+      .InSequence(Seq);
+  EXPECT_CALL(Observer, OnEvent(Property(&SimulationLog::Event::GetCycle, 1)))
+      .InSequence(Seq);
+  EXPECT_CALL(Observer,
+              OnIterationEnd(1, Field(&SimulationLog::IterationStats::EndCycle,
+                                      Eq(1))))
+      .InSequence(Seq);
+
+  const auto Result = Simulator.Run(BlockContext, /*MaxNumIterations=*/2,
+                                    /*MaxNumCycles=*/0, {&Observer});
+  EXPECT_EQ(Result->GetNumCompleteIterations(), 2);
+  EXPECT_TRUE(Result->Events.empty());
+}
+
 TEST(SimulatorTest, Iterations) {
   const GlobalContext Context;
   std::vector<llvm::MCInst> Instructions(2);
@@ -158,6 +283,133 @@ TEST(SimulatorTest, Iterations) {
                   Field(&SimulationLog::IterationStats::EndCycle, Eq(3))));
 }
 
+// Completes `NumIterationsPerCycle` iterations of a single-instruction block
+// per cycle.
+class IterationsComponent : public Component {
+ public:
+  IterationsComponent(const GlobalContext* Context,
+                      Sink<InstructionIndex>* Sink,
+                      size_t NumIterationsPerCycle)
+      : Component(Context),
+        Sink_(Sink),
+        NumIterationsPerCycle_(NumIterationsPerCycle) {}
+
+  void Init() override { NextIteration_ = 0; }
+
+  void Tick(const BlockContext* BlockContext) override {
+    for (size_t I = 0; I < NumIterationsPerCycle_; ++I) {
+      EXPECT_TRUE(Sink_->Push({0, NextIteration_++}));
+    }
+  }
+
+  void SaveState(StateWriter* Writer) const override {
+    Writer->Write(NextIteration_);
+  }
+
+  void RestoreState(StateReader* Reader) override {
+    Reader->Read(&NextIteration_);
+  }
+
+ private:
+  Sink<InstructionIndex>* const Sink_;
+  const size_t NumIterationsPerCycle_;
+  size_t NextIteration_ = 0;
+};
+
+std::vector<unsigned> GetEndCycles(const SimulationLog& Log) {
+  std::vector<unsigned> EndCycles;
+  for (const auto& Iteration : Log.Iterations) {
+    EndCycles.push_back(Iteration.EndCycle);
+  }
+  return EndCycles;
+}
+
+TEST(SimulatorTest, SnapshotAndResume) {
+  const GlobalContext Context;
+  std::vector<llvm::MCInst> Instructions(1);
+  const BlockContext BlockContext(Instructions, true);
+
+  Simulator Simulator;
+  Simulator.AddComponent(absl::make_unique<IterationsComponent>(
+      &Context, Simulator.GetInstructionSink(), 2));
+
+  // Iteration 3 completes during the last cycle, after the simulation stops.
+  const auto WarmUp = Simulator.Run(BlockContext, /*MaxNumIterations=*/3,
+                                    /*MaxNumCycles=*/0);
+  EXPECT_THAT(GetEndCycles(*WarmUp), ElementsAre(0, 0, 1));
+  const SimulatorSnapshot Snapshot = Simulator.TakeSnapshot(BlockContext,
+                                                            *WarmUp);
+  EXPECT_EQ(Snapshot.NumCycles, 2);
+
+  for (int Repeat = 0; Repeat < 2; ++Repeat) {
+    TestObserver Observer;
+    EXPECT_CALL(Observer, GetSubscriptions())
+        .WillRepeatedly(Return(LogEventMask()));
+    EXPECT_CALL(Observer, Init(_, _));
+    EXPECT_CALL(Observer, OnIterationEnd(_, _)).Times(6);
+    const auto Resumed =
+        Simulator.Resume(BlockContext, Snapshot, /*MaxNumIterations=*/6,
+                         /*MaxNumCycles=*/0, {&Observer});
+    EXPECT_THAT(GetEndCycles(*Resumed), ElementsAre(0, 0, 1, 1, 2, 2));
+    EXPECT_EQ(Resumed->NumCycles, 3);
+  }
+
+  const auto FromScratch = Simulator.Run(BlockContext, /*MaxNumIterations=*/6,
+                                         /*MaxNumCycles=*/0);
+  EXPECT_THAT(GetEndCycles(*FromScratch), ElementsAre(0, 0, 1, 1, 2, 2));
+  EXPECT_EQ(FromScratch->NumCycles, 3);
+}
+
+// Counts its ticks in `(*Ticks)[Index]`.
+class GroupMemberComponent : public Component {
+ public:
+  GroupMemberComponent(const GlobalContext* Context, size_t Index,
+                       std::vector<size_t>* Ticks)
+      : Component(Context), Index_(Index), Ticks_(Ticks) {}
+
+  void Tick(const BlockContext* BlockContext) override { ++(*Ticks_)[Index_]; }
+
+ private:
+  const size_t Index_;
+  std::vector<size_t>* const Ticks_;
+};
+
+TEST(SimulatorTest, ComponentGroups) {
+  const GlobalContext Context;
+  std::vector<llvm::MCInst> Instructions;
+  const BlockContext BlockContext(Instructions, false);
+  constexpr size_t kNumComponents = 10;
+  constexpr int kMaxNumCycles = 100;
+
+  for (unsigned NumThreads : {1, 4}) {
+    Simulator Simulator;
+    Simulator.SetNumTickThreads(NumThreads);
+    std::vector<size_t> Ticks(kNumComponents);
+    // The component after the group checks that all the components of the
+    // group have been ticked.
+    auto After = absl::make_unique<TestComponent>(&Context);
+    EXPECT_CALL(*After, Init());
+    size_t Cycle = 0;
+    EXPECT_CALL(*After, Tick(NotNull()))
+        .WillRepeatedly(InvokeWithoutArgs([&Ticks, &Cycle]() {
+          ++Cycle;
+          for (size_t I = 0; I < kNumComponents; ++I) {
+            EXPECT_EQ(Ticks[I], Cycle) << I;
+          }
+        }));
+    std::vector<std::unique_ptr<Component>> Group;
+    for (size_t I = 0; I < kNumComponents; ++I) {
+      Group.push_back(
+          absl::make_unique<GroupMemberComponent>(&Context, I, &Ticks));
+    }
+    Simulator.AddComponentGroup(std::move(Group));
+    Simulator.AddComponent(std::move(After));
+    const auto Result = Simulator.Run(BlockContext, 0, kMaxNumCycles);
+    EXPECT_EQ(Result->NumCycles, kMaxNumCycles);
+    EXPECT_EQ(Cycle, kMaxNumCycles);
+  }
+}
+
 }  // namespace
 }  // namespace simulator
 }  // namespace exegesis
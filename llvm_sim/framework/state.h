@@ -0,0 +1,190 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Serialization of the state of components and buffers into a compact blob,
+// see `Component::SaveState()` and `Buffer::SaveState()`.
+//
+// The blob is a plain concatenation of the values in native byte order, with
+// no field names or version: it is only meant to be restored by the same
+// binary, into a simulator built in the same way as the one that saved it.
+//
+// Values are serialized through `StateTraits<T>`. Trivially copyable types,
+// vectors and bitsets are supported out of the box, other types specialize
+// `StateTraits`:
+//   template <> struct StateTraits<MyType> {
+//     static void Save(StateWriter* Writer, const MyType& Value);
+//     static void Restore(StateReader* Reader, MyType* Value);
+//   };
+
+#ifndef EXEGESIS_LLVM_SIM_FRAMEWORK_STATE_H_
+#define EXEGESIS_LLVM_SIM_FRAMEWORK_STATE_H_
+
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MathExtras.h"
+
+namespace exegesis {
+namespace simulator {
+
+template <typename T, typename Enable = void>
+struct StateTraits;
+
+class StateWriter {
+ public:
+  // Appends `Value` to the blob.
+  template <typename T>
+  void Write(const T& Value) {
+    StateTraits<T>::Save(this, Value);
+  }
+
+  // Appends `Size` raw bytes to the blob.
+  void WriteBytes(const void* Data, size_t Size) {
+    Blob_.append(static_cast<const char*>(Data), Size);
+  }
+
+  const std::string& GetBlob() const { return Blob_; }
+  std::string TakeBlob() { return std::move(Blob_); }
+
+ private:
+  std::string Blob_;
+};
+
+class StateReader {
+ public:
+  // `Blob` must outlive the reader.
+  explicit StateReader(llvm::StringRef Blob) : Remaining_(Blob) {}
+
+  // Reads `*Value` from the blob. Values must be read in the order in which
+  // they were written.
+  template <typename T>
+  void Read(T* Value) {
+    StateTraits<T>::Restore(this, Value);
+  }
+
+  // Convenience overload for types that are cheap to default-construct.
+  template <typename T>
+  T Read() {
+    T Value;
+    Read(&Value);
+    return Value;
+  }
+
+  // Reads `Size` raw bytes from the blob.
+  void ReadBytes(void* Data, size_t Size) {
+    assert(Size <= Remaining_.size() && "reading past the end of the state");
+    std::memcpy(Data, Remaining_.data(), Size);
+    Remaining_ = Remaining_.drop_front(Size);
+  }
+
+  // Returns true if the whole blob has been read.
+  bool AtEnd() const { return Remaining_.empty(); }
+
+ private:
+  llvm::StringRef Remaining_;
+};
+
+template <typename T>
+struct StateTraits<
+    T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type> {
+  static void Save(StateWriter* Writer, const T& Value) {
+    Writer->WriteBytes(&Value, sizeof(T));
+  }
+  static void Restore(StateReader* Reader, T* Value) {
+    Reader->ReadBytes(Value, sizeof(T));
+  }
+};
+
+namespace internal {
+
+// Vectors are serialized as their size followed by their elements.
+template <typename VectorT>
+struct VectorStateTraits {
+  using ValueT = typename VectorT::value_type;
+
+  static void Save(StateWriter* Writer, const VectorT& Values) {
+    Writer->Write<uint64_t>(Values.size());
+    if constexpr (std::is_trivially_copyable<ValueT>::value) {
+      Writer->WriteBytes(Values.data(), Values.size() * sizeof(ValueT));
+    } else {
+      for (const ValueT& Value : Values) {
+        Writer->Write(Value);
+      }
+    }
+  }
+
+  static void Restore(StateReader* Reader, VectorT* Values) {
+    Values->resize(Reader->Read<uint64_t>());
+    if constexpr (std::is_trivially_copyable<ValueT>::value) {
+      Reader->ReadBytes(Values->data(), Values->size() * sizeof(ValueT));
+    } else {
+      for (ValueT& Value : *Values) {
+        Reader->Read(&Value);
+      }
+    }
+  }
+};
+
+}  // namespace internal
+
+template <typename T>
+struct StateTraits<std::vector<T>>
+    : internal::VectorStateTraits<std::vector<T>> {};
+
+template <typename T, unsigned N>
+struct StateTraits<llvm::SmallVector<T, N>>
+    : internal::VectorStateTraits<llvm::SmallVector<T, N>> {};
+
+// Bitsets are serialized as their size followed by their words.
+template <>
+struct StateTraits<llvm::BitVector> {
+  using WordT = decltype(
+      std::declval<const llvm::BitVector&>().getData())::value_type;
+
+  static void Save(StateWriter* Writer, const llvm::BitVector& Bits) {
+    Writer->Write<uint64_t>(Bits.size());
+    if (Bits.empty()) {
+      return;
+    }
+    const auto Words = Bits.getData();
+    Writer->WriteBytes(Words.data(), Words.size() * sizeof(WordT));
+  }
+
+  static void Restore(StateReader* Reader, llvm::BitVector* Bits) {
+    const uint64_t Size = Reader->Read<uint64_t>();
+    Bits->clear();
+    Bits->resize(Size);
+    constexpr size_t kBitsPerWord = sizeof(WordT) * 8;
+    const size_t NumWords = llvm::divideCeil(Size, kBitsPerWord);
+    for (size_t I = 0; I < NumWords; ++I) {
+      WordT Word = Reader->Read<WordT>();
+      while (Word != 0) {
+        Bits->set(I * kBitsPerWord + llvm::countTrailingZeros(Word));
+        Word &= Word - 1;
+      }
+    }
+  }
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_FRAMEWORK_STATE_H_
@@ -0,0 +1,128 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/state.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace exegesis {
+namespace simulator {
+
+struct TestElem {
+  int Id;
+  llvm::SmallVector<size_t, 2> Values;
+};
+
+template <>
+struct StateTraits<TestElem> {
+  static void Save(StateWriter* Writer, const TestElem& Elem) {
+    Writer->Write(Elem.Id);
+    Writer->Write(Elem.Values);
+  }
+  static void Restore(StateReader* Reader, TestElem* Elem) {
+    Reader->Read(&Elem->Id);
+    Reader->Read(&Elem->Values);
+  }
+};
+
+namespace {
+
+using testing::ElementsAre;
+
+TEST(StateTest, TriviallyCopyable) {
+  struct Pod {
+    size_t A;
+    unsigned B;
+  };
+  StateWriter Writer;
+  Writer.Write(42);
+  Writer.Write(Pod{3, 4});
+  Writer.Write(true);
+  EXPECT_EQ(Writer.GetBlob().size(), sizeof(int) + sizeof(Pod) + sizeof(bool));
+
+  const std::string Blob = Writer.TakeBlob();
+  StateReader Reader(Blob);
+  EXPECT_EQ(Reader.Read<int>(), 42);
+  const Pod P = Reader.Read<Pod>();
+  EXPECT_EQ(P.A, 3);
+  EXPECT_EQ(P.B, 4);
+  EXPECT_FALSE(Reader.AtEnd());
+  EXPECT_TRUE(Reader.Read<bool>());
+  EXPECT_TRUE(Reader.AtEnd());
+}
+
+TEST(StateTest, Vectors) {
+  StateWriter Writer;
+  Writer.Write(std::vector<int>{1, 2, 3});
+  Writer.Write(llvm::SmallVector<size_t, 2>{4, 5, 6, 7});
+  Writer.Write(std::vector<int>());
+
+  const std::string Blob = Writer.TakeBlob();
+  StateReader Reader(Blob);
+  // Restoring overwrites the previous contents.
+  std::vector<int> Ints = {8, 9, 10, 11};
+  Reader.Read(&Ints);
+  EXPECT_THAT(Ints, ElementsAre(1, 2, 3));
+  llvm::SmallVector<size_t, 2> Sizes;
+  Reader.Read(&Sizes);
+  EXPECT_THAT(Sizes, ElementsAre(4, 5, 6, 7));
+  Reader.Read(&Ints);
+  EXPECT_TRUE(Ints.empty());
+  EXPECT_TRUE(Reader.AtEnd());
+}
+
+TEST(StateTest, BitVector) {
+  llvm::BitVector Bits(200);
+  Bits.set(0);
+  Bits.set(63);
+  Bits.set(64);
+  Bits.set(199);
+  StateWriter Writer;
+  Writer.Write(Bits);
+  Writer.Write(llvm::BitVector());
+
+  const std::string Blob = Writer.TakeBlob();
+  StateReader Reader(Blob);
+  llvm::BitVector Restored(200);
+  Restored.set(1);
+  Reader.Read(&Restored);
+  EXPECT_EQ(Restored, Bits);
+  Reader.Read(&Restored);
+  EXPECT_TRUE(Restored.empty());
+  EXPECT_TRUE(Reader.AtEnd());
+}
+
+TEST(StateTest, CustomTraits) {
+  StateWriter Writer;
+  Writer.Write(std::vector<TestElem>{{1, {2}}, {3, {4, 5, 6}}});
+
+  const std::string Blob = Writer.TakeBlob();
+  StateReader Reader(Blob);
+  std::vector<TestElem> Elems;
+  Reader.Read(&Elems);
+  ASSERT_EQ(Elems.size(), 2);
+  EXPECT_EQ(Elems[0].Id, 1);
+  EXPECT_THAT(Elems[0].Values, ElementsAre(2));
+  EXPECT_EQ(Elems[1].Id, 3);
+  EXPECT_THAT(Elems[1].Values, ElementsAre(4, 5, 6));
+  EXPECT_TRUE(Reader.AtEnd());
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
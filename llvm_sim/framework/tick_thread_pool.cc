@@ -0,0 +1,107 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/tick_thread_pool.h"
+
+#include <cassert>
+
+namespace exegesis {
+namespace simulator {
+
+namespace {
+
+// The number of times an idle worker polls for work before going to sleep.
+// Polling is cheap compared to waking up a sleeping thread, and consecutive
+// jobs are typically only a simulated cycle apart.
+constexpr int kNumSpinIterations = 1 << 16;
+
+}  // namespace
+
+TickThreadPool::TickThreadPool(unsigned NumThreads) {
+  assert(NumThreads >= 2);
+  for (unsigned I = 1; I < NumThreads; ++I) {
+    Workers_.emplace_back([this]() { WorkerLoop(); });
+  }
+}
+
+TickThreadPool::~TickThreadPool() {
+  {
+    std::lock_guard<std::mutex> Lock(Mutex_);
+    Stop_.store(true);
+    Generation_.fetch_add(1);
+  }
+  WakeUp_.notify_all();
+  for (std::thread& Worker : Workers_) {
+    Worker.join();
+  }
+}
+
+void TickThreadPool::Run(size_t NumItems,
+                         llvm::function_ref<void(size_t)> Fn) {
+  // All workers are done with the previous job, so nobody reads the job.
+  NumItems_ = NumItems;
+  Fn_ = Fn;
+  NextItem_.store(0, std::memory_order_relaxed);
+  NumDoneWorkers_.store(0, std::memory_order_relaxed);
+  {
+    // Publishes the job. The lock ensures that a worker that is about to
+    // sleep either sees the new generation or gets notified.
+    std::lock_guard<std::mutex> Lock(Mutex_);
+    Generation_.fetch_add(1, std::memory_order_release);
+  }
+  WakeUp_.notify_all();
+
+  RunItems();
+  // Wait for the workers, which also makes their writes visible to the
+  // caller.
+  while (NumDoneWorkers_.load(std::memory_order_acquire) != Workers_.size()) {
+    std::this_thread::yield();
+  }
+}
+
+void TickThreadPool::RunItems() {
+  for (size_t I = NextItem_.fetch_add(1, std::memory_order_relaxed);
+       I < NumItems_; I = NextItem_.fetch_add(1, std::memory_order_relaxed)) {
+    Fn_(I);
+  }
+}
+
+void TickThreadPool::WorkerLoop() {
+  uint64_t LastGeneration = 0;
+  while (true) {
+    // Wait for the next job.
+    uint64_t Generation = Generation_.load(std::memory_order_acquire);
+    for (int I = 0; I < kNumSpinIterations && Generation == LastGeneration;
+         ++I) {
+      Generation = Generation_.load(std::memory_order_acquire);
+    }
+    if (Generation == LastGeneration) {
+      std::unique_lock<std::mutex> Lock(Mutex_);
+      WakeUp_.wait(Lock, [this, LastGeneration]() {
+        return Generation_.load(std::memory_order_acquire) != LastGeneration;
+      });
+      Generation = Generation_.load(std::memory_order_acquire);
+    }
+    LastGeneration = Generation;
+    if (Stop_.load()) {
+      return;
+    }
+
+    RunItems();
+    NumDoneWorkers_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+}  // namespace simulator
+}  // namespace exegesis
@@ -0,0 +1,79 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A thread pool used by the simulator to tick independent components
+// concurrently within a cycle (see `Simulator::SetNumTickThreads()`).
+//
+// Work is dispatched to the pool at least once per simulated cycle, so the
+// pool is optimized for latency rather than throughput: idle workers spin for
+// a while waiting for work before going to sleep.
+
+#ifndef EXEGESIS_LLVM_SIM_FRAMEWORK_TICK_THREAD_POOL_H_
+#define EXEGESIS_LLVM_SIM_FRAMEWORK_TICK_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/STLExtras.h"
+
+namespace exegesis {
+namespace simulator {
+
+class TickThreadPool {
+ public:
+  // Creates a pool that runs work on `NumThreads` threads, including the
+  // thread that calls Run(). `NumThreads` must be at least 2.
+  explicit TickThreadPool(unsigned NumThreads);
+
+  ~TickThreadPool();
+
+  unsigned GetNumThreads() const { return Workers_.size() + 1; }
+
+  // Calls `Fn(I)` for each `I` in [0, NumItems), and returns when all calls
+  // have returned. Calls for different indices happen concurrently. Run() must
+  // not be called concurrently.
+  void Run(size_t NumItems, llvm::function_ref<void(size_t)> Fn);
+
+ private:
+  void WorkerLoop();
+
+  // Runs items of the current job until there are none left.
+  void RunItems();
+
+  std::vector<std::thread> Workers_;
+
+  // The current job. Written by Run() before publishing a new generation.
+  size_t NumItems_ = 0;
+  llvm::function_ref<void(size_t)> Fn_;
+  // The index of the next item to run.
+  std::atomic<size_t> NextItem_{0};
+  // The number of workers that are done with the current job.
+  std::atomic<unsigned> NumDoneWorkers_{0};
+
+  // Incremented for each job. Workers wait for it to change.
+  std::atomic<uint64_t> Generation_{0};
+  std::atomic<bool> Stop_{false};
+  // Sleeping workers wait on `WakeUp_`.
+  std::mutex Mutex_;
+  std::condition_variable WakeUp_;
+};
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_FRAMEWORK_TICK_THREAD_POOL_H_
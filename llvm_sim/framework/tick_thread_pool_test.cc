@@ -0,0 +1,53 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/framework/tick_thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+TEST(TickThreadPoolTest, RunsEachItemOnce) {
+  TickThreadPool Pool(4);
+  EXPECT_EQ(Pool.GetNumThreads(), 4);
+  for (size_t NumItems : {0, 1, 3, 4, 17, 1000}) {
+    for (int Repeat = 0; Repeat < 100; ++Repeat) {
+      std::vector<std::atomic<int>> Counts(NumItems);
+      Pool.Run(NumItems, [&Counts](size_t I) { ++Counts[I]; });
+      for (size_t I = 0; I < NumItems; ++I) {
+        ASSERT_EQ(Counts[I].load(), 1) << NumItems << " " << I;
+      }
+    }
+  }
+}
+
+TEST(TickThreadPoolTest, WritesAreVisibleAfterRun) {
+  TickThreadPool Pool(3);
+  std::vector<int> Values(64);
+  for (int Round = 1; Round <= 1000; ++Round) {
+    Pool.Run(Values.size(), [&Values, Round](size_t I) { Values[I] = Round; });
+    for (int Value : Values) {
+      ASSERT_EQ(Value, Round);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
@@ -14,22 +14,29 @@
 
 // A IACA-like simulator (main).
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 
+#include "absl/memory/memory.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/MC/MCInstPrinter.h"
 #include "llvm/MC/TargetRegistry.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm_sim/analysis/inverse_throughput.h"
 #include "llvm_sim/analysis/port_pressure.h"
+#include "llvm_sim/analysis/steady_state.h"
+#include "llvm_sim/framework/batch_simulator.h"
+#include "llvm_sim/framework/block_trace.h"
 #include "llvm_sim/x86/faucon_lib.h"
-#include "llvm_sim/x86/haswell.h"
+#include "llvm_sim/x86/pipeline.h"
 
 static llvm::cl::opt<std::string> LogFile(
     "log", llvm::cl::desc("Write simulation log to file"),
@@ -40,9 +47,52 @@ static llvm::cl::opt<std::string> TraceFile(
     llvm::cl::value_desc("trace_file"), llvm::cl::init(""),
     llvm::cl::NotHidden);
 
-static llvm::cl::opt<std::string> InputFile(llvm::cl::Positional,
-                                            llvm::cl::desc("<input file>"),
-                                            llvm::cl::Required);
+static llvm::cl::opt<std::string> BlockTraceFile(
+    "block_trace",
+    llvm::cl::desc("Simulate the input blocks in the order given by a trace "
+                   "file of block indices (whitespace-separated, typically one "
+                   "per line), instead of looping over each block. Blocks are "
+                   "numbered in input order. --max_iters and --max_cycles "
+                   "only apply when given"),
+    llvm::cl::value_desc("block_trace_file"), llvm::cl::init(""),
+    llvm::cl::NotHidden);
+
+static llvm::cl::list<std::string> InputFiles(llvm::cl::Positional,
+                                              llvm::cl::desc("<input files>"),
+                                              llvm::cl::ZeroOrMore);
+
+static llvm::cl::opt<std::string> CpuName(
+    "cpu",
+    llvm::cl::desc("The LLVM name of the CPU to simulate. Uses the built-in "
+                   "pipeline preset for the CPU unless --pipeline_config is "
+                   "given, in which case this overrides its cpu_name"),
+    llvm::cl::value_desc("cpu_name"), llvm::cl::init("haswell"),
+    llvm::cl::NotHidden);
+
+static llvm::cl::opt<std::string> PipelineConfigFile(
+    "pipeline_config",
+    llvm::cl::desc("Read the pipeline description from a YAML file"),
+    llvm::cl::value_desc("config_file"), llvm::cl::init(""),
+    llvm::cl::NotHidden);
+
+static llvm::cl::opt<bool> PrintPipelineConfig(
+    "print_pipeline_config",
+    llvm::cl::desc("Print the pipeline description that is simulated, in the "
+                   "format of --pipeline_config"),
+    llvm::cl::init(false), llvm::cl::NotHidden);
+
+static llvm::cl::opt<unsigned> NumThreads(
+    "num_threads",
+    llvm::cl::desc("Number of simulation threads when simulating several "
+                   "input files (0 means one per hardware thread)"),
+    llvm::cl::value_desc("num"), llvm::cl::init(0), llvm::cl::NotHidden);
+
+static llvm::cl::opt<unsigned> NumTickThreads(
+    "tick_threads",
+    llvm::cl::desc("Number of threads used to tick the execution units of a "
+                   "simulation concurrently within a cycle. Only pays off for "
+                   "very long simulations of wide pipelines"),
+    llvm::cl::value_desc("num"), llvm::cl::init(1), llvm::cl::NotHidden);
 
 static llvm::cl::opt<int> MaxIters(
     "max_iters", llvm::cl::desc("Maximum number of iterations"),
@@ -54,29 +104,50 @@ static llvm::cl::opt<int> MaxCycles("max_cycles",
                                     llvm::cl::init(100000),
                                     llvm::cl::NotHidden);
 
+static llvm::cl::opt<bool> PrintPortPressure(
+    "port_pressure", llvm::cl::desc("Print the port pressure analysis"),
+    llvm::cl::init(true), llvm::cl::NotHidden);
+
+static llvm::cl::opt<bool> StopAtSteadyState(
+    "steady_state",
+    llvm::cl::desc("Stop the simulation when the steady state is reached. "
+                   "--max_iters and --max_cycles remain upper bounds, but "
+                   "the default --max_iters is raised to find long periods"),
+    llvm::cl::init(false), llvm::cl::NotHidden);
+
 static llvm::cl::opt<bool> IsLoopBody(
     "loop_body", llvm::cl::desc("Whether the code is in a loop body"),
     llvm::cl::init(true), llvm::cl::NotHidden);
 
-enum class InputFileTypeE { Bin, AsmIntel, AsmATT };
+enum class InputFileTypeE { Bin, AsmIntel, AsmATT, HexCorpus };
 static llvm::cl::opt<InputFileTypeE> InputFileType(
     "input_type", llvm::cl::desc("input file type"),
     llvm::cl::values(
         clEnumValN(InputFileTypeE::Bin, "bin", "IACA-marked binary"),
         clEnumValN(InputFileTypeE::AsmIntel, "intel_asm", "Intel assembly"),
-        clEnumValN(InputFileTypeE::AsmATT, "att_asm", "AT&T assembly")));
+        clEnumValN(InputFileTypeE::AsmATT, "att_asm", "AT&T assembly"),
+        clEnumValN(InputFileTypeE::HexCorpus, "hex_corpus",
+                   "Several blocks, one hex-encoded block per line")));
+
+enum class OutputFormatE { Text, Csv, JsonLines };
+static llvm::cl::opt<OutputFormatE> OutputFormat(
+    "output_format", llvm::cl::desc("output format"),
+    llvm::cl::values(
+        clEnumValN(OutputFormatE::Text, "text", "Human-readable tables"),
+        clEnumValN(OutputFormatE::Csv, "csv", "One CSV record per block"),
+        clEnumValN(OutputFormatE::JsonLines, "jsonl",
+                   "One JSON object per line and per block")),
+    llvm::cl::init(OutputFormatE::Text));
 
 namespace exegesis {
 namespace simulator {
 namespace {
 
-void PrintPortPressures(const GlobalContext& Context,
-                        const BlockContext& BlockContext,
-                        const SimulationLog& Log,
-                        llvm::MCInstPrinter& AsmPrinter) {
-  // Compute port pressures.
-  const auto PortPressures = ComputePortPressure(BlockContext, Log);
-
+void PrintPortPressures(
+    const GlobalContext& Context, const BlockContext& BlockContext,
+    const std::vector<BufferDescription>& BufferDescriptions,
+    const PortPressureAnalysis& PortPressures,
+    llvm::MCInstPrinter& AsmPrinter) {
   // Display global port pressure.
   {
     std::cout << "\nPort Pressure (cycles per iteration):\n";
@@ -86,7 +157,7 @@ void PrintPortPressures(const GlobalContext& Context,
     for (int I = 0; I < PortPressures.Pressures.size(); ++I) {
       Table.SetValue(
           0, I + 1,
-          Log.BufferDescriptions[PortPressures.Pressures[I].BufferIndex]
+          BufferDescriptions[PortPressures.Pressures[I].BufferIndex]
               .DisplayName);
       const auto Pressure = PortPressures.Pressures[I].CyclesPerIteration;
       if (Pressure == 0.0f) {
@@ -96,7 +167,9 @@ void PrintPortPressures(const GlobalContext& Context,
       snprintf(buf, sizeof(buf), "%0.2f", Pressure);
       Table.SetValue(1, I + 1, buf);
     }
+    std::cout.flush();
     Table.Render(llvm::outs());
+    llvm::outs().flush();
   }
   std::cout << "\n";
 
@@ -112,7 +185,7 @@ void PrintPortPressures(const GlobalContext& Context,
     for (int I = 0; I < PortPressures.Pressures.size(); ++I) {
       Table.SetValue(
           0, I + 1,
-          Log.BufferDescriptions[PortPressures.Pressures[I].BufferIndex]
+          BufferDescriptions[PortPressures.Pressures[I].BufferIndex]
               .DisplayName);
     }
     // Write instruction port pressures.
@@ -149,54 +222,207 @@ void PrintPortPressures(const GlobalContext& Context,
       OS.flush();
       Table.SetTrailingValue(CurTableRow, InstrString);
     }
+    std::cout.flush();
     Table.Render(llvm::outs());
+    llvm::outs().flush();
   }
 }
 
-int Simulate() {
-  const auto Context = GlobalContext::Create("x86_64", "haswell");
-  if (!Context) {
-    return EXIT_FAILURE;
-  }
-  const auto Simulator = CreateHaswellSimulator(*Context);
-
-  std::cout << "analyzing '" << InputFile << "'\n";
-  std::vector<llvm::MCInst> Instructions;
+std::vector<llvm::MCInst> ParseInputFile(const GlobalContext& Context,
+                                         const std::string& FileName) {
   switch (InputFileType) {
     case InputFileTypeE::Bin:
-      Instructions = ParseIACAMarkedCodeFromFile(*Context, InputFile);
-      break;
+      return ParseIACAMarkedCodeFromFile(Context, FileName);
     case InputFileTypeE::AsmIntel:
-      Instructions =
-          ParseAsmCodeFromFile(*Context, InputFile, llvm::InlineAsm::AD_Intel);
-      break;
+      return ParseAsmCodeFromFile(Context, FileName, llvm::InlineAsm::AD_Intel);
     case InputFileTypeE::AsmATT:
-      Instructions =
-          ParseAsmCodeFromFile(*Context, InputFile, llvm::InlineAsm::AD_ATT);
-      break;
+      return ParseAsmCodeFromFile(Context, FileName, llvm::InlineAsm::AD_ATT);
+    case InputFileTypeE::HexCorpus:
+      llvm_unreachable("corpus files are read by ReadInputBlocks()");
   }
-  std::cout << "analyzing " << Instructions.size() << " instructions\n";
-  const BlockContext BlockContext(Instructions, IsLoopBody);
-
-  const auto Log = Simulator->Run(BlockContext, MaxIters, MaxCycles);
+  return {};
+}
 
-  std::cout << "ran " << Log->Iterations.size() << " iterations in "
-            << Log->NumCycles << " cycles\n";
+// The blocks to simulate, with a name for each block.
+struct InputBlocks {
+  std::vector<std::vector<llvm::MCInst>> Instructions;
+  std::vector<std::string> Names;
+  // The index of each block among all the input blocks, including the ones
+  // that were skipped. This identifies the block in machine-readable output.
+  std::vector<size_t> Indices;
+};
 
-  // Optionally write log to file.
-  if (!LogFile.empty()) {
-    std::ofstream OFS(LogFile);
-    OFS << Log->DebugString();
+// Reads the blocks of all input files. Returns false on error.
+bool ReadInputBlocks(const GlobalContext& Context, InputBlocks* Blocks) {
+  size_t NumBlocks = 0;
+  for (const std::string& InputFile : InputFiles) {
+    if (InputFileType != InputFileTypeE::HexCorpus) {
+      Blocks->Instructions.push_back(ParseInputFile(Context, InputFile));
+      Blocks->Names.push_back(InputFile);
+      Blocks->Indices.push_back(NumBlocks++);
+      continue;
+    }
+    auto Buffer = llvm::MemoryBuffer::getFile(InputFile);
+    if (!Buffer) {
+      std::cerr << "cannot read '" << InputFile
+                << "': " << Buffer.getError().message() << "\n";
+      return false;
+    }
+    auto Corpus = ParseHexCorpus((*Buffer)->getBuffer());
+    if (!Corpus) {
+      std::cerr << InputFile << ": " << llvm::toString(Corpus.takeError())
+                << "\n";
+      return false;
+    }
+    const auto GetName = [&InputFile](const size_t I) {
+      return InputFile + ":" + std::to_string(I);
+    };
+    bool HasErrors = false;
+    std::vector<CorpusBlock> Decoded = DecodeHexCorpus(
+        Context, *Corpus, [&](const size_t I, llvm::Error Error) {
+          std::cerr << GetName(I) << ": " << llvm::toString(std::move(Error))
+                    << "\n";
+          HasErrors = true;
+          if (BlockTraceFile.empty()) {
+            std::cerr << "skipping block " << GetName(I) << "\n";
+          }
+        });
+    // The block trace refers to the blocks by index, so blocks cannot be
+    // skipped.
+    if (HasErrors && !BlockTraceFile.empty()) return false;
+    for (CorpusBlock& Block : Decoded) {
+      Blocks->Instructions.push_back(std::move(Block.Instructions));
+      Blocks->Names.push_back(GetName(Block.Index));
+      Blocks->Indices.push_back(NumBlocks + Block.Index);
+    }
+    NumBlocks += Corpus->size();
   }
+  return true;
+}
 
+std::unique_ptr<llvm::MCInstPrinter> CreateAsmPrinter(
+    const GlobalContext& Context) {
   constexpr const unsigned kIntelSyntax = 1;
-  const std::unique_ptr<llvm::MCInstPrinter> AsmPrinter(
-      Context->Target->createMCInstPrinter(
-          Context->Triple, kIntelSyntax, *Context->AsmInfo, *Context->InstrInfo,
-          *Context->RegisterInfo));
+  std::unique_ptr<llvm::MCInstPrinter> AsmPrinter(
+      Context.Target->createMCInstPrinter(
+          Context.Triple, kIntelSyntax, *Context.AsmInfo, *Context.InstrInfo,
+          *Context.RegisterInfo));
   AsmPrinter->setPrintImmHex(true);
+  return AsmPrinter;
+}
+
+void PrintInverseThroughput(const InverseThroughputAnalysis& InvThroughput) {
+  std::cout << "Block Inverse Throughput (last " << InvThroughput.NumIterations
+            << " iterations): [" << InvThroughput.Min << "-"
+            << InvThroughput.Max << "] cycles per iteration, "
+            << InvThroughput.TotalNumCycles << " cycles total\n";
+}
+
+void PrintSteadyState(const SteadyStateAnalysis& SteadyState) {
+  if (!SteadyState.IsSteady) {
+    std::cout << "steady state not reached\n";
+    return;
+  }
+  std::cout << "steady state reached at iteration "
+            << SteadyState.FirstIteration << ": period of "
+            << SteadyState.PeriodIterations << " iterations in "
+            << SteadyState.PeriodCycles << " cycles ("
+            << SteadyState.GetCyclesPerIteration()
+            << " cycles per iteration)\n";
+}
+
+// Returns the log events needed for the requested outputs. The analyses are
+// computed by observers during the simulation, so only --log and --trace need
+// events in the log.
+LogEventMask GetLogSubscriptions() {
+  if (!LogFile.empty()) {
+    return LogEventMask::All();
+  }
+  if (!TraceFile.empty()) {
+    return kTraceLogEvents;
+  }
+  return LogEventMask();
+}
+
+// The observers that compute the analyses printed for a block.
+struct AnalysisObservers {
+  // `MaxNumIterations` is the iteration cap of the simulation, or 0 if there
+  // is none. Like ComputeInverseThroughput(), we skip the first half of the
+  // iterations.
+  explicit AnalysisObservers(unsigned MaxNumIterations)
+      : InvThroughput(MaxNumIterations / 2) {}
+
+  // Adds the observers to `Observers`.
+  void AppendTo(std::vector<SimulationObserver*>* Observers) {
+    Observers->push_back(&InvThroughput);
+    if (PrintPortPressure) {
+      Observers->push_back(&PortPressure);
+    }
+  }
+
+  // Returns the inverse throughput of the simulation that produced `Log`.
+  InverseThroughputAnalysis GetInverseThroughput(
+      const BlockContext& BlockContext, const SimulationLog& Log) const {
+    if (InvThroughput.GetResult().NumIterations == 0) {
+      // The simulation stopped before the iteration cap (--max_cycles,
+      // --steady_state, end of the block trace) and all iterations were
+      // skipped. Use the iteration stats, which the log always keeps.
+      return ComputeInverseThroughput(BlockContext, Log);
+    }
+    return InvThroughput.GetResult();
+  }
+
+  InverseThroughputObserver InvThroughput;
+  PortPressureObserver PortPressure;
+};
+
+// Returns the pipeline description requested on the command line.
+llvm::Expected<PipelineConfig> GetPipelineConfig() {
+  if (PipelineConfigFile.empty()) {
+    const PipelineConfig* const Preset = FindPipelinePreset(CpuName);
+    if (Preset == nullptr) {
+      std::string Presets;
+      for (const PipelineConfig& Config : GetPipelinePresets()) {
+        Presets += " " + Config.CpuName;
+      }
+      return llvm::make_error<llvm::StringError>(
+          "no pipeline preset for cpu '" + CpuName +
+              "', use --pipeline_config. Presets:" + Presets,
+          llvm::inconvertibleErrorCode());
+    }
+    return *Preset;
+  }
+  auto Buffer = llvm::MemoryBuffer::getFile(PipelineConfigFile);
+  if (!Buffer) {
+    return llvm::make_error<llvm::StringError>(
+        "cannot read '" + PipelineConfigFile + "'", Buffer.getError());
+  }
+  llvm::Expected<PipelineConfig> Config =
+      ParsePipelineConfig((*Buffer)->getBuffer());
+  if (Config && CpuName.getNumOccurrences() > 0) {
+    Config->CpuName = CpuName;
+  }
+  return Config;
+}
+
+std::unique_ptr<Simulator> CreateSimulator(const GlobalContext& Context,
+                                           const PipelineConfig& Config) {
+  auto Simulator = CreatePipelineSimulator(Context, Config);
+  Simulator->SetLogSubscriptions(GetLogSubscriptions());
+  Simulator->SetNumTickThreads(NumTickThreads);
+  return Simulator;
+}
+
+// Optionally writes the log and the trace of the simulation to files.
+void WriteLogAndTrace(const GlobalContext& Context,
+                      const BlockContext& BlockContext,
+                      const SimulationLog& Log,
+                      llvm::MCInstPrinter& AsmPrinter) {
+  if (!LogFile.empty()) {
+    std::ofstream OFS(LogFile);
+    OFS << Log.DebugString();
+  }
 
-  // Optionally write trace to file.
   if (!TraceFile.empty()) {
     std::error_code ErrorCode;
     llvm::raw_fd_ostream OFS(TraceFile, ErrorCode,
@@ -206,25 +432,312 @@ int Simulate() {
     if (ErrorCode) {
       std::cerr << "Cannot write trace file: " << ErrorCode << "\n";
     } else {
-      PrintTrace(*Context, BlockContext, *Log, *AsmPrinter, OFS);
+      PrintTrace(Context, BlockContext, Log, AsmPrinter, OFS);
     }
   }
+}
+
+int SimulateOne(const GlobalContext& Context, const PipelineConfig& Config,
+                const std::string& InputFile) {
+  const auto Simulator = CreateSimulator(Context, Config);
+
+  std::cout << "analyzing '" << InputFile << "'\n";
+  const std::vector<llvm::MCInst> Instructions =
+      ParseInputFile(Context, InputFile);
+  std::cout << "analyzing " << Instructions.size() << " instructions\n";
+  const BlockContext BlockContext(Instructions, IsLoopBody);
+
+  const SteadyStateObserver::Config SteadyStateConfig = {
+      /*MaxPeriodIterations=*/16, /*MinRepetitions=*/3};
+  SteadyStateObserver SteadyState(SteadyStateConfig);
+  std::vector<SimulationObserver*> Observers;
+  int NumIters = MaxIters;
+  if (StopAtSteadyState) {
+    Observers.push_back(&SteadyState);
+    // The default number of iterations is too small to repeat the longest
+    // periods, so it is raised unless --max_iters is given.
+    if (MaxIters.getNumOccurrences() == 0) {
+      NumIters = std::max<int>(NumIters,
+                               SteadyStateConfig.MaxPeriodIterations *
+                                   SteadyStateConfig.MinRepetitions);
+    }
+  }
+  AnalysisObservers Analyses(NumIters);
+  Analyses.AppendTo(&Observers);
+  const auto Log =
+      Simulator->Run(BlockContext, NumIters, MaxCycles, Observers);
+
+  std::cout << "ran " << Log->Iterations.size() << " iterations in "
+            << Log->NumCycles << " cycles\n";
+  if (StopAtSteadyState) {
+    PrintSteadyState(SteadyState.GetResult());
+  }
+
+  const auto AsmPrinter = CreateAsmPrinter(Context);
+  WriteLogAndTrace(Context, BlockContext, *Log, *AsmPrinter);
 
   if (Log->Iterations.empty()) {
     return 0;
   }
 
-  const auto InvThroughput = ComputeInverseThroughput(BlockContext, *Log);
-  std::cout << "Block Inverse Throughput (last " << InvThroughput.NumIterations
-            << " iterations): [" << InvThroughput.Min << "-"
-            << InvThroughput.Max << "] cycles per iteration, "
-            << InvThroughput.TotalNumCycles << " cycles total\n";
+  PrintInverseThroughput(Analyses.GetInverseThroughput(BlockContext, *Log));
+  if (PrintPortPressure) {
+    PrintPortPressures(Context, BlockContext, Log->BufferDescriptions,
+                       Analyses.PortPressure.GetResult(), *AsmPrinter);
+  }
+
+  return 0;
+}
+
+struct BlockResult {
+  unsigned NumIterations = 0;
+  unsigned NumCycles = 0;
+  std::vector<BufferDescription> BufferDescriptions;
+  InverseThroughputAnalysis InvThroughput;
+  PortPressureAnalysis PortPressures;
+};
+
+// Prints one record per block in a machine-readable `Format`. `Indices` are
+// the ids of the blocks, see `InputBlocks`.
+void PrintBlockSummaries(BlockSummaryWriter::FormatE Format,
+                         llvm::ArrayRef<BlockContext> Blocks,
+                         llvm::ArrayRef<size_t> Indices,
+                         llvm::ArrayRef<BlockResult> Results) {
+  // All blocks are simulated on the same pipeline, so they have the same ports.
+  std::vector<std::string> PortNames;
+  for (const BlockResult& Result : Results) {
+    if (!Result.PortPressures.Pressures.empty()) {
+      for (const auto& Pressure : Result.PortPressures.Pressures) {
+        PortNames.push_back(
+            Result.BufferDescriptions[Pressure.BufferIndex].DisplayName);
+      }
+      break;
+    }
+  }
+
+  BlockSummaryWriter Writer(Format, PortNames, &llvm::outs());
+  Writer.WriteHeader();
+  for (size_t I = 0; I < Blocks.size(); ++I) {
+    const BlockResult& Result = Results[I];
+    BlockSummary Summary;
+    Summary.BlockIndex = Indices[I];
+    Summary.NumInstructions = Blocks[I].GetNumBasicBlockInstructions();
+    Summary.NumIterations = Result.NumIterations;
+    Summary.NumCycles = Result.NumCycles;
+    Summary.InvThroughput = Result.InvThroughput;
+    for (const auto& Pressure : Result.PortPressures.Pressures) {
+      Summary.PortPressures.push_back(Pressure.CyclesPerIteration);
+    }
+    Writer.Write(Summary);
+  }
+  llvm::outs().flush();
+}
+
+// Simulates all input blocks in parallel and prints the results in the order
+// of the input blocks. The global context and the simulators are created once
+// for all blocks.
+int SimulateBatch(const GlobalContext& Context, const PipelineConfig& Config,
+                  const InputBlocks& Inputs) {
+  if (!LogFile.empty() || !TraceFile.empty() || StopAtSteadyState) {
+    std::cerr << "--log, --trace and --steady_state require a single input "
+                 "block\n";
+    return EXIT_FAILURE;
+  }
 
-  PrintPortPressures(*Context, BlockContext, *Log, *AsmPrinter);
+  std::vector<BlockContext> Blocks;
+  Blocks.reserve(Inputs.Instructions.size());
+  for (const auto& Instructions : Inputs.Instructions) {
+    Blocks.emplace_back(Instructions, IsLoopBody);
+  }
+
+  const BatchSimulator Batch(
+      &Context,
+      [&Config](const GlobalContext& Context) {
+        return CreateSimulator(Context, Config);
+      },
+      NumThreads);
+  // Keep stdout clean for machine-readable output.
+  (OutputFormat == OutputFormatE::Text ? std::cout : std::cerr)
+      << "simulating " << Blocks.size() << " blocks on "
+      << Batch.GetNumThreads() << " threads\n";
+  // Each block is handled by a single worker, which creates its observers
+  // before the simulation and destroys them once the result is extracted.
+  std::vector<std::unique_ptr<AnalysisObservers>> Observers(Blocks.size());
+  std::vector<BlockResult> Results(Blocks.size());
+  Batch.Run(
+      Blocks, MaxIters, MaxCycles,
+      [&Observers](size_t BlockIndex) {
+        Observers[BlockIndex] =
+            absl::make_unique<AnalysisObservers>(MaxIters);
+        std::vector<SimulationObserver*> BlockObservers;
+        Observers[BlockIndex]->AppendTo(&BlockObservers);
+        return BlockObservers;
+      },
+      [&Observers, &Results](size_t BlockIndex,
+                             const BlockContext& BlockContext,
+                             const SimulationLog& Log) {
+        BlockResult& Result = Results[BlockIndex];
+        Result.NumIterations = Log.GetNumCompleteIterations();
+        Result.NumCycles = Log.NumCycles;
+        if (Result.NumIterations > 0) {
+          const AnalysisObservers& Analyses = *Observers[BlockIndex];
+          Result.BufferDescriptions = Log.BufferDescriptions;
+          Result.InvThroughput =
+              Analyses.GetInverseThroughput(BlockContext, Log);
+          if (PrintPortPressure) {
+            Result.PortPressures = Analyses.PortPressure.GetResult();
+          }
+        }
+        Observers[BlockIndex].reset();
+      });
+
+  switch (OutputFormat) {
+    case OutputFormatE::Text:
+      break;
+    case OutputFormatE::Csv:
+      PrintBlockSummaries(BlockSummaryWriter::FormatE::kCsv, Blocks,
+                          Inputs.Indices, Results);
+      return 0;
+    case OutputFormatE::JsonLines:
+      PrintBlockSummaries(BlockSummaryWriter::FormatE::kJsonLines, Blocks,
+                          Inputs.Indices, Results);
+      return 0;
+  }
 
+  const auto AsmPrinter = CreateAsmPrinter(Context);
+  for (size_t I = 0; I < Blocks.size(); ++I) {
+    const BlockResult& Result = Results[I];
+    std::cout << "\nanalyzed '" << Inputs.Names[I] << "' ("
+              << Blocks[I].GetNumBasicBlockInstructions()
+              << " instructions): ran " << Result.NumIterations
+              << " iterations in " << Result.NumCycles << " cycles\n";
+    if (Result.NumIterations == 0) {
+      continue;
+    }
+    PrintInverseThroughput(Result.InvThroughput);
+    if (PrintPortPressure) {
+      PrintPortPressures(Context, Blocks[I], Result.BufferDescriptions,
+                         Result.PortPressures, *AsmPrinter);
+    }
+  }
   return 0;
 }
 
+// Simulates the input blocks as the basic blocks of a single region, in the
+// order given by the block trace.
+int SimulateTrace(const GlobalContext& Context, const PipelineConfig& Config,
+                  const InputBlocks& Inputs) {
+  if (StopAtSteadyState) {
+    std::cerr << "--steady_state is not supported with --block_trace\n";
+    return EXIT_FAILURE;
+  }
+  std::vector<llvm::MCInst> Instructions;
+  std::vector<size_t> BlockEnds;
+  for (size_t I = 0; I < Inputs.Instructions.size(); ++I) {
+    if (Inputs.Instructions[I].empty()) {
+      std::cerr << "block " << I << " ('" << Inputs.Names[I]
+                << "') has no instructions\n";
+      return EXIT_FAILURE;
+    }
+    Instructions.insert(Instructions.end(), Inputs.Instructions[I].begin(),
+                        Inputs.Instructions[I].end());
+    BlockEnds.push_back(Instructions.size());
+  }
+  auto Trace = FileBlockTrace::Open(BlockTraceFile, BlockEnds.size());
+  if (!Trace) {
+    std::cerr << llvm::toString(Trace.takeError()) << "\n";
+    return EXIT_FAILURE;
+  }
+  const BlockContext BlockContext(Instructions, BlockEnds, Trace->get());
+
+  const auto Simulator = CreateSimulator(Context, Config);
+  std::cout << "analyzing " << BlockEnds.size() << " blocks with "
+            << Instructions.size() << " instructions along trace '"
+            << BlockTraceFile << "'\n";
+  const unsigned NumIters = MaxIters.getNumOccurrences() > 0 ? MaxIters : 0;
+  // Without --max_iters, the length of the trace is not known upfront, so no
+  // iteration is skipped when computing the inverse throughput.
+  AnalysisObservers Analyses(NumIters);
+  std::vector<SimulationObserver*> Observers;
+  Analyses.AppendTo(&Observers);
+  const auto Log = Simulator->Run(
+      BlockContext, NumIters, MaxCycles.getNumOccurrences() > 0 ? MaxCycles : 0,
+      Observers);
+  if (llvm::Error Error = (*Trace)->TakeError()) {
+    std::cerr << llvm::toString(std::move(Error)) << "\n";
+    return EXIT_FAILURE;
+  }
+
+  // Count the instructions of the blocks that were simulated.
+  (*Trace)->Rewind();
+  size_t NumInstructions = 0;
+  size_t BlockId;
+  while ((*Trace)->GetPosition() < Log->Iterations.size() &&
+         (*Trace)->Next(&BlockId)) {
+    NumInstructions +=
+        BlockContext.GetBlockEnd(BlockId) - BlockContext.GetBlockBegin(BlockId);
+  }
+  std::cout << "ran " << Log->Iterations.size() << " blocks ("
+            << NumInstructions << " instructions) in " << Log->NumCycles
+            << " cycles";
+  if (Log->NumCycles > 0) {
+    std::cout << " (" << static_cast<double>(NumInstructions) / Log->NumCycles
+              << " instructions per cycle)";
+  }
+  std::cout << "\n";
+
+  const auto AsmPrinter = CreateAsmPrinter(Context);
+  WriteLogAndTrace(Context, BlockContext, *Log, *AsmPrinter);
+
+  if (Log->Iterations.empty()) {
+    return 0;
+  }
+  PrintInverseThroughput(Analyses.GetInverseThroughput(BlockContext, *Log));
+  if (PrintPortPressure) {
+    std::cout << "\nAn iteration is a block of the trace.\n";
+    PrintPortPressures(Context, BlockContext, Log->BufferDescriptions,
+                       Analyses.PortPressure.GetResult(), *AsmPrinter);
+  }
+  return 0;
+}
+
+int Simulate() {
+  llvm::Expected<PipelineConfig> Config = GetPipelineConfig();
+  if (!Config) {
+    llvm::errs() << llvm::toString(Config.takeError()) << "\n";
+    return EXIT_FAILURE;
+  }
+  if (PrintPipelineConfig) {
+    std::cout << FormatPipelineConfig(*Config) << "\n";
+    if (InputFiles.empty()) {
+      return 0;
+    }
+  }
+  if (InputFiles.empty()) {
+    std::cerr << "no input files\n";
+    return EXIT_FAILURE;
+  }
+
+  const auto Context = GlobalContext::Create("x86_64", Config->CpuName);
+  if (!Context) {
+    return EXIT_FAILURE;
+  }
+  if (BlockTraceFile.empty() && InputFiles.size() == 1 &&
+      InputFileType != InputFileTypeE::HexCorpus &&
+      OutputFormat == OutputFormatE::Text) {
+    return SimulateOne(*Context, *Config, InputFiles.front());
+  }
+  // Parsing uses the (non thread-safe) LLVM context, so it happens upfront.
+  InputBlocks Inputs;
+  if (!ReadInputBlocks(*Context, &Inputs)) {
+    return EXIT_FAILURE;
+  }
+  if (!BlockTraceFile.empty()) {
+    return SimulateTrace(*Context, *Config, Inputs);
+  }
+  return SimulateBatch(*Context, *Config, Inputs);
+}
+
 }  // namespace
 }  // namespace simulator
 }  // namespace exegesis
@@ -14,6 +14,7 @@
 
 #include "llvm_sim/x86/faucon_lib.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "llvm/MC/MCAsmInfo.h"
@@ -25,8 +26,12 @@
 #include "llvm/MC/MCParser/MCAsmParser.h"
 #include "llvm/MC/MCParser/MCTargetAsmParser.h"
 #include "llvm/MC/MCStreamer.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm_sim/framework/block_trace.h"
 #include "llvm_sim/x86/constants.h"
 
 namespace exegesis {
@@ -94,16 +99,23 @@ std::vector<uint8_t> GetIACAMarkedCode(const std::string& FileName) {
   return {};
 }
 
-std::vector<llvm::MCInst> ParseMCInsts(const GlobalContext& Context,
-                                       llvm::ArrayRef<uint8_t> CodeBytes) {
+llvm::Expected<std::vector<llvm::MCInst>> ParseMCInsts(
+    const GlobalContext& Context, llvm::ArrayRef<uint8_t> CodeBytes) {
   std::vector<llvm::MCInst> Result;
   const std::unique_ptr<llvm::MCDisassembler> Disasm(
       Context.Target->createMCDisassembler(*Context.SubtargetInfo,
                                            *Context.LLVMContext));
+  const size_t NumBytes = CodeBytes.size();
   llvm::MCInst Inst;
   uint64_t InstSize = 0;
-  while (Disasm->getInstruction(Inst, InstSize, CodeBytes, 0, llvm::nulls()) ==
-         llvm::MCDisassembler::Success) {
+  while (!CodeBytes.empty()) {
+    if (Disasm->getInstruction(Inst, InstSize, CodeBytes, 0, llvm::nulls()) !=
+        llvm::MCDisassembler::Success) {
+      return llvm::createStringError(
+          llvm::inconvertibleErrorCode(),
+          "cannot decode instruction at byte %zu of %zu",
+          NumBytes - CodeBytes.size(), NumBytes);
+    }
     Result.push_back(Inst);
     CodeBytes = CodeBytes.drop_front(InstSize);
   }
@@ -119,7 +131,12 @@ std::vector<llvm::MCInst> ParseIACAMarkedCodeFromFile(
   }
   std::cout << "analyzing " << CodeBytes.size() << " bytes\n";
 
-  return ParseMCInsts(Context, CodeBytes);
+  auto Instructions = ParseMCInsts(Context, CodeBytes);
+  if (!Instructions) {
+    std::cerr << llvm::toString(Instructions.takeError()) << "\n";
+    return {};
+  }
+  return std::move(*Instructions);
 }
 
 namespace {
@@ -268,19 +285,19 @@ struct TraceMatrix {
                        const BlockContext& BlockContext,
                        const SimulationLog& Log)
       : EmptyRow_(Log.NumCycles, ' ') {
-    for (const auto& Line : Log.Lines) {
-      switch (Log.BufferDescriptions[Line.BufferIndex].Id) {
+    for (const auto& Event : Log.Events) {
+      switch (Log.BufferDescriptions[Event.GetBufferIndex()].Id) {
         case IntelBufferIds::kAllocated:
-          TryAssignState(Log, Line, 'A');
+          TryAssignState(Log, Event, 'A');
           break;
         case IntelBufferIds::kIssuePort:
-          TryAssignState(Log, Line, 'd');
+          TryAssignState(Log, Event, 'd');
           break;
         case IntelBufferIds::kWriteback:
-          TryAssignState(Log, Line, 'w');
+          TryAssignState(Log, Event, 'w');
           break;
         case IntelBufferIds::kRetired:
-          TryAssignState(Log, Line, 'R');
+          TryAssignState(Log, Event, 'R');
           break;
         default:
           break;
@@ -296,16 +313,12 @@ struct TraceMatrix {
   }
 
  private:
-  void TryAssignState(const SimulationLog& Log, const SimulationLog::Line& Line,
-                      const char State) {
-    if (Line.MsgTag != UopId::kTagName) {
-      return;
-    }
-    UopId::Type Uop;
-    llvm::StringRef Msg = Line.Msg;
-    if (UopId::Consume(Msg, Uop)) {
+  void TryAssignState(const SimulationLog& Log,
+                      const SimulationLog::Event& Event, const char State) {
+    if (Event.GetKind() != SimulationLog::Event::KindE::kUop) {
       return;
     }
+    const UopId::Type Uop = Event.GetUopId();
     if (Uop.InstrIndex.Iteration >= Log.GetNumCompleteIterations()) {
       // Ignore any incomplete iteration.
       return;
@@ -315,7 +328,7 @@ struct TraceMatrix {
       // This is the first time we hit this row, create it.
       MatrixRow = EmptyRow_;
     }
-    MatrixRow[Line.Cycle] = State;
+    MatrixRow[Event.GetCycle()] = State;
   }
 
   struct UopIdLess {
@@ -463,13 +476,156 @@ void PrintTrace(const GlobalContext& Context, const BlockContext& BlockContext,
 
   WriteTraceHeader(Log, ColumnWidths, FOS);
 
+  // With a block trace, each iteration only has the instructions of its block.
+  BlockTrace* const Trace = BlockContext.GetTrace();
+  if (Trace != nullptr) {
+    Trace->Rewind();
+  }
   for (size_t Iter = 0; Iter < Log.GetNumCompleteIterations(); ++Iter) {
-    for (size_t BBIndex = 0;
-         BBIndex < BlockContext.GetNumBasicBlockInstructions(); ++BBIndex) {
+    size_t BlockId = 0;
+    if (Trace != nullptr && !Trace->Next(&BlockId)) {
+      break;
+    }
+    for (size_t BBIndex = BlockContext.GetBlockBegin(BlockId);
+         BBIndex < BlockContext.GetBlockEnd(BlockId); ++BBIndex) {
       WriteTraceLine(Context, BlockContext, Log, AsmPrinter, Matrix, Iter,
                      BBIndex, ColumnWidths, FOS);
     }
   }
 }
+
+llvm::Expected<std::vector<std::vector<uint8_t>>> ParseHexCorpus(
+    llvm::StringRef Corpus) {
+  std::vector<std::vector<uint8_t>> Blocks;
+  for (size_t LineNumber = 1; !Corpus.empty(); ++LineNumber) {
+    llvm::StringRef Line;
+    std::tie(Line, Corpus) = Corpus.split('\n');
+    const llvm::StringRef Hex = Line.split(',').first.trim();
+    if (Hex.empty()) {
+      continue;
+    }
+    std::string Bytes;
+    if (Hex.size() % 2 != 0 || !llvm::tryGetFromHex(Hex, Bytes)) {
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "line " + llvm::Twine(LineNumber) +
+                                         ": invalid hex block '" + Hex + "'");
+    }
+    Blocks.emplace_back(Bytes.begin(), Bytes.end());
+  }
+  return Blocks;
+}
+
+std::vector<CorpusBlock> DecodeHexCorpus(
+    const GlobalContext& Context, llvm::ArrayRef<std::vector<uint8_t>> Corpus,
+    llvm::function_ref<void(size_t Index, llvm::Error Error)> OnError) {
+  std::vector<CorpusBlock> Blocks;
+  for (size_t I = 0; I < Corpus.size(); ++I) {
+    auto Instructions = ParseMCInsts(Context, Corpus[I]);
+    if (!Instructions) {
+      OnError(I, Instructions.takeError());
+      continue;
+    }
+    Blocks.push_back({I, std::move(*Instructions)});
+  }
+  return Blocks;
+}
+
+namespace {
+
+// Formats cycle counts with enough precision for analysis, but without the
+// noise of printing the exact binary value.
+void WriteCycles(double Cycles, llvm::raw_ostream& OS) {
+  OS << llvm::format("%g", Cycles);
+}
+
+double GetAverageCycles(const InverseThroughputAnalysis& InvThroughput) {
+  return static_cast<double>(InvThroughput.TotalNumCycles) /
+         InvThroughput.NumIterations;
+}
+
+}  // namespace
+
+void BlockSummaryWriter::WriteHeader() {
+  switch (Format_) {
+    case FormatE::kCsv:
+      OS_ << "block,num_instructions,num_iterations,num_cycles,min_cycles,"
+             "max_cycles,avg_cycles";
+      for (const std::string& PortName : PortNames_) {
+        OS_ << "," << PortName;
+      }
+      OS_ << "\n";
+      return;
+    case FormatE::kJsonLines:
+      return;
+  }
+}
+
+void BlockSummaryWriter::Write(const BlockSummary& Summary) {
+  switch (Format_) {
+    case FormatE::kCsv:
+      WriteCsv(Summary);
+      return;
+    case FormatE::kJsonLines:
+      WriteJson(Summary);
+      return;
+  }
+}
+
+void BlockSummaryWriter::WriteCsv(const BlockSummary& Summary) {
+  OS_ << Summary.BlockIndex << "," << Summary.NumInstructions << ","
+      << Summary.NumIterations << "," << Summary.NumCycles << ",";
+  if (Summary.InvThroughput.NumIterations > 0) {
+    const InverseThroughputAnalysis& InvThroughput = Summary.InvThroughput;
+    OS_ << InvThroughput.Min << "," << InvThroughput.Max << ",";
+    WriteCycles(GetAverageCycles(InvThroughput), OS_);
+  } else {
+    OS_ << ",,";
+  }
+  for (size_t I = 0; I < PortNames_.size(); ++I) {
+    OS_ << ",";
+    if (I < Summary.PortPressures.size()) {
+      WriteCycles(Summary.PortPressures[I], OS_);
+    }
+  }
+  OS_ << "\n";
+}
+
+void BlockSummaryWriter::WriteJson(const BlockSummary& Summary) {
+  llvm::json::OStream JOS(OS_);
+  JOS.object([&]() {
+    JOS.attribute("block", static_cast<int64_t>(Summary.BlockIndex));
+    JOS.attribute("num_instructions",
+                  static_cast<int64_t>(Summary.NumInstructions));
+    JOS.attribute("num_iterations", Summary.NumIterations);
+    JOS.attribute("num_cycles", Summary.NumCycles);
+    if (Summary.InvThroughput.NumIterations > 0) {
+      const InverseThroughputAnalysis& InvThroughput = Summary.InvThroughput;
+      JOS.attributeObject("inverse_throughput", [&]() {
+        JOS.attribute("min_cycles", InvThroughput.Min);
+        JOS.attribute("max_cycles", InvThroughput.Max);
+        JOS.attributeBegin("avg_cycles");
+        JOS.rawValue([&](llvm::raw_ostream& OS) {
+          WriteCycles(GetAverageCycles(InvThroughput), OS);
+        });
+        JOS.attributeEnd();
+      });
+    }
+    if (!Summary.PortPressures.empty()) {
+      JOS.attributeObject("port_pressure", [&]() {
+        const size_t NumPorts =
+            std::min(PortNames_.size(), Summary.PortPressures.size());
+        for (size_t I = 0; I < NumPorts; ++I) {
+          JOS.attributeBegin(PortNames_[I]);
+          JOS.rawValue([&](llvm::raw_ostream& OS) {
+            WriteCycles(Summary.PortPressures[I], OS);
+          });
+          JOS.attributeEnd();
+        }
+      });
+    }
+  });
+  OS_ << "\n";
+}
+
 }  // namespace simulator
 }  // namespace exegesis
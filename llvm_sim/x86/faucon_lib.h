@@ -22,9 +22,13 @@
 #include <vector>
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/IR/InlineAsm.h"
 #include "llvm/MC/MCInst.h"
 #include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Error.h"
+#include "llvm_sim/analysis/inverse_throughput.h"
 #include "llvm_sim/framework/context.h"
 #include "llvm_sim/framework/log.h"
 
@@ -49,15 +53,77 @@ std::vector<llvm::MCInst> ParseAsmCodeFromString(
 // Returns the code in between IACA markers. Returns an empty vector on error.
 std::vector<uint8_t> GetIACAMarkedCode(const std::string& FileName);
 
-// Parse `CodeBytes` into MCInsts.
-std::vector<llvm::MCInst> ParseMCInsts(const GlobalContext& Context,
-                                       llvm::ArrayRef<uint8_t> CodeBytes);
+// Parse `CodeBytes` into MCInsts. Returns an error if some of the bytes cannot
+// be decoded.
+llvm::Expected<std::vector<llvm::MCInst>> ParseMCInsts(
+    const GlobalContext& Context, llvm::ArrayRef<uint8_t> CodeBytes);
+
+// Parses a corpus of basic blocks with one hex-encoded block per line, e.g.
+// "4801c84801c3". Anything after the first ',' on a line is ignored, so that
+// CSV files whose first column is the block can be read directly. Empty lines
+// are skipped.
+llvm::Expected<std::vector<std::vector<uint8_t>>> ParseHexCorpus(
+    llvm::StringRef Corpus);
+
+// A decoded block of a corpus.
+struct CorpusBlock {
+  // The index of the block in the corpus.
+  size_t Index = 0;
+  std::vector<llvm::MCInst> Instructions;
+};
+
+// Decodes the blocks of a corpus read by ParseHexCorpus(). Blocks that cannot
+// be decoded are skipped after passing their index and error to `OnError`, so
+// the index of the returned blocks is not necessarily their position.
+std::vector<CorpusBlock> DecodeHexCorpus(
+    const GlobalContext& Context, llvm::ArrayRef<std::vector<uint8_t>> Corpus,
+    llvm::function_ref<void(size_t Index, llvm::Error Error)> OnError);
+
+// The results of the simulation of a block, for machine-readable output.
+struct BlockSummary {
+  size_t BlockIndex = 0;
+  size_t NumInstructions = 0;
+  unsigned NumIterations = 0;
+  unsigned NumCycles = 0;
+  // Only meaningful when `InvThroughput.NumIterations > 0`.
+  InverseThroughputAnalysis InvThroughput;
+  // The cycles per iteration on each port, in the order of the port names
+  // of the `BlockSummaryWriter`. Empty when port pressure was not computed.
+  std::vector<float> PortPressures;
+};
+
+// Writes `BlockSummary`s with one record per line.
+class BlockSummaryWriter {
+ public:
+  enum class FormatE { kCsv, kJsonLines };
+
+  BlockSummaryWriter(FormatE Format, std::vector<std::string> PortNames,
+                     llvm::raw_ostream* OS)
+      : Format_(Format), PortNames_(std::move(PortNames)), OS_(*OS) {}
+
+  // Writes the header, if the format has one.
+  void WriteHeader();
+
+  void Write(const BlockSummary& Summary);
+
+ private:
+  void WriteCsv(const BlockSummary& Summary);
+  void WriteJson(const BlockSummary& Summary);
+
+  const FormatE Format_;
+  const std::vector<std::string> PortNames_;
+  llvm::raw_ostream& OS_;
+};
 
 // Prints a IACA-style execution trace.
 void PrintTrace(const GlobalContext& Context, const BlockContext& BlockContext,
                 const SimulationLog& Log, llvm::MCInstPrinter& AsmPrinter,
                 llvm::raw_ostream& OS);
 
+// The log events that PrintTrace() needs.
+constexpr LogEventMask kTraceLogEvents =
+    LogEventMask().With(LogEventKind::kUop);
+
 // A class to represent a table and render it out to an llvm::raw_ostream.
 class TextTable {
  public:
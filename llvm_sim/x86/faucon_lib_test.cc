@@ -28,6 +28,8 @@ namespace exegesis {
 namespace simulator {
 namespace {
 
+using testing::ElementsAre;
+
 class FauconUtilTest : public ::testing::Test {
  protected:
   static void SetUpTestSuite() {
@@ -59,8 +61,18 @@ TEST_F(FauconUtilTest, GetIACAMarkedCode) {
 
 TEST_F(FauconUtilTest, ParseMCInsts) {
   const auto Context = GlobalContext::Create("x86_64", "haswell");
-  const auto Instructions = ParseMCInsts(*Context, kTestCodeBytes);
-  EXPECT_EQ(Instructions.size(), 6);
+  auto Instructions = ParseMCInsts(*Context, kTestCodeBytes);
+  ASSERT_TRUE(static_cast<bool>(Instructions));
+  EXPECT_EQ(Instructions->size(), 6);
+}
+
+TEST_F(FauconUtilTest, ParseMCInstsInvalidBytes) {
+  const auto Context = GlobalContext::Create("x86_64", "haswell");
+  // add eax, ecx; followed by a truncated add.
+  auto Instructions = ParseMCInsts(*Context, {0x01, 0xC8, 0x01});
+  ASSERT_FALSE(static_cast<bool>(Instructions));
+  EXPECT_EQ(llvm::toString(Instructions.takeError()),
+            "cannot decode instruction at byte 2 of 3");
 }
 
 TEST_F(FauconUtilTest, ParseAsmCodeFromFile) {
@@ -89,6 +101,92 @@ TEST_F(FauconUtilTest, ParseAsmCodeFromString) {
   EXPECT_EQ(Instructions.size(), 7);
 }
 
+TEST(ParseHexCorpusTest, Works) {
+  auto Blocks = ParseHexCorpus("4801c8\n\n  4801C84801c3 ,42.5\n");
+  ASSERT_TRUE(static_cast<bool>(Blocks));
+  EXPECT_THAT(*Blocks,
+              ElementsAre(ElementsAre(0x48, 0x01, 0xc8),
+                          ElementsAre(0x48, 0x01, 0xc8, 0x48, 0x01, 0xc3)));
+}
+
+TEST(ParseHexCorpusTest, InvalidHex) {
+  auto Blocks = ParseHexCorpus("4801c8\n4801c\n");
+  ASSERT_FALSE(static_cast<bool>(Blocks));
+  EXPECT_EQ(llvm::toString(Blocks.takeError()),
+            "line 2: invalid hex block '4801c'");
+}
+
+TEST_F(FauconUtilTest, DecodeHexCorpus) {
+  const auto Context = GlobalContext::Create("x86_64", "haswell");
+  // add eax, ecx; a truncated add; add rax, rcx.
+  const std::vector<std::vector<uint8_t>> Corpus = {
+      {0x01, 0xC8}, {0x01, 0xC8, 0x01}, {0x48, 0x01, 0xC8}};
+  std::vector<size_t> Errors;
+  const std::vector<CorpusBlock> Blocks = DecodeHexCorpus(
+      *Context, Corpus, [&Errors](size_t Index, llvm::Error Error) {
+        EXPECT_EQ(llvm::toString(std::move(Error)),
+                  "cannot decode instruction at byte 2 of 3");
+        Errors.push_back(Index);
+      });
+  EXPECT_THAT(Errors, ElementsAre(1));
+  // The blocks after the undecodable one keep their index in the corpus.
+  ASSERT_EQ(Blocks.size(), 2);
+  EXPECT_EQ(Blocks[0].Index, 0);
+  EXPECT_EQ(Blocks[0].Instructions.size(), 1);
+  EXPECT_EQ(Blocks[1].Index, 2);
+  EXPECT_EQ(Blocks[1].Instructions.size(), 1);
+}
+
+BlockSummary MakeSummary() {
+  BlockSummary Summary;
+  Summary.BlockIndex = 3;
+  Summary.NumInstructions = 7;
+  Summary.NumIterations = 10;
+  Summary.NumCycles = 42;
+  Summary.InvThroughput.Min = 2;
+  Summary.InvThroughput.Max = 4;
+  Summary.InvThroughput.NumIterations = 4;
+  Summary.InvThroughput.TotalNumCycles = 11;
+  Summary.PortPressures = {1.75f, 0.0f};
+  return Summary;
+}
+
+TEST(BlockSummaryWriterTest, Csv) {
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  BlockSummaryWriter Writer(BlockSummaryWriter::FormatE::kCsv, {"P0", "P1"},
+                            &OS);
+  Writer.WriteHeader();
+  Writer.Write(MakeSummary());
+  BlockSummary NotSimulated;
+  Writer.Write(NotSimulated);
+  OS.flush();
+  EXPECT_EQ(Out,
+            "block,num_instructions,num_iterations,num_cycles,min_cycles,"
+            "max_cycles,avg_cycles,P0,P1\n"
+            "3,7,10,42,2,4,2.75,1.75,0\n"
+            "0,0,0,0,,,,,\n");
+}
+
+TEST(BlockSummaryWriterTest, JsonLines) {
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  BlockSummaryWriter Writer(BlockSummaryWriter::FormatE::kJsonLines,
+                            {"P0", "P1"}, &OS);
+  Writer.WriteHeader();
+  Writer.Write(MakeSummary());
+  BlockSummary NotSimulated;
+  Writer.Write(NotSimulated);
+  OS.flush();
+  EXPECT_EQ(Out,
+            "{\"block\":3,\"num_instructions\":7,\"num_iterations\":10,"
+            "\"num_cycles\":42,\"inverse_throughput\":{\"min_cycles\":2,"
+            "\"max_cycles\":4,\"avg_cycles\":2.75},\"port_pressure\":{"
+            "\"P0\":1.75,\"P1\":0}}\n"
+            "{\"block\":0,\"num_instructions\":0,\"num_iterations\":0,"
+            "\"num_cycles\":0}\n");
+}
+
 TEST(TextTableTest, NoHeader) {
   TextTable Table(2, 3, false);
   Table.SetValue(0, 1, "a");
@@ -174,41 +272,22 @@ TEST_F(FauconUtilTest, PrintTrace) {
   SimulationLog Log(BufferDescriptions);
   Log.NumCycles = 21;
   Log.Iterations.push_back({/*EndCycle=*/18});
-  SimulationLog::Line Line;
-
-  Line.Cycle = 3;
-  Line.BufferIndex = 0;
-  Line.MsgTag = UopId::kTagName;
-  Line.Msg = UopId::Format({{0, 0}, 0});
-  Log.Lines.push_back(Line);
-
-  Line.Cycle = 5;
-  Line.BufferIndex = 1;
-  Line.MsgTag = UopId::kTagName;
-  Line.Msg = UopId::Format({{0, 0}, 0});
-  Log.Lines.push_back(Line);
-
-  Line.Cycle = 7;
-  Line.BufferIndex = 2;
-  Line.MsgTag = UopId::kTagName;
-  Line.Msg = UopId::Format({{0, 0}, 0});
-  Log.Lines.push_back(Line);
-
-  Line.Cycle = 9;
-  Line.BufferIndex = 3;
-  Line.MsgTag = UopId::kTagName;
-  Line.Msg = UopId::Format({{0, 0}, 0});
-  Log.Lines.push_back(Line);
-
-  Line.Cycle = 11;
-  Line.BufferIndex = 4;
-  Line.MsgTag = UopId::kTagName;
-  Line.Msg = UopId::Format({{0, 0}, 0});
-  Log.Lines.push_back(Line);
+  // Uop 0 of instruction 0 goes through all buffers.
+  const UopId::Type Uop = {{0, 0}, 0};
+  Log.Events.push_back(
+      SimulationLog::Event::Uop(/*Cycle=*/3, /*BufferIndex=*/0, Uop));
+  Log.Events.push_back(
+      SimulationLog::Event::Uop(/*Cycle=*/5, /*BufferIndex=*/1, Uop));
+  Log.Events.push_back(
+      SimulationLog::Event::Uop(/*Cycle=*/7, /*BufferIndex=*/2, Uop));
+  Log.Events.push_back(
+      SimulationLog::Event::Uop(/*Cycle=*/9, /*BufferIndex=*/3, Uop));
+  Log.Events.push_back(
+      SimulationLog::Event::Uop(/*Cycle=*/11, /*BufferIndex=*/4, Uop));
 
   const auto Context = GlobalContext::Create("x86_64", "haswell");
   const auto Instructions =
-      ParseMCInsts(*Context, {0x01, 0xC8} /* add eax, ecx */);
+      llvm::cantFail(ParseMCInsts(*Context, {0x01, 0xC8} /* add eax, ecx */));
   const BlockContext BlockContext(Instructions, true);
 
   std::string Out;
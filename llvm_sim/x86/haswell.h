@@ -23,6 +23,7 @@
 namespace exegesis {
 namespace simulator {
 
+// Creates a simulator for the "haswell" pipeline preset (see pipeline.h).
 std::unique_ptr<Simulator> CreateHaswellSimulator(const GlobalContext& Context);
 
 }  // namespace simulator
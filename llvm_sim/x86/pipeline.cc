@@ -0,0 +1,456 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/x86/pipeline.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm_sim/components/buffer.h"
+#include "llvm_sim/components/decoder.h"
+#include "llvm_sim/components/dispatch_port.h"
+#include "llvm_sim/components/execution_unit.h"
+#include "llvm_sim/components/fetcher.h"
+#include "llvm_sim/components/load_store_queue.h"
+#include "llvm_sim/components/ordered_merger.h"
+#include "llvm_sim/components/parser.h"
+#include "llvm_sim/components/port.h"
+#include "llvm_sim/components/register_renamer.h"
+#include "llvm_sim/components/reorder_buffer.h"
+#include "llvm_sim/components/retirer.h"
+#include "llvm_sim/components/simplified_execution_units.h"
+#include "llvm_sim/components/uop_cache.h"
+#include "llvm_sim/x86/constants.h"
+
+namespace llvm {
+namespace yaml {
+
+using exegesis::simulator::PipelineConfig;
+
+template <>
+struct ScalarEnumerationTraits<PipelineConfig::IssuePolicyE> {
+  static void enumeration(IO& Io, PipelineConfig::IssuePolicyE& Value) {
+    Io.enumCase(Value, "greedy", PipelineConfig::IssuePolicyE::kGreedy);
+    Io.enumCase(Value, "least_loaded",
+                PipelineConfig::IssuePolicyE::kLeastLoaded);
+  }
+};
+
+template <>
+struct MappingTraits<PipelineConfig> {
+  static void mapping(IO& Io, PipelineConfig& Config) {
+    if (!Io.outputting()) {
+      // Keys that are not specified keep the value of the base preset.
+      std::string Base;
+      Io.mapOptional("base", Base);
+      if (!Base.empty()) {
+        const PipelineConfig* const Preset =
+            exegesis::simulator::FindPipelinePreset(Base);
+        if (Preset == nullptr) {
+          Io.setError("unknown base preset '" + Base + "'");
+          return;
+        }
+        Config = *Preset;
+      }
+    }
+    Io.mapOptional("cpu_name", Config.CpuName);
+    Io.mapOptional("fetch_bytes_per_cycle", Config.FetchBytesPerCycle);
+    Io.mapOptional("parse_instructions_per_cycle",
+                   Config.ParseInstructionsPerCycle);
+    Io.mapOptional("instruction_queue_size", Config.InstructionQueueSize);
+    Io.mapOptional("num_decoders", Config.NumDecoders);
+    Io.mapOptional("instruction_decode_queue_size",
+                   Config.InstructionDecodeQueueSize);
+    Io.mapOptional("rename_uops_per_cycle", Config.RenameUopsPerCycle);
+    Io.mapOptional("num_physical_registers", Config.NumPhysicalRegisters);
+    Io.mapOptional("rob_size", Config.NumROBEntries);
+    Io.mapOptional("retire_uops_per_cycle", Config.RetireUopsPerCycle);
+    Io.mapOptional("issue_policy", Config.IssuePolicy);
+    Io.mapOptional("load_queue_size", Config.LoadQueueSize);
+    Io.mapOptional("store_queue_size", Config.StoreQueueSize);
+    Io.mapOptional("store_forwarding_latency", Config.StoreForwardingLatency);
+    Io.mapOptional("uop_cache_lines", Config.UopCacheLines);
+    Io.mapOptional("uop_cache_uops_per_line", Config.UopCacheUopsPerLine);
+    Io.mapOptional("uop_cache_window_bytes", Config.UopCacheWindowBytes);
+    Io.mapOptional("uop_cache_uops_per_cycle", Config.UopCacheUopsPerCycle);
+    Io.mapOptional("loop_buffer_size", Config.LoopBufferSize);
+  }
+
+  static std::string validate(IO& Io, PipelineConfig& Config) {
+    if (Config.CpuName.empty()) {
+      return "cpu_name must not be empty";
+    }
+    if (Config.FetchBytesPerCycle == 0 ||
+        Config.ParseInstructionsPerCycle == 0 ||
+        Config.InstructionQueueSize == 0 || Config.NumDecoders == 0 ||
+        Config.InstructionDecodeQueueSize == 0 ||
+        Config.RenameUopsPerCycle == 0 || Config.NumPhysicalRegisters == 0 ||
+        Config.NumROBEntries == 0 || Config.RetireUopsPerCycle == 0 ||
+        Config.LoadQueueSize == 0 || Config.StoreQueueSize == 0) {
+      return "widths and sizes must be positive";
+    }
+    if ((Config.UopCacheLines > 0 || Config.LoopBufferSize > 0) &&
+        (Config.UopCacheUopsPerCycle == 0 || Config.UopCacheWindowBytes == 0)) {
+      return "uop cache widths and sizes must be positive";
+    }
+    if (Config.UopCacheLines > 0 &&
+        (Config.UopCacheUopsPerLine == 0 ||
+         Config.UopCacheLines < PipelineConfig::kUopCacheMaxLinesPerWindow)) {
+      return "the uop cache must have room for a window";
+    }
+    return "";
+  }
+};
+
+}  // namespace yaml
+}  // namespace llvm
+
+namespace exegesis {
+namespace simulator {
+
+namespace {
+
+constexpr const size_t kInfiniteCapacity = std::numeric_limits<size_t>::max();
+
+std::vector<PipelineConfig> MakePipelinePresets() {
+  std::vector<PipelineConfig> Presets;
+
+  // The default values of PipelineConfig model Haswell.
+  const PipelineConfig Haswell;
+  Presets.push_back(Haswell);
+
+  PipelineConfig Broadwell = Haswell;
+  Broadwell.CpuName = "broadwell";
+  Presets.push_back(Broadwell);
+
+  PipelineConfig Skylake = Haswell;
+  Skylake.CpuName = "skylake";
+  Skylake.ParseInstructionsPerCycle = 5;
+  Skylake.InstructionQueueSize = 25;
+  Skylake.RenameUopsPerCycle = 4;
+  Skylake.NumROBEntries = 224;
+  Skylake.RetireUopsPerCycle = 4;
+  Skylake.StoreQueueSize = 56;
+  Skylake.UopCacheUopsPerCycle = 6;
+  // The loop stream detector is disabled by a microcode update (SKL150).
+  Skylake.LoopBufferSize = 0;
+  Presets.push_back(Skylake);
+
+  PipelineConfig SkylakeServer = Skylake;
+  SkylakeServer.CpuName = "skylake-avx512";
+  Presets.push_back(SkylakeServer);
+
+  PipelineConfig IceLake = Skylake;
+  IceLake.CpuName = "icelake-client";
+  IceLake.InstructionDecodeQueueSize = 70;
+  IceLake.RenameUopsPerCycle = 5;
+  IceLake.NumROBEntries = 352;
+  IceLake.RetireUopsPerCycle = 8;
+  IceLake.LoadQueueSize = 128;
+  IceLake.StoreQueueSize = 72;
+  IceLake.UopCacheLines = 384;
+  IceLake.LoopBufferSize = 70;
+  Presets.push_back(IceLake);
+
+  PipelineConfig IceLakeServer = IceLake;
+  IceLakeServer.CpuName = "icelake-server";
+  Presets.push_back(IceLakeServer);
+
+  // Zen 2 fetches twice as many bytes per cycle, but has only 4 decoders.
+  PipelineConfig Zen2 = Haswell;
+  Zen2.CpuName = "znver2";
+  Zen2.FetchBytesPerCycle = 32;
+  Zen2.ParseInstructionsPerCycle = 4;
+  Zen2.InstructionQueueSize = 24;
+  Zen2.NumDecoders = 4;
+  Zen2.InstructionDecodeQueueSize = 72;
+  Zen2.RenameUopsPerCycle = 6;
+  Zen2.NumROBEntries = 224;
+  Zen2.RetireUopsPerCycle = 8;
+  Zen2.LoadQueueSize = 44;
+  Zen2.StoreQueueSize = 48;
+  Zen2.StoreForwardingLatency = 7;
+  // The op cache holds 4096 ops in 64-byte windows, and has no loop buffer.
+  Zen2.UopCacheLines = 512;
+  Zen2.UopCacheUopsPerLine = 8;
+  Zen2.UopCacheWindowBytes = 64;
+  Zen2.UopCacheUopsPerCycle = 8;
+  Zen2.LoopBufferSize = 0;
+  Presets.push_back(Zen2);
+
+  PipelineConfig Zen3 = Zen2;
+  Zen3.CpuName = "znver3";
+  Zen3.NumROBEntries = 256;
+  Zen3.LoadQueueSize = 72;
+  Zen3.StoreQueueSize = 64;
+  Presets.push_back(Zen3);
+
+  return Presets;
+}
+
+std::unique_ptr<IssuePolicy> CreateIssuePolicy(
+    PipelineConfig::IssuePolicyE Policy) {
+  switch (Policy) {
+    case PipelineConfig::IssuePolicyE::kGreedy:
+      return IssuePolicy::Greedy();
+    case PipelineConfig::IssuePolicyE::kLeastLoaded:
+      return IssuePolicy::LeastLoaded();
+  }
+  llvm_unreachable("unknown issue policy");
+}
+
+// Returns the load ports of the scheduling model, i.e. the proc resources
+// used by `mov rax, qword ptr [rsi]`.
+std::vector<unsigned> GetLoadProcResIdxs(const GlobalContext& Context) {
+  const auto FindOpcode = [&Context](llvm::StringRef Name) {
+    for (unsigned I = 0; I < Context.InstrInfo->getNumOpcodes(); ++I) {
+      if (Context.InstrInfo->getName(I) == Name) return I;
+    }
+    llvm_unreachable("unknown opcode");
+  };
+  const auto FindReg = [&Context](llvm::StringRef Name) {
+    for (unsigned I = 0; I < Context.RegisterInfo->getNumRegs(); ++I) {
+      if (Context.RegisterInfo->getName(I) == Name) return I;
+    }
+    llvm_unreachable("unknown register");
+  };
+  const llvm::MCInst Load = llvm::MCInstBuilder(FindOpcode("MOV64rm"))
+                                .addReg(FindReg("RAX"))
+                                .addReg(FindReg("RSI"))
+                                .addImm(1)
+                                .addReg(0)
+                                .addImm(0)
+                                .addReg(0);
+  return LoadStoreQueue::GetLoadProcResIdxs(Context, Load);
+}
+
+}  // namespace
+
+llvm::ArrayRef<PipelineConfig> GetPipelinePresets() {
+  static const auto* const Presets =
+      new std::vector<PipelineConfig>(MakePipelinePresets());
+  return *Presets;
+}
+
+const PipelineConfig* FindPipelinePreset(llvm::StringRef CpuName) {
+  for (const PipelineConfig& Preset : GetPipelinePresets()) {
+    if (Preset.CpuName == CpuName) {
+      return &Preset;
+    }
+  }
+  return nullptr;
+}
+
+llvm::Expected<PipelineConfig> ParsePipelineConfig(llvm::StringRef Text) {
+  std::string ErrorMessage;
+  llvm::yaml::Input Input(
+      Text, /*Ctxt=*/nullptr,
+      [](const llvm::SMDiagnostic& Diag, void* Context) {
+        *static_cast<std::string*>(Context) = Diag.getMessage().str();
+      },
+      &ErrorMessage);
+  PipelineConfig Config;
+  Input >> Config;
+  if (Input.error()) {
+    return llvm::make_error<llvm::StringError>(
+        "invalid pipeline config: " + ErrorMessage, Input.error());
+  }
+  return Config;
+}
+
+std::string FormatPipelineConfig(const PipelineConfig& Config) {
+  std::string Result;
+  llvm::raw_string_ostream OS(Result);
+  llvm::yaml::Output Output(OS);
+  // yaml::Output only takes non-const references.
+  PipelineConfig Copy = Config;
+  Output << Copy;
+  OS.flush();
+  return Result;
+}
+
+std::unique_ptr<Simulator> CreatePipelineSimulator(
+    const GlobalContext& Context, const PipelineConfig& Config) {
+  // Create Buffers ------------------------------------------------------------
+  // "Instruction Queue", a.k.a. "Pre-Decode Buffer".
+  auto InstructionQueue = absl::make_unique<FifoBuffer<InstructionIndex>>(
+      Config.InstructionQueueSize);
+  // "Instruction Decode Queue", a.k.a. "IDQ", "uOp Queue".
+  auto InstructionDecodeQueue =
+      absl::make_unique<FifoBuffer<UopId>>(Config.InstructionDecodeQueueSize);
+  // Ports. `PortSinks` is indexed by `ProcResIdx - 1`, and is null for
+  // ProcResGroups, which can be interleaved with unit resources in some
+  // scheduling models (e.g. znver2).
+  std::vector<std::unique_ptr<LinkBuffer<ROBUopId>>> Ports;
+  std::vector<Sink<ROBUopId>*> PortSinks;
+  std::vector<std::string> PortNames;
+  for (int ProcResIdx = 1;
+       ProcResIdx < Context.SchedModel->getNumProcResourceKinds();
+       ++ProcResIdx) {
+    const llvm::MCProcResourceDesc* const ProcResDesc =
+        Context.SchedModel->getProcResource(ProcResIdx);
+    if (ProcResDesc->SubUnitsIdxBegin == nullptr) {
+      // NumUnits is the number of units of a ProcResource. For example,
+      // SandyBridge has:
+      //   def SBPort23 : ProcResource<2>;
+      // i.e. it models the two ports as a single resource with two units.
+      // As for as the simulator is concerned, this is similar to having two
+      // ports with one unit, but the reorder buffer dispatches by resource id.
+      Ports.push_back(
+          absl::make_unique<DispatchPort<ROBUopId>>(ProcResDesc->NumUnits));
+      PortSinks.push_back(Ports.back().get());
+      PortNames.push_back(ProcResDesc->Name);
+    } else {
+      PortSinks.push_back(nullptr);
+    }
+  }
+  // Links.
+  // Fetched instructions buffer.
+  auto FetchedInstructionsLink =
+      absl::make_unique<LinkBuffer<InstructionIndex>>(kInfiniteCapacity);
+  // Uop Cache <-> legacy pipeline buffers. The decoded uops are queued like in
+  // the IDQ, so that the decoders stall when the IDQ is full.
+  const bool HasUopCache =
+      Config.UopCacheLines > 0 || Config.LoopBufferSize > 0;
+  auto LegacyInstructionsLink =
+      absl::make_unique<LinkBuffer<InstructionIndex>>(kInfiniteCapacity);
+  auto DecodedUopsQueue =
+      absl::make_unique<FifoBuffer<UopId>>(Config.InstructionDecodeQueueSize);
+  auto RenamerToROBLink =
+      absl::make_unique<LinkBuffer<RenamedUopId>>(kInfiniteCapacity);
+  // ROB->Retirer and Retirer->ROB writeback links.
+  auto UopsToRetireLink =
+      absl::make_unique<LinkBuffer<ROBUopId>>(Config.RetireUopsPerCycle);
+  auto RetiredUopsLink =
+      absl::make_unique<LinkBuffer<ROBUopId>>(kInfiniteCapacity);
+  auto ExecDepsTracker = absl::make_unique<ExecDepsBuffer<ROBUopId>>();
+  // Executed uops writeback link.
+  auto ExecutedWritebackLink =
+      absl::make_unique<LinkBuffer<ROBUopId>>(kInfiniteCapacity);
+
+  // Create and add components -------------------------------------------------
+  auto Simulator = absl::make_unique<class Simulator>();
+
+  // Instruction Fetcher. With a uop cache, the fetch bandwidth only limits
+  // the legacy pipeline, and the uop cache enforces it. The fetcher still
+  // fetches at most one uop cache window per cycle, so that the fetch buffer
+  // only stalls while the uop cache cannot take more instructions.
+  Simulator->AddComponent(absl::make_unique<Fetcher>(
+      &Context,
+      Fetcher::Config{static_cast<int>(
+          HasUopCache
+              ? std::max(Config.FetchBytesPerCycle, Config.UopCacheWindowBytes)
+              : Config.FetchBytesPerCycle)},
+      FetchedInstructionsLink.get()));
+  // Uop Cache and Loop Stream Detector.
+  if (HasUopCache) {
+    Simulator->AddComponent(absl::make_unique<UopCache>(
+        &Context,
+        UopCache::Config{Config.UopCacheUopsPerCycle, Config.FetchBytesPerCycle,
+                         Config.UopCacheWindowBytes, Config.UopCacheLines,
+                         Config.UopCacheUopsPerLine,
+                         PipelineConfig::kUopCacheMaxLinesPerWindow,
+                         Config.LoopBufferSize},
+        FetchedInstructionsLink.get(), LegacyInstructionsLink.get(),
+        DecodedUopsQueue.get(), InstructionDecodeQueue.get()));
+  }
+  // Instruction Parser.
+  Simulator->AddComponent(absl::make_unique<InstructionParser>(
+      &Context,
+      InstructionParser::Config{
+          static_cast<int>(Config.ParseInstructionsPerCycle)},
+      HasUopCache ? LegacyInstructionsLink.get()
+                  : FetchedInstructionsLink.get(),
+      InstructionQueue.get()));
+  // Instruction Decoder.
+  Simulator->AddComponent(absl::make_unique<InstructionDecoder>(
+      &Context,
+      InstructionDecoder::Config{static_cast<int>(Config.NumDecoders)},
+      InstructionQueue.get(),
+      HasUopCache ? DecodedUopsQueue.get() : InstructionDecodeQueue.get()));
+  // Register Renamer.
+  Simulator->AddComponent(absl::make_unique<RegisterRenamer>(
+      &Context,
+      RegisterRenamer::Config{Config.RenameUopsPerCycle,
+                              Config.NumPhysicalRegisters},
+      InstructionDecodeQueue.get(), RenamerToROBLink.get()));
+  // Reorder Buffer.
+  Simulator->AddComponent(absl::make_unique<ReorderBuffer>(
+      &Context, ReorderBuffer::Config{Config.NumROBEntries},
+      RenamerToROBLink.get(), ExecDepsTracker.get(),
+      ExecutedWritebackLink.get(), RetiredUopsLink.get(), ExecDepsTracker.get(),
+      PortSinks, UopsToRetireLink.get(), CreateIssuePolicy(Config.IssuePolicy),
+      absl::make_unique<LoadStoreQueue>(
+          &Context,
+          LoadStoreQueue::Config{Config.LoadQueueSize, Config.StoreQueueSize,
+                                 Config.StoreForwardingLatency,
+                                 GetLoadProcResIdxs(Context)})));
+  // Execution units. The ports are independent within a cycle, so they can be
+  // ticked concurrently. They write back through an ordered merger.
+  auto WritebackMerger = absl::make_unique<OrderedMerger<ROBUopId>>(
+      &Context, Ports.size(), ExecutedWritebackLink.get());
+  std::vector<std::unique_ptr<Component>> ExecutionUnits;
+  for (int Port = 0; Port < Ports.size(); ++Port) {
+    ExecutionUnits.push_back(
+        absl::make_unique<SimplifiedExecutionUnits<ROBUopId>>(
+            &Context, SimplifiedExecutionUnits<ROBUopId>::Config{},
+            Ports[Port].get(), WritebackMerger->GetLane(Port)));
+  }
+  Simulator->AddComponentGroup(std::move(ExecutionUnits));
+  Simulator->AddComponent(std::move(WritebackMerger));
+  // Retirement Station.
+  Simulator->AddComponent(absl::make_unique<Retirer<ROBUopId>>(
+      &Context, Retirer<ROBUopId>::Config{}, UopsToRetireLink.get(),
+      RetiredUopsLink.get(), Simulator->GetInstructionSink()));
+
+  // Add Buffers ---------------------------------------------------------------
+  Simulator->AddBuffer(std::move(FetchedInstructionsLink),
+                       BufferDescription("FetchBuffer"));
+  if (HasUopCache) {
+    Simulator->AddBuffer(std::move(LegacyInstructionsLink),
+                         BufferDescription("Legacy Decode Buffer"));
+    Simulator->AddBuffer(std::move(DecodedUopsQueue),
+                         BufferDescription("Decoded Uops"));
+  }
+  Simulator->AddBuffer(std::move(InstructionQueue),
+                       BufferDescription("Pre-Decode Buffer"));
+  Simulator->AddBuffer(std::move(InstructionDecodeQueue),
+                       BufferDescription("Instruction Decode Queue"));
+  for (int I = 0; I < Ports.size(); ++I) {
+    Simulator->AddBuffer(
+        std::move(Ports[I]),
+        BufferDescription(PortNames[I], IntelBufferIds::kIssuePort));
+  }
+  Simulator->AddBuffer(
+      std::move(RenamerToROBLink),
+      BufferDescription("Renamed Uops", IntelBufferIds::kAllocated));
+  Simulator->AddBuffer(std::move(UopsToRetireLink),
+                       BufferDescription("Ready to Retire Uops"));
+  Simulator->AddBuffer(
+      std::move(ExecutedWritebackLink),
+      BufferDescription("ROB Writeback", IntelBufferIds::kWriteback));
+  Simulator->AddBuffer(std::move(ExecDepsTracker),
+                       BufferDescription("Outputs Available"));
+  Simulator->AddBuffer(
+      std::move(RetiredUopsLink),
+      BufferDescription("Retired Uops", IntelBufferIds::kRetired));
+  return Simulator;
+}
+
+}  // namespace simulator
+}  // namespace exegesis
@@ -0,0 +1,124 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A declarative description of an out-of-order x86 pipeline, and the code that
+// builds the corresponding simulator.
+//
+// All pipelines share the same structure:
+//   Fetcher -> Parser -> Pre-Decode Buffer -> Decoder -> Instruction Decode
+//   Queue -> Register Renamer -> Reorder Buffer -> Ports -> Execution Units
+//   -> Retirer
+// The reorder buffer tracks memory accesses in a load/store queue. Unless they
+// are disabled, the uop cache and the loop stream detector sit between the
+// Fetcher and the Parser, and stream uops directly to the Instruction Decode
+// Queue (see components/uop_cache.h).
+// The ports and the latencies are taken from the LLVM scheduling model of the
+// CPU, and `PipelineConfig` describes the widths and queue sizes of the other
+// stages.
+//
+// Configs can be read from text in YAML format, e.g.:
+//   base: skylake              # Start from the "skylake" preset.
+//   cpu_name: skylake-avx512   # The LLVM CPU name.
+//   rob_size: 256
+// Keys that are not specified keep the value of the base preset, or of the
+// "haswell" preset when there is no `base`.
+
+#ifndef EXEGESIS_LLVM_SIM_X86_PIPELINE_H_
+#define EXEGESIS_LLVM_SIM_X86_PIPELINE_H_
+
+#include <memory>
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/framework/simulator.h"
+
+namespace exegesis {
+namespace simulator {
+
+struct PipelineConfig {
+  enum class IssuePolicyE { kGreedy, kLeastLoaded };
+
+  // The maximal number of uop cache lines of a code window.
+  static constexpr unsigned kUopCacheMaxLinesPerWindow = 3;
+
+  // The LLVM name of the CPU, used to create the `GlobalContext`.
+  std::string CpuName = "haswell";
+  // The number of instruction bytes fetched per cycle.
+  unsigned FetchBytesPerCycle = 16;
+  // The number of instructions parsed (pre-decoded) per cycle.
+  unsigned ParseInstructionsPerCycle = 4;
+  // The size of the Pre-Decode Buffer, a.k.a. "Instruction Queue".
+  unsigned InstructionQueueSize = 20;
+  // The number of instructions decoded per cycle.
+  unsigned NumDecoders = 5;
+  // The size of the Instruction Decode Queue, a.k.a. "IDQ", "uOp Queue".
+  // TODO(user) This should not be smaller than the number of uops of the
+  // largest instruction, which is currently 68 because of IDIV decompositions.
+  unsigned InstructionDecodeQueueSize = 68;
+  // The number of uops renamed per cycle.
+  unsigned RenameUopsPerCycle = 3;
+  // The number of physical registers. The default is effectively unbounded.
+  unsigned NumPhysicalRegisters = 1000000;
+  // The number of entries in the reorder buffer.
+  unsigned NumROBEntries = 192;
+  // The number of uops that can be sent for retirement per cycle.
+  unsigned RetireUopsPerCycle = 3;
+  // The number of entries in the load and store buffers.
+  unsigned LoadQueueSize = 72;
+  unsigned StoreQueueSize = 42;
+  // The latency of a load that gets its data from an in-flight store.
+  unsigned StoreForwardingLatency = 5;
+  // The number of lines of the uop cache, a.k.a. "Decoded Stream Buffer".
+  // Zero disables the uop cache.
+  unsigned UopCacheLines = 256;
+  // The number of uops in a line of the uop cache.
+  unsigned UopCacheUopsPerLine = 6;
+  // The size of the code windows cached by the uop cache. With the uop cache or
+  // the loop stream detector, the fetcher fetches up to this many bytes per
+  // cycle if it is more than FetchBytesPerCycle.
+  unsigned UopCacheWindowBytes = 32;
+  // The number of uops streamed per cycle by the uop cache and the loop stream
+  // detector.
+  unsigned UopCacheUopsPerCycle = 4;
+  // The number of uops of the loop stream detector. Zero disables it.
+  unsigned LoopBufferSize = 56;
+  // The policy used by the reorder buffer to pick a port for a uop.
+  IssuePolicyE IssuePolicy = IssuePolicyE::kLeastLoaded;
+};
+
+// Returns the built-in pipeline configs. The parameters of the presets are
+// approximations based on public documentation of the microarchitectures.
+llvm::ArrayRef<PipelineConfig> GetPipelinePresets();
+
+// Returns the preset for the given LLVM CPU name, or nullptr if there is none.
+const PipelineConfig* FindPipelinePreset(llvm::StringRef CpuName);
+
+// Parses a config from its YAML representation (see top of file).
+llvm::Expected<PipelineConfig> ParsePipelineConfig(llvm::StringRef Text);
+
+// Returns the YAML representation of `Config`.
+std::string FormatPipelineConfig(const PipelineConfig& Config);
+
+// Creates a simulator for the pipeline described by `Config`. `Context` must
+// have been created for `Config.CpuName`.
+std::unique_ptr<Simulator> CreatePipelineSimulator(
+    const GlobalContext& Context, const PipelineConfig& Config);
+
+}  // namespace simulator
+}  // namespace exegesis
+
+#endif  // EXEGESIS_LLVM_SIM_X86_PIPELINE_H_
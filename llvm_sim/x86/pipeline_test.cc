@@ -0,0 +1,396 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llvm_sim/x86/pipeline.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm_sim/framework/block_trace.h"
+#include "llvm_sim/framework/log_levels.h"
+#include "llvm_sim/x86/faucon_lib.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+using testing::HasSubstr;
+
+// Returns the error message of `Config`, or an empty string on success.
+std::string GetError(llvm::Expected<PipelineConfig> Config) {
+  return Config ? "" : llvm::toString(Config.takeError());
+}
+
+TEST(PipelineConfigTest, Presets) {
+  std::set<std::string> Names;
+  for (const PipelineConfig& Preset : GetPipelinePresets()) {
+    EXPECT_TRUE(Names.insert(Preset.CpuName).second) << Preset.CpuName;
+    EXPECT_EQ(FindPipelinePreset(Preset.CpuName), &Preset);
+  }
+  EXPECT_EQ(FindPipelinePreset("haswell")->NumROBEntries, 192);
+  EXPECT_EQ(FindPipelinePreset("unknown"), nullptr);
+}
+
+TEST(PipelineConfigTest, ParseDefaultsToHaswell) {
+  auto Config = ParsePipelineConfig("rob_size: 100");
+  ASSERT_TRUE(static_cast<bool>(Config)) << llvm::toString(Config.takeError());
+  EXPECT_EQ(Config->CpuName, "haswell");
+  EXPECT_EQ(Config->NumROBEntries, 100);
+  EXPECT_EQ(Config->InstructionQueueSize, 20);
+  EXPECT_EQ(Config->IssuePolicy, PipelineConfig::IssuePolicyE::kLeastLoaded);
+  EXPECT_EQ(Config->StoreQueueSize, 42);
+}
+
+TEST(PipelineConfigTest, ParseWithBase) {
+  auto Config = ParsePipelineConfig(R"(
+base: skylake
+cpu_name: skylake-avx512
+num_decoders: 4
+issue_policy: greedy
+)");
+  ASSERT_TRUE(static_cast<bool>(Config)) << llvm::toString(Config.takeError());
+  EXPECT_EQ(Config->CpuName, "skylake-avx512");
+  EXPECT_EQ(Config->NumDecoders, 4);
+  EXPECT_EQ(Config->IssuePolicy, PipelineConfig::IssuePolicyE::kGreedy);
+  // Inherited from the base.
+  EXPECT_EQ(Config->NumROBEntries,
+            FindPipelinePreset("skylake")->NumROBEntries);
+}
+
+TEST(PipelineConfigTest, ParseErrors) {
+  EXPECT_THAT(GetError(ParsePipelineConfig("rob_entries: 100")),
+              HasSubstr("unknown key 'rob_entries'"));
+  EXPECT_THAT(GetError(ParsePipelineConfig("base: pentium")),
+              HasSubstr("unknown base preset 'pentium'"));
+  EXPECT_THAT(GetError(ParsePipelineConfig("num_decoders: 0")),
+              HasSubstr("must be positive"));
+  EXPECT_THAT(GetError(ParsePipelineConfig("store_queue_size: 0")),
+              HasSubstr("must be positive"));
+  EXPECT_THAT(GetError(ParsePipelineConfig("uop_cache_uops_per_cycle: 0")),
+              HasSubstr("must be positive"));
+  EXPECT_THAT(GetError(ParsePipelineConfig("uop_cache_lines: 2")),
+              HasSubstr("room for a window"));
+  EXPECT_THAT(GetError(ParsePipelineConfig("issue_policy: random")),
+              HasSubstr("unknown enumerated scalar"));
+}
+
+TEST(PipelineConfigTest, FormatRoundTrips) {
+  for (const PipelineConfig& Preset : GetPipelinePresets()) {
+    const std::string Text = FormatPipelineConfig(Preset);
+    auto Config = ParsePipelineConfig(Text);
+    ASSERT_TRUE(static_cast<bool>(Config))
+        << llvm::toString(Config.takeError());
+    EXPECT_EQ(FormatPipelineConfig(*Config), Text);
+  }
+}
+
+class PipelineSimulatorTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    LLVMInitializeX86Target();
+    LLVMInitializeX86TargetInfo();
+    LLVMInitializeX86TargetMC();
+    LLVMInitializeX86AsmParser();
+  }
+};
+
+// Checks that all presets can simulate a simple loop without stalling.
+TEST_F(PipelineSimulatorTest, PresetsSimulate) {
+  for (const PipelineConfig& Preset : GetPipelinePresets()) {
+    SCOPED_TRACE(Preset.CpuName);
+    const auto Context = GlobalContext::Create("x86_64", Preset.CpuName);
+    ASSERT_NE(Context, nullptr);
+    const auto Simulator = CreatePipelineSimulator(*Context, Preset);
+    const auto Instructions = ParseAsmCodeFromString(*Context, R"(
+        add eax, ecx
+        imul edx, eax
+        add ecx, 1
+    )", llvm::InlineAsm::AD_Intel);
+    ASSERT_EQ(Instructions.size(), 3);
+    const BlockContext BlockContext(Instructions, true);
+    const auto Log = Simulator->Run(BlockContext, /*MaxNumIterations=*/20,
+                                    /*MaxNumCycles=*/10000);
+    EXPECT_EQ(Log->GetNumCompleteIterations(), 20);
+  }
+}
+
+// Checks that the pipeline follows a trace through several basic blocks, and
+// that resuming from a snapshot in the middle of the trace gives the same
+// results.
+TEST_F(PipelineSimulatorTest, SimulateTrace) {
+  const auto Context = GlobalContext::Create("x86_64", "haswell");
+  ASSERT_NE(Context, nullptr);
+  const auto Simulator =
+      CreatePipelineSimulator(*Context, *FindPipelinePreset("haswell"));
+  // Block 0 is a chain of dependent multiplications, block 1 has independent
+  // additions.
+  const auto Instructions = ParseAsmCodeFromString(*Context, R"(
+      imul eax, eax
+      imul eax, eax
+      add ecx, 1
+      add edx, 1
+      add esi, 1
+  )", llvm::InlineAsm::AD_Intel);
+  ASSERT_EQ(Instructions.size(), 5);
+  const std::vector<size_t> BlockEnds = {2, 5};
+  std::vector<size_t> BlockIds;
+  for (int I = 0; I < 20; ++I) {
+    BlockIds.push_back(I % 3 == 0 ? 0 : 1);
+  }
+  VectorBlockTrace Trace(BlockIds);
+  const BlockContext BlockContext(Instructions, BlockEnds, &Trace);
+
+  // The simulation stops at the end of the trace.
+  const auto Log = Simulator->Run(BlockContext, /*MaxNumIterations=*/0,
+                                  /*MaxNumCycles=*/0);
+  ASSERT_EQ(Log->GetNumCompleteIterations(), BlockIds.size());
+  EXPECT_EQ(Log->NumCycles, Log->Iterations.back().EndCycle + 1);
+  // Each multiplication of the chain takes 3 cycles.
+  EXPECT_GE(Log->NumCycles, 7 * 2 * 3);
+
+  // The same simulation, in two steps.
+  const auto WarmUp = Simulator->Run(BlockContext, /*MaxNumIterations=*/8,
+                                     /*MaxNumCycles=*/0);
+  ASSERT_EQ(WarmUp->GetNumCompleteIterations(), 8);
+  const SimulatorSnapshot Snapshot =
+      Simulator->TakeSnapshot(BlockContext, *WarmUp);
+  const auto Resumed = Simulator->Resume(BlockContext, Snapshot,
+                                         /*MaxNumIterations=*/0,
+                                         /*MaxNumCycles=*/0);
+  EXPECT_EQ(Resumed->NumCycles, Log->NumCycles);
+  ASSERT_EQ(Resumed->GetNumCompleteIterations(), BlockIds.size());
+  for (size_t I = 0; I < BlockIds.size(); ++I) {
+    EXPECT_EQ(Resumed->Iterations[I].EndCycle, Log->Iterations[I].EndCycle)
+        << I;
+  }
+}
+
+// Checks that resuming from a snapshot gives the same results as simulating
+// from scratch, including when resuming in another simulator.
+TEST_F(PipelineSimulatorTest, ResumeFromSnapshot) {
+  for (const PipelineConfig& Preset : GetPipelinePresets()) {
+    SCOPED_TRACE(Preset.CpuName);
+    const auto Context = GlobalContext::Create("x86_64", Preset.CpuName);
+    ASSERT_NE(Context, nullptr);
+    const auto Instructions = ParseAsmCodeFromString(*Context, R"(
+        add eax, ecx
+        imul edx, eax
+        mov dword ptr [rsi], edx
+        add ecx, 1
+    )", llvm::InlineAsm::AD_Intel);
+    ASSERT_EQ(Instructions.size(), 4);
+    const BlockContext BlockContext(Instructions, true);
+
+    const auto Simulator = CreatePipelineSimulator(*Context, Preset);
+    const auto WarmUp = Simulator->Run(BlockContext, /*MaxNumIterations=*/5,
+                                       /*MaxNumCycles=*/0);
+    const SimulatorSnapshot Snapshot =
+        Simulator->TakeSnapshot(BlockContext, *WarmUp);
+    const auto Expected = Simulator->Run(BlockContext,
+                                         /*MaxNumIterations=*/30,
+                                         /*MaxNumCycles=*/0);
+
+    const auto OtherSimulator = CreatePipelineSimulator(*Context, Preset);
+    for (const auto* S : {Simulator.get(), OtherSimulator.get()}) {
+      const auto Resumed = S->Resume(BlockContext, Snapshot,
+                                     /*MaxNumIterations=*/30,
+                                     /*MaxNumCycles=*/0);
+      EXPECT_EQ(Resumed->NumCycles, Expected->NumCycles);
+      ASSERT_EQ(Resumed->GetNumCompleteIterations(), 30);
+      for (size_t I = 0; I < 30; ++I) {
+        EXPECT_EQ(Resumed->Iterations[I].EndCycle,
+                  Expected->Iterations[I].EndCycle)
+            << I;
+      }
+    }
+  }
+}
+
+// Checks that ticking the execution units concurrently does not change the
+// results.
+TEST_F(PipelineSimulatorTest, TickThreads) {
+  for (const PipelineConfig& Preset : GetPipelinePresets()) {
+    SCOPED_TRACE(Preset.CpuName);
+    const auto Context = GlobalContext::Create("x86_64", Preset.CpuName);
+    ASSERT_NE(Context, nullptr);
+    const auto Instructions = ParseAsmCodeFromString(*Context, R"(
+        add eax, ecx
+        imul edx, eax
+        mov dword ptr [rsi], edx
+        vmulps ymm0, ymm1, ymm2
+        add ecx, 1
+    )", llvm::InlineAsm::AD_Intel);
+    ASSERT_EQ(Instructions.size(), 5);
+    const BlockContext BlockContext(Instructions, true);
+
+    const auto Sequential = CreatePipelineSimulator(*Context, Preset);
+    const auto Expected = Sequential->Run(BlockContext,
+                                          /*MaxNumIterations=*/50,
+                                          /*MaxNumCycles=*/0);
+    const auto Concurrent = CreatePipelineSimulator(*Context, Preset);
+    Concurrent->SetNumTickThreads(4);
+    const auto Log = Concurrent->Run(BlockContext, /*MaxNumIterations=*/50,
+                                     /*MaxNumCycles=*/0);
+    EXPECT_EQ(Log->NumCycles, Expected->NumCycles);
+    ASSERT_EQ(Log->Events.size(), Expected->Events.size());
+    for (size_t I = 0; I < Log->Events.size(); ++I) {
+      const auto& Event = Log->Events[I];
+      const auto& ExpectedEvent = Expected->Events[I];
+      ASSERT_EQ(Event.GetKind(), ExpectedEvent.GetKind()) << I;
+      ASSERT_EQ(Event.GetCycle(), ExpectedEvent.GetCycle()) << I;
+      ASSERT_EQ(Event.GetBufferIndex(), ExpectedEvent.GetBufferIndex()) << I;
+      if (Event.GetKind() == LogEventKind::kUop) {
+        ASSERT_EQ(Event.GetUopId().InstrIndex.Iteration,
+                  ExpectedEvent.GetUopId().InstrIndex.Iteration)
+            << I;
+        ASSERT_EQ(Event.GetUopId().InstrIndex.BBIndex,
+                  ExpectedEvent.GetUopId().InstrIndex.BBIndex)
+            << I;
+        ASSERT_EQ(Event.GetUopId().UopIndex, ExpectedEvent.GetUopId().UopIndex)
+            << I;
+      }
+    }
+  }
+}
+
+// Returns the number of cycles to run `NumIterations` iterations of `Code` on
+// `Config`.
+unsigned GetNumCycles(const PipelineConfig& Config, const char* Code,
+                      unsigned NumIterations) {
+  const auto Context = GlobalContext::Create("x86_64", Config.CpuName);
+  const auto Instructions =
+      ParseAsmCodeFromString(*Context, Code, llvm::InlineAsm::AD_Intel);
+  const BlockContext BlockContext(Instructions, true);
+  const auto Log = CreatePipelineSimulator(*Context, Config)
+                       ->Run(BlockContext, NumIterations, /*MaxNumCycles=*/0);
+  EXPECT_EQ(Log->GetNumCompleteIterations(), NumIterations);
+  return Log->NumCycles;
+}
+
+// Checks that a load from an in-flight store waits for the store, and gets its
+// data with the forwarding latency.
+TEST_F(PipelineSimulatorTest, StoreForwarding) {
+  // Each iteration loads the value stored by the previous one.
+  constexpr const char kCode[] = R"(
+      mov eax, dword ptr [rsi]
+      mov dword ptr [rsi], eax
+  )";
+  PipelineConfig Config = *FindPipelinePreset("haswell");
+  const unsigned Fast = GetNumCycles(Config, kCode, 100);
+  Config.StoreForwardingLatency += 10;
+  const unsigned Slow = GetNumCycles(Config, kCode, 100);
+  // The loop is bound by the latency of the chain.
+  EXPECT_GE(Slow, Fast + 100 * 9);
+
+  // Loads from other addresses do not wait.
+  constexpr const char kIndependentCode[] = R"(
+      mov eax, dword ptr [rsi + 8]
+      mov dword ptr [rsi], eax
+  )";
+  EXPECT_LT(GetNumCycles(Config, kIndependentCode, 100), Fast);
+}
+
+// Checks that the reorder buffer stalls when the store buffer is full.
+TEST_F(PipelineSimulatorTest, StoreQueueCapacity) {
+  constexpr const char kCode[] = R"(
+      mov dword ptr [rsi], eax
+      mov dword ptr [rsi + 4], eax
+      mov dword ptr [rsi + 8], eax
+      mov dword ptr [rsi + 12], eax
+  )";
+  PipelineConfig Config = *FindPipelinePreset("haswell");
+  const unsigned Unconstrained = GetNumCycles(Config, kCode, 50);
+  Config.StoreQueueSize = 1;
+  EXPECT_GT(GetNumCycles(Config, kCode, 50), Unconstrained);
+}
+
+// Checks that the uop cache and the loop stream detector bypass the fetch
+// bandwidth of the legacy pipeline.
+TEST_F(PipelineSimulatorTest, UopCache) {
+  // Three 10-byte instructions: the legacy pipeline fetches one per cycle, the
+  // uop cache streams the whole 32-byte window.
+  constexpr const char kCode[] = R"(
+      movabs rax, 0x123456789
+      movabs rcx, 0x123456789
+      movabs rdx, 0x123456789
+  )";
+  PipelineConfig Legacy = *FindPipelinePreset("haswell");
+  Legacy.UopCacheLines = 0;
+  Legacy.LoopBufferSize = 0;
+  const unsigned LegacyCycles = GetNumCycles(Legacy, kCode, 100);
+  EXPECT_GE(LegacyCycles, 300);
+
+  PipelineConfig UopCacheOnly = Legacy;
+  UopCacheOnly.UopCacheLines = 256;
+  const unsigned UopCacheCycles = GetNumCycles(UopCacheOnly, kCode, 100);
+  EXPECT_LT(UopCacheCycles, LegacyCycles / 2);
+
+  PipelineConfig LoopBufferOnly = Legacy;
+  LoopBufferOnly.LoopBufferSize = 56;
+  EXPECT_LT(GetNumCycles(LoopBufferOnly, kCode, 100), LegacyCycles / 2);
+
+  // The loop fits in a single window, which needs too many lines to be cached.
+  constexpr const char kWideCode[] = R"(
+      movabs rax, 0x123456789
+      movabs rcx, 0x123456789
+      movabs rdx, 0x123456789
+      movabs rsi, 0x123456789
+  )";
+  UopCacheOnly.UopCacheWindowBytes = 64;
+  UopCacheOnly.UopCacheUopsPerLine = 1;
+  EXPECT_GE(GetNumCycles(UopCacheOnly, kWideCode, 100),
+            GetNumCycles(Legacy, kWideCode, 100));
+}
+
+// Checks that the fetcher does not run ahead of a backend-bound block: the
+// fetch buffer only holds one window, so it never stalls for long.
+TEST_F(PipelineSimulatorTest, UopCacheBackendBoundBlock) {
+  // A long chain of dependent multiplications.
+  std::string Code;
+  for (int I = 0; I < 300; ++I) {
+    Code += "imul eax, eax\n";
+  }
+  const PipelineConfig Config = *FindPipelinePreset("haswell");
+  const auto Context = GlobalContext::Create("x86_64", Config.CpuName);
+  const auto Instructions =
+      ParseAsmCodeFromString(*Context, Code, llvm::InlineAsm::AD_Intel);
+  ASSERT_EQ(Instructions.size(), 300);
+  const BlockContext BlockContext(Instructions, true);
+  const auto Log = CreatePipelineSimulator(*Context, Config)
+                       ->Run(BlockContext, /*MaxNumIterations=*/3,
+                             /*MaxNumCycles=*/0);
+  EXPECT_EQ(Log->GetNumCompleteIterations(), 3);
+  for (const auto& Line : Log->Lines) {
+    EXPECT_NE(Line.MsgTag, LogLevels::kWarning) << Line.Msg;
+  }
+  unsigned MaxFetchStallCycles = 0;
+  for (const SimulationLog::Event& Event : Log->Events) {
+    if (Event.GetKind() == LogEventKind::kStall &&
+        Log->BufferDescriptions[Event.GetBufferIndex()].DisplayName ==
+            "FetchBuffer") {
+      MaxFetchStallCycles =
+          std::max(MaxFetchStallCycles, Event.GetNumStallCycles());
+    }
+  }
+  // A window holds at most 10 multiplications, which have a latency of 3.
+  EXPECT_LT(MaxFetchStallCycles, 50);
+}
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
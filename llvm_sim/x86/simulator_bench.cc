@@ -0,0 +1,303 @@
+// Copyright 2018 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks for the simulator, on the blocks of `llvm_sim/x86/testdata`:
+//  - End-to-end: simulated cycles per second of the Haswell simulator.
+//  - Components: the hot component and framework functions, in isolation.
+//    The components are driven by test sources and sinks, with the inputs
+//    computed upfront, so that only the benchmarked function is measured.
+//
+// Run with:
+//   bazel run -c opt //llvm_sim/x86:simulator_bench -- --benchmark_filter=.
+
+#include <cassert>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "benchmark/benchmark.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCSchedule.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm_sim/components/buffer.h"
+#include "llvm_sim/components/common.h"
+#include "llvm_sim/components/issue_policy.h"
+#include "llvm_sim/components/register_renamer.h"
+#include "llvm_sim/components/reorder_buffer.h"
+#include "llvm_sim/components/testing.h"
+#include "llvm_sim/framework/context.h"
+#include "llvm_sim/x86/faucon_lib.h"
+#include "llvm_sim/x86/haswell.h"
+#include "llvm_sim/x86/pipeline.h"
+
+namespace exegesis {
+namespace simulator {
+namespace {
+
+// The number of iterations of a block in the simulations.
+constexpr const unsigned kNumIterations = 100;
+
+// A block of `llvm_sim/x86/testdata`, with its own context: parsing defines the
+// labels of the file in the context, so files cannot be parsed twice in the
+// same context.
+struct TestCase {
+  std::unique_ptr<const GlobalContext> Context;
+  std::vector<llvm::MCInst> Instructions;
+};
+
+// Returns the parsed test case. Test cases are parsed once.
+const TestCase& GetTestCase(const std::string& Name) {
+  static auto* const TestCases = []() {
+    LLVMInitializeX86Target();
+    LLVMInitializeX86TargetInfo();
+    LLVMInitializeX86TargetMC();
+    LLVMInitializeX86AsmParser();
+    return new std::map<std::string, TestCase>();
+  }();
+  TestCase& Result = (*TestCases)[Name];
+  if (!Result.Context) {
+    Result.Context = GlobalContext::Create("x86_64", "haswell");
+    const std::string FileName = std::string(getenv("TEST_SRCDIR")) +
+                                 "/__main__/llvm_sim/"
+                                 "x86/testdata/" +
+                                 Name;
+    Result.Instructions = ParseAsmCodeFromFile(*Result.Context, FileName,
+                                               llvm::InlineAsm::AD_Intel);
+    if (Result.Instructions.empty()) {
+      llvm::errs() << "could not parse " << FileName << "\n";
+      std::abort();
+    }
+  }
+  return Result;
+}
+
+// A logger that does not subscribe to any event.
+class NullLogger : public Logger {
+ public:
+  NullLogger() : Logger(LogEventMask()) {}
+  void Log(std::string MsgTag, std::string Msg) override {}
+};
+
+// End-to-end -----------------------------------------------------------------
+
+// Items are simulated cycles.
+void BM_HaswellSimulator(benchmark::State& State, const char* TestCase) {
+  const auto& Context = *GetTestCase(TestCase).Context;
+  const auto& Instructions = GetTestCase(TestCase).Instructions;
+  const BlockContext BlockContext(Instructions, true);
+  const auto Simulator = CreateHaswellSimulator(Context);
+  size_t NumCycles = 0;
+  while (State.KeepRunning()) {
+    const auto Log = Simulator->Run(BlockContext, kNumIterations,
+                                    /*MaxNumCycles=*/100000);
+    NumCycles += Log->NumCycles;
+  }
+  State.SetItemsProcessed(NumCycles);
+  State.SetLabel(TestCase);
+}
+
+// `test10.s` is not simulated, see `haswell_test.cc`.
+BENCHMARK_CAPTURE(BM_HaswellSimulator, test1, "test1.s");
+BENCHMARK_CAPTURE(BM_HaswellSimulator, test2, "test2.s");
+BENCHMARK_CAPTURE(BM_HaswellSimulator, test3, "test3.s");
+BENCHMARK_CAPTURE(BM_HaswellSimulator, test4, "test4.s");
+BENCHMARK_CAPTURE(BM_HaswellSimulator, test5, "test5.s");
+BENCHMARK_CAPTURE(BM_HaswellSimulator, test6, "test6.s");
+BENCHMARK_CAPTURE(BM_HaswellSimulator, test9, "test9.s");
+
+// Components -----------------------------------------------------------------
+
+const PipelineConfig& GetHaswellConfig() {
+  return *FindPipelinePreset("haswell");
+}
+
+RegisterRenamer::Config GetRenamerConfig() {
+  return {GetHaswellConfig().RenameUopsPerCycle,
+          GetHaswellConfig().NumPhysicalRegisters};
+}
+
+// Returns the uops of `NumIterations` iterations of the block.
+std::vector<UopId::Type> GetUops(const GlobalContext& Context,
+                                 const BlockContext& BlockContext,
+                                 size_t NumIterations) {
+  std::vector<UopId::Type> Uops;
+  for (size_t Iteration = 0; Iteration < NumIterations; ++Iteration) {
+    for (size_t I = 0; I < BlockContext.GetNumBasicBlockInstructions(); ++I) {
+      const size_t NumUops =
+          Context.GetInstructionDecomposition(BlockContext.GetInstruction(I))
+              .Uops.size();
+      for (size_t UopIndex = 0; UopIndex < NumUops; ++UopIndex) {
+        Uops.push_back({{I, Iteration}, UopIndex});
+      }
+    }
+  }
+  return Uops;
+}
+
+// Items are decompositions.
+void BM_GetInstructionDecomposition(benchmark::State& State,
+                                    const char* TestCase) {
+  const auto& Context = *GetTestCase(TestCase).Context;
+  const auto& Instructions = GetTestCase(TestCase).Instructions;
+  // The first lookup computes the decompositions, the benchmark measures the
+  // cached lookups that happen during the simulation.
+  Context.WarmUpInstructionDecompositions(Instructions);
+  while (State.KeepRunning()) {
+    for (const llvm::MCInst& Inst : Instructions) {
+      benchmark::DoNotOptimize(&Context.GetInstructionDecomposition(Inst));
+    }
+  }
+  State.SetItemsProcessed(State.iterations() * Instructions.size());
+}
+
+BENCHMARK_CAPTURE(BM_GetInstructionDecomposition, test1, "test1.s");
+BENCHMARK_CAPTURE(BM_GetInstructionDecomposition, test3, "test3.s");
+
+// Items are propagated elements. `State.range(0)` elements are pushed every
+// cycle.
+template <typename BufferT>
+void BM_BufferPropagate(benchmark::State& State) {
+  const size_t Width = State.range(0);
+  BufferT Buffer(Width);
+  NullLogger Log;
+  Buffer.Init(&Log);
+  const std::vector<UopId::Type> Elems(Width, UopId::Type{{0, 0}, 0});
+  while (State.KeepRunning()) {
+    const bool Pushed = Buffer.PushMany(Elems);
+    assert(Pushed);
+    (void)Pushed;
+    Buffer.Propagate(&Log);
+    while (Buffer.Peek()) {
+      Buffer.Pop();
+    }
+  }
+  State.SetItemsProcessed(State.iterations() * Width);
+}
+
+BENCHMARK_TEMPLATE(BM_BufferPropagate, FifoBuffer<UopId>)->Arg(1)->Arg(4);
+BENCHMARK_TEMPLATE(BM_BufferPropagate, LinkBuffer<UopId>)->Arg(1)->Arg(4);
+
+// Items are renamed uops. The renamer sees the uops of the block in a loop.
+void BM_RegisterRenamerTick(benchmark::State& State, const char* TestCase) {
+  const auto& Context = *GetTestCase(TestCase).Context;
+  const auto& Instructions = GetTestCase(TestCase).Instructions;
+  const BlockContext BlockContext(Instructions, true);
+  const auto Uops = GetUops(Context, BlockContext, kNumIterations);
+  TestSource<UopId> Source;
+  TestSink<RenamedUopId> Sink;
+  RegisterRenamer Renamer(&Context, GetRenamerConfig(), &Source, &Sink);
+  size_t NumRenamedUops = 0;
+  while (State.KeepRunning()) {
+    if (Source.Buffer_.empty()) {
+      // Physical registers are never released, start over.
+      State.PauseTiming();
+      Renamer.Init();
+      Source.Buffer_.assign(Uops.begin(), Uops.end());
+      State.ResumeTiming();
+    }
+    Renamer.Tick(&BlockContext);
+    NumRenamedUops += Sink.Buffer_.size();
+    Sink.Buffer_.clear();
+  }
+  State.SetItemsProcessed(NumRenamedUops);
+}
+
+BENCHMARK_CAPTURE(BM_RegisterRenamerTick, test1, "test1.s");
+BENCHMARK_CAPTURE(BM_RegisterRenamerTick, test3, "test3.s");
+
+// Items are retired uops. The renamed uops are computed upfront. Execution
+// units have a latency of one cycle: issued uops are written back and their
+// results are available on the next cycle.
+void BM_ReorderBufferTick(benchmark::State& State, const char* TestCase) {
+  const auto& Context = *GetTestCase(TestCase).Context;
+  const auto& Instructions = GetTestCase(TestCase).Instructions;
+  const BlockContext BlockContext(Instructions, true);
+
+  std::vector<RenamedUopId::Type> RenamedUops;
+  {
+    TestSource<UopId> Source;
+    TestSink<RenamedUopId> Sink;
+    const auto Uops = GetUops(Context, BlockContext, kNumIterations);
+    Source.Buffer_.assign(Uops.begin(), Uops.end());
+    RegisterRenamer Renamer(&Context, GetRenamerConfig(), &Source, &Sink);
+    Renamer.Init();
+    while (Sink.Buffer_.size() < Uops.size()) {
+      Renamer.Tick(&BlockContext);
+    }
+    RenamedUops = std::move(Sink.Buffer_);
+  }
+
+  TestSource<RenamedUopId> UopSource;
+  TestSource<ROBUopId> AvailableDepsSource;
+  TestSource<ROBUopId> WritebackSource;
+  TestSource<ROBUopId> RetiredSource;
+  TestSink<ROBUopId> IssuedSink;
+  TestSink<ROBUopId> RetirementSink;
+  // `PortSinks` is indexed by `ProcResIdx - 1`, see `CreatePipelineSimulator`.
+  std::vector<std::unique_ptr<TestSink<ROBUopId>>> Ports;
+  std::vector<Sink<ROBUopId>*> PortSinks;
+  for (unsigned ProcResIdx = 1;
+       ProcResIdx < Context.SchedModel->getNumProcResourceKinds();
+       ++ProcResIdx) {
+    if (Context.SchedModel->getProcResource(ProcResIdx)->SubUnitsIdxBegin ==
+        nullptr) {
+      Ports.push_back(absl::make_unique<TestSink<ROBUopId>>());
+      Ports.back()->SetCapacity(1);
+      PortSinks.push_back(Ports.back().get());
+    } else {
+      PortSinks.push_back(nullptr);
+    }
+  }
+  ReorderBuffer ROB(&Context, {GetHaswellConfig().NumROBEntries}, &UopSource,
+                    &AvailableDepsSource, &WritebackSource, &RetiredSource,
+                    &IssuedSink, PortSinks, &RetirementSink,
+                    IssuePolicy::LeastLoaded());
+  ROB.Init();
+  size_t NumRetiredUops = 0;
+  while (State.KeepRunning()) {
+    if (UopSource.Buffer_.empty()) {
+      State.PauseTiming();
+      UopSource.Buffer_.assign(RenamedUops.begin(), RenamedUops.end());
+      State.ResumeTiming();
+    }
+    ROB.Tick(&BlockContext);
+    // Execute, write back and retire.
+    for (const auto& Port : Ports) {
+      Port->Buffer_.clear();
+    }
+    AvailableDepsSource.Buffer_.assign(IssuedSink.Buffer_.begin(),
+                                       IssuedSink.Buffer_.end());
+    WritebackSource.Buffer_.assign(IssuedSink.Buffer_.begin(),
+                                   IssuedSink.Buffer_.end());
+    IssuedSink.Buffer_.clear();
+    RetiredSource.Buffer_.assign(RetirementSink.Buffer_.begin(),
+                                 RetirementSink.Buffer_.end());
+    NumRetiredUops += RetirementSink.Buffer_.size();
+    RetirementSink.Buffer_.clear();
+  }
+  State.SetItemsProcessed(NumRetiredUops);
+}
+
+BENCHMARK_CAPTURE(BM_ReorderBufferTick, test1, "test1.s");
+BENCHMARK_CAPTURE(BM_ReorderBufferTick, test3, "test3.s");
+
+}  // namespace
+}  // namespace simulator
+}  // namespace exegesis
+
+BENCHMARK_MAIN();